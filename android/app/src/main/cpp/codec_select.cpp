@@ -3,6 +3,7 @@
 //
 
 #include "sharedUtils.h"
+#include "profile_log.h"
 #include "codec_select.h"
 #include "jpeg_compression.h"
 #include "platform.h"
@@ -37,6 +38,31 @@ static const int NUM_CALIB_IOU_SAMPLES = 5;
 // How many latency samples need to be collected before doing codec selection decision
 static const int MIN_NSAMPLES = 2;
 
+// Online (bandit) selection: discount of the statistics per round (old rounds fade out after about
+// 1 / (1 - discount) rounds) and how optimistic to be about codecs that ran little recently
+static const float BANDIT_DISCOUNT = 0.98f;
+static const float BANDIT_EXPLORATION = 0.1f;
+
+// Predictive selection: how much the fit of the transfer time keeps of old frames (per remote
+// frame), smoothing of the kernel times and sizes and of the correction of each codec, and how
+// much better another codec has to be predicted to switch to it while the current one fits
+static const float PREDICT_FORGETTING = 0.7f;
+static const float PREDICT_ALPHA = 0.8f;
+static const float PREDICT_RESIDUAL_ALPHA = 0.9f;
+static const float PREDICT_HYSTERESIS = 0.1f;
+
+// Rate control: which part of the hard latency limit to aim for, smoothing of the measured
+// throughput, steps per frame (relative for HEVC bitrate, absolute for JPEG quality), how much the
+// JPEG quality changes per doubling of the target size, size ratios (log2) too small to react to,
+// and how far the HEVC bitrate must drift before reconfiguring the encoder, which is expensive
+static const float RC_TARGET_FRACTION = 0.8f;
+static const float RC_THROUGHPUT_ALPHA = 0.8f;
+static const float RC_MAX_BITRATE_STEP = 0.15f;
+static const float RC_MAX_QUALITY_STEP = 5.0f;
+static const float RC_QUALITY_PER_DOUBLING = 12.0f;
+static const float RC_DEADBAND = 0.1f;
+static const float RC_BITRATE_HYSTERESIS = 0.1f;
+
 // Empty initializers
 
 static const kernel_times_ms_t EMPTY_KERNEL_TIMES = {.enc = 0.0f, .dec = 0.0f, .dnn = 0.0f, .postprocess = 0.0f, .seg_enc = 0.0f, .seg_dec = 0.0f, .reconstruct = 0.0f,};
@@ -354,6 +380,503 @@ bool is_calibrating(const codec_select_state_t *const state) {
     return state->stage != STAGE_RUNNING;
 }
 
+/**
+ * @return whether the codec selection needs IoU samples from the eval pipeline
+ */
+bool needs_eval(const codec_select_state_t *const state) {
+    return state->stage == STAGE_CALIB_IOU_ONLY || state->algorithm == SELECT_ALGORITHM_BANDIT ||
+           state->algorithm == SELECT_ALGORITHM_PREDICT;
+}
+
+// whether the metric is minimized or maximized, taken from the first constraint on it
+static optimization_t metric_optimization(const codec_select_state_t *const state,
+                                          metric_t metric) {
+    for (int i = 0; i < NUM_CONSTRAINTS; ++i) {
+        if (state->constraints[i].metric == metric) {
+            return state->constraints[i].optimization;
+        }
+    }
+    return OPT_MIN;
+}
+
+/**
+ * add a received frame to the current round of the bandit, under the codec it ran with
+ */
+static void bandit_collect(const frame_metadata_t *frame_metadata, const codec_stats_t *stats,
+                           bandit_data_t *bandit) {
+    const int id = frame_metadata->codec.id;
+    const float latency_ms =
+            (float) (frame_metadata->host_ts_ns.stop - frame_metadata->host_ts_ns.start) / 1e6f;
+    const float size_bytes = (float) (frame_metadata->size_bytes_tx +
+                                      frame_metadata->size_bytes_rx);
+
+    // IoU comes from signal_eval_finish(), relative power needs calibrated power
+    float vals[NUM_METRICS];
+    populate_vals(latency_ms, size_bytes, stats->external_data->pow_w[id], 0.0f, 1.0f, vals);
+
+    for (int i = 0; i < NUM_METRICS; ++i) {
+        bandit->round_sums[id][i] += vals[i];
+    }
+    bandit->round_nsamples[id] += 1;
+}
+
+/**
+ * discount the statistics of all codecs and add the averages of the round that just ended
+ */
+static void bandit_end_round(bandit_data_t *bandit) {
+    for (int id = 0; id < NUM_CONFIGS; ++id) {
+        bandit->count[id] *= BANDIT_DISCOUNT;
+        bandit->iou_count[id] *= BANDIT_DISCOUNT;
+        bandit->iou_sum[id] *= BANDIT_DISCOUNT;
+
+        const int nsamples = bandit->round_nsamples[id];
+        for (int i = 0; i < NUM_METRICS; ++i) {
+            bandit->sums[id][i] *= BANDIT_DISCOUNT;
+            if (nsamples > 0) {
+                bandit->sums[id][i] += bandit->round_sums[id][i] / (float) (nsamples);
+            }
+            bandit->round_sums[id][i] = 0.0f;
+        }
+
+        if (nsamples > 0) {
+            bandit->count[id] += 1.0f;
+        }
+        bandit->round_nsamples[id] = 0;
+    }
+
+    bandit->nrounds += 1;
+}
+
+static bool is_rate_controlled(int codec_id) {
+    const compression_t compression_type = CONFIGS[codec_id].compression_type;
+    return CONFIGS[codec_id].device_type != LOCAL_DEVICE &&
+           (compression_type == JPEG_COMPRESSION || compression_type == HEVC_COMPRESSION);
+}
+
+static void rate_control_init(bool enabled, rate_control_t *rc) {
+    rc->enabled = enabled;
+    rc->min_quality = 100.0f;
+    rc->min_bitrate = (float) INT32_MAX;
+    for (int id = 0; id < NUM_CONFIGS; ++id) {
+        if (!is_rate_controlled(id)) {
+            continue;
+        }
+        if (CONFIGS[id].compression_type == JPEG_COMPRESSION) {
+            rc->applied[id] = CONFIGS[id].config.jpeg.quality;
+            rc->min_quality = fminf(rc->min_quality, (float) rc->applied[id]);
+        } else {
+            rc->applied[id] = CONFIGS[id].config.hevc.bitrate;
+            rc->min_bitrate = fminf(rc->min_bitrate, (float) rc->applied[id]);
+        }
+        rc->param[id] = (float) rc->applied[id];
+    }
+}
+
+/**
+ * Move the quality or bitrate of the codec of a received frame toward the encoded size that fits
+ * the latency budget. The budget is what remains of tgt_latency_ms after the kernels and the ping;
+ * the rest of the network time is the transfer, which gives the throughput.
+ *
+ * @param latency_ms end-to-end latency of the frame
+ * @param network_ms latency of the frame without the kernel times
+ */
+static void rate_control_update(codec_select_state_t *state, const frame_metadata_t *frame_metadata,
+                                float latency_ms, float network_ms) {
+    rate_control_t *rc = &state->rate_control;
+    const int id = frame_metadata->codec.id;
+    const float size_bytes = (float) frame_metadata->size_bytes_tx;
+    if (size_bytes <= 0.0f) {
+        return;
+    }
+
+    const float ping_ms = state->stats.cur_avg_ping_ms;
+    const float transfer_ms = fmaxf(1.0f, network_ms - ping_ms);
+    const float throughput_bpms = size_bytes / transfer_ms;
+    if (rc->throughput_bpms == 0.0f) {
+        rc->throughput_bpms = throughput_bpms;
+    } else {
+        ewma(RC_THROUGHPUT_ALPHA, throughput_bpms, &rc->throughput_bpms);
+    }
+
+    const float budget_ms = state->tgt_latency_ms - (latency_ms - network_ms) - ping_ms;
+    rc->tgt_size_bytes = rc->throughput_bpms * fmaxf(0.0f, budget_ms);
+    // an exhausted budget just means the largest step down
+    const float log2_ratio = log2f(fmaxf(rc->tgt_size_bytes, 1.0f) / size_bytes);
+
+    if (fabsf(log2_ratio) >= RC_DEADBAND) {
+        if (CONFIGS[id].compression_type == JPEG_COMPRESSION) {
+            const float step = fmaxf(-RC_MAX_QUALITY_STEP,
+                                     fminf(RC_MAX_QUALITY_STEP, RC_QUALITY_PER_DOUBLING * log2_ratio));
+            rc->param[id] = fmaxf(rc->min_quality, fminf((float) CONFIGS[id].config.jpeg.quality,
+                                                         rc->param[id] + step));
+            rc->applied[id] = (int) lroundf(rc->param[id]);
+        } else {
+            // HEVC frame size is roughly proportional to the bitrate
+            const float ratio = fmaxf(1.0f - RC_MAX_BITRATE_STEP,
+                                      fminf(1.0f + RC_MAX_BITRATE_STEP, exp2f(log2_ratio)));
+            const float max_bitrate = (float) CONFIGS[id].config.hevc.bitrate;
+            rc->param[id] = fmaxf(rc->min_bitrate, fminf(max_bitrate, rc->param[id] * ratio));
+            const float drift = fabsf(rc->param[id] - (float) rc->applied[id]);
+            const float applied = (float) rc->applied[id];
+            if (drift > RC_BITRATE_HYSTERESIS * applied ||
+                rc->param[id] == max_bitrate || rc->param[id] == rc->min_bitrate) {
+                // the encoder sees bounded steps too, however far the value drifted
+                rc->applied[id] = (int) fmaxf((1.0f - RC_MAX_BITRATE_STEP) * applied,
+                                              fminf((1.0f + RC_MAX_BITRATE_STEP) * applied,
+                                                    rc->param[id]));
+            }
+        }
+    }
+
+    if (state->enable_profiling) {
+        const int frame_index = frame_metadata->frame_index;
+        log_frame_f(state->fd, frame_index, "cs_rate_control", "tgt_latency_ms",
+                    state->tgt_latency_ms);
+        log_frame_f(state->fd, frame_index, "cs_rate_control", "throughput_bpms",
+                    rc->throughput_bpms);
+        log_frame_f(state->fd, frame_index, "cs_rate_control", "tgt_size_bytes",
+                    rc->tgt_size_bytes);
+        log_frame_f(state->fd, frame_index, "cs_rate_control", "param", rc->param[id]);
+        log_frame_int(state->fd, frame_index, "cs_rate_control", "applied", rc->applied[id]);
+    }
+}
+
+/**
+ * Metrics of a codec for the bandit. They are optimistic (upper confidence bound): the less the
+ * codec ran recently compared to all codecs, the more its latency etc. are scaled towards better
+ * values, and the constraints are checked on those values. A codec that breaks a hard constraint
+ * is explored again only once its statistics are uncertain enough that it might fit, codecs far
+ * from fitting are not explored. IoU without samples is assumed perfect.
+ */
+static indexed_metrics_t
+bandit_metrics(const codec_select_state_t *const state, int codec_id, float total_count) {
+    const bandit_data_t *bandit = &state->bandit;
+    const float log_total = logf(1.0f + total_count);
+
+    indexed_metrics_t metrics;
+    memset(&metrics, 0, sizeof(metrics));
+    metrics.codec_id = codec_id;
+    for (int i = 0; i < NUM_METRICS; ++i) {
+        metrics.vals[i] = bandit->sums[codec_id][i] / bandit->count[codec_id];
+    }
+    metrics.vals[METRIC_IOU] = 1.0f;
+    if (codec_id != LOCAL_CODEC_ID && bandit->iou_count[codec_id] > 0.0f) {
+        metrics.vals[METRIC_IOU] = bandit->iou_sum[codec_id] / bandit->iou_count[codec_id];
+    }
+
+    for (int i = 0; i < NUM_METRICS; ++i) {
+        // IoU has its own sample count
+        const float count = (i == METRIC_IOU && bandit->iou_count[codec_id] > 0.0f)
+                            ? bandit->iou_count[codec_id] : bandit->count[codec_id];
+        const float bonus = BANDIT_EXPLORATION * sqrtf(log_total / count);
+
+        switch (metric_optimization(state, to_metric(i))) {
+            case OPT_MIN:
+                metrics.vals[i] /= 1.0f + bonus;
+                break;
+            case OPT_MAX:
+                metrics.vals[i] *= 1.0f + bonus;
+                break;
+        }
+    }
+    metrics.vals[METRIC_IOU] = fmin(1.0f, metrics.vals[METRIC_IOU]);
+    metrics_product(state, &metrics);
+    return metrics;
+}
+
+/**
+ * Online codec selection. Every allowed codec runs for one round first, after that the codec with
+ * the best metrics from bandit_metrics() wins, in the same order as the calibrated selection:
+ * fitting the constraints first, then by product. A codec that did not run for long becomes
+ * uncertain enough to win again, in case the network has changed.
+ * @return ID of the codec to run for the next round
+ */
+static int select_codec_bandit(codec_select_state_t *state) {
+    bandit_data_t *bandit = &state->bandit;
+    const int old_id = state->id;
+
+    bandit_end_round(bandit);
+
+    float total_count = 0.0f;
+    for (int id = 0; id < NUM_CONFIGS; ++id) {
+        total_count += bandit->count[id];
+    }
+
+    for (int id = 0; id < NUM_CONFIGS; ++id) {
+        if (state->is_allowed[id] && bandit->count[id] == 0.0f) {
+            SLOGI(SLOG_SELECT, "SELECT | Bandit | Codec %2d did not run yet, trying it", id);
+            if (state->enable_profiling) {
+                log_frame_int(state->fd, state->last_frame_id, "cs_bandit", "untried_codec_id", id);
+            }
+            return id;
+        }
+    }
+
+    indexed_metrics_t metrics[NUM_CONFIGS];
+    memset(metrics, 0, sizeof(metrics));
+    int new_codec_id = old_id;
+
+    for (int id = 0; id < NUM_CONFIGS; ++id) {
+        if (state->is_allowed[id]) {
+            metrics[id] = bandit_metrics(state, id, total_count);
+        } else {
+            // disallowed codecs never ran, metrics_product() only marks them as not fitting
+            metrics[id].codec_id = id;
+            metrics_product(state, &metrics[id]);
+        }
+
+        SLOGI(SLOG_SELECT_2,
+              "SELECT | Bandit | Codec %2d, count %6.2f, iou count %6.2f, latency %6.1f ms, iou %5.3f, fits: %d, prod %8.5f",
+              id, bandit->count[id], bandit->iou_count[id], metrics[id].vals[METRIC_LATENCY_MS],
+              metrics[id].vals[METRIC_IOU], metrics[id].all_fit_constraints, metrics[id].product);
+
+        if (state->enable_profiling) {
+            char tag[32];
+            sprintf(tag, "cs_bandit%02d", id);
+            log_frame_f(state->fd, state->last_frame_id, tag, "count", bandit->count[id]);
+            log_frame_f(state->fd, state->last_frame_id, tag, "iou_count", bandit->iou_count[id]);
+            log_frame_int(state->fd, state->last_frame_id, tag, "fits",
+                          metrics[id].all_fit_constraints ? 1 : 0);
+            if (state->is_allowed[id]) {
+                for (int i = 0; i < NUM_METRICS; ++i) {
+                    log_frame_f(state->fd, state->last_frame_id, tag, METRIC_NAMES[i],
+                                metrics[id].vals[i]);
+                }
+            }
+            log_frame_f(state->fd, state->last_frame_id, tag, "product", metrics[id].product);
+        }
+
+        // ties keep the current codec, switching costs a frame of statistics
+        if (cmp_metrics(&metrics[id], &metrics[new_codec_id]) > 0) {
+            new_codec_id = id;
+        }
+    }
+
+    // keep the ranking available to get_codec_sort_id()
+    qsort(metrics, NUM_CONFIGS, sizeof(metrics[0]), cmp_metrics);
+    for (int sort_id = 0; sort_id < NUM_CONFIGS; ++sort_id) {
+        state->init_sorted_ids[sort_id] = metrics[sort_id].codec_id;
+    }
+
+    if (state->enable_profiling) {
+        log_frame_int(state->fd, state->last_frame_id, "cs_bandit", "round", bandit->nrounds);
+        log_frame_int(state->fd, state->last_frame_id, "cs_bandit", "new_codec_id",
+                      new_codec_id);
+    }
+
+    return new_codec_id;
+}
+
+/**
+ * @return latency of the next frame with the codec, as far as the latency model explains it
+ */
+static float predict_base_ms(const predict_data_t *predict, int codec_id) {
+    float latency_ms = predict->kernel_ms[codec_id];
+    if (codec_id != LOCAL_CODEC_ID) {
+        latency_ms += predict->ping_ms + predict->ms_per_byte * predict->size_bytes[codec_id];
+    }
+    return latency_ms;
+}
+
+static float predict_latency_ms(const predict_data_t *predict, int codec_id) {
+    return predict_base_ms(predict, codec_id) + predict->residual_ms[codec_id];
+}
+
+/**
+ * add a received frame to the latency model: the kernel times and size of its codec, the ping,
+ * the transfer time per byte and the correction of its codec
+ * @param latency_ms end-to-end latency of the frame
+ * @param network_ms latency of the frame without the kernel times, 0 for local frames
+ */
+static void predict_collect(codec_select_state_t *state, const frame_metadata_t *frame_metadata,
+                            float latency_ms, float network_ms) {
+    predict_data_t *predict = &state->predict;
+    const int id = frame_metadata->codec.id;
+    const float size_bytes = (float) (frame_metadata->size_bytes_tx +
+                                      frame_metadata->size_bytes_rx);
+    const bool is_first = predict->nsamples[id] == 0;
+    const float predicted_ms = predict_latency_ms(predict, id);
+
+    // the fill ping is in ns despite its name
+    if (frame_metadata->host_ts_ns.fill_ping_duration_ms > 0) {
+        predict->ping_ms = (float) frame_metadata->host_ts_ns.fill_ping_duration_ms / 1e6f;
+    } else if (state->stats.cur_avg_ping_ms > 0.0f) {
+        predict->ping_ms = state->stats.cur_avg_ping_ms;
+    }
+
+    if (id != LOCAL_CODEC_ID && size_bytes > 0.0f) {
+        const float transfer_ms = fmaxf(0.0f, network_ms - predict->ping_ms);
+        predict->sxx = PREDICT_FORGETTING * predict->sxx + size_bytes * size_bytes;
+        predict->sxy = PREDICT_FORGETTING * predict->sxy + size_bytes * transfer_ms;
+        predict->ms_per_byte = predict->sxy / predict->sxx;
+        predict->remote_ts_ns = frame_metadata->host_ts_ns.stop;
+    }
+
+    // local frames have no network time, so all of their latency counts as kernel time
+    const float kernel_ms = latency_ms - network_ms;
+    if (is_first) {
+        predict->kernel_ms[id] = kernel_ms;
+        predict->size_bytes[id] = size_bytes;
+    } else {
+        ewma(PREDICT_ALPHA, kernel_ms, &predict->kernel_ms[id]);
+        ewma(PREDICT_ALPHA, size_bytes, &predict->size_bytes[id]);
+    }
+
+    // what the rest of the model, already updated with this frame, does not explain
+    const float residual_ms = latency_ms - predict_base_ms(predict, id);
+    if (is_first) {
+        predict->residual_ms[id] = residual_ms;
+    } else {
+        ewma(PREDICT_RESIDUAL_ALPHA, residual_ms, &predict->residual_ms[id]);
+    }
+
+    predict->nsamples[id] += 1;
+    if (id == state->id) {
+        predict->dwell_nsamples += 1;
+    }
+
+    if (state->enable_profiling) {
+        const int frame_index = frame_metadata->frame_index;
+        if (!is_first) {
+            log_frame_f(state->fd, frame_index, "cs_predict", "predicted_ms", predicted_ms);
+        }
+        log_frame_f(state->fd, frame_index, "cs_predict", "ping_ms", predict->ping_ms);
+        log_frame_f(state->fd, frame_index, "cs_predict", "ms_per_byte", predict->ms_per_byte);
+        log_frame_f(state->fd, frame_index, "cs_predict", "residual_ms", predict->residual_ms[id]);
+    }
+}
+
+/**
+ * Metrics of a codec for the predictive selection, with the predicted latency and the IoU of its
+ * eval samples. IoU without samples is assumed perfect.
+ */
+static indexed_metrics_t predict_metrics(const codec_select_state_t *const state, int codec_id) {
+    const predict_data_t *predict = &state->predict;
+
+    float iou = 1.0f;
+    if (codec_id != LOCAL_CODEC_ID && predict->iou_nsamples[codec_id] > 0) {
+        iou = predict->iou[codec_id];
+    }
+
+    indexed_metrics_t metrics;
+    metrics.codec_id = codec_id;
+    populate_vals(predict_latency_ms(predict, codec_id), predict->size_bytes[codec_id],
+                  state->stats.external_data->pow_w[codec_id], iou, 1.0f, metrics.vals);
+    for (int i = 0; i < NUM_METRICS; ++i) {
+        metrics.vol_vals[i] = 0.0f;
+    }
+    metrics_product(state, &metrics);
+    return metrics;
+}
+
+/**
+ * Predictive codec selection, run for every received frame. Every allowed codec runs first for
+ * MIN_NSAMPLES frames and until it got an IoU sample, or for SELECT_INTERVAL_MS without one.
+ * After that the codec with the best predicted metrics wins, in the same order as the other
+ * selections: fitting the constraints first, then by product. A codec that is predicted to break
+ * the constraints is left after its first measured frame, otherwise the current codec has to run
+ * MIN_NSAMPLES frames and be beaten by PREDICT_HYSTERESIS, so noise does not make it flip.
+ * Running locally, the best remote codec is tried after SELECT_INTERVAL_MS without remote frames,
+ * in case the network has recovered.
+ * @return ID of the codec to run for the next frame
+ */
+static int select_codec_predict(codec_select_state_t *state, int64_t now_ns) {
+    predict_data_t *predict = &state->predict;
+    const int old_id = state->id;
+
+    if (!predict->explored[old_id]) {
+        const bool has_iou = old_id == LOCAL_CODEC_ID || predict->iou_nsamples[old_id] > 0;
+        const bool timed_out = now_ns - predict->switch_ts_ns >= SELECT_INTERVAL_MS * 1000000;
+        if (predict->dwell_nsamples < MIN_NSAMPLES || !(has_iou || timed_out)) {
+            return old_id;
+        }
+        predict->explored[old_id] = true;
+    }
+
+    for (int id = 0; id < NUM_CONFIGS; ++id) {
+        if (state->is_allowed[id] && !predict->explored[id]) {
+            SLOGI(SLOG_SELECT, "SELECT | Predict | Codec %2d was not measured yet, trying it", id);
+            if (state->enable_profiling) {
+                log_frame_int(state->fd, state->last_frame_id, "cs_predict", "explore_codec_id",
+                              id);
+            }
+            return id;
+        }
+    }
+
+    // the first frame after a switch is not measured, there is nothing new to decide on
+    if (predict->dwell_nsamples < 1) {
+        return old_id;
+    }
+
+    indexed_metrics_t metrics[NUM_CONFIGS];
+    memset(metrics, 0, sizeof(metrics));
+    int new_codec_id = old_id;
+
+    for (int id = 0; id < NUM_CONFIGS; ++id) {
+        if (state->is_allowed[id]) {
+            metrics[id] = predict_metrics(state, id);
+        } else {
+            metrics[id].codec_id = id;
+            metrics_product(state, &metrics[id]);
+        }
+
+        if (cmp_metrics(&metrics[id], &metrics[new_codec_id]) > 0) {
+            new_codec_id = id;
+        }
+    }
+
+    const indexed_metrics_t *old_metrics = &metrics[old_id];
+    if (new_codec_id != old_id && old_metrics->all_fit_constraints &&
+        (predict->dwell_nsamples < MIN_NSAMPLES ||
+         metrics[new_codec_id].product < (1.0f + PREDICT_HYSTERESIS) * old_metrics->product)) {
+        new_codec_id = old_id;
+    }
+
+    // local frames do not tell when the network recovers
+    if (new_codec_id == LOCAL_CODEC_ID &&
+        now_ns - predict->remote_ts_ns >= SELECT_INTERVAL_MS * 1000000) {
+        int probe_id = LOCAL_CODEC_ID;
+        for (int id = 0; id < NUM_CONFIGS; ++id) {
+            if (id != LOCAL_CODEC_ID && state->is_allowed[id] &&
+                (probe_id == LOCAL_CODEC_ID || cmp_metrics(&metrics[id], &metrics[probe_id]) > 0)) {
+                probe_id = id;
+            }
+        }
+        if (probe_id != LOCAL_CODEC_ID && state->enable_profiling) {
+            log_frame_int(state->fd, state->last_frame_id, "cs_predict", "probe_codec_id",
+                          probe_id);
+        }
+        new_codec_id = probe_id;
+    }
+
+    if (new_codec_id != old_id && state->enable_profiling) {
+        for (int id = 0; id < NUM_CONFIGS; ++id) {
+            if (!state->is_allowed[id]) {
+                continue;
+            }
+            char tag[32];
+            sprintf(tag, "cs_predict%02d", id);
+            log_frame_f(state->fd, state->last_frame_id, tag, "latency_ms",
+                        metrics[id].vals[METRIC_LATENCY_MS]);
+            log_frame_f(state->fd, state->last_frame_id, tag, "iou", metrics[id].vals[METRIC_IOU]);
+            log_frame_int(state->fd, state->last_frame_id, tag, "fits",
+                          metrics[id].all_fit_constraints ? 1 : 0);
+            log_frame_f(state->fd, state->last_frame_id, tag, "product", metrics[id].product);
+        }
+        log_frame_int(state->fd, state->last_frame_id, "cs_predict", "new_codec_id",
+                      new_codec_id);
+    }
+
+    // keep the ranking available to get_codec_sort_id()
+    qsort(metrics, NUM_CONFIGS, sizeof(metrics[0]), cmp_metrics);
+    for (int sort_id = 0; sort_id < NUM_CONFIGS; ++sort_id) {
+        state->init_sorted_ids[sort_id] = metrics[sort_id].codec_id;
+    }
+
+    return new_codec_id;
+}
+
 static int select_codec(const codec_select_state_t *const state,
                         const constraint_t constraints[NUM_CONSTRAINTS],
                         const indexed_metrics_t sorted_metrics[NUM_CONFIGS]) {
@@ -557,7 +1080,10 @@ static int select_codec(const codec_select_state_t *const state,
     return new_codec_id;
 }
 
-static void
+/**
+ * @return the latency of the frame without the kernel times
+ */
+static float
 collect_latency(const codec_select_state_t *state, const frame_metadata_t *frame_metadata,
                 int64_t received_frame_ts_ns, bool should_skip, codec_stats_t *stats) {
 
@@ -714,6 +1240,8 @@ collect_latency(const codec_select_state_t *state, const frame_metadata_t *frame
                     data->size_bytes);
         log_frame_int(state->fd, frame_index, "cs_update_latency", "nsamples", *nsamples);
     }
+
+    return network_ms;
 }
 
 static void collect_external_data(const codec_select_state_t *state, int frame_codec_id,
@@ -871,13 +1399,22 @@ init_codec_select(int config_flags, int fd, int do_algorithm, bool lock_codec, b
             continue;
         }
 
-        // all remote codecs allowed, unless running local-only
-        new_state->is_allowed[id] = !new_state->local_only;
+        // all remote codecs allowed, unless running local-only or on a model the server lacks
+        new_state->is_allowed[id] = !new_state->local_only &&
+                                    (CONFIGS[id].model_id != DNN_MODEL_LOW_RES ||
+                                     (config_flags & LOW_RES_MODEL) != 0);
     }
-    if (do_algorithm == 0) {
+    new_state->algorithm = do_algorithm;
+    if (do_algorithm == SELECT_ALGORITHM_NONE) {
         new_state->stage = STAGE_RUNNING;
         new_state->stage_id = NUM_STAGES - 1;
         new_state->lock_codec = true;
+    } else if (do_algorithm == SELECT_ALGORITHM_BANDIT ||
+               do_algorithm == SELECT_ALGORITHM_PREDICT) {
+        // these learn while running, so there is no calibration and no codec to lock
+        new_state->stage = STAGE_RUNNING;
+        new_state->stage_id = NUM_STAGES - 1;
+        new_state->lock_codec = false;
     } else {
         if (new_state->local_only) {
             // there is nothing to calibrate in local-only
@@ -893,6 +1430,8 @@ init_codec_select(int config_flags, int fd, int do_algorithm, bool lock_codec, b
     new_state->sync_with_input = sync_with_input;
     new_state->enable_profiling = ENABLE_PROFILING & config_flags;
     new_state->fd = fd;
+    new_state->tgt_latency_ms = RC_TARGET_FRACTION * LIMIT_LATENCY_MS;
+    rate_control_init((config_flags & RATE_CONTROL) != 0, &new_state->rate_control);
 
     int nconstr = 0;
     new_state->constraints[nconstr++] = {.metric = METRIC_LATENCY_MS, .optimization = OPT_MIN, .type = CONSTR_HARD, .limit = LIMIT_LATENCY_MS, .scale = LATENCY_SCALE};
@@ -920,6 +1459,8 @@ init_codec_select(int config_flags, int fd, int do_algorithm, bool lock_codec, b
 
     log_constraints(new_state, new_state->constraints, -1);
     log_frame_int(new_state->fd, -1, "cs_init", "lock_codec", new_state->lock_codec);
+    log_frame_int(new_state->fd, -1, "cs_init", "algorithm", new_state->algorithm);
+    log_frame_int(new_state->fd, -1, "cs_init", "rate_control", new_state->rate_control.enabled);
 
     *state = new_state;
 }
@@ -985,12 +1526,30 @@ void update_stats(const frame_metadata_t *frame_metadata, const eval_pipeline_co
     }
 
     // Collect latency (do not update averages if codec just changed)
-    collect_latency(state, frame_metadata, update_start_ns, should_skip, stats);
+    const float network_ms = collect_latency(state, frame_metadata, update_start_ns, should_skip,
+                                             stats);
 
     // Collect power
     collect_external_data(state, frame_codec_id, frame_stop_ts_ns, stats);
 
-    if ((stats->prev_frame_codec_id != frame_codec_id) && is_calibrating(state)) {
+    if (state->algorithm == SELECT_ALGORITHM_BANDIT && !should_skip) {
+        bandit_collect(frame_metadata, stats, &state->bandit);
+    }
+
+    const float latency_ms = (float) (frame_stop_ts_ns - frame_metadata->host_ts_ns.start) / 1e6f;
+    if (state->algorithm == SELECT_ALGORITHM_PREDICT && !should_skip) {
+        predict_collect(state, frame_metadata, latency_ms, network_ms);
+    }
+
+    // calibration measures the codecs as they are in CONFIGS
+    if (state->rate_control.enabled && !should_skip && !is_calibrating(state) &&
+        frame_codec_id == state->id && is_rate_controlled(frame_codec_id)) {
+        rate_control_update(state, frame_metadata, latency_ms, network_ms);
+    }
+
+    // the first frame has no previous codec
+    if ((stats->prev_frame_codec_id != frame_codec_id) && (stats->prev_frame_codec_id >= 0) &&
+        is_calibrating(state)) {
         stats->init_nruns[stats->prev_frame_codec_id] += 1;
     }
 
@@ -1041,6 +1600,7 @@ select_codec_manual(device_type_enum device_index, int do_segment, compression_t
     config->rotation = rotation;
     config->do_segment = do_segment;
     config->id = LOCAL_CODEC_ID;  // unused in manual selection
+    config->model_id = DNN_MODEL_DEFAULT;
 
     if (HEVC_COMPRESSION == compression_type || SOFTWARE_HEVC_COMPRESSION == compression_type) {
         const int framerate = 5;
@@ -1056,6 +1616,15 @@ select_codec_manual(device_type_enum device_index, int do_segment, compression_t
 }
 
 void select_codec_auto(codec_select_state_t *state) {
+    select_codec_auto_at(state, get_timestamp_ns());
+}
+
+/**
+ * select_codec_auto() with the time given by the caller, for replaying a run on its own clock
+ * @param state
+ * @param now_ns timestamp of the selection, in the clock of the frame timestamps
+ */
+void select_codec_auto_at(codec_select_state_t *state, int64_t now_ns) {
     const int64_t start_ns = get_timestamp_ns();
     float duration_ms;
     bool codec_selected = false;
@@ -1072,12 +1641,26 @@ void select_codec_auto(codec_select_state_t *state) {
 
     if (state->last_timestamp_ns == 0) {
         // skipping first frame
-        state->last_timestamp_ns = start_ns;
+        state->last_timestamp_ns = now_ns;
         goto cleanup;
     }
 
-    state->since_last_select_ms += (start_ns - state->last_timestamp_ns) / 1000000;
-    state->last_timestamp_ns = start_ns;
+    state->since_last_select_ms += (now_ns - state->last_timestamp_ns) / 1000000;
+    state->last_timestamp_ns = now_ns;
+
+    if (state->algorithm == SELECT_ALGORITHM_PREDICT) {
+        // the model learns from every frame, so the codec can change with every frame too
+        const int new_id = select_codec_predict(state, now_ns);
+        if (new_id == old_id) {
+            goto cleanup;
+        }
+
+        state->id = new_id;
+        state->predict.switch_ts_ns = now_ns;
+        state->predict.dwell_nsamples = 0;
+        SLOGI(SLOG_SELECT, "SELECT | Predict | Codec %2d -> %2d", old_id, state->id);
+        goto selected;
+    }
 
     if (is_calibrating(state) && state->sync_with_input) {
         if (state->got_last_frame) {
@@ -1095,7 +1678,16 @@ void select_codec_auto(codec_select_state_t *state) {
 
     state->since_last_select_ms = 0.0f;
 
-    if (is_calibrating(state)) {
+    if (state->algorithm == SELECT_ALGORITHM_BANDIT) {
+        if (state->bandit.round_nsamples[old_id] < MIN_NSAMPLES) {
+            SLOGI(SLOG_SELECT, "SELECT | Bandit | Got only %d/%d samples. Not enough, skipping",
+                  state->bandit.round_nsamples[old_id], MIN_NSAMPLES);
+            goto cleanup;
+        }
+
+        state->id = select_codec_bandit(state);
+        SLOGI(SLOG_SELECT, "SELECT | Bandit | Codec %2d -> %2d", old_id, state->id);
+    } else if (is_calibrating(state)) {
         // works on init data which are updated only during calibration
         set_min_pow_id(stats->external_data);
 
@@ -1169,7 +1761,7 @@ void select_codec_auto(codec_select_state_t *state) {
                 stats->external_data->ping_ms[id] = stats->external_data->init_ping_ms[id];
             }
 
-            state->calib_end_ns = get_timestamp_ns();
+            state->calib_end_ns = now_ns;
             SLOGI(SLOG_SELECT, "SELECT | Calibrating | End | (%2d -> %2d)", old_id, state->id);
         }
     } else {
@@ -1178,7 +1770,7 @@ void select_codec_auto(codec_select_state_t *state) {
             for (int i = NUM_LATENCY_OFFSETS - 1; i >= 0; --i) {
                 int64_t offset_time_ns = LATENCY_OFFSET_TIMES_SEC[i] * 1000000000;
 
-                if ((start_ns - state->calib_end_ns) > offset_time_ns) {
+                if ((now_ns - state->calib_end_ns) > offset_time_ns) {
                     state->latency_offset_ms = LATENCY_OFFSETS_MS[i];
                     SLOGI(SLOG_SELECT_DBG, "SELECT | Select | Set offset %ld ms",
                           state->latency_offset_ms);
@@ -1311,6 +1903,7 @@ void select_codec_auto(codec_select_state_t *state) {
     }
 
     // signal that we just performed a codec selection
+    selected:
     codec_selected = true;
 
     duration_ms = (float) (get_timestamp_ns() - start_ns) / 1e6f;
@@ -1350,6 +1943,13 @@ codec_params_t get_codec_params(codec_select_state_t *state) {
     pthread_mutex_lock(&state->lock);
     assert(state->id >= 0 && state->id < NUM_CONFIGS);
     codec_params_t params = CONFIGS[state->id];
+    if (state->rate_control.enabled && !is_calibrating(state) && is_rate_controlled(state->id)) {
+        if (params.compression_type == JPEG_COMPRESSION) {
+            params.config.jpeg.quality = state->rate_control.applied[state->id];
+        } else {
+            params.config.hevc.bitrate = state->rate_control.applied[state->id];
+        }
+    }
     pthread_mutex_unlock(&state->lock);
     return params;
 }
@@ -1405,6 +2005,21 @@ void signal_eval_finish(codec_select_state_t *state, float iou) {
             } else {
                 ewma(IOU_ALPHA, iou, iou_avg);
             }
+
+            if (state->algorithm == SELECT_ALGORITHM_BANDIT) {
+                state->bandit.iou_count[codec_id] += 1.0f;
+                state->bandit.iou_sum[codec_id] += iou;
+            }
+
+            if (state->algorithm == SELECT_ALGORITHM_PREDICT) {
+                predict_data_t *predict = &state->predict;
+                if (predict->iou_nsamples[codec_id] == 0) {
+                    predict->iou[codec_id] = iou;
+                } else {
+                    ewma(IOU_ALPHA, iou, &predict->iou[codec_id]);
+                }
+                predict->iou_nsamples[codec_id] += 1;
+            }
         }
 
         SLOGI(SLOG_EVAL,
@@ -1470,6 +2085,29 @@ void signal_last_frame(codec_select_state_t *state) {
     pthread_mutex_unlock(&state->lock);
 }
 
+/**
+ * account for a frame that reused the results of an earlier frame instead of running. Its
+ * latency says nothing about the codec, so it is not added to the stats. Only the time it was
+ * received is kept, so that the frame time of the next frame that runs starts from this one.
+ * @param state
+ * @param frame_metadata of the skipped frame
+ */
+void signal_skipped_frame(codec_select_state_t *state, const frame_metadata_t *frame_metadata) {
+    const int64_t received_ns = get_timestamp_ns();
+    pthread_mutex_lock(&state->lock);
+
+    state->last_frame_id = frame_metadata->frame_index;
+    state->stats.last_received_image_ts_ns = received_ns;
+
+    if (state->enable_profiling) {
+        log_frame_int(state->fd, frame_metadata->frame_index, "cs_update", "is_skipped", 1);
+        log_frame_int(state->fd, frame_metadata->frame_index, "cs_update",
+                      "reference_frame_index", frame_metadata->reference_frame_index);
+    }
+
+    pthread_mutex_unlock(&state->lock);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,7 +37,7 @@ extern "C" {
  * Number of codec configs considered by the selection algorithm (should be >= 1 to always have at
  * least local execution).
  */
-#define NUM_CONFIGS 8
+#define NUM_CONFIGS 10
 
 /**
  * Size of external stats storage (should be set such that slow update_stats() doesn't cause buffer
@@ -65,6 +65,15 @@ extern "C" {
  */
 #define NUM_STAGES 5
 
+/**
+ * Selection algorithms, passed to init_codec_select as do_algorithm. Also defined in
+ * JNIPoclImageProcessor.java.
+ */
+#define SELECT_ALGORITHM_NONE 0    // keep the codec set from the UI
+#define SELECT_ALGORITHM_STAGED 1  // calibrate every codec through STAGES, then project the results
+#define SELECT_ALGORITHM_BANDIT 2  // keep learning online, see bandit_data_t
+#define SELECT_ALGORITHM_PREDICT 3 // choose every frame from predicted latency, see predict_data_t
+
 // scaling values to multiply metrics when calculating product (to bring the values into some normal range)
 const float LATENCY_SCALE = 1.0f / 1e3f;
 const float POWER_SCALE = 1.0f;
@@ -103,12 +112,14 @@ typedef struct {
         jpeg_config_t jpeg;
         hevc_config_t hevc;
     } config;
+    int model_id;  // DNN model to run on, see DNN_MODEL_NAMES
 } codec_params_t;
 
 /**
  * Codec configs the selection algorithm is allowed to consider.
  *
- * The first one should always be local, the second one remote without compression.
+ * The first one should always be local, the second one remote without compression. The model is
+ * one more dimension of the config, configs that don't set it run the default model.
  */
 static const codec_params_t CONFIGS[NUM_CONFIGS] = {
 
@@ -123,6 +134,8 @@ static const codec_params_t CONFIGS[NUM_CONFIGS] = {
                 .i_frame_interval = 1, .framerate = 1, .bitrate = 250000}}},
         {.compression_type = HEVC_COMPRESSION, .device_type= REMOTE_DEVICE, .config = {.hevc = {
                 .i_frame_interval = 1, .framerate = 1, .bitrate = 10000}}},
+        {.compression_type = NO_COMPRESSION, .device_type= REMOTE_DEVICE, .config = {.jpeg = {.quality = 0}}, .model_id = DNN_MODEL_LOW_RES},
+        {.compression_type = JPEG_COMPRESSION, .device_type= REMOTE_DEVICE, .config = {.jpeg = {.quality = 80}}, .model_id = DNN_MODEL_LOW_RES},
 };
 
 /**
@@ -267,6 +280,65 @@ typedef struct {
     float cur_avg_pow_w;                // average power
 } codec_stats_t;
 
+/**
+ * Statistics of the online (bandit) selection. A round is the time between two selections. At the
+ * end of every round, all statistics are discounted and the average metrics of the round are
+ * added, so old observations fade out and a codec that has not run for a while becomes worth
+ * trying again when the network changes.
+ */
+typedef struct {
+    float count[NUM_CONFIGS];  // discounted number of rounds each codec ran
+    float sums[NUM_CONFIGS][NUM_METRICS];  // discounted sums of the round averages
+    float iou_count[NUM_CONFIGS];  // IoU comes from eval frames, so it is counted per sample
+    float iou_sum[NUM_CONFIGS];
+    int round_nsamples[NUM_CONFIGS];  // frames received during this round, by the codec they ran
+    float round_sums[NUM_CONFIGS][NUM_METRICS];
+    int nrounds;
+} bandit_data_t;
+
+/**
+ * Per-frame latency model of the predictive selection. The latency of a remote codec for the next
+ * frame is predicted as its kernel times, plus the latest ping, plus its encoded size times the
+ * transfer time per byte, plus a correction for what this misses with that codec. The transfer
+ * time per byte comes from all remote frames, as a least-squares fit of the network time without
+ * the ping over the frame size that forgets old frames quickly, so one fit covers every codec and
+ * follows the network within a few frames. Local frames have no network part and say nothing
+ * about the network, so while running locally a remote codec is tried now and then.
+ */
+typedef struct {
+    int nsamples[NUM_CONFIGS];  // frames measured with each codec
+    float kernel_ms[NUM_CONFIGS];  // smoothed sum of the kernel times
+    float size_bytes[NUM_CONFIGS];  // smoothed size of the encoded frame and the results
+    float residual_ms[NUM_CONFIGS];  // smoothed latency the rest of the model does not explain
+    int iou_nsamples[NUM_CONFIGS];
+    float iou[NUM_CONFIGS];
+    bool explored[NUM_CONFIGS];  // whether the codec ran long enough to be predicted
+    float ping_ms;  // latest ping
+    int64_t remote_ts_ns;  // when the last remote frame was received
+    float sxx;  // discounted sums of the fit of the transfer time over the size
+    float sxy;
+    float ms_per_byte;
+    int64_t switch_ts_ns;  // when the current codec was selected
+    int dwell_nsamples;  // frames measured with the current codec since it was selected
+} predict_data_t;
+
+/**
+ * Closed-loop rate control of the codec that is running (RATE_CONTROL config flag). The CONFIGS
+ * entry of a codec is the highest JPEG quality or HEVC bitrate it may use. Every received frame
+ * moves the value by a bounded step toward the encoded size that fits the latency budget
+ * tgt_latency_ms at the measured throughput, never below the lowest value in CONFIGS. The values
+ * are kept per codec, so a codec selected again starts from where it was left.
+ */
+typedef struct {
+    bool enabled;
+    float param[NUM_CONFIGS];  // continuous quality or bitrate, 0 for codecs without either
+    int applied[NUM_CONFIGS];  // value handed to the encoder by get_codec_params()
+    float min_quality;  // lowest JPEG quality in CONFIGS
+    float min_bitrate;  // lowest HEVC bitrate in CONFIGS
+    float throughput_bpms;  // smoothed bytes per ms of the network part of the latency
+    float tgt_size_bytes;  // encoded size that fits the budget, from the last update
+} rate_control_t;
+
 /**
  * Stores all data required to perform codec selection
  */
@@ -275,6 +347,7 @@ typedef struct {
     collected_events_t *collected_events;
     codec_stats_t stats;
     bool local_only;
+    int algorithm;  // SELECT_ALGORITHM_*
     stage_t stage;
     int stage_id;
 //    bool is_calibrating;
@@ -295,6 +368,9 @@ typedef struct {
     int init_sorted_ids[NUM_CONFIGS];  // IDs of init_latency_ms sorted by latency
     bool is_allowed[NUM_CONFIGS];  // If the codec is allowed to be used or not (based on init devices)
     constraint_t constraints[NUM_CONSTRAINTS]; // Constraints considered for the codec selection
+    bandit_data_t bandit;  // used only with SELECT_ALGORITHM_BANDIT
+    predict_data_t predict;  // used only with SELECT_ALGORITHM_PREDICT
+    rate_control_t rate_control;
 } codec_select_state_t;
 
 /**
@@ -313,6 +389,7 @@ typedef struct {
 } indexed_metrics_t;
 
 bool is_calibrating(const codec_select_state_t *const state);
+bool needs_eval(const codec_select_state_t *const state);
 
 void
 init_codec_select(int config_flags, int fd, int do_algorithm, bool lock_codec, bool sync_with_input,
@@ -328,6 +405,7 @@ select_codec_manual(device_type_enum device_index, int do_segment, compression_t
                     int quality, int rotation, codec_config_t *state);
 
 void select_codec_auto(codec_select_state_t *state);
+void select_codec_auto_at(codec_select_state_t *state, int64_t now_ns);
 
 int get_codec_id(codec_select_state_t *state);
 int get_codec_sort_id(codec_select_state_t *state);
@@ -342,6 +420,7 @@ void push_external_pow(codec_select_state_t *state, int64_t ts_ns, int amp, int
 void push_external_ping(codec_select_state_t *state, int64_t ts_ns, float ping_ms);
 
 void signal_last_frame(codec_select_state_t *state);
+void signal_skipped_frame(codec_select_state_t *state, const frame_metadata_t *frame_metadata);
 
 #ifdef __cplusplus
 }
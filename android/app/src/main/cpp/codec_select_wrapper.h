@@ -31,6 +31,7 @@ static void get_codec_config(codec_select_state_t *state, int rotation, int do_s
     codec_config->rotation = rotation;
     codec_config->do_segment = do_segment;
     codec_config->id = codec_id;
+    codec_config->model_id = params.model_id;
     if (codec_config->compression_type == JPEG_COMPRESSION) {
         codec_config->config.jpeg = params.config.jpeg;
     } else if (codec_config->compression_type == HEVC_COMPRESSION ||
@@ -76,7 +77,7 @@ codec_select_submit_image(codec_select_state_t *state, pocl_image_processor_cont
     }
 
     // check if we need to submit image to the eval pipeline
-    if (ctx->enable_eval || state->stage == STAGE_CALIB_IOU_ONLY) {
+    if (ctx->enable_eval || needs_eval(state)) {
         // TODO: see if this is taking a lot of time
         status = check_eval(ctx->eval_ctx, state, codec_config, eval_every_frame,
                             &run_args.is_eval_frame);
@@ -86,10 +87,8 @@ codec_select_submit_image(codec_select_state_t *state, pocl_image_processor_cont
     // submit the image for the actual encoding (needs to be submitted *before* the eval frame)
     run_args.codec_selected = drain_codec_selected(state);
     run_args.latency_offset_ms = get_latency_offset_ms(state);
-    // if the codec select changes the device from local to remote, we need to also release
-    // the local sem since it was acquired java side
-    run_args.release_local_sem =
-            device_index == LOCAL_DEVICE & device_index != codec_config.device_type;
+    // calibration needs every frame to run, and so does the first frame of a new codec
+    run_args.allow_skip = !is_calibrating(state) && !run_args.codec_selected;
     status = submit_image(ctx, codec_config, *image_data, run_args);
     CHECK_AND_RETURN(status, "could not submit frame");
 
@@ -113,10 +112,14 @@ codec_select_receive_image(codec_select_state_t *state, pocl_image_processor_con
     status = receive_image(ctx, detection_array, segmentation_array, &metadata,
                            (int32_t *) metadata_array, state->collected_events);
 
-    if (status == CL_SUCCESS) {
+    if (status == CL_SUCCESS && metadata.is_skipped) {
+        // the frame reused earlier results, so it does not tell anything about the codec
+        signal_skipped_frame(state, &metadata);
+    } else if (status == CL_SUCCESS) {
         // log statistics to codec selection data
         update_stats(&metadata, ctx->eval_ctx, state);
     }
+    // a frame dropped because its server failed is neither, POCL_IMAGE_PROCESSOR_FRAME_DROPPED
 
     // not strictly necessary, just easier to debug without having old values lying around
     reset_collected_events(state->collected_events);
@@ -104,6 +104,8 @@ init_dnn_context(dnn_context_t *dnn_context, int config_flags, cl_context ocl_co
 
     status |= clSetKernelArg(dnn_context->dnn_kernel, 6, sizeof(cl_mem),
                              &(dnn_context->out_mask_buf));
+    cl_int model_id = DNN_MODEL_DEFAULT;
+    status |= clSetKernelArg(dnn_context->dnn_kernel, 7, sizeof(cl_int), &model_id);
     CHECK_AND_RETURN(status, "could not assign dnn kernel args");
 
     status = clSetKernelArg(dnn_context->postprocess_kernel, 0, sizeof(cl_mem),
@@ -112,6 +114,13 @@ init_dnn_context(dnn_context_t *dnn_context, int config_flags, cl_context ocl_co
                              &(dnn_context->out_mask_buf));
     status |= clSetKernelArg(dnn_context->postprocess_kernel, 2, sizeof(cl_mem),
                              &(dnn_context->postprocess_buf));
+    status |= clSetKernelArg(dnn_context->postprocess_kernel, 3, sizeof(cl_int),
+                             &(dnn_context->rotate_cw_degrees));
+    // the masks are laid out like the frame the dnn gets, whatever the model
+    status |= clSetKernelArg(dnn_context->postprocess_kernel, 4, sizeof(cl_uint),
+                             &(dnn_context->width));
+    status |= clSetKernelArg(dnn_context->postprocess_kernel, 5, sizeof(cl_uint),
+                             &(dnn_context->height));
     CHECK_AND_RETURN(status, "could not assign postprocess kernel args");
 
 
@@ -200,7 +209,150 @@ write_buffer_dnn(const dnn_context_t *ctx, device_type_enum device_type, uint8_t
 }
 
 /**
- * Function to enqueue the opencl commands related to object detection.
+ * release the command buffers of a recording
+ * @param rec recording to release, its command buffers are set to NULL
+ */
+static void
+release_dnn_recording(dnn_recording_t *rec) {
+    if (NULL != rec->command_buffer) {
+        clReleaseCommandBufferKHR(rec->command_buffer);
+        rec->command_buffer = NULL;
+    }
+    if (NULL != rec->reconstruct_buffer) {
+        clReleaseCommandBufferKHR(rec->reconstruct_buffer);
+        rec->reconstruct_buffer = NULL;
+    }
+}
+
+/**
+ * record the kernels of a dnn path into a command buffer
+ * @param ctx dnn context with the kernels
+ * @param dnn_queue queue to run the dnn and postprocessing on
+ * @param rec path to record, the command buffer is written to it
+ * @return OpenCL status
+ */
+static cl_int
+record_dnn(dnn_context_t *ctx, cl_command_queue dnn_queue, dnn_recording_t *rec) {
+    ZoneScoped;
+    cl_int status;
+
+    status = clSetKernelArg(ctx->dnn_kernel, 0, sizeof(cl_mem), &(rec->inp_buf));
+    status |= clSetKernelArg(ctx->dnn_kernel, 3, sizeof(cl_int), &(rec->rotation));
+    status |= clSetKernelArg(ctx->dnn_kernel, 4, sizeof(cl_int), &(rec->inp_format));
+    status |= clSetKernelArg(ctx->dnn_kernel, 7, sizeof(cl_int), &(rec->model_id));
+    status |= clSetKernelArg(ctx->postprocess_kernel, 3, sizeof(cl_int), &(rec->rotation));
+    status |= clSetKernelArg(ctx->reconstruct_kernel, 0, sizeof(cl_mem),
+                             &(ctx->postprocess_buf));
+    CHECK_AND_RETURN(status, "could not assign kernel args to record");
+
+    // a lane can submit the next frame before the callback of the previous replay ran
+    cl_command_buffer_properties_khr properties[] = {CL_COMMAND_BUFFER_FLAGS_KHR,
+                                                     CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR, 0};
+    rec->command_buffer = clCreateCommandBufferKHR(1, &dnn_queue, properties, &status);
+    CHECK_AND_RETURN(status, "could not create dnn command buffer");
+
+    cl_sync_point_khr dnn_sync;
+    status = clCommandNDRangeKernelKHR(rec->command_buffer, dnn_queue, NULL, ctx->dnn_kernel,
+                                       ctx->work_dim, NULL, ctx->global_size, ctx->local_size, 0,
+                                       NULL, &dnn_sync, NULL);
+    CHECK_AND_RETURN(status, "could not record dnn kernel");
+
+    if (rec->do_segment) {
+        status = clCommandNDRangeKernelKHR(rec->command_buffer, dnn_queue, NULL,
+                                           ctx->postprocess_kernel, ctx->work_dim, NULL,
+                                           ctx->global_size, ctx->local_size, 1, &dnn_sync,
+                                           NULL, NULL);
+        CHECK_AND_RETURN(status, "could not record postprocess kernel");
+    }
+
+    status = clFinalizeCommandBufferKHR(rec->command_buffer);
+    CHECK_AND_RETURN(status, "could not finalize dnn command buffer");
+
+    // reconstruction is always done on the local device
+    if (rec->do_segment && rec->do_reconstruct) {
+        rec->reconstruct_buffer = clCreateCommandBufferKHR(1, &(ctx->local_queue), properties,
+                                                           &status);
+        CHECK_AND_RETURN(status, "could not create reconstruct command buffer");
+
+        status = clCommandNDRangeKernelKHR(rec->reconstruct_buffer, ctx->local_queue, NULL,
+                                           ctx->reconstruct_kernel, ctx->work_dim, NULL,
+                                           ctx->global_size, ctx->local_size, 0, NULL, NULL,
+                                           NULL);
+        CHECK_AND_RETURN(status, "could not record reconstruct kernel");
+
+        status = clFinalizeCommandBufferKHR(rec->reconstruct_buffer);
+        CHECK_AND_RETURN(status, "could not finalize reconstruct command buffer");
+    }
+
+    return CL_SUCCESS;
+}
+
+/**
+ * get the command buffer of a dnn path, recording it the first time the path is used.
+ * @param ctx dnn context with the recordings
+ * @param dnn_queue queue to run the dnn and postprocessing on
+ * @param config config of the frame
+ * @param inp_format the format that the inp_buf is in
+ * @param do_reconstruct reconstruct full segmentation mask
+ * @param inp_buf input of the dnn
+ * @param recording output: recording to replay, NULL if there is no room to record
+ * @return OpenCL status
+ */
+static cl_int
+get_dnn_recording(dnn_context_t *ctx, cl_command_queue dnn_queue, const codec_config_t config,
+                  const cl_int inp_format, const bool do_reconstruct, const cl_mem inp_buf,
+                  const dnn_recording_t **recording) {
+
+    dnn_recording_t *rec = NULL;
+    for (int i = 0; i < ctx->num_recordings; i++) {
+        dnn_recording_t *r = &(ctx->recordings[i]);
+        if (r->device_type == config.device_type && r->do_segment == config.do_segment &&
+            r->do_reconstruct == do_reconstruct && r->inp_buf == inp_buf) {
+            rec = r;
+            break;
+        }
+    }
+
+    if (NULL != rec && rec->inp_format == inp_format && rec->rotation == config.rotation &&
+        rec->model_id == config.model_id) {
+        *recording = rec;
+        return CL_SUCCESS;
+    }
+
+    if (NULL == rec) {
+        if (DNN_MAX_RECORDINGS == ctx->num_recordings) {
+            *recording = NULL;
+            return CL_SUCCESS;
+        }
+        rec = &(ctx->recordings[ctx->num_recordings]);
+        ctx->num_recordings++;
+    } else {
+        // replays that are still running keep their own reference
+        release_dnn_recording(rec);
+    }
+
+    rec->inp_buf = inp_buf;
+    rec->inp_format = inp_format;
+    rec->rotation = config.rotation;
+    rec->model_id = config.model_id;
+    rec->device_type = config.device_type;
+    rec->do_segment = config.do_segment;
+    rec->do_reconstruct = do_reconstruct;
+    cl_int status = record_dnn(ctx, dnn_queue, rec);
+    if (CL_SUCCESS != status) {
+        // make sure a half recorded path is never replayed
+        release_dnn_recording(rec);
+        rec->device_type = -1;
+    }
+    CHECK_AND_RETURN(status, "could not record dnn path");
+
+    *recording = rec;
+    return CL_SUCCESS;
+}
+
+/**
+ * Function to enqueue the opencl commands related to object detection. With
+ * REPLAY_COMMAND_BUFFERS the kernels are replayed from a command buffer recorded per path.
  * @param ctx with relevant info
  * @param wait_event event to wait on before starting these commands
  * @param config config with relevant info
@@ -215,7 +367,7 @@ write_buffer_dnn(const dnn_context_t *ctx, device_type_enum device_type, uint8_t
  * @return CL_SUCCESS if everything went well, otherwise a cl error number
  */
 cl_int
-enqueue_dnn(const dnn_context_t *ctx, const cl_event *wait_event, const codec_config_t config,
+enqueue_dnn(dnn_context_t *ctx, const cl_event *wait_event, const codec_config_t config,
             const pixel_format_enum input_format, const bool do_reconstruct, const cl_mem inp_buf,
             event_array_t *event_array, cl_event *out_event, tmp_buf_ctx_t *tmp_buf_ctx) {
     ZoneScoped;
@@ -224,11 +376,6 @@ enqueue_dnn(const dnn_context_t *ctx, const cl_event *wait_event, const codec_co
     // cast enum to int
     cl_int inp_format = (cl_int) input_format;
 
-    status = clSetKernelArg(ctx->dnn_kernel, 0, sizeof(cl_mem), &inp_buf);
-    status |= clSetKernelArg(ctx->dnn_kernel, 3, sizeof(cl_int), &(config.rotation));
-    status |= clSetKernelArg(ctx->dnn_kernel, 4, sizeof(cl_int), &inp_format);
-    CHECK_AND_RETURN(status, "could not assign buffers to DNN kernel");
-
     // figure out on which queue to run the dnn
     cl_command_queue dnn_queue;
     TracyCLCtx dnn_tracy_ctx;
@@ -252,6 +399,52 @@ enqueue_dnn(const dnn_context_t *ctx, const cl_event *wait_event, const codec_co
     CHECK_AND_RETURN(status, "failed to migrate detect buf back");
     append_to_event_array(event_array, detect_mig_event, VAR_NAME(detect_mig_event));
 
+    // eval frames copy the results in between the kernels and segment_4b compression has its
+    // own stage, these are enqueued one by one.
+    bool seg_4b_stage = (ctx->config_flags & SEGMENT_4B) && (config.device_type != LOCAL_DEVICE);
+    if ((ctx->config_flags & REPLAY_COMMAND_BUFFERS) && NULL == tmp_buf_ctx &&
+        !(seg_4b_stage && config.do_segment && do_reconstruct)) {
+        const dnn_recording_t *rec;
+        status = get_dnn_recording(ctx, dnn_queue, config, inp_format, do_reconstruct, inp_buf,
+                                   &rec);
+        CHECK_AND_RETURN(status, "could not get dnn command buffer");
+
+        if (NULL != rec) {
+            // the replay covers the dnn and the postprocess, codec selection only needs the sum
+            {
+                TracyCLZone(dnn_tracy_ctx, "DNN replay");
+                status = clEnqueueCommandBufferKHR(0, NULL, rec->command_buffer, 1,
+                                                   &detect_mig_event, &dnn_event);
+                CHECK_AND_RETURN(status, "failed to replay dnn command buffer");
+                append_to_event_array(event_array, dnn_event, VAR_NAME(dnn_event));
+                TracyCLZoneSetEvent(dnn_event);
+            }
+            *out_event = dnn_event;
+
+            if (NULL != rec->reconstruct_buffer) {
+                TracyCLZone(ctx->local_tracy_ctx, "reconstruct replay");
+                cl_event reconstruct_event;
+                status = clEnqueueCommandBufferKHR(0, NULL, rec->reconstruct_buffer, 1,
+                                                   &dnn_event, &reconstruct_event);
+                CHECK_AND_RETURN(status, "failed to replay reconstruct command buffer");
+                append_to_event_array(event_array, reconstruct_event,
+                                      VAR_NAME(reconstruct_event));
+                TracyCLZoneSetEvent(reconstruct_event);
+                *out_event = reconstruct_event;
+            }
+            return CL_SUCCESS;
+        }
+    }
+
+    status = clSetKernelArg(ctx->dnn_kernel, 0, sizeof(cl_mem), &inp_buf);
+    status |= clSetKernelArg(ctx->dnn_kernel, 3, sizeof(cl_int), &(config.rotation));
+    status |= clSetKernelArg(ctx->dnn_kernel, 4, sizeof(cl_int), &inp_format);
+    // the model can be picked per frame
+    status |= clSetKernelArg(ctx->dnn_kernel, 7, sizeof(cl_int), &(config.model_id));
+    // the postprocess masks are laid out like the rotated frame
+    status |= clSetKernelArg(ctx->postprocess_kernel, 3, sizeof(cl_int), &(config.rotation));
+    CHECK_AND_RETURN(status, "could not assign buffers to DNN kernel");
+
     {
         TracyCLZone(dnn_tracy_ctx, "DNN");
         status = clEnqueueNDRangeKernel(dnn_queue, ctx->dnn_kernel, ctx->work_dim, NULL,
@@ -318,7 +511,7 @@ enqueue_dnn(const dnn_context_t *ctx, const cl_event *wait_event, const codec_co
 
     cl_event reconstruct_wait_event = postprocess_event;
 
-    if ((ctx->config_flags & SEGMENT_4B) && (config.device_type != LOCAL_DEVICE)) {
+    if (seg_4b_stage) {
         ZoneScopedN("enq seg4b");
         status = encode_segment_4b(ctx->segment_4b_ctx, &postprocess_event, ctx->postprocess_buf,
                                    ctx->detect_buf,
@@ -327,7 +520,11 @@ enqueue_dnn(const dnn_context_t *ctx, const cl_event *wait_event, const codec_co
         CHECK_AND_RETURN(status, "could not enqueue segment compression");
         status = clSetKernelArg(ctx->reconstruct_kernel, 0, sizeof(cl_mem),
                                 &(ctx->decompress_output_buf));
+    } else {
+        status = clSetKernelArg(ctx->reconstruct_kernel, 0, sizeof(cl_mem),
+                                &(ctx->postprocess_buf));
     }
+    CHECK_AND_RETURN(status, "could not assign reconstruct input");
 
     {
         // reconstruct postprocessed data to RGBA segmentation mask
@@ -349,20 +546,22 @@ enqueue_dnn(const dnn_context_t *ctx, const cl_event *wait_event, const codec_co
 }
 
 /**
- * read the results of the dnn stage and put them in the arrays
+ * enqueue reading the results of the dnn stage into the arrays, without waiting for them
  * @param ctx
  * @param config contains relevant things like device type and do_segmentation
- * @param detection_array output: contains bounding boxes
- * @param segmentation_array output: contains a segmentation mask
+ * @param detection_array output: contains bounding boxes once the read events completed
+ * @param segmentation_array output: contains a segmentation mask once the read events completed
  * @param event_array for bookkeeping
  * @param wait_size
  * @param wait_list list of event to wait on before starting
+ * @param read_events output: room for two events that complete when the arrays are valid
+ * @param read_event_count output: number of events in read_events
  * @return OpenCL status
  */
 cl_int
 enqueue_read_results_dnn(dnn_context_t *ctx, codec_config_t *config, int32_t *detection_array,
                          uint8_t *segmentation_array, event_array_t *event_array, int wait_size,
-                         cl_event *wait_list) {
+                         cl_event *wait_list, cl_event *read_events, int *read_event_count) {
     ZoneScoped;
 
     // figure out on which queue to run the dnn
@@ -381,13 +580,14 @@ enqueue_read_results_dnn(dnn_context_t *ctx, codec_config_t *config, int32_t *de
 
     int status;
     cl_event read_detect_event, read_segment_event = NULL;
-    int wait_event_size = 1;
+    *read_event_count = 0;
 
     status = clEnqueueReadBuffer(queue, ctx->detect_buf, CL_FALSE, 0, DET_COUNT * sizeof(cl_int),
                                  detection_array, wait_size, wait_list, &read_detect_event);
     CHECK_AND_RETURN(status, "could not read detection array");
 
     append_to_event_array(event_array, read_detect_event, VAR_NAME(read_detect_event));
+    read_events[(*read_event_count)++] = read_detect_event;
 
     if (config->do_segment) {
         status = clEnqueueReadBuffer(ctx->local_queue, ctx->segmentation_buf, CL_FALSE, 0,
@@ -395,33 +595,24 @@ enqueue_read_results_dnn(dnn_context_t *ctx, codec_config_t *config, int32_t *de
                                      wait_size, wait_list, &read_segment_event);
         CHECK_AND_RETURN(status, "could not read segmentation array");
         append_to_event_array(event_array, read_segment_event, VAR_NAME(read_segment_event));
-        // increment the size of the wait event list
-        wait_event_size = 2;
+        read_events[(*read_event_count)++] = read_segment_event;
     }
 
-    {
-        ZoneScopedN("wait");
-        cl_event wait_events[] = {read_detect_event, read_segment_event};
-        // after this wait, the detection and segmentation arrays are valid
-        status = clWaitForEvents(wait_event_size, wait_events);
-        CHECK_AND_RETURN(status, "could not wait on final event");
-
 //#define SAVE_OUTPUT
 #ifdef SAVE_OUTPUT
-        static bool saved = false;
-
-        if(!saved) {
-          int ret;
-          char * postprocess_host = (char *) malloc(MASK_W * MASK_H * sizeof(cl_uchar));
-          status = clEnqueueReadBuffer(ctx->local_queue, ctx->postprocess_buf, CL_TRUE, 0, MASK_W * MASK_H * sizeof(cl_uchar), postprocess_host, 2, wait_events, NULL);
-          ret = write_bin_file("../tests/data/segmentation.bin",
-                               postprocess_host, MASK_W * MASK_H * sizeof(cl_uchar));
-          assert(ret == 0);
-          free(postprocess_host);
-          saved = true;
-        }
-#endif
+    static bool saved = false;
+
+    if(!saved) {
+      int ret;
+      char * postprocess_host = (char *) malloc(MASK_W * MASK_H * sizeof(cl_uchar));
+      status = clEnqueueReadBuffer(ctx->local_queue, ctx->postprocess_buf, CL_TRUE, 0, MASK_W * MASK_H * sizeof(cl_uchar), postprocess_host, *read_event_count, read_events, NULL);
+      ret = write_bin_file("../tests/data/segmentation.bin",
+                           postprocess_host, MASK_W * MASK_H * sizeof(cl_uchar));
+      assert(ret == 0);
+      free(postprocess_host);
+      saved = true;
     }
+#endif
 
     return CL_SUCCESS;
 }
@@ -446,6 +637,10 @@ cl_int destroy_dnn_context(dnn_context_t **context) {
         TracyCLDestroy(c->remote_tracy_ctx);
     }
 
+    for (int i = 0; i < c->num_recordings; i++) {
+        release_dnn_recording(&(c->recordings[i]));
+    }
+
     COND_REL_MEM(c->out_mask_buf)
 
     COND_REL_MEM(c->postprocess_buf)
@@ -10,6 +10,7 @@
 #endif
 #include <rename_opencl.h>
 #include <CL/cl.h>
+#include <CL/cl_ext.h>
 #include "event_logger.h"
 #include "poclImageProcessorTypes.h"
 #include "segment_4b_compression.hpp"
@@ -25,6 +26,24 @@ extern "C" {
 #define MASK_SZ1 160
 #define MASK_SZ2 120
 
+/**
+ * Models that the server can run a frame with, indexed by model_id. This
+ * has to match the order of the POCL_DNN_MODELS setting of the server,
+ * ids the server doesn't know fall back to its default model. The default
+ * setting only has the default model, codec configs on the low resolution
+ * model are only selected with the LOW_RES_MODEL config flag.
+ */
+#define NUM_DNN_MODELS 4
+#define DNN_MODEL_DEFAULT 0
+#define DNN_MODEL_LOW_RES 1
+#define DNN_MODEL_INT8 2
+#define DNN_MODEL_FP16 3
+
+static const char *const DNN_MODEL_NAMES[NUM_DNN_MODELS] = {"yolov8n-seg:640x480",
+                                                            "yolov8n-seg:320x256",
+                                                            "yolov8n-seg:640x480:int8",
+                                                            "yolov8n-seg:640x480:fp16"};
+
 #define DET_COUNT (1 + MAX_DETECTIONS * 6)
 #define SEG_COUNT (MAX_DETECTIONS * MASK_SZ1 * MASK_SZ2)
 #define SEG_OUT_COUNT (MASK_SZ1 * MASK_SZ2 * 4)
@@ -44,6 +63,27 @@ extern "C" {
         return -1;\
     }\
 
+// enough for every dnn path of a lane: device, segmentation, reconstruction and input buffer
+#define DNN_MAX_RECORDINGS 16
+
+/**
+ * The kernels of one dnn path recorded as a command buffer. Kernel arguments are captured
+ * when recording, so it is recorded again when the input format, rotation or model changes.
+ * The reconstruction runs on the local device and gets a command buffer of its own, so that
+ * the replays of both have events of their own for the kernel times of codec selection.
+ */
+typedef struct {
+    cl_command_buffer_khr command_buffer; // dnn and postprocess on the dnn device
+    cl_command_buffer_khr reconstruct_buffer; // NULL without reconstruction
+    cl_mem inp_buf;
+    cl_int inp_format;
+    cl_int rotation;
+    cl_int model_id;
+    int device_type;
+    int do_segment;
+    int do_reconstruct;
+} dnn_recording_t;
+
 typedef struct {
     cl_mem out_mask_buf; // input for postprocess kernel
     cl_mem postprocess_buf; // input for postprocess kernel
@@ -77,6 +117,10 @@ typedef struct {
     segment_4b_context_t *segment_4b_ctx;
     cl_mem decompress_output_buf;
 
+    // paths recorded so far, only used with REPLAY_COMMAND_BUFFERS
+    dnn_recording_t recordings[DNN_MAX_RECORDINGS];
+    int num_recordings;
+
 } dnn_context_t;
 
 typedef struct {
@@ -100,14 +144,14 @@ write_buffer_dnn(const dnn_context_t *ctx, device_type_enum device_type, uint8_t
                  event_array_t *event_array, cl_event *result_event);
 
 cl_int
-enqueue_dnn(const dnn_context_t *ctx, const cl_event *wait_event, const codec_config_t config,
+enqueue_dnn(dnn_context_t *ctx, const cl_event *wait_event, const codec_config_t config,
             const pixel_format_enum input_format, const bool do_reconstruct, const cl_mem inp_buf,
             event_array_t *event_array, cl_event *out_event, tmp_buf_ctx_t *tmp_buf_ctx);
 
 cl_int
 enqueue_read_results_dnn(dnn_context_t *ctx, codec_config_t *config, int32_t *detection_array,
                          uint8_t *segmentation_array, event_array_t *event_array, int wait_size,
-                         cl_event *wait_list);
+                         cl_event *wait_list, cl_event *read_events, int *read_event_count);
 
 cl_int destroy_dnn_context(dnn_context_t **context);
 
@@ -83,7 +83,7 @@ submit_eval_frame(eval_pipeline_context_t *eval_ctx, const codec_config_t codec_
 
     codec_config_t eval_config = {NO_COMPRESSION, codec_config.device_type, codec_config.rotation,
                                   codec_config.do_segment, {.jpeg = {.quality = 0}},
-                                  LOCAL_CODEC_ID};
+                                  LOCAL_CODEC_ID, DNN_MODEL_DEFAULT};
 
     dnn_results eval_results;
     eval_results.event_list_size = 1;
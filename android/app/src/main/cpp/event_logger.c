@@ -3,6 +3,7 @@
 // implementations for event_logger.h
 //
 #include "event_logger.h"
+#include "profile_log.h"
 #include "sharedUtils.h"
 #include <assert.h>
 #include <string.h>
@@ -66,7 +67,7 @@ int log_events(int fd, int frame_index, const event_array_t *array) {
                  array->array[i].description, __FILE__, __LINE__, status);
             continue;
         }
-        dprintf(fd, "%d,%s,queued_ns,%lu\n", frame_index, array->array[i].description, event_time);
+        log_frame_u64(fd, frame_index, array->array[i].description, "queued_ns", event_time);
 
         status = clGetEventProfilingInfo(array->array[i].event, CL_PROFILING_COMMAND_SUBMIT,
                                          sizeof(cl_ulong), &event_time, NULL);
@@ -76,7 +77,7 @@ int log_events(int fd, int frame_index, const event_array_t *array) {
                  array->array[i].description, __FILE__, __LINE__, status);
             continue;
         }
-        dprintf(fd, "%d,%s,submit_ns,%lu\n", frame_index, array->array[i].description, event_time);
+        log_frame_u64(fd, frame_index, array->array[i].description, "submit_ns", event_time);
 
         status = clGetEventProfilingInfo(array->array[i].event, CL_PROFILING_COMMAND_START,
                                          sizeof(cl_ulong), &event_time, NULL);
@@ -86,7 +87,7 @@ int log_events(int fd, int frame_index, const event_array_t *array) {
                  array->array[i].description, __FILE__, __LINE__, status);
             continue;
         }
-        dprintf(fd, "%d,%s,start_ns,%lu\n", frame_index, array->array[i].description, event_time);
+        log_frame_u64(fd, frame_index, array->array[i].description, "start_ns", event_time);
 
         status = clGetEventProfilingInfo(array->array[i].event, CL_PROFILING_COMMAND_END,
                                          sizeof(cl_ulong), &event_time, NULL);
@@ -96,7 +97,7 @@ int log_events(int fd, int frame_index, const event_array_t *array) {
                  array->array[i].description, __FILE__, __LINE__, status);
             continue;
         }
-        dprintf(fd, "%d,%s,end_ns,%lu\n", frame_index, array->array[i].description, event_time);
+        log_frame_u64(fd, frame_index, array->array[i].description, "end_ns", event_time);
 
 #ifdef PRINT_PROFILE_TIME
         PRINT_DIFF(event_time - start, array->array[i].description);
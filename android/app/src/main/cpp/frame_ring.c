@@ -0,0 +1,402 @@
+//
+// Lane bookkeeping of the image processor, see frame_ring.h
+//
+
+#include "frame_ring.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NS_PER_MS 1000000L
+#define NS_PER_SEC 1000000000L
+
+/**
+ * turn a timeout into an absolute CLOCK_MONOTONIC deadline
+ * @param timeout_ms negative to wait forever
+ * @param deadline output
+ * @return deadline if there is a timeout, otherwise NULL
+ */
+static struct timespec *
+get_deadline(const int timeout_ms, struct timespec *const deadline) {
+    if (timeout_ms < 0) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    long nsec = deadline->tv_nsec + (timeout_ms % 1000) * NS_PER_MS;
+    deadline->tv_sec += timeout_ms / 1000 + nsec / NS_PER_SEC;
+    deadline->tv_nsec = nsec % NS_PER_SEC;
+    return deadline;
+}
+
+/**
+ * sleep as long as word still holds value, or until the deadline has passed.
+ * FUTEX_WAIT takes a relative timeout that is measured against CLOCK_MONOTONIC,
+ * so changes to the wall clock do not affect it.
+ * @param word to sleep on
+ * @param value that word had when the caller decided to sleep
+ * @param deadline absolute CLOCK_MONOTONIC time, NULL to wait forever
+ * @return 0 when woken up or interrupted, ETIMEDOUT when the deadline has passed
+ */
+static int
+futex_wait(uint32_t *const word, const uint32_t value, const struct timespec *const deadline) {
+    struct timespec remaining;
+    struct timespec *timeout = NULL;
+    if (NULL != deadline) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        remaining.tv_sec = deadline->tv_sec - now.tv_sec;
+        remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if (remaining.tv_nsec < 0) {
+            remaining.tv_sec -= 1;
+            remaining.tv_nsec += NS_PER_SEC;
+        }
+        if (remaining.tv_sec < 0) {
+            return ETIMEDOUT;
+        }
+        timeout = &remaining;
+    }
+
+    if (-1 == syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, timeout, NULL, 0) &&
+        ETIMEDOUT == errno) {
+        return ETIMEDOUT;
+    }
+    // woken up, interrupted or word already changed (EAGAIN), the caller checks again
+    return 0;
+}
+
+static void
+futex_wake(uint32_t *const word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * wait until fewer than capacity spots are in use, where acquired is the number of spots
+ * the producer handed out and released the number of spots the consumer gave back.
+ * @return 0 on success, ETIMEDOUT otherwise
+ */
+static int
+wait_for_spot(frame_ring_t *const ring, const uint32_t acquired, const uint32_t *const released,
+              const uint32_t capacity, const struct timespec *const deadline) {
+    for (;;) {
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+        if (acquired - __atomic_load_n(released, __ATOMIC_SEQ_CST) < capacity) {
+            return 0;
+        }
+
+        // announce that we are going to sleep and check again, so that a frame popped in
+        // between either shows up here or wakes us up
+        __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (acquired - __atomic_load_n(released, __ATOMIC_SEQ_CST) < capacity) {
+            __atomic_store_n(&ring->producer_waiting, 0, __ATOMIC_RELAXED);
+            return 0;
+        }
+
+        int ret = futex_wait(&ring->tail, tail, deadline);
+        __atomic_store_n(&ring->producer_waiting, 0, __ATOMIC_RELAXED);
+        if (ETIMEDOUT == ret) {
+            return (acquired - __atomic_load_n(released, __ATOMIC_SEQ_CST) < capacity) ? 0
+                                                                                      : ETIMEDOUT;
+        }
+    }
+}
+
+/**
+ * @return mask of the slots that are not in use. Producer side only.
+ */
+static uint32_t
+free_slots(const frame_ring_t *const ring) {
+    const uint32_t all_slots = (ring->capacity == 32) ? UINT32_MAX : (1u << ring->capacity) - 1;
+    const uint32_t in_use =
+            ring->acquired_slots ^ __atomic_load_n(&ring->released_slots, __ATOMIC_ACQUIRE);
+    return ~in_use & all_slots;
+}
+
+/**
+ * wait until one of the slots in slot_mask is not in use, like wait_for_spot
+ * @return 0 on success, ETIMEDOUT otherwise
+ */
+static int
+wait_for_slot(frame_ring_t *const ring, const uint32_t slot_mask,
+              const struct timespec *const deadline) {
+    for (;;) {
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+        if (0 != (free_slots(ring) & slot_mask)) {
+            return 0;
+        }
+
+        __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (0 != (free_slots(ring) & slot_mask)) {
+            __atomic_store_n(&ring->producer_waiting, 0, __ATOMIC_RELAXED);
+            return 0;
+        }
+
+        int ret = futex_wait(&ring->tail, tail, deadline);
+        __atomic_store_n(&ring->producer_waiting, 0, __ATOMIC_RELAXED);
+        if (ETIMEDOUT == ret) {
+            return (0 != (free_slots(ring) & slot_mask)) ? 0 : ETIMEDOUT;
+        }
+    }
+}
+
+/**
+ * @param ring to initialize
+ * @param capacity number of frames that can be in flight, one per lane
+ * @param local_capacity number of those frames that can run on the local device
+ */
+void
+frame_ring_init(frame_ring_t *const ring, const uint32_t capacity, const uint32_t local_capacity) {
+    assert(capacity > 0 && capacity <= FRAME_RING_MAX_CAPACITY);
+    ring->head = 0;
+    ring->reserved = 0;
+    ring->local_reserved = 0;
+    ring->acquired_slots = 0;
+    ring->tail = 0;
+    ring->local_released = 0;
+    ring->released_slots = 0;
+    ring->taken_slots = 0;
+    ring->producer_waiting = 0;
+    ring->completed_slots = 0;
+    ring->consumer_waiting = 0;
+    ring->capacity = capacity;
+    ring->local_capacity = local_capacity;
+}
+
+/**
+ * reserve a spot for a frame that will be pushed later. Producer side only.
+ * @param ring
+ * @param local also reserve one of the local spots
+ * @param timeout_ms how long to wait for a spot, negative to wait forever
+ * @return 0 if successful, otherwise -1 with errno set to ETIMEDOUT
+ */
+int frame_ring_reserve(frame_ring_t *const ring, const int local, const int timeout_ms) {
+    struct timespec deadline_ts;
+    const struct timespec *deadline = get_deadline(timeout_ms, &deadline_ts);
+
+    if (local) {
+        if (0 != wait_for_spot(ring, ring->local_reserved, &ring->local_released,
+                               ring->local_capacity, deadline)) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+
+    if (0 != wait_for_spot(ring, ring->reserved, &ring->tail, ring->capacity, deadline)) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    if (local) {
+        ring->local_reserved += 1;
+    }
+    ring->reserved += 1;
+    return 0;
+}
+
+/**
+ * like frame_ring_reserve, but also waits until one of the slots in slot_mask is free, so that
+ * frame_ring_next_slot_in finds one. Producer side only, with no other spot reserved.
+ * @param ring
+ * @param local also reserve one of the local spots
+ * @param slot_mask slots the frame may use
+ * @param timeout_ms how long to wait for both, negative to wait forever
+ * @return 0 if successful, otherwise -1 with errno set to ETIMEDOUT
+ */
+int frame_ring_reserve_in(frame_ring_t *const ring, const int local, const uint32_t slot_mask,
+                          const int timeout_ms) {
+    struct timespec deadline_ts;
+    const struct timespec *deadline = get_deadline(timeout_ms, &deadline_ts);
+
+    // the spot is reserved first, the time left goes to waiting for the slot
+    if (0 != frame_ring_reserve(ring, local, timeout_ms)) {
+        return -1;
+    }
+    if (0 != wait_for_slot(ring, slot_mask, deadline)) {
+        frame_ring_unreserve(ring, 1, local);
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * give back spots that were reserved but will not be pushed. Producer side only.
+ * @param ring
+ * @param count number of spots
+ * @param local the spots were also local spots
+ */
+void frame_ring_unreserve(frame_ring_t *const ring, const uint32_t count, const int local) {
+    ring->reserved -= count;
+    if (local) {
+        ring->local_reserved -= count;
+    }
+}
+
+/**
+ * @param ring
+ * @return the number of frames pushed so far, which is the index of the next frame
+ */
+uint32_t frame_ring_head(const frame_ring_t *const ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+}
+
+/**
+ * find a slot that is not in use. Producer side only, the caller needs to have reserved a
+ * spot, which guarantees that there is one.
+ * @param ring
+ * @return the lowest free slot
+ */
+int frame_ring_next_slot(const frame_ring_t *const ring) {
+    const uint32_t available = free_slots(ring);
+    assert(0 != available && "no spot was reserved");
+    return __builtin_ctz(available);
+}
+
+/**
+ * find a slot among slot_mask that is not in use. Producer side only.
+ * @param ring
+ * @param slot_mask slots to choose from
+ * @return the lowest free slot in slot_mask, -1 if all of them are in use
+ */
+int frame_ring_next_slot_in(const frame_ring_t *const ring, const uint32_t slot_mask) {
+    const uint32_t available = free_slots(ring) & slot_mask;
+    return (0 == available) ? -1 : __builtin_ctz(available);
+}
+
+/**
+ * @param ring
+ * @return mask of the slots that are not in use. Producer side only.
+ */
+uint32_t frame_ring_free_slots(const frame_ring_t *const ring) {
+    return free_slots(ring);
+}
+
+/**
+ * mark the slot as in use by the next frame. Producer side only. The slot is handed to the
+ * consumer once it is completed with frame_ring_complete.
+ * @param ring
+ * @param slot from frame_ring_next_slot
+ */
+void frame_ring_push(frame_ring_t *const ring, const int slot) {
+    ring->acquired_slots ^= (1u << slot);
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * mark the frame in the slot as done. Can be called from any thread, including OpenCL
+ * event callbacks, once per push.
+ * @param ring
+ * @param slot that was pushed
+ */
+void frame_ring_complete(frame_ring_t *const ring, const int slot) {
+    __atomic_fetch_or(&ring->completed_slots, 1u << slot, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->consumer_waiting, __ATOMIC_SEQ_CST)) {
+        futex_wake(&ring->completed_slots);
+    }
+}
+
+/**
+ * wait until at least one slot completed since the last take, and take all of them
+ * @return 0 if slots were taken, otherwise -1 with errno set to ETIMEDOUT
+ */
+static int
+take_completed(frame_ring_t *const ring, const int timeout_ms) {
+    struct timespec deadline_ts;
+    const struct timespec *deadline = NULL;
+    for (;;) {
+        uint32_t completed = __atomic_exchange_n(&ring->completed_slots, 0, __ATOMIC_ACQUIRE);
+        if (0 != completed) {
+            ring->taken_slots |= completed;
+            return 0;
+        }
+
+        if (NULL == deadline) {
+            deadline = get_deadline(timeout_ms, &deadline_ts);
+        }
+
+        // announce that we are going to sleep and check again, so that a slot completed in
+        // between either shows up here or wakes us up
+        __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (0 != __atomic_load_n(&ring->completed_slots, __ATOMIC_SEQ_CST)) {
+            __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        int ret = futex_wait(&ring->completed_slots, 0, deadline);
+        __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_RELAXED);
+        if (ETIMEDOUT == ret && 0 == __atomic_load_n(&ring->completed_slots, __ATOMIC_SEQ_CST)) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+}
+
+/**
+ * wait until there is a completed frame to pop, and take all frames that completed so far.
+ * Consumer side only.
+ * @param ring
+ * @param timeout_ms how long to wait, negative to wait forever
+ * @return 0 if a frame is available, otherwise -1 with errno set to ETIMEDOUT
+ */
+int frame_ring_wait(frame_ring_t *const ring, const int timeout_ms) {
+    if (0 != ring->taken_slots) {
+        return 0;
+    }
+    return take_completed(ring, timeout_ms);
+}
+
+/**
+ * like frame_ring_wait, but also waits when there are completed frames already, until one
+ * more frame completes. Used when the frames taken so far can't be popped yet. Consumer side
+ * only.
+ * @param ring
+ * @param timeout_ms how long to wait, negative to wait forever
+ * @return 0 if another frame is available, otherwise -1 with errno set to ETIMEDOUT
+ */
+int frame_ring_wait_more(frame_ring_t *const ring, const int timeout_ms) {
+    return take_completed(ring, timeout_ms);
+}
+
+/**
+ * @param ring
+ * @return mask of the completed slots taken by frame_ring_wait that are not popped yet.
+ * Consumer side only.
+ */
+uint32_t frame_ring_completed(const frame_ring_t *const ring) {
+    return ring->taken_slots;
+}
+
+/**
+ * @param ring
+ * @return the number of frames popped so far
+ */
+uint32_t frame_ring_tail(const frame_ring_t *const ring) {
+    return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+}
+
+/**
+ * hand the slot back to the producer. Consumer side only, the slot needs to be one of
+ * frame_ring_completed.
+ * @param ring
+ * @param slot to give back
+ * @param release_local also give back a local spot
+ */
+void frame_ring_pop(frame_ring_t *const ring, const int slot, const int release_local) {
+    assert((ring->taken_slots & (1u << slot)) && "slot is not completed");
+    ring->taken_slots &= ~(1u << slot);
+    __atomic_store_n(&ring->released_slots, ring->released_slots ^ (1u << slot),
+                     __ATOMIC_RELEASE);
+    if (release_local) {
+        assert(__atomic_load_n(&ring->local_reserved, __ATOMIC_RELAXED) != ring->local_released &&
+               "no local spot to give back");
+        __atomic_store_n(&ring->local_released, ring->local_released + 1, __ATOMIC_SEQ_CST);
+    }
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->producer_waiting, __ATOMIC_SEQ_CST)) {
+        futex_wake(&ring->tail);
+    }
+}
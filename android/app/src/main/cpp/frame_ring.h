@@ -0,0 +1,80 @@
+//
+// Single producer, single consumer ring that hands out the lanes of the image processor.
+// The producer (dequeue_spot and submit_image) and the consumer (wait_image_available and
+// receive_image) each own their indices on a separate cache line, so that the hot path takes
+// no locks and does no system calls. Slots are completed by the OpenCL event callbacks of
+// their frame, in whatever order the lanes finish, and the consumer takes all completed slots
+// at once. A side only sleeps on a futex when there is nothing for it to do yet.
+//
+
+#ifndef POCL_AISA_DEMO_FRAME_RING_H
+#define POCL_AISA_DEMO_FRAME_RING_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_RING_CACHE_LINE 64
+#define FRAME_RING_ALIGNED __attribute__((aligned(FRAME_RING_CACHE_LINE)))
+#define FRAME_RING_MAX_CAPACITY 32 // slots are tracked with bit masks
+
+typedef struct {
+    // written by the producer only
+    FRAME_RING_ALIGNED uint32_t head; // frames pushed so far
+    uint32_t reserved; // spots handed out by frame_ring_reserve
+    uint32_t local_reserved; // local spots handed out by frame_ring_reserve
+    uint32_t acquired_slots; // slot i is in use while bit i differs from released_slots
+
+    // written by the consumer only
+    FRAME_RING_ALIGNED uint32_t tail; // frames popped so far, the producer sleeps on this word
+    uint32_t local_released; // local spots given back by frame_ring_pop
+    uint32_t released_slots; // bit i flips every time slot i is popped
+    uint32_t taken_slots; // completed slots that the consumer took but did not pop yet
+    uint32_t producer_waiting; // set by the producer right before it sleeps on tail
+
+    // set by whichever thread completes a slot, cleared by the consumer
+    FRAME_RING_ALIGNED uint32_t completed_slots; // the consumer sleeps on this word
+    uint32_t consumer_waiting; // set by the consumer right before it sleeps on completed_slots
+
+    // read only after init
+    FRAME_RING_ALIGNED uint32_t capacity;
+    uint32_t local_capacity;
+} frame_ring_t;
+
+void frame_ring_init(frame_ring_t *ring, uint32_t capacity, uint32_t local_capacity);
+
+int frame_ring_reserve(frame_ring_t *ring, int local, int timeout_ms);
+
+int frame_ring_reserve_in(frame_ring_t *ring, int local, uint32_t slot_mask, int timeout_ms);
+
+void frame_ring_unreserve(frame_ring_t *ring, uint32_t count, int local);
+
+uint32_t frame_ring_head(const frame_ring_t *ring);
+
+int frame_ring_next_slot(const frame_ring_t *ring);
+
+int frame_ring_next_slot_in(const frame_ring_t *ring, uint32_t slot_mask);
+
+uint32_t frame_ring_free_slots(const frame_ring_t *ring);
+
+void frame_ring_push(frame_ring_t *ring, int slot);
+
+void frame_ring_complete(frame_ring_t *ring, int slot);
+
+int frame_ring_wait(frame_ring_t *ring, int timeout_ms);
+
+int frame_ring_wait_more(frame_ring_t *ring, int timeout_ms);
+
+uint32_t frame_ring_completed(const frame_ring_t *ring);
+
+uint32_t frame_ring_tail(const frame_ring_t *ring);
+
+void frame_ring_pop(frame_ring_t *ring, int slot, int release_local);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //POCL_AISA_DEMO_FRAME_RING_H
@@ -8,6 +8,7 @@
 #include "codec_select.h"
 #include "eval.h"
 #include "sharedUtils.h"
+#include "profile_log.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -44,6 +45,7 @@ Java_org_portablecl_poclaisademo_JNIPoclImageProcessor_initPoclImageProcessorV2(
                                                                                 jint height,
                                                                                 jint fd,
                                                                                 jint max_lanes,
+                                                                                jint lane_depth,
                                                                                 jint do_algorithm,
                                                                                 jint runtime_eval,
                                                                                 jint lock_codec,
@@ -63,7 +65,8 @@ Java_org_portablecl_poclaisademo_JNIPoclImageProcessor_initPoclImageProcessorV2(
     if (service_name != NULL)
         _service_name = (char *) env->GetStringUTFChars(service_name, 0);
 
-    jint status = create_pocl_image_processor_context(&ctx, max_lanes, width, height, config_flags,
+    jint status = create_pocl_image_processor_context(&ctx, max_lanes, lane_depth, width, height,
+                                                      config_flags,
                                                       (const char **) codec_sources,
                                                       (const size_t *) src_sizes, fd, runtime_eval,
                                                       _service_name);
@@ -173,7 +176,7 @@ Java_org_portablecl_poclaisademo_JNIPoclImageProcessor_poclSubmitYUVImage(JNIEnv
                                            quality, rotation, do_algorithm, &image_data);
 
     if (state->enable_profiling) {
-        log_frame_int(state->fd, ctx->frame_index_head - 1, "frame", "is_last_frame",
+        log_frame_int(state->fd, get_frame_index(ctx) - 1, "frame", "is_last_frame",
                       is_last_playback_frame ? 1 : 0);
     }
 
@@ -188,6 +191,15 @@ Java_org_portablecl_poclaisademo_JNIPoclImageProcessor_dequeue_1spot(JNIEnv *env
     return dequeue_spot(ctx, timeout, (device_type_enum) dev_type);
 }
 
+JNIEXPORT void JNICALL
+Java_org_portablecl_poclaisademo_JNIPoclImageProcessor_setBackpressurePolicy(JNIEnv *env,
+                                                                             jclass clazz,
+                                                                             jint mode,
+                                                                             jint deadline_ms) {
+    assert(NULL != ctx);
+    set_backpressure_policy(ctx, (backpressure_mode_t) mode, deadline_ms);
+}
+
 JNIEXPORT jint JNICALL
 Java_org_portablecl_poclaisademo_JNIPoclImageProcessor_waitImageAvailable(JNIEnv *env, jclass clazz,
                                                                           jint timeout) {
@@ -0,0 +1,171 @@
+//
+// Frame difference check that lets the image processor skip static frames, see motion_skip.h
+//
+
+#include "motion_skip.h"
+
+#include <stdlib.h>
+
+// a shifted match has to be this much better than no motion at all, so that noise on a
+// static scene does not move the results around
+#define MOTION_SHIFT_MARGIN 0.9f
+
+/**
+ * shrink the y plane to a thumbnail, averaging a grid of 4x4 pixels out of every cell
+ * @param y_plane luma plane of the frame
+ * @param row_stride bytes between rows
+ * @param pixel_stride bytes between pixels
+ * @param thumb_width number of cells in a row
+ * @param thumb_height number of cells in a column
+ * @param thumb output
+ */
+static void
+make_thumbnail(const uint8_t *const y_plane, const int row_stride, const int pixel_stride,
+               const int thumb_width, const int thumb_height, uint8_t *const thumb) {
+    for (int ty = 0; ty < thumb_height; ty++) {
+        for (int tx = 0; tx < thumb_width; tx++) {
+            const uint8_t *cell = y_plane + ty * MOTION_CELL_SIZE * row_stride +
+                                  tx * MOTION_CELL_SIZE * pixel_stride;
+            uint32_t sum = 0;
+            for (int y = 0; y < MOTION_CELL_SIZE; y += 2) {
+                for (int x = 0; x < MOTION_CELL_SIZE; x += 2) {
+                    sum += cell[y * row_stride + x * pixel_stride];
+                }
+            }
+            thumb[ty * thumb_width + tx] = (uint8_t) (sum / 16);
+        }
+    }
+}
+
+/**
+ * compare the thumbnails where they overlap, with the current one moved by (sx, sy)
+ * @return mean absolute difference per overlapping thumbnail pixel
+ */
+static float
+shifted_difference(const motion_skip_t *const ctx, const int sx, const int sy) {
+    const int x_start = (sx > 0) ? sx : 0;
+    const int x_end = (sx < 0) ? ctx->thumb_width + sx : ctx->thumb_width;
+    const int y_start = (sy > 0) ? sy : 0;
+    const int y_end = (sy < 0) ? ctx->thumb_height + sy : ctx->thumb_height;
+
+    uint32_t sad = 0;
+    for (int y = y_start; y < y_end; y++) {
+        const uint8_t *cur = ctx->current + y * ctx->thumb_width;
+        const uint8_t *ref = ctx->reference + (y - sy) * ctx->thumb_width - sx;
+        for (int x = x_start; x < x_end; x++) {
+            sad += abs((int) cur[x] - (int) ref[x]);
+        }
+    }
+    return (float) sad / (float) ((x_end - x_start) * (y_end - y_start));
+}
+
+/**
+ * @param ctx to initialize
+ * @param width of the camera frames
+ * @param height of the camera frames
+ * @param threshold mean absolute luma difference below which frames are skipped
+ * @param max_skipped_frames frames that can be skipped in a row
+ * @return 0 if successful, otherwise -1
+ */
+int init_motion_skip(motion_skip_t *const ctx, const int width, const int height,
+                     const float threshold, const int max_skipped_frames) {
+    ctx->thumb_width = width / MOTION_CELL_SIZE;
+    ctx->thumb_height = height / MOTION_CELL_SIZE;
+    ctx->threshold = threshold;
+    ctx->max_skipped_frames = max_skipped_frames;
+    ctx->has_reference = 0;
+    ctx->skipped_frames = 0;
+
+    if (ctx->thumb_width <= 2 * MOTION_SEARCH_RANGE ||
+        ctx->thumb_height <= 2 * MOTION_SEARCH_RANGE) {
+        ctx->reference = NULL;
+        ctx->current = NULL;
+        return -1;
+    }
+
+    ctx->reference = (uint8_t *) malloc(ctx->thumb_width * ctx->thumb_height);
+    ctx->current = (uint8_t *) malloc(ctx->thumb_width * ctx->thumb_height);
+    if (NULL == ctx->reference || NULL == ctx->current) {
+        destroy_motion_skip(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+void destroy_motion_skip(motion_skip_t *const ctx) {
+    free(ctx->reference);
+    free(ctx->current);
+    ctx->reference = NULL;
+    ctx->current = NULL;
+}
+
+/**
+ * forget the reference frame, so that the next frame runs the dnn. Needed when the results
+ * of the reference frame can't be reused, for example because the codec config changed.
+ * @param ctx
+ */
+void reset_motion_skip(motion_skip_t *const ctx) {
+    ctx->has_reference = 0;
+    ctx->skipped_frames = 0;
+}
+
+/**
+ * check whether the frame can reuse the results of the reference frame. If not, the frame
+ * becomes the new reference frame, so the caller needs to run the dnn on it.
+ * @param ctx
+ * @param y_plane luma plane of the frame, with the dimensions given to init_motion_skip
+ * @param row_stride bytes between rows
+ * @param pixel_stride bytes between pixels
+ * @param allow_skip 0 if the frame has to run the dnn anyway, for example eval frames
+ * @param motion output, movement of the scene since the reference frame in frame pixels
+ * @return 1 if the frame can be skipped, otherwise 0
+ */
+int check_motion_skip(motion_skip_t *const ctx, const uint8_t *const y_plane,
+                      const int row_stride, const int pixel_stride, const int allow_skip,
+                      motion_estimate_t *const motion) {
+
+    make_thumbnail(y_plane, row_stride, pixel_stride, ctx->thumb_width, ctx->thumb_height,
+                   ctx->current);
+
+    motion->dx = 0;
+    motion->dy = 0;
+    motion->score = -1.0f;
+
+    if (ctx->has_reference) {
+        float best_score = shifted_difference(ctx, 0, 0);
+        motion->score = best_score;
+        // a scene that is static already does not need the search
+        const int search_range = (best_score < ctx->threshold) ? 0 : MOTION_SEARCH_RANGE;
+        for (int sy = -search_range; sy <= search_range; sy++) {
+            for (int sx = -search_range; sx <= search_range; sx++) {
+                if (0 == sx && 0 == sy) {
+                    continue;
+                }
+                float score = shifted_difference(ctx, sx, sy);
+                if (score < best_score && score < motion->score * MOTION_SHIFT_MARGIN) {
+                    best_score = score;
+                    motion->dx = sx * MOTION_CELL_SIZE;
+                    motion->dy = sy * MOTION_CELL_SIZE;
+                }
+            }
+        }
+        // the score without motion is kept when no shift was clearly better
+        if (0 != motion->dx || 0 != motion->dy) {
+            motion->score = best_score;
+        }
+
+        if (allow_skip && motion->score < ctx->threshold &&
+            ctx->skipped_frames < ctx->max_skipped_frames) {
+            ctx->skipped_frames += 1;
+            return 1;
+        }
+    }
+
+    // this frame runs the dnn, so later frames are compared against it
+    uint8_t *tmp = ctx->reference;
+    ctx->reference = ctx->current;
+    ctx->current = tmp;
+    ctx->has_reference = 1;
+    ctx->skipped_frames = 0;
+    return 0;
+}
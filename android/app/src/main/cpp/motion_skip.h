@@ -0,0 +1,55 @@
+//
+// Decides whether a camera frame changed enough since the last frame that ran the dnn to be
+// worth encoding, offloading and running again. Both frames are shrunk to a thumbnail of the
+// y plane, the thumbnails are compared at a few global shifts, and the best match gives both
+// the motion score and the motion of the scene, which is used to move the old results along.
+//
+
+#ifndef POCL_AISA_DEMO_MOTION_SKIP_H
+#define POCL_AISA_DEMO_MOTION_SKIP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOTION_CELL_SIZE 8 // pixels of the y plane that are averaged into one thumbnail pixel
+#define MOTION_SEARCH_RANGE 3 // thumbnail pixels that the scene may move in each direction
+// mean absolute luma difference per thumbnail pixel below which a frame is skipped
+#define MOTION_SKIP_THRESHOLD 3.0f
+// run the dnn at least every this many frames, so that slow changes are still picked up
+#define MOTION_SKIP_MAX_FRAMES 10
+
+typedef struct {
+    int dx; // pixels the scene moved to the right since the reference frame
+    int dy; // pixels the scene moved down since the reference frame
+    float score; // mean absolute difference of the thumbnails at that shift
+} motion_estimate_t;
+
+typedef struct {
+    int thumb_width;
+    int thumb_height;
+    uint8_t *reference; // thumbnail of the last frame that ran the dnn
+    uint8_t *current; // thumbnail of the frame being checked
+    int has_reference;
+    int skipped_frames; // frames skipped in a row since the reference frame
+    float threshold;
+    int max_skipped_frames;
+} motion_skip_t;
+
+int init_motion_skip(motion_skip_t *ctx, int width, int height, float threshold,
+                     int max_skipped_frames);
+
+void destroy_motion_skip(motion_skip_t *ctx);
+
+void reset_motion_skip(motion_skip_t *ctx);
+
+int check_motion_skip(motion_skip_t *ctx, const uint8_t *y_plane, int row_stride,
+                      int pixel_stride, int allow_skip, motion_estimate_t *motion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //POCL_AISA_DEMO_MOTION_SKIP_H
@@ -481,6 +481,12 @@ initPoclImageProcessor(const int width, const int height, const int init_config_
     status |= clSetKernelArg(dnn_kernel, 2, sizeof(cl_int), &inp_h);
     status |=
             clSetKernelArg(dnn_kernel, 3, sizeof(cl_int), &rotate_cw_degrees);
+    // always run the default model
+    cl_int model_id = 0;
+    status |= clSetKernelArg(dnn_kernel, 7, sizeof(cl_int), &model_id);
+    status |= clSetKernelArg(postprocess_kernel, 3, sizeof(cl_int), &rotate_cw_degrees);
+    status |= clSetKernelArg(postprocess_kernel, 4, sizeof(cl_int), &inp_w);
+    status |= clSetKernelArg(postprocess_kernel, 5, sizeof(cl_int), &inp_h);
 //    status |= clSetKernelArg(dnn_kernel, 4, sizeof(cl_int), &inp_format);
     //status |= clSetKernelArg(dnn_kernel, 5, sizeof(cl_mem), &out_buf);
     //status |= clSetKernelArg(dnn_kernel, 6, sizeof(cl_mem), &out_mask_buf);
@@ -1178,6 +1184,7 @@ poclProcessImage(codec_config_t config, int frame_index, int do_segment,
         rotate_cw_degrees = rotation;
         status =
                 clSetKernelArg(dnn_kernel, 3, sizeof(cl_int), &rotate_cw_degrees);
+        status |= clSetKernelArg(postprocess_kernel, 3, sizeof(cl_int), &rotate_cw_degrees);
         CHECK_AND_RETURN(status, "failed to set rotation");
     }
 
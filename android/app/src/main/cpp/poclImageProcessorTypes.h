@@ -34,7 +34,24 @@ typedef enum {
 
 enum {
     ENABLE_PROFILING = (1 << 8),
-    LOCAL_ONLY = (1 << 9)
+    LOCAL_ONLY = (1 << 9),
+    // record the kernels of each pipeline path once per lane as a command buffer and replay it
+    // every frame. The replayed kernels don't get an event each: the dnn replay is logged as
+    // dnn_event and covers the postprocess too, the reconstruction keeps its reconstruct_event.
+    REPLAY_COMMAND_BUFFERS = (1 << 10),
+    // don't run frames that barely differ from the last frame that ran the dnn, but return the
+    // results of that frame moved along with the scene
+    SKIP_STATIC_FRAMES = (1 << 11),
+    // let the codec selection adjust the JPEG quality and HEVC bitrate of the running codec to
+    // the latency budget, see rate_control_t
+    RATE_CONTROL = (1 << 14),
+    // spread the lanes over all remote devices, each taken as a server of its own, and send
+    // frames to the least loaded one, see server_pool.h
+    MULTI_SERVER = (1 << 15),
+    // the server lists the low resolution model in POCL_DNN_MODELS, let the codec selection use
+    // the configs that run it. Without it they are dropped, the server would fall back to the
+    // default model and they would only repeat the default model configs.
+    LOW_RES_MODEL = (1 << 16),
 };
 
 typedef enum {
@@ -128,6 +145,7 @@ typedef struct {
         hevc_config_t hevc;
     } config; // codec specific configuration parameters
     int id; // ID of the codec config pointing at the array of available configs
+    int model_id; // DNN model to run the frame with, see DNN_MODEL_NAMES
 } codec_config_t;
 
 /**
@@ -3,7 +3,9 @@
 //
 
 #include "poclImageProcessorUtils.h"
+#include "profile_log.h"
 #include <assert.h>
+#include <string.h>
 #include <Tracy.hpp>
 
 #ifdef __cplusplus
@@ -72,45 +74,128 @@ void copy_yuv_to_arrayV2(const int width, const int height, const image_data_t i
 
 }
 
+/**
+ * swap the two bytes of every pair, eight bytes at a time
+ * @param src
+ * @param dest
+ * @param npairs
+ */
+static void swap_byte_pairs(const uint8_t *__restrict src, uint8_t *__restrict dest,
+                            const size_t npairs) {
+    const size_t nbytes = 2 * npairs;
+    size_t i = 0;
+    for (; i + 8 <= nbytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, 8);
+        word = ((word & 0x00FF00FF00FF00FFull) << 8) | ((word >> 8) & 0x00FF00FF00FF00FFull);
+        memcpy(dest + i, &word, 8);
+    }
+    for (; i < nbytes; i += 2) {
+        dest[i] = src[i + 1];
+        dest[i + 1] = src[i];
+    }
+}
+
+/**
+ * Same output as copy_yuv_to_arrayV2 in a single pass over the image. The y
+ * plane is copied with memcpy and the chroma planes of the layouts android
+ * cameras produce (nv12, nv21 and planar i420) are interleaved a word at a
+ * time, other layouts fall back to the byte loop.
+ * @param width
+ * @param height
+ * @param image needs to be a yuv image
+ * @param dest_buf nv12 output, can be a mapped device buffer
+ */
+void copy_yuv_to_nv12(const int width, const int height, const image_data_t image,
+                      cl_uchar *const dest_buf) {
+    ZoneScoped;
+    assert(image.type == YUV_DATA_T && "image is not a yuv image");
+
+    const int yrow_stride = image.data.yuv.row_strides[0];
+    const uint8_t *y_ptr = image.data.yuv.planes[0];
+    const uint8_t *u_ptr = image.data.yuv.planes[1];
+    const uint8_t *v_ptr = image.data.yuv.planes[2];
+    const int ypixel_stride = image.data.yuv.pixel_strides[0];
+    const int upixel_stride = image.data.yuv.pixel_strides[1];
+    const int vpixel_stride = image.data.yuv.pixel_strides[2];
+
+    if (1 == ypixel_stride) {
+        memcpy(dest_buf, y_ptr, (size_t) height * yrow_stride);
+    } else {
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < yrow_stride; j++) {
+                dest_buf[i * yrow_stride + j] = y_ptr[(i * yrow_stride + j) * ypixel_stride];
+            }
+        }
+    }
+
+    cl_uchar *__restrict uv_dest = dest_buf + (size_t) height * yrow_stride;
+    const int uv_pairs = (height * width) / 4;
+    if (2 == upixel_stride && 2 == vpixel_stride && v_ptr == u_ptr + 1) {
+        // semiplanar nv12 already has the layout we want
+        memcpy(uv_dest, u_ptr, 2 * (size_t) uv_pairs);
+    } else if (2 == upixel_stride && 2 == vpixel_stride && u_ptr == v_ptr + 1) {
+        // nv21, the usual camera output, only needs v and u swapped
+        swap_byte_pairs(v_ptr, uv_dest, uv_pairs);
+    } else if (1 == upixel_stride && 1 == vpixel_stride) {
+        // planar i420, a plain zip that the compiler vectorizes
+        const uint8_t *__restrict u_src = u_ptr;
+        const uint8_t *__restrict v_src = v_ptr;
+        for (int i = 0; i < uv_pairs; i++) {
+            uv_dest[2 * i] = u_src[i];
+            uv_dest[2 * i + 1] = v_src[i];
+        }
+    } else {
+        for (int i = 0; i < uv_pairs; i++) {
+            uv_dest[2 * i] = u_ptr[i * upixel_stride];
+            uv_dest[2 * i + 1] = v_ptr[i * vpixel_stride];
+        }
+    }
+}
+
 void log_eval_metadata(const int file_descriptor, const int frame_index,
                        const frame_metadata_t metadata) {
-    dprintf(file_descriptor, "%d,frame,timestamp,%ld\n", frame_index, metadata.image_timestamp);
-    dprintf(file_descriptor, "%d,frame,is_eval,%d\n", frame_index, metadata.run_args.is_eval_frame);
+    log_frame_i64(file_descriptor, frame_index, "frame", "timestamp", metadata.image_timestamp);
+    log_frame_int(file_descriptor, frame_index, "frame", "is_eval", metadata.run_args.is_eval_frame);
 //    dprintf(file_descriptor, "%d,config,segment,%d\n", frame_index, metadata.segmentation);
     log_host_ts_ns(file_descriptor, frame_index, metadata.host_ts_ns);
 }
 
 void log_host_ts_ns(const int file_descriptor, const int frame_index, const host_ts_ns_t host_ts) {
-    dprintf(file_descriptor, "%d,frame_time,start_ns,%lu\n", frame_index, host_ts.start);
-    dprintf(file_descriptor, "%d,frame_time,before_enc_ns,%lu\n", frame_index, host_ts.before_enc);
-    dprintf(file_descriptor, "%d,frame_time,before_dnn_ns,%lu\n", frame_index, host_ts.before_dnn);
-    dprintf(file_descriptor, "%d,frame_time,before_wait_ns,%lu\n", frame_index,
-            host_ts.before_wait);
-    dprintf(file_descriptor, "%d,frame_time,after_wait_ns,%lu\n", frame_index, host_ts.after_wait);
-    dprintf(file_descriptor, "%d,frame_time,stop_ns,%lu\n", frame_index, host_ts.stop);
-    dprintf(file_descriptor, "%d,frame_time,fill_ping_ns,%ld\n", frame_index,
-            host_ts.fill_ping_duration_ms);
+    log_frame_u64(file_descriptor, frame_index, "frame_time", "start_ns", host_ts.start);
+    log_frame_u64(file_descriptor, frame_index, "frame_time", "before_enc_ns", host_ts.before_enc);
+    log_frame_u64(file_descriptor, frame_index, "frame_time", "before_dnn_ns", host_ts.before_dnn);
+    log_frame_u64(file_descriptor, frame_index, "frame_time", "before_wait_ns",
+                  host_ts.before_wait);
+    log_frame_u64(file_descriptor, frame_index, "frame_time", "after_wait_ns", host_ts.after_wait);
+    log_frame_u64(file_descriptor, frame_index, "frame_time", "stop_ns", host_ts.stop);
+    log_frame_i64(file_descriptor, frame_index, "frame_time", "fill_ping_ns",
+                  host_ts.fill_ping_duration_ms);
 }
 
 void
 log_codec_config(const int file_descriptor, const int frame_index, const codec_config_t config) {
 
-    dprintf(file_descriptor, "%d,device,index,%d\n", frame_index, config.device_type);
-    dprintf(file_descriptor, "%d,config,segment,%d\n", frame_index, config.do_segment);
-    dprintf(file_descriptor, "%d,compression,name,%s\n", frame_index,
-            get_compression_name(config.compression_type));
+    log_frame_int(file_descriptor, frame_index, "device", "index", config.device_type);
+    log_frame_int(file_descriptor, frame_index, "config", "segment", config.do_segment);
+    log_frame_str(file_descriptor, frame_index, "compression", "name",
+                  get_compression_name(config.compression_type));
+    if (config.model_id >= 0 && config.model_id < NUM_DNN_MODELS) {
+        log_frame_str(file_descriptor, frame_index, "config", "model",
+                      DNN_MODEL_NAMES[config.model_id]);
+    }
 
     // depending on the codec config log different parameters
     if (JPEG_COMPRESSION == config.compression_type) {
-        dprintf(file_descriptor, "%d,compression,quality,%d\n", frame_index,
-                config.config.jpeg.quality);
+        log_frame_int(file_descriptor, frame_index, "compression", "quality",
+                      config.config.jpeg.quality);
     } else if (HEVC_COMPRESSION == config.compression_type) {
-        dprintf(file_descriptor, "%d,compression,i_frame_interval,%d\n", frame_index,
-                config.config.hevc.i_frame_interval);
-        dprintf(file_descriptor, "%d,compression,framerate,%d\n", frame_index,
-                config.config.hevc.framerate);
-        dprintf(file_descriptor, "%d,compression,bitrate,%d\n", frame_index,
-                config.config.hevc.bitrate);
+        log_frame_int(file_descriptor, frame_index, "compression", "i_frame_interval",
+                      config.config.hevc.i_frame_interval);
+        log_frame_int(file_descriptor, frame_index, "compression", "framerate",
+                      config.config.hevc.framerate);
+        log_frame_int(file_descriptor, frame_index, "compression", "bitrate",
+                      config.config.hevc.bitrate);
     }
 
 }
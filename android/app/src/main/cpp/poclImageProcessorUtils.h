@@ -20,6 +20,10 @@ copy_yuv_to_arrayV2(const int width, const int height, const image_data_t image,
                     const compression_t compression_type,
                     cl_uchar *const dest_buf);
 
+void
+copy_yuv_to_nv12(const int width, const int height, const image_data_t image,
+                 cl_uchar *const dest_buf);
+
 void
 log_eval_metadata(const int fd, const int frame_index, const frame_metadata_t metadata);
 
@@ -8,6 +8,7 @@
 #include "eval.h"
 #include "platform.h"
 #include "poclImageProcessorUtils.h"
+#include "profile_log.h"
 #include "sharedUtils.h"
 #include <assert.h>
 #include <cstring>
@@ -109,6 +110,19 @@ int supports_config_flags(const int config_flags) {
             goto FINISH;                                                              \
         }
 
+/**
+ * point the pipeline at the buffer set that the next frame submitted to it uses
+ * @param ctx pipeline context
+ * @param buffer_index index of the set, below the depth of the pipeline
+ */
+static void select_lane_buffers(pipeline_context *ctx, const int buffer_index) {
+    assert(buffer_index < ctx->depth);
+    ctx->buffer_index = buffer_index;
+    ctx->inp_yuv_mem = ctx->buffers[buffer_index].inp_yuv_mem;
+    ctx->comp_to_dnn_buf = ctx->buffers[buffer_index].comp_to_dnn_buf;
+    ctx->event_array = ctx->buffers[buffer_index].event_array;
+}
+
 /**
  * create a pipeline context that has the requested codecs initialized
  * @param ctx address to the pipeline ctx
@@ -120,16 +134,19 @@ int supports_config_flags(const int config_flags) {
  * @param cl_ctx opencl context used to create opencl objects
  * @param devices list of devices
  * @param no_devs number of devices
+ * @param depth number of frames that can be in flight in the pipeline at the same time
  * @return opencl status
  */
 int setup_pipeline_context(pipeline_context *ctx, const int width, const int height,
                            const int config_flags, const char **codec_sources,
                            const size_t *src_size,
-                           cl_context cl_ctx, cl_device_id *devices, cl_uint no_devs, int is_eval) {
+                           cl_context cl_ctx, cl_device_id *devices, cl_uint no_devs, int is_eval,
+                           const int depth) {
     if (supports_config_flags(config_flags) != 0) {
         return -1;
     }
     assert(1 <= no_devs && "setup_pipeline_context requires atleast one device");
+    assert(1 <= depth && depth <= MAX_LANE_DEPTH);
     if ((config_flags &
          (YUV_COMPRESSION | HEVC_COMPRESSION | SOFTWARE_HEVC_COMPRESSION | JPEG_COMPRESSION |
           SEGMENT_4B | SEGMENT_RLE)) &&
@@ -159,14 +176,31 @@ int setup_pipeline_context(pipeline_context *ctx, const int width, const int hei
 
     size_t img_buf_size = sizeof(cl_uchar) * width * height * 3 / 2;
     size_t comp_to_dnn_size = sizeof(cl_uchar) * height * width * 3;
-    ctx->inp_yuv_mem = clCreateBuffer(cl_ctx, CL_MEM_READ_ONLY, img_buf_size, NULL, &status);
-    CHECK_AND_RETURN(status, "failed to create the input buffer");
-    // setting it to the maximum size which is an rgb image
-    ctx->comp_to_dnn_buf = clCreateBuffer(cl_ctx, CL_MEM_READ_WRITE, comp_to_dnn_size, NULL,
-                                          &status);
-    CHECK_AND_RETURN(status, "failed to create the comp to dnn buf");
-    ctx->host_inp_buf = (cl_uchar *) malloc(img_buf_size);
-    ctx->host_inp_buf_size = img_buf_size;
+    ctx->depth = depth;
+    for (int i = 0; i < depth; i++) {
+        lane_buffers_t *buffers = &(ctx->buffers[i]);
+        // host visible, so that camera frames can be written into it without a staging copy
+        buffers->inp_yuv_mem = clCreateBuffer(cl_ctx, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                              img_buf_size, NULL, &status);
+        CHECK_AND_RETURN(status, "failed to create the input buffer");
+        // setting it to the maximum size which is an rgb image
+        buffers->comp_to_dnn_buf = clCreateBuffer(cl_ctx, CL_MEM_READ_WRITE, comp_to_dnn_size,
+                                                  NULL, &status);
+        CHECK_AND_RETURN(status, "failed to create the comp to dnn buf");
+        buffers->event_array = create_event_array_pointer(PIP_MAX_EVENTS);
+    }
+    ctx->inp_yuv_size = img_buf_size;
+    select_lane_buffers(ctx, 0);
+
+    // a blocking map on the queue that reads the frame would wait for the previous frame
+    if (depth > 1) {
+        ctx->upload_queues = (cl_command_queue *) calloc(no_devs, sizeof(cl_command_queue));
+        for (unsigned i = 0; i < no_devs; ++i) {
+            ctx->upload_queues[i] = clCreateCommandQueueWithProperties(cl_ctx, devices[i],
+                                                                       cq_properties, &status);
+            CHECK_AND_RETURN(status, "creating upload queue failed");
+        }
+    }
 
     // setup all codec contexts
     if (YUV_COMPRESSION & ctx->config_flags) {
@@ -178,6 +212,7 @@ int setup_pipeline_context(pipeline_context *ctx, const int width, const int hei
         ctx->yuv_context->width = width;
         ctx->yuv_context->enc_queue = ctx->enq_queues[PASSTHRU_DEVICE];
         ctx->yuv_context->dec_queue = ctx->enq_queues[REMOTE_DEVICE];
+        ctx->yuv_context->replay_command_buffer = (REPLAY_COMMAND_BUFFERS & config_flags) != 0;
         status = init_yuv_context(ctx->yuv_context, cl_ctx, devices[PASSTHRU_DEVICE],
                                   devices[REMOTE_DEVICE], codec_sources[0], src_size[0], 1);
 
@@ -273,8 +308,6 @@ int setup_pipeline_context(pipeline_context *ctx, const int width, const int hei
     }
     CHECK_AND_RETURN(status, "could not init dnn_context");
 
-    ctx->event_array = create_event_array_pointer(PIP_MAX_EVENTS);
-
     ctx->state_mut = PTHREAD_MUTEX_INITIALIZER;
     ctx->state = LANE_READY;
 
@@ -301,13 +334,27 @@ cl_int destroy_pipeline_context(pipeline_context ctx) {
 #endif
     destroy_yuv_context(&(ctx.yuv_context));
 
-    COND_REL_MEM(ctx.inp_yuv_mem);
-    COND_REL_MEM(ctx.comp_to_dnn_buf);
-    free(ctx.host_inp_buf);
+    if (NULL != ctx.prev_decoded_event) {
+        clReleaseEvent(ctx.prev_decoded_event);
+    }
+    for (int i = 0; i < ctx.prev_read_event_count; i++) {
+        clReleaseEvent(ctx.prev_read_events[i]);
+    }
+
+    for (int i = 0; i < ctx.depth; i++) {
+        COND_REL_MEM(ctx.buffers[i].inp_yuv_mem);
+        COND_REL_MEM(ctx.buffers[i].comp_to_dnn_buf);
+        free_event_array_pointer(&(ctx.buffers[i].event_array));
+    }
     for (int i = 0; i < ctx.queue_count; i++) {
         COND_REL_QUEUE(ctx.enq_queues[i]);
     }
-    free_event_array_pointer(&(ctx.event_array));
+    if (NULL != ctx.upload_queues) {
+        for (int i = 0; i < ctx.queue_count; i++) {
+            COND_REL_QUEUE(ctx.upload_queues[i]);
+        }
+        free(ctx.upload_queues);
+    }
     pthread_mutex_destroy(&(ctx.state_mut));
 
     return CL_SUCCESS;
@@ -334,7 +381,7 @@ cl_int init_eval_ctx(eval_pipeline_context_t **const ctx, int width, int height,
     out_ctx->eval_pipeline = (pipeline_context *) calloc(1, sizeof(pipeline_context));
     status = setup_pipeline_context(out_ctx->eval_pipeline, width, height,
                                     ENABLE_PROFILING | NO_COMPRESSION, NULL, 0, cl_ctx, device, 1,
-                                    1);
+                                    1, 1);
     CHECK_AND_RETURN(status, "could not init eval pipeline \n");
 
     clock_gettime(CLOCK_MONOTONIC, &out_ctx->next_eval_ts);
@@ -361,9 +408,11 @@ cl_int init_eval_ctx(eval_pipeline_context_t **const ctx, int width, int height,
 }
 
 /*
- * pick_device retrieves all available devices in the platform and returns array of 4 devices
- * containing 2 local devices and 2 remote devices. The remote devices are selected by comparing
- * service_name with the name gotten through clGetDeviceInfo().
+ * pick_device retrieves all available devices in the platform and returns the 2 local devices
+ * followed by one remote device of each discovered server, at most SERVER_POOL_MAX_SERVERS. A
+ * remote device is named after the service name of its server (see pocld), so the devices whose
+ * names start with the same service name belong to one server. The server of service_name comes
+ * first, at REMOTE_DEVICE.
  */
 cl_int pick_device(cl_platform_id platform, cl_device_id *devices, cl_uint *devices_found,
                    char *service_name) {
@@ -371,37 +420,57 @@ cl_int pick_device(cl_platform_id platform, cl_device_id *devices, cl_uint *devi
     cl_device_id *all_devices = NULL;
     cl_int status;
     char result_array[256];
+    // service names of the servers picked so far, in the order of devices
+    char server_names[SERVER_POOL_MAX_SERVERS][SERVICE_NAME_LEN + 1] = {};
 
     status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, NULL, &device_num);
     LOGI("JNI DISCOVERY NUM OF DEVICES: %d", device_num);
     all_devices = (cl_device_id *) malloc(device_num * sizeof(cl_device_id));
     status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, device_num, all_devices, NULL);
 
-    if (4 > device_num) {
+    if (REMOTE_DEVICE + 1 > device_num) {
         LOGE("DISCOVERY DID NOT FIND REQUIRED NUMBER OF DEVICES (%d devs)", device_num);
         status = POCL_IMAGE_PROCESSOR_ERROR;
         goto END;
     }
 
-    *devices_found = 0;
-    for (uint i = 0; i < device_num; ++i) {
+    devices[LOCAL_DEVICE] = all_devices[0];
+    devices[PASSTHRU_DEVICE] = all_devices[1];
+    *devices_found = REMOTE_DEVICE;
+
+    // the selected server first, then the other servers in the order they were added
+    for (uint i = REMOTE_DEVICE; i < device_num; ++i) {
         clGetDeviceInfo(all_devices[i], CL_DEVICE_NAME, 256 * sizeof(char), result_array, NULL);
-        if (!strncmp(service_name, result_array, 32)) {
-            devices[0] = all_devices[0];
-            devices[1] = all_devices[1];
-            devices[2] = all_devices[i];
-            devices[3] = all_devices[i + 1];
-            *devices_found = 4;
+        if (!strncmp(service_name, result_array, SERVICE_NAME_LEN)) {
+            devices[REMOTE_DEVICE] = all_devices[i];
+            strncpy(server_names[0], result_array, SERVICE_NAME_LEN);
+            *devices_found = REMOTE_DEVICE + 1;
             LOGI("JNI DISCOVERY SUCCEEDED");
-            status = CL_SUCCESS;
             break;
         }
     }
 
-    if (4 != *devices_found) {
+    if (REMOTE_DEVICE + 1 != *devices_found) {
         LOGE("JNI DISCOVERY FAILED");
         status = POCL_IMAGE_PROCESSOR_ERROR;
+        goto END;
+    }
+
+    for (uint i = REMOTE_DEVICE; i < device_num && *devices_found < MAX_NUM_CL_DEVICES; ++i) {
+        clGetDeviceInfo(all_devices[i], CL_DEVICE_NAME, 256 * sizeof(char), result_array, NULL);
+        const int server_count = (int) *devices_found - REMOTE_DEVICE;
+        bool known = false;
+        for (int j = 0; j < server_count && !known; j++) {
+            known = !strncmp(server_names[j], result_array, SERVICE_NAME_LEN);
+        }
+        if (!known) {
+            devices[*devices_found] = all_devices[i];
+            strncpy(server_names[server_count], result_array, SERVICE_NAME_LEN);
+            *devices_found += 1;
+        }
     }
+    LOGI("JNI DISCOVERY FOUND %d SERVERS", *devices_found - REMOTE_DEVICE);
+    status = CL_SUCCESS;
 
     END:
     free(all_devices);
@@ -413,6 +482,8 @@ cl_int pick_device(cl_platform_id platform, cl_device_id *devices, cl_uint *devi
  * create a context that with a number of pipelines
  * @param ret_ctx destination pointer to the created object
  * @param max_lanes the number of images that can be simultaneously processed
+ * @param lane_depth the number of images each lane can have in flight at the same time, the
+ * next image is uploaded and encoded while the previous one is still in the dnn
  * @param width
  * @param height
  * @param config_flags what options to enable
@@ -423,19 +494,27 @@ cl_int pick_device(cl_platform_id platform, cl_device_id *devices, cl_uint *devi
  * @return
  */
 int create_pocl_image_processor_context(pocl_image_processor_context **ret_ctx, const int max_lanes,
-                                        const int width, const int height, const int config_flags,
-                                        const char **codec_sources, const size_t *src_size, int fd,
-                                        bool enable_eval, char *service_name) {
+                                        const int lane_depth, const int width, const int height,
+                                        const int config_flags, const char **codec_sources,
+                                        const size_t *src_size, int fd, bool enable_eval,
+                                        char *service_name) {
 
     if (supports_config_flags(config_flags) != 0) {
         return -1;
     }
 
+    if (lane_depth < 1 || lane_depth > MAX_LANE_DEPTH ||
+        max_lanes * lane_depth > FRAME_RING_MAX_CAPACITY) {
+        LOGE("%d lanes with a depth of %d are not supported\n", max_lanes, lane_depth);
+        return -1;
+    }
+
     int final_status = CL_SUCCESS;
     cl_platform_id platform;
     cl_context context = NULL;
     cl_device_id devices[MAX_NUM_CL_DEVICES] = {nullptr};
     cl_uint devices_found;
+    int server_count = 1;
     cl_int status;
 
 //    cl_command_queue_properties cq_properties = CL_QUEUE_PROFILING_ENABLE;
@@ -449,24 +528,26 @@ int create_pocl_image_processor_context(pocl_image_processor_context **ret_ctx,
                                                                                 sizeof(pocl_image_processor_context));
 
     ctx->enable_eval = enable_eval;
-    ctx->frame_index_head = 0;
-    ctx->frame_index_tail = 0;
     ctx->file_descriptor = fd;
     ctx->lane_count = max_lanes;
-    ctx->metadata_array = (frame_metadata_t *) calloc(max_lanes, sizeof(frame_metadata_t));
-    if (sem_init(&ctx->pipe_sem, 0, max_lanes) == -1) {
-        CATCH_AND_SET_STATUS(POCL_IMAGE_PROCESSOR_UNRECOVERABLE_ERROR, "could not init pipe sem");
-    }
-    if (sem_init(&ctx->local_sem, 0, 1) == -1) {
-        CATCH_AND_SET_STATUS(POCL_IMAGE_PROCESSOR_UNRECOVERABLE_ERROR, "could not init local sem");
-    }
-    if (sem_init(&ctx->image_sem, 0, 0) == -1) {
-        CATCH_AND_SET_STATUS(POCL_IMAGE_PROCESSOR_UNRECOVERABLE_ERROR, "could not init image sem");
-    }
+    ctx->slot_count = max_lanes * lane_depth;
+    ctx->metadata_array = (frame_metadata_t *) calloc(ctx->slot_count, sizeof(frame_metadata_t));
+    // local execution can't handle many lanes, so only one lane worth of frames can run locally,
+    // with depth > 1 the next local frame is uploaded while the previous one is in the dnn
+    frame_ring_init(&ctx->frame_ring, ctx->slot_count, lane_depth);
+    ctx->backpressure_mode = BACKPRESSURE_WAIT;
 
     status = clGetPlatformIDs(1, &platform, NULL);
     CHECK_AND_RETURN(status, "getting platform id failed");
 
+    // used to check that frames don't allocate runtime objects once the free lists are warm
+    ctx->get_alloc_stats = (clGetMemManagerStatsPOCL_fn)
+            clGetExtensionFunctionAddressForPlatform(platform, "clGetMemManagerStatsPOCL");
+    cl_mem_manager_stats_pocl alloc_stats;
+    if (NULL != ctx->get_alloc_stats && CL_SUCCESS != ctx->get_alloc_stats(&alloc_stats)) {
+        ctx->get_alloc_stats = NULL;
+    }
+
     if (service_name != NULL) {
         status = pick_device(platform, devices, &devices_found, service_name);
     } else {
@@ -500,18 +581,45 @@ int create_pocl_image_processor_context(pocl_image_processor_context **ret_ctx,
     context = clCreateContext(cps, devices_found, devices, NULL, NULL, &status);
     CATCH_AND_SET_STATUS(status, "creating context failed");
 
+    // every remote device is a server of its own with MULTI_SERVER, pick_device returns one per
+    // discovered server. Otherwise the lanes all offload to the first one
+    if ((MULTI_SERVER & config_flags) && devices_found > 2) {
+        server_count = (int) devices_found - REMOTE_DEVICE;
+        assert(server_count <= SERVER_POOL_MAX_SERVERS);
+        if (server_count > max_lanes) {
+            LOGW("%d lanes can only offload to %d of the %d servers\n", max_lanes, max_lanes,
+                 server_count);
+        }
+    }
+    server_pool_init(&ctx->server_pool, server_count, SERVER_RETRY_MS);
+    for (int i = 0; i < ctx->slot_count; i++) {
+        ctx->server_slots[(i % max_lanes) % server_count] |= 1u << i;
+    }
+
     // create the pipelines
     ctx->pipeline_array = (pipeline_context *) calloc(max_lanes, sizeof(pipeline_context));
     for (int i = 0; i < max_lanes; i++) {
+        // a lane only sees the remote device of its own server
+        cl_device_id lane_devices[] = {devices[LOCAL_DEVICE], devices[PASSTHRU_DEVICE],
+                                       devices[REMOTE_DEVICE + i % server_count]};
+        cl_device_id *pipeline_devices = (server_count > 1) ? lane_devices : devices;
+        const cl_uint pipeline_devs = (devices_found > REMOTE_DEVICE) ? REMOTE_DEVICE + 1
+                                                                      : devices_found;
+
         // NOTE: it is probably possible to put the decompression and dnn kernels on the same
         // device by making the second and third cl_device_id the same. Something to look at in the future.
         status = setup_pipeline_context(&(ctx->pipeline_array[i]), width, height, config_flags,
-                                        codec_sources, src_size, context, devices, devices_found,
-                                        0);
+                                        codec_sources, src_size, context, pipeline_devices,
+                                        pipeline_devs, 0, lane_depth);
         CATCH_AND_SET_STATUS(status, "could not create pipeline context ");
 
         snprintf(ctx->pipeline_array[i].lane_name, sizeof(ctx->pipeline_array[i].lane_name),
                  "lane: %hu", i);
+        // frames of the same lane overlap, so each buffer set gets its own frames in tracy
+        for (int j = 0; j < lane_depth; j++) {
+            lane_buffers_t *buffers = &(ctx->pipeline_array[i].buffers[j]);
+            snprintf(buffers->frame_name, sizeof(buffers->frame_name), "lane: %hu.%d", i, j);
+        }
 
         // Set names for tracy contexts
         char ctx_name[32];
@@ -519,14 +627,30 @@ int create_pocl_image_processor_context(pocl_image_processor_context **ret_ctx,
         TracyCLContextName(ctx->pipeline_array[i].dnn_context->local_tracy_ctx, ctx_name,
                            strlen(ctx_name));
         if (devices_found > 2) {
-            sprintf(ctx_name, "remote %d", i);
+            sprintf(ctx_name, "remote %d.%d", i % server_count, i);
             TracyCLContextName(ctx->pipeline_array[i].dnn_context->remote_tracy_ctx, ctx_name,
                                strlen(ctx_name));
         }
     }
 
     // create a collection of cl buffers to store results in
-    ctx->collected_results = (dnn_results *) calloc(max_lanes, sizeof(dnn_results));
+    ctx->collected_results = (dnn_results *) calloc(ctx->slot_count, sizeof(dnn_results));
+    for (int i = 0; i < ctx->slot_count; i++) {
+        ctx->collected_results[i].detections = (int32_t *) malloc(DET_COUNT * sizeof(int32_t));
+        ctx->collected_results[i].segmentation = (uint8_t *) malloc(SEG_OUT_COUNT);
+        ctx->collected_results[i].frame_ring = &ctx->frame_ring;
+        ctx->collected_results[i].slot = i;
+    }
+
+    // skipped frames return the results of an earlier frame, which the lanes don't keep around
+    ctx->last_received_frame_index = -1;
+    if (SKIP_STATIC_FRAMES & config_flags) {
+        status = init_motion_skip(&ctx->motion_skip, width, height, MOTION_SKIP_THRESHOLD,
+                                  MOTION_SKIP_MAX_FRAMES);
+        CATCH_AND_SET_STATUS(status, "could not init motion skip");
+        ctx->last_detections = (int32_t *) calloc(DET_COUNT, sizeof(int32_t));
+        ctx->last_segmentation = (uint8_t *) calloc(SEG_OUT_COUNT, sizeof(uint8_t));
+    }
 
     // create a queue used to receive images
     assert(1 <= devices_found && "expected at least 1 device, but not the case");
@@ -537,18 +661,19 @@ int create_pocl_image_processor_context(pocl_image_processor_context **ret_ctx,
 
     if (devices_found > 2) {
 
-        ctx->remote_queue = clCreateCommandQueueWithProperties(context, devices[REMOTE_DEVICE],
-                                                               cq_properties,
-                                                               &status);
-        CATCH_AND_SET_STATUS(status, "creating remote queue failed");
+        for (int i = 0; i < server_count; i++) {
+            ctx->remote_queues[i] = clCreateCommandQueueWithProperties(context,
+                                                                       devices[REMOTE_DEVICE + i],
+                                                                       cq_properties, &status);
+            CATCH_AND_SET_STATUS(status, "creating remote queue failed");
+            ctx->ping_threads[i] = new PingThread(context);
+        }
 
         status = init_eval_ctx(&ctx->eval_ctx, width, height, context, &(devices[REMOTE_DEVICE]));
         CATCH_AND_SET_STATUS(status, "creating init eval ctx failed");
 
         // TODO: create a thread that waits on the eval queue
         //  for now read eval data when reading results
-
-        ctx->ping_thread = new PingThread(context);
     }
 
     for (int i = 0; i < MAX_NUM_CL_DEVICES; ++i) {
@@ -562,11 +687,15 @@ int create_pocl_image_processor_context(pocl_image_processor_context **ret_ctx,
 
     // setup profiling
     if (ENABLE_PROFILING & config_flags) {
-        status = dprintf(fd, CSV_HEADER);
-        CATCH_AND_SET_STATUS((status < 0), "could not write csv header");
+        // the values are written as binary records off the hot path, and only if that can't be
+        // set up, as csv lines right away
+        if (0 != profile_log_open(fd)) {
+            LOGW("could not open binary profile log, logging csv instead\n");
+            status = dprintf(fd, CSV_HEADER);
+            CATCH_AND_SET_STATUS((status < 0), "could not write csv header");
+        }
         std::time_t t = std::time(nullptr);
-        status = dprintf(fd, "-1,unix_timestamp,time_s,%ld\n", t);
-        CATCH_AND_SET_STATUS((status < 0), "could not write timestamp");
+        log_frame_i64(fd, -1, "unix_timestamp", "time_s", t);
     }
 
     // FIXME init global hevc codecs
@@ -642,21 +771,34 @@ int destroy_pocl_image_processor_context(pocl_image_processor_context **ctx_ptr)
         }
     }
 
+    if (NULL != ctx->collected_results) {
+        for (int i = 0; i < ctx->slot_count; i++) {
+            free(ctx->collected_results[i].detections);
+            free(ctx->collected_results[i].segmentation);
+        }
+    }
     free(ctx->collected_results);
 
+    destroy_motion_skip(&ctx->motion_skip);
+    free(ctx->last_detections);
+    free(ctx->last_segmentation);
+
     free(ctx->metadata_array);
-    sem_destroy(&(ctx->pipe_sem));
-    sem_destroy(&(ctx->local_sem));
-    sem_destroy(&(ctx->image_sem));
     clReleaseCommandQueue(ctx->read_queue);
-    clReleaseCommandQueue(ctx->remote_queue);
+    for (int i = 0; i < SERVER_POOL_MAX_SERVERS; i++) {
+        if (nullptr != ctx->remote_queues[i]) {
+            clReleaseCommandQueue(ctx->remote_queues[i]);
+        }
+        delete ctx->ping_threads[i];
+        ctx->ping_threads[i] = nullptr;
+    }
 
     if (ctx->eval_ctx != NULL) {
         destroy_eval_context(&ctx->eval_ctx);
     }
 
-    delete ctx->ping_thread;
-    ctx->ping_thread = nullptr;
+    // writes out what is left in the profile log
+    profile_log_close(ctx->file_descriptor);
 
     // FIXME release global hevc configs
 
@@ -665,6 +807,24 @@ int destroy_pocl_image_processor_context(pocl_image_processor_context **ctx_ptr)
     return CL_SUCCESS;
 }
 
+/**
+ * @param ctx
+ * @param now_ns current time
+ * @return mask of the slots whose lanes offload to a usable server, all slots if no server is
+ * usable, so that frames keep going and find out if a server is back
+ */
+static uint32_t usable_server_slots(const pocl_image_processor_context *const ctx,
+                                    const int64_t now_ns) {
+    uint32_t slots = 0;
+    const uint32_t usable = server_pool_usable_mask(&ctx->server_pool, now_ns);
+    for (int i = 0; i < ctx->server_pool.server_count; i++) {
+        if (usable & (1u << i)) {
+            slots |= ctx->server_slots[i];
+        }
+    }
+    return (0 == slots) ? UINT32_MAX : slots;
+}
+
 /**
  * function to check that an image can be submitted to the context.
  * this function should be called before submitting an image.
@@ -677,49 +837,150 @@ int dequeue_spot(pocl_image_processor_context *const ctx, const int timeout,
     ZoneScoped;
     FrameMark;
 
-    struct timespec ts;
-    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
-        return -1;
-    }
-
     assert(timeout > 0);
-    add_ns_to_time(&ts, ((long) timeout) * 1000000);
-
-    int ret;
 
-    if (LOCAL_DEVICE == dev_type) {
-        while ((ret = sem_timedwait(&(ctx->local_sem), &ts)) == -1 && errno == EINTR) {
-            // continue if interrupted for any reason
-        }
-        if (ret != 0) {
-            return ret;
-        }
+    // a frame that waits for a lane gets older, so depending on the policy wait less or not at all
+    int wait_ms = timeout;
+    if (BACKPRESSURE_LATEST_FRAME == ctx->backpressure_mode) {
+        wait_ms = 0;
+    } else if (BACKPRESSURE_DEADLINE == ctx->backpressure_mode &&
+               ctx->backpressure_deadline_ms < timeout) {
+        wait_ms = ctx->backpressure_deadline_ms;
     }
 
-    while ((ret = sem_timedwait(&(ctx->pipe_sem), &ts)) == -1 && errno == EINTR) {
-        // continue if interrupted for any reason
+    // also waits for the local spot, which is given back if no lane becomes free in time
+    int ret;
+    if (ctx->server_pool.server_count > 1 && LOCAL_DEVICE != dev_type) {
+        // only a lane of a server that is not lost will do
+        ret = frame_ring_reserve_in(&ctx->frame_ring, 0,
+                                    usable_server_slots(ctx, get_timestamp_ns()), wait_ms);
+        ctx->local_spot_reserved = false;
+    } else {
+        ret = frame_ring_reserve(&ctx->frame_ring, LOCAL_DEVICE == dev_type, wait_ms);
+        ctx->local_spot_reserved = 0 == ret && LOCAL_DEVICE == dev_type;
     }
 
-    // the local pipe succeeded, but the global didn't,
-    // so give local one back
-    if (LOCAL_DEVICE == dev_type && ret != 0) {
-        sem_post(&(ctx->local_sem));
+    if (0 != ret) {
+        if (BACKPRESSURE_LATEST_FRAME == ctx->backpressure_mode) {
+            ctx->backpressure_stats.superseded_frames += 1;
+        } else {
+            ctx->backpressure_stats.dropped_frames += 1;
+        }
     }
 
-
 #ifdef DEBUG_SEMAPHORES
     if (ret == 0) {
-        int sem_value;
-        sem_getvalue(&(ctx->pipe_sem), &sem_value);
-        LOGW("dequeue_spot decremented pipe sem to: %d \n", sem_value);
-        sem_getvalue(&(ctx->local_sem), &sem_value);
-        LOGW("dequeue_spot decremented local sem to: %d \n", sem_value);
+        LOGW("dequeue_spot reserved spot, lanes in use: %u, local in use: %u \n",
+             ctx->frame_ring.reserved - frame_ring_tail(&ctx->frame_ring),
+             ctx->frame_ring.local_reserved - ctx->frame_ring.local_released);
     }
 #endif
 
     return ret;
 }
 
+/**
+ * write the camera image into the input buffer. The buffer is mapped on the queue that reads it
+ * first, the image is converted to nv12 straight into the mapping and the buffer is unmapped.
+ * @param ctx pipeline context with the input buffer
+ * @param queue queue of the device that reads the input buffer first
+ * @param image_data object containing image planes
+ * @param result_event output: event of the unmap that readers of the buffer need to wait on
+ * @return opencl return status
+ */
+static cl_int
+write_input_image(pipeline_context *ctx, cl_command_queue queue, const image_data_t image_data,
+                  cl_event *result_event) {
+    ZoneScoped;
+
+    cl_int status;
+    cl_event undef_img_mig_event, unmap_img_event;
+
+    // in a deeper lane, upload on a separate queue of the same device, so that the blocking map
+    // does not wait for the previous frame of the lane
+    if (NULL != ctx->upload_queues) {
+        for (int i = 0; i < ctx->queue_count; i++) {
+            if (ctx->enq_queues[i] == queue) {
+                queue = ctx->upload_queues[i];
+                break;
+            }
+        }
+    }
+
+    status = clEnqueueMigrateMemObjects(queue, 1, &(ctx->inp_yuv_mem),
+                                        CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED, 0, NULL,
+                                        &undef_img_mig_event);
+    CHECK_AND_RETURN(status, "could not migrate input buffer before mapping");
+    append_to_event_array(ctx->event_array, undef_img_mig_event, VAR_NAME(undef_img_mig_event));
+
+    cl_uchar *mapped_buf = (cl_uchar *) clEnqueueMapBuffer(queue, ctx->inp_yuv_mem, CL_TRUE,
+                                                           CL_MAP_WRITE_INVALIDATE_REGION, 0,
+                                                           ctx->inp_yuv_size, 1,
+                                                           &undef_img_mig_event, NULL, &status);
+    CHECK_AND_RETURN(status, "could not map input buffer");
+
+    copy_yuv_to_nv12(ctx->width, ctx->height, image_data, mapped_buf);
+
+    status = clEnqueueUnmapMemObject(queue, ctx->inp_yuv_mem, mapped_buf, 0, NULL,
+                                     &unmap_img_event);
+    CHECK_AND_RETURN(status, "could not unmap input buffer");
+    append_to_event_array(ctx->event_array, unmap_img_event, VAR_NAME(unmap_img_event));
+
+    *result_event = unmap_img_event;
+    return CL_SUCCESS;
+}
+
+/**
+ * make a stage of the frame also wait for events of the previous frame in the lane, which still
+ * uses buffers that the stage overwrites. Only needed in lanes deeper than one, otherwise the
+ * previous frame is done before the next one is submitted.
+ * @param ctx pipeline context
+ * @param queue queue that the stage runs on
+ * @param previous events of the previous frame, may be NULL if there are none
+ * @param previous_count number of events in previous
+ * @param event in: what the stage waits on already, out: what it needs to wait on instead
+ * @return opencl status
+ */
+static cl_int
+wait_for_previous_frame(pipeline_context *ctx, cl_command_queue queue, const cl_event *previous,
+                        const int previous_count, cl_event *event) {
+    if (ctx->depth <= 1 || 0 == previous_count || NULL == previous[0]) {
+        return CL_SUCCESS;
+    }
+
+    cl_event wait_list[4];
+    assert(previous_count < 4);
+    wait_list[0] = *event;
+    memcpy(&(wait_list[1]), previous, previous_count * sizeof(cl_event));
+
+    cl_event lane_order_event;
+    cl_int status = clEnqueueMarkerWithWaitList(queue, previous_count + 1, wait_list,
+                                                &lane_order_event);
+    CHECK_AND_RETURN(status, "could not enqueue marker for the previous frame");
+    append_to_event_array(ctx->event_array, lane_order_event, VAR_NAME(lane_order_event));
+    *event = lane_order_event;
+    return CL_SUCCESS;
+}
+
+/**
+ * keep the events of this frame that the next frame of the lane needs to wait on
+ * @param events to keep, they are retained
+ * @param count number of events
+ * @param kept the previously kept events, which are released
+ * @param kept_count in: number of previously kept events, out: count
+ */
+static void
+keep_for_next_frame(const cl_event *events, const int count, cl_event *kept, int *kept_count) {
+    for (int i = 0; i < *kept_count; i++) {
+        clReleaseEvent(kept[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        clRetainEvent(events[i]);
+        kept[i] = events[i];
+    }
+    *kept_count = count;
+}
+
 /**
  * submit an image to the respective pipeline
  * @param ctx pipeline config to run on
@@ -736,7 +997,7 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
                                 tmp_buf_ctx_t *tmp_buf_ctx) {
     ZoneScoped;
 
-    TracyCFrameMarkStart(ctx->lane_name);
+    TracyCFrameMarkStart(ctx->buffers[ctx->buffer_index].frame_name);
 
     /* When a remote device is lost, pocl may try to use the remote device. We prevent from that to
        happen and return with an error to start fresh.
@@ -783,13 +1044,19 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
     // the default dnn input buffer
     cl_mem dnn_input_buf = NULL;
 
+    cl_command_queue dnn_queue;
+    if (LOCAL_DEVICE == config.device_type) {
+        dnn_queue = ctx->dnn_context->local_queue;
+    } else {
+        dnn_queue = ctx->dnn_context->remote_queue;
+    }
+
     if (NULL != metadata) {
         metadata->host_ts_ns.before_enc = get_timestamp_ns();
     }
 
-    // copy the yuv image data over to the host_img_buf and make sure it's semiplanar.
-    copy_yuv_to_arrayV2(ctx->width, ctx->height, image_data, compression_type, ctx->host_inp_buf);
-
+    // the image is written to inp_yuv_mem as semiplanar nv12 on the queue of whichever device
+    // reads it first.
     // the local device does not support other compression types, but this function with
     // local devices should only be called with no compression, so other paths will not be
     // reached. There is also an assert to make sure of this.
@@ -797,9 +1064,7 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
         // normal execution
         inp_format = YUV_NV12;
 
-        status = write_buffer_dnn(ctx->dnn_context, config.device_type, ctx->host_inp_buf,
-                                  ctx->host_inp_buf_size, ctx->inp_yuv_mem, NULL, ctx->event_array,
-                                  &dnn_wait_event);
+        status = write_input_image(ctx, dnn_queue, image_data, &dnn_wait_event);
         CHECK_AND_CATCH(status, "could not write raw image to dnn buffer", new_state)
         // no compression is an edge case since it uses the uncompressed
         // yuv buffer as input for the dnn stage
@@ -809,8 +1074,13 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
         inp_format = ctx->yuv_context->output_format;
 
         cl_event wait_on_yuv_event;
-        write_buffer_yuv(ctx->yuv_context, ctx->host_inp_buf, ctx->host_inp_buf_size,
-                         ctx->inp_yuv_mem, NULL, ctx->event_array, &wait_on_yuv_event);
+        status = write_input_image(ctx, ctx->yuv_context->enc_queue, image_data,
+                                   &wait_on_yuv_event);
+        CHECK_AND_CATCH(status, "could not write input image to yuv buffer", new_state);
+        // the codec buffers are still used to decode the previous frame of the lane
+        status = wait_for_previous_frame(ctx, ctx->yuv_context->enc_queue,
+                                         &(ctx->prev_decoded_event), 1, &wait_on_yuv_event);
+        CHECK_AND_CATCH(status, "could not wait for the previous frame", new_state);
 
         status = enqueue_yuv_compression(ctx->yuv_context, wait_on_yuv_event, ctx->inp_yuv_mem,
                                          ctx->comp_to_dnn_buf, ctx->event_array, &dnn_wait_event);
@@ -824,8 +1094,12 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
         ctx->jpeg_context->quality = config.config.jpeg.quality;
 
         cl_event wait_on_write_event;
-        write_buffer_jpeg(ctx->jpeg_context, ctx->host_inp_buf, ctx->host_inp_buf_size,
-                          ctx->inp_yuv_mem, ctx->event_array, &wait_on_write_event);
+        status = write_input_image(ctx, ctx->jpeg_context->enc_queue, image_data,
+                                   &wait_on_write_event);
+        CHECK_AND_CATCH(status, "could not write input image to jpeg buffer", new_state);
+        status = wait_for_previous_frame(ctx, ctx->jpeg_context->enc_queue,
+                                         &(ctx->prev_decoded_event), 1, &wait_on_write_event);
+        CHECK_AND_CATCH(status, "could not wait for the previous frame", new_state);
         status = enqueue_jpeg_compression(ctx->jpeg_context, wait_on_write_event, ctx->inp_yuv_mem,
                                           ctx->comp_to_dnn_buf, ctx->event_array, &dnn_wait_event);
         CHECK_AND_CATCH(status, "could not enqueue jpeg compression", new_state)
@@ -837,10 +1111,12 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
 
         inp_format = ctx->hevc_context->output_format;
         cl_event wait_on_hevc_write_event;
-        status = write_buffer_hevc(ctx->hevc_context, ctx->host_inp_buf, ctx->host_inp_buf_size,
-                                   ctx->inp_yuv_mem, NULL, ctx->event_array,
+        status = write_input_image(ctx, ctx->hevc_context->enc_queue, image_data,
                                    &wait_on_hevc_write_event);
         CHECK_AND_RETURN(status, "could no write input image to hevc buffer");
+        status = wait_for_previous_frame(ctx, ctx->hevc_context->enc_queue,
+                                         &(ctx->prev_decoded_event), 1, &wait_on_hevc_write_event);
+        CHECK_AND_CATCH(status, "could not wait for the previous frame", new_state);
 
         status = enqueue_hevc_compression(ctx->hevc_context, &wait_on_hevc_write_event,
                                           ctx->inp_yuv_mem, ctx->comp_to_dnn_buf, ctx->event_array,
@@ -852,10 +1128,13 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
 
         inp_format = ctx->software_hevc_context->output_format;
         cl_event wait_on_soft_hevc_write_event;
-        status = write_buffer_hevc(ctx->software_hevc_context, ctx->host_inp_buf,
-                                   ctx->host_inp_buf_size, ctx->inp_yuv_mem, NULL, ctx->event_array,
+        status = write_input_image(ctx, ctx->software_hevc_context->enc_queue, image_data,
                                    &wait_on_soft_hevc_write_event);
         CHECK_AND_RETURN(status, "could no write input image to hevc buffer");
+        status = wait_for_previous_frame(ctx, ctx->software_hevc_context->enc_queue,
+                                         &(ctx->prev_decoded_event), 1,
+                                         &wait_on_soft_hevc_write_event);
+        CHECK_AND_CATCH(status, "could not wait for the previous frame", new_state);
 
         status = enqueue_hevc_compression(ctx->software_hevc_context,
                                           &wait_on_soft_hevc_write_event, ctx->inp_yuv_mem,
@@ -873,6 +1152,20 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
         metadata->host_ts_ns.before_dnn = get_timestamp_ns();
     }
 
+    // the next frame of the lane can be encoded once this one is decoded
+    if (ctx->depth > 1) {
+        if (NULL != ctx->prev_decoded_event) {
+            clReleaseEvent(ctx->prev_decoded_event);
+        }
+        clRetainEvent(dnn_wait_event);
+        ctx->prev_decoded_event = dnn_wait_event;
+    }
+
+    // the dnn buffers are still read back for the previous frame of the lane
+    status = wait_for_previous_frame(ctx, dnn_queue, ctx->prev_read_events,
+                                     ctx->prev_read_event_count, &dnn_wait_event);
+    CHECK_AND_CATCH(status, "could not wait for the previous frame", new_state);
+
     status = enqueue_dnn(ctx->dnn_context, &dnn_wait_event, config, (pixel_format_enum) inp_format,
                          do_reconstruct, dnn_input_buf, ctx->event_array, &(output->event_list[0]),
                          tmp_buf_ctx);
@@ -886,8 +1179,215 @@ cl_int submit_image_to_pipeline(pipeline_context *ctx, const codec_config_t conf
     return status;
 }
 
+/**
+ * enqueue reading the size of the compressed image, without waiting for it
+ * @param pipeline_ctx
+ * @param codec used for the frame
+ * @param size_bytes_tx output: valid once read_event completed
+ * @param read_event output: NULL if the size is known without reading
+ * @return opencl status
+ */
+static cl_int
+get_compression_size(pipeline_context *pipeline_ctx, const codec_config_t *codec,
+                     cl_ulong *size_bytes_tx, cl_event *read_event) {
+    cl_int status;
+    cl_mem sz_buf = nullptr;
+    cl_command_queue sz_queue = nullptr;
+    *read_event = NULL;
+
+    // TODO: refactor to use get_compression_size_<codec>()
+    // Read the encoded size buffer if applicable
+    switch (codec->compression_type) {
+#ifndef  DISABLE_JPEG
+        case JPEG_COMPRESSION:
+            sz_buf = pipeline_ctx->jpeg_context->size_buf;
+            sz_queue = pipeline_ctx->jpeg_context->enc_queue;
+            break;
+#endif
+#ifndef DISABLE_HEVC
+        case HEVC_COMPRESSION:
+            sz_buf = pipeline_ctx->hevc_context->size_buf;
+            sz_queue = pipeline_ctx->hevc_context->enc_queue;
+            break;
+#endif
+        default:
+            *size_bytes_tx = pipeline_ctx->inp_yuv_size;
+    }
+
+    if (sz_buf != nullptr && sz_queue != nullptr) {
+        cl_event sz_read_event;
+        status = clEnqueueReadBuffer(sz_queue, sz_buf, CL_FALSE, 0, sizeof(cl_ulong),
+                                     size_bytes_tx, 0, NULL, &sz_read_event);
+        CHECK_AND_RETURN(status, "could not read size_bytes buffer");
+        append_to_event_array(pipeline_ctx->event_array, sz_read_event, VAR_NAME(sz_read_event));
+        *read_event = sz_read_event;
+    }
+
+    return CL_SUCCESS;
+}
+
+/**
+ * drop one of the pending reads of a frame, the last one completes the slot of the frame
+ * @param result of the frame
+ */
+static void release_frame_read(dnn_results *result) {
+    if (0 == __atomic_sub_fetch(&result->pending_reads, 1, __ATOMIC_ACQ_REL)) {
+        frame_ring_complete(result->frame_ring, result->slot);
+    }
+}
+
+/**
+ * called by the OpenCL runtime when a read of a frame is done, also when it failed. The
+ * receiving thread finds out about failures when it checks the read events.
+ */
+static void CL_CALLBACK
+complete_read_callback(cl_event event, cl_int event_command_status, void *user_data) {
+    release_frame_read((dnn_results *) user_data);
+}
+
+/**
+ * enqueue reading the results and the compressed size of the frame into the lane, so that
+ * the frame completes as soon as its own reads are done, regardless of the other lanes.
+ * @param pipeline that runs the frame
+ * @param codec used for the frame
+ * @param result of the frame, with the output event of the dnn stage
+ * @return opencl status
+ */
+static cl_int
+enqueue_frame_readback(pipeline_context *pipeline, codec_config_t *codec, dnn_results *result) {
+    ZoneScoped;
+    cl_int status;
+
+    status = enqueue_read_results_dnn(pipeline->dnn_context, codec, result->detections,
+                                      result->segmentation, pipeline->event_array,
+                                      result->event_list_size, result->event_list,
+                                      result->read_events, &result->read_event_count);
+    CHECK_AND_RETURN(status, "could not read results back");
+
+    cl_event size_event;
+    status = get_compression_size(pipeline, codec, &result->size_bytes_tx, &size_event);
+    CHECK_AND_RETURN(status, "could not get compression size");
+    if (NULL != size_event) {
+        result->read_events[result->read_event_count++] = size_event;
+    }
+
+    for (int i = 0; i < result->read_event_count; i++) {
+        __atomic_add_fetch(&result->pending_reads, 1, __ATOMIC_RELAXED);
+        status = clSetEventCallback(result->read_events[i], CL_COMPLETE, complete_read_callback,
+                                    result);
+        if (CL_SUCCESS != status) {
+            release_frame_read(result);
+        }
+        CHECK_AND_RETURN(status, "could not set read callback");
+    }
+
+    return CL_SUCCESS;
+}
+
+/**
+ * move the results of an earlier frame along with the scene, for frames that reuse them
+ * @param detections count followed by the detections, with boxes in pixels of the dnn input
+ * @param segmentation RGBA mask, NULL if there is none
+ * @param rotation if set, the dnn input is the camera frame rotated 90 degrees clockwise
+ * @param width of the camera frame
+ * @param height of the camera frame
+ * @param motion of the scene in pixels of the camera frame
+ */
+static void
+move_results(int32_t *detections, uint8_t *segmentation, const int rotation, const int width,
+             const int height, const motion_estimate_t *motion) {
+    int dx = motion->dx;
+    int dy = motion->dy;
+    int out_width = width;
+    int out_height = height;
+    int mask_width = MASK_SZ1;
+    int mask_height = MASK_SZ2;
+    if (rotation) {
+        // the camera frame moving down moves the rotated frame to the left
+        dx = -motion->dy;
+        dy = motion->dx;
+        out_width = height;
+        out_height = width;
+        mask_width = MASK_SZ2;
+        mask_height = MASK_SZ1;
+    }
+
+    const int count = (detections[0] < MAX_DETECTIONS) ? detections[0] : MAX_DETECTIONS;
+    for (int i = 0; i < count; i++) {
+        detections[1 + 6 * i + 2] += dx;
+        detections[1 + 6 * i + 3] += dy;
+    }
+
+    const int mask_dx = dx * mask_width / out_width;
+    const int mask_dy = dy * mask_height / out_height;
+    if (NULL == segmentation || (0 == mask_dx && 0 == mask_dy)) {
+        return;
+    }
+
+    // go through the rows against the motion, so that rows are read before being overwritten.
+    // the part of the mask that moved in from outside the frame is left transparent.
+    const int pixel_size = 4;
+    const int row_size = mask_width * pixel_size;
+    const int moved_size = (mask_width - abs(mask_dx)) * pixel_size;
+    for (int i = 0; i < mask_height; i++) {
+        const int y = (mask_dy > 0) ? mask_height - 1 - i : i;
+        const int src_y = y - mask_dy;
+        uint8_t *row = segmentation + y * row_size;
+        if (src_y < 0 || src_y >= mask_height) {
+            memset(row, 0, row_size);
+            continue;
+        }
+        const uint8_t *src_row = segmentation + src_y * row_size;
+        if (mask_dx >= 0) {
+            memmove(row + mask_dx * pixel_size, src_row, moved_size);
+            memset(row, 0, mask_dx * pixel_size);
+        } else {
+            memmove(row, src_row - mask_dx * pixel_size, moved_size);
+            memset(row + moved_size, 0, -mask_dx * pixel_size);
+        }
+    }
+}
+
+/**
+ * pick the slot of the next frame. With more than one server, a remote frame goes to the least
+ * loaded usable server that has a lane free, and otherwise to the lowest free slot.
+ * @param ctx
+ * @param device_type that the frame is going to run on
+ * @return a free slot
+ */
+static int choose_slot(const pocl_image_processor_context *const ctx,
+                       const device_type_enum device_type) {
+    const server_pool_t *pool = &ctx->server_pool;
+    if (pool->server_count > 1 && REMOTE_DEVICE == device_type) {
+        const uint32_t free_slots = frame_ring_free_slots(&ctx->frame_ring);
+        uint32_t candidates = 0;
+        for (int i = 0; i < pool->server_count; i++) {
+            if (free_slots & ctx->server_slots[i]) {
+                candidates |= 1u << i;
+            }
+        }
+        const int server = server_pool_choose(pool, candidates, get_timestamp_ns());
+        if (server >= 0) {
+            return frame_ring_next_slot_in(&ctx->frame_ring, ctx->server_slots[server]);
+        }
+    }
+    return frame_ring_next_slot(&ctx->frame_ring);
+}
+
+/**
+ * let a lane that lost its server take frames again, for when other servers are left to
+ * offload to
+ * @param pipeline
+ */
+static void revive_lane(pipeline_context *pipeline) {
+    pthread_mutex_lock(&(pipeline->state_mut));
+    pipeline->state = LANE_READY;
+    pipeline->local_only = 0;
+    pthread_mutex_unlock(&(pipeline->state_mut));
+}
+
 int get_frame_index(const pocl_image_processor_context *const ctx) {
-    return ctx->frame_index_head;
+    return (int) frame_ring_head(&ctx->frame_ring);
 }
 
 /**
@@ -904,13 +1404,17 @@ int submit_image(pocl_image_processor_context *ctx, codec_config_t codec_config,
     // this function should be called when dequeue_spot acquired a semaphore,
     ZoneScoped;
 
-    int status;
-    int index = ctx->frame_index_head % ctx->lane_count;
+    int status = CL_SUCCESS;
+    // the slot is handed to the receiving thread once the readback of the frame completed
     int frame_index = get_frame_index(ctx);
-    ctx->frame_index_head += 1;
-
-    char *markId = new char[16];
-    snprintf(markId, 16, "frame start: %i", frame_index);
+    int index = choose_slot(ctx, codec_config.device_type);
+    frame_ring_push(&ctx->frame_ring, index);
+    // slots of the same lane share the codecs and the dnn, but each has its own buffers
+    pipeline_context *pipeline = &(ctx->pipeline_array[index % ctx->lane_count]);
+    select_lane_buffers(pipeline, index / ctx->lane_count);
+
+    char markId[25];
+    snprintf(markId, sizeof(markId), "frame start: %d", frame_index);
     TracyMessage(markId, strlen(markId));
 
     // store metadata
@@ -918,75 +1422,159 @@ int submit_image(pocl_image_processor_context *ctx, codec_config_t codec_config,
     image_metadata->run_args = run_args;
 
     dnn_results *collected_result = &(ctx->collected_results[index]);
+    collected_result->read_event_count = 0;
+    // held by submit_image, so that the slot can't complete before the frame is set up
+    collected_result->pending_reads = 1;
+    image_metadata->frame_index = frame_index;
 
     // a catch to make sure we are falling back to local when it goes into localonly mode
-    if (1 == ctx->pipeline_array[index].local_only && REMOTE_DEVICE == codec_config.device_type) {
+    if (1 == pipeline->local_only && REMOTE_DEVICE == codec_config.device_type) {
         LOGW("pipeline is in local only mode, but codec requests remote device, falling back to local\n");
         codec_config.device_type = LOCAL_DEVICE;
         codec_config.compression_type = NO_COMPRESSION;
     }
 
-    tmp_buf_ctx_t *tmp_buf_ctx = NULL;
-    if (run_args.is_eval_frame) {
-        tmp_buf_ctx = &ctx->eval_ctx->tmp_buf_ctx;
+    // populate the metadata
+    image_metadata->image_timestamp = image_data.image_timestamp;
+    image_metadata->codec = codec_config;
+    image_metadata->event_array = pipeline->event_array;
+    // only the local spot that dequeue_spot reserved is given back, the codec may have moved the
+    // frame to another device since
+    image_metadata->run_args.release_local_sem = ctx->local_spot_reserved;
+    ctx->local_spot_reserved = false;
+
+    // a frame that barely changed since the last frame that ran the dnn reuses its results
+    image_metadata->is_skipped = 0;
+    image_metadata->motion = {0, 0, -1.0f};
+    if (SKIP_STATIC_FRAMES & pipeline->config_flags) {
+        // the earlier results only fit if they were made the same way, and eval frames need
+        // to run to be compared against the uncompressed frame
+        int allow_skip = run_args.allow_skip && !run_args.is_eval_frame &&
+                         ctx->reference_codec.rotation == codec_config.rotation &&
+                         ctx->reference_codec.do_segment == codec_config.do_segment &&
+                         ctx->reference_codec.model_id == codec_config.model_id;
+
+        if (YUV_DATA_T == image_data.type) {
+            image_metadata->is_skipped = check_motion_skip(
+                    &ctx->motion_skip, image_data.data.yuv.planes[0],
+                    image_data.data.yuv.row_strides[0], image_data.data.yuv.pixel_strides[0],
+                    allow_skip, &image_metadata->motion);
+        } else {
+            reset_motion_skip(&ctx->motion_skip);
+        }
+
+        if (image_metadata->is_skipped) {
+            image_metadata->reference_frame_index = ctx->reference_frame_index;
+        } else {
+            ctx->reference_frame_index = frame_index;
+            ctx->reference_codec = codec_config;
+        }
     }
 
-    if (HEVC_COMPRESSION == codec_config.compression_type ||
-        SOFTWARE_HEVC_COMPRESSION == codec_config.compression_type) {
+    if (image_metadata->is_skipped) {
+        // nothing is enqueued, so the frame completes as soon as submit_image lets go of it
+        image_metadata->host_ts_ns.start = get_timestamp_ns();
+        image_metadata->host_ts_ns.before_enc = image_metadata->host_ts_ns.start;
+        image_metadata->host_ts_ns.before_dnn = image_metadata->host_ts_ns.start;
+    }
 
-        assert(codec_config.compression_type & ctx->pipeline_array[index].config_flags);
-        status = check_and_configure_global_hevc(ctx, codec_config, &(ctx->pipeline_array[index]));
-        CHECK_AND_CATCH_NO_STATE(status, "could not configure hevc codec");
+    // counted out again by receive_image, also when the frame fails on the way
+    image_metadata->server = -1;
+    if (!image_metadata->is_skipped && REMOTE_DEVICE == codec_config.device_type) {
+        image_metadata->server = (index % ctx->lane_count) % ctx->server_pool.server_count;
+        server_pool_submit(&ctx->server_pool, image_metadata->server);
     }
 
-    status = submit_image_to_pipeline(&(ctx->pipeline_array[index]), codec_config, true, image_data,
-                                      image_metadata, collected_result, tmp_buf_ctx);
-    CHECK_AND_CATCH_NO_STATE(status, "could not submit image to pipeline");
+    if (!image_metadata->is_skipped) {
+        tmp_buf_ctx_t *tmp_buf_ctx = NULL;
+        if (run_args.is_eval_frame) {
+            tmp_buf_ctx = &ctx->eval_ctx->tmp_buf_ctx;
+        }
 
-    // TODO PING: Don't run ping on each frame
-    // run the ping buffer (needs to run also on local device to check if network improved)
-    if (ctx->devices_found > 2) {
-        // todo: see if this should be run on every device
-        ctx->ping_thread->ping(ctx->remote_queue);
-    }
+        if (HEVC_COMPRESSION == codec_config.compression_type ||
+            SOFTWARE_HEVC_COMPRESSION == codec_config.compression_type) {
 
-    collected_result->event_list[1] = NULL;
-    collected_result->event_list_size = 1;
+            assert(codec_config.compression_type & pipeline->config_flags);
+            status = check_and_configure_global_hevc(ctx, codec_config,
+                                                     pipeline);
+            CHECK_AND_CATCH_NO_STATE(status, "could not configure hevc codec");
+        }
 
-    // populate the metadata
-    image_metadata->frame_index = frame_index;
-    image_metadata->image_timestamp = image_data.image_timestamp;
-    image_metadata->codec = codec_config;
-    image_metadata->event_array = ctx->pipeline_array[index].event_array;
-    // pass on bool to indicate that local semaphore needs to be released
-    image_metadata->run_args.release_local_sem |= codec_config.device_type == LOCAL_DEVICE;
+        status = submit_image_to_pipeline(pipeline, codec_config, true,
+                                          image_data, image_metadata, collected_result,
+                                          tmp_buf_ctx);
+        CHECK_AND_CATCH_NO_STATE(status, "could not submit image to pipeline");
+
+        // TODO PING: Don't run ping on each frame
+        // run the ping buffer (needs to run also on local device to check if network improved)
+        if (ctx->devices_found > 2) {
+            // a frame that did not offload pings the first server
+            const int server = (image_metadata->server >= 0) ? image_metadata->server : 0;
+            ctx->ping_threads[server]->ping(ctx->remote_queues[server]);
+        }
 
-    // do some logging
-    if (ENABLE_PROFILING & ctx->pipeline_array[index].config_flags) {
+        collected_result->event_list[1] = NULL;
+        collected_result->event_list_size = 1;
+
+        status = enqueue_frame_readback(pipeline, &codec_config,
+                                        collected_result);
+        CHECK_AND_CATCH_NO_STATE(status, "could not enqueue readback");
 
-        dprintf(ctx->file_descriptor, "%d,frame,timestamp,%ld\n", image_metadata->frame_index,
-                image_data.image_timestamp);  // this should match device timestamp in camera log
-        dprintf(ctx->file_descriptor, "%d,frame,is_eval,%d\n", image_metadata->frame_index,
-                run_args.is_eval_frame);
-        log_codec_config(ctx->file_descriptor, image_metadata->frame_index, codec_config);
+        // the next frame of the lane overwrites the dnn output once these reads are done
+        if (pipeline->depth > 1) {
+            keep_for_next_frame(collected_result->read_events, collected_result->read_event_count,
+                                pipeline->prev_read_events, &pipeline->prev_read_event_count);
+        }
+    }
+
+    // do some logging
+    if (ENABLE_PROFILING & pipeline->config_flags) {
+
+        const int fd = ctx->file_descriptor;
+        // this should match device timestamp in camera log
+        log_frame_i64(fd, frame_index, "frame", "timestamp", image_data.image_timestamp);
+        log_frame_int(fd, frame_index, "frame", "is_eval", run_args.is_eval_frame);
+        log_codec_config(fd, frame_index, codec_config);
+        log_frame_i64(fd, frame_index, "backpressure", "dropped_frames",
+                      ctx->backpressure_stats.dropped_frames);
+        log_frame_i64(fd, frame_index, "backpressure", "superseded_frames",
+                      ctx->backpressure_stats.superseded_frames);
+        if (SKIP_STATIC_FRAMES & pipeline->config_flags) {
+            log_frame_int(fd, frame_index, "skip", "is_skipped", image_metadata->is_skipped);
+            log_frame_f(fd, frame_index, "skip", "motion_score", image_metadata->motion.score);
+            log_frame_int(fd, frame_index, "skip", "motion_dx", image_metadata->motion.dx);
+            log_frame_int(fd, frame_index, "skip", "motion_dy", image_metadata->motion.dy);
+        }
+        if (ctx->server_pool.server_count > 1) {
+            log_frame_int(fd, frame_index, "frame", "server", image_metadata->server);
+        }
     }
 
     FINISH:
 
+    // while other servers are left, the lane stays up and receive_image reports the frame dropped
+    if (image_metadata->server >= 0 && CL_SUCCESS != status && ctx->server_pool.server_count > 1) {
+        const int64_t now_ns = get_timestamp_ns();
+        server_pool_mark_lost(&ctx->server_pool, image_metadata->server, now_ns);
+        if (0 != server_pool_usable_mask(&ctx->server_pool, now_ns)) {
+            LOGW("server %d is lost, offloading to the other servers\n", image_metadata->server);
+            revive_lane(pipeline);
+            status = CL_SUCCESS;
+        }
+    }
+
 #ifdef DEBUG_SEMAPHORES
     LOGE("submit_image %d (%d), type : %d", frame_index, index, image_metadata->codec.device_type);
-    int sem_value;
-    sem_getvalue(&(ctx->image_sem), &sem_value);
-    LOGW("submit_image incremented image sem to: %d \n", sem_value + 1);
 #endif
-    // increment the semaphore so that image reading thread knows there is an image ready
-    sem_post(&(ctx->image_sem));
+    // if the reads are done already, this hands the frame to the image reading thread
+    release_frame_read(collected_result);
 
     return status;
 }
 
 /**
- * wait until an image is done being processed
+ * wait until an image is done being processed. All images that are done at that point are
+ * taken at once, so receive_image can be called for each of them without waiting again.
  * @param ctx to wait on
  * @param timeout in milliseconds
  * @return opencl return status
@@ -995,23 +1583,12 @@ int wait_image_available(pocl_image_processor_context *ctx, int timeout) {
 
     ZoneScoped;
 
-    struct timespec ts;
-    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
-        return -1;
-    }
-
-    add_ns_to_time(&ts, timeout * 1000000);
-
-    int ret;
-    while ((ret = sem_timedwait(&(ctx->image_sem), &ts)) == -1 && errno == EINTR) {
-        // continue if interrupted for any reason
-    }
+    int ret = frame_ring_wait(&ctx->frame_ring, timeout);
 
 #ifdef DEBUG_SEMAPHORES
     if (0 == ret) {
-        int sem_value;
-        sem_getvalue(&(ctx->image_sem), &sem_value);
-        LOGW("wait_image_available decremented image sem to: %d \n", sem_value);
+        LOGW("wait_image_available images ready: %d \n",
+             __builtin_popcount(frame_ring_completed(&ctx->frame_ring)));
     }
 #endif
 
@@ -1019,49 +1596,6 @@ int wait_image_available(pocl_image_processor_context *ctx, int timeout) {
 
 }
 
-cl_int get_compression_size(pipeline_context *pipeline_ctx, frame_metadata_t *frame_metadata) {
-    cl_int status;
-    cl_mem sz_buf = nullptr;
-    cl_command_queue sz_queue = nullptr;
-
-    // TODO: refactor to use get_compression_size_<codec>()
-    // Read the encoded size buffer if applicable
-    switch (frame_metadata->codec.compression_type) {
-#ifndef  DISABLE_JPEG
-        case JPEG_COMPRESSION:
-            sz_buf = pipeline_ctx->jpeg_context->size_buf;
-            sz_queue = pipeline_ctx->jpeg_context->enc_queue;
-            break;
-#endif
-#ifndef DISABLE_HEVC
-        case HEVC_COMPRESSION:
-            sz_buf = pipeline_ctx->hevc_context->size_buf;
-            sz_queue = pipeline_ctx->hevc_context->enc_queue;
-            break;
-#endif
-        default:
-            frame_metadata->size_bytes_tx = pipeline_ctx->host_inp_buf_size;
-    }
-
-    if (sz_buf != nullptr && sz_queue != nullptr) {
-        cl_event sz_read_event;
-        status = clEnqueueReadBuffer(sz_queue, sz_buf, CL_FALSE, 0, sizeof(cl_ulong),
-                                     &frame_metadata->size_bytes_tx, 0, NULL, &sz_read_event);
-        CHECK_AND_RETURN(status, "could not read size_bytes buffer");
-
-        status = clWaitForEvents(1, &sz_read_event);
-        CHECK_AND_RETURN(status, "failed to wait for sz read event");
-    }
-
-    if (pipeline_ctx->config_flags | SEGMENT_4B) {
-        frame_metadata->size_bytes_rx = DET_COUNT + MASK_SZ1 * MASK_SZ2 / 2;
-    } else {
-        frame_metadata->size_bytes_rx = DET_COUNT + MASK_SZ1 * MASK_SZ2;
-    }
-
-    return CL_SUCCESS;
-}
-
 /**
  * read done images from the pipeline
  * @param ctx to read from
@@ -1069,7 +1603,8 @@ cl_int get_compression_size(pipeline_context *pipeline_ctx, frame_metadata_t *fr
  * @param segmentation_array mask of detections
  * @param return_metadata evaluation results
  * @param segmentation indicate that segmentation has been done
- * @return opencl status results
+ * @return opencl status results, or POCL_IMAGE_PROCESSOR_FRAME_DROPPED when the frame failed on
+ * its server and the output arrays were left as they were
  */
 int receive_image(pocl_image_processor_context *const ctx, int32_t *detection_array,
                   uint8_t *segmentation_array, frame_metadata_t *return_metadata,
@@ -1079,15 +1614,49 @@ int receive_image(pocl_image_processor_context *const ctx, int32_t *detection_ar
     // variables used later, but need to be declared now for goto statement
     char markId[23];
 
-    int index = ctx->frame_index_tail % ctx->lane_count;
-    ctx->frame_index_tail += 1;
+    if (0 == frame_ring_completed(&ctx->frame_ring)) {
+        frame_ring_wait(&ctx->frame_ring, -1);
+    }
+
+    // of the frames that completed, take the oldest one. The slot is handed back to the
+    // submitting thread with frame_ring_pop when done
+    int index;
+    for (;;) {
+        index = -1;
+        for (uint32_t completed = frame_ring_completed(&ctx->frame_ring);
+             0 != completed; completed &= completed - 1) {
+            int slot = __builtin_ctz(completed);
+            if (index < 0 ||
+                ctx->metadata_array[slot].frame_index < ctx->metadata_array[index].frame_index) {
+                index = slot;
+            }
+        }
+
+        // a skipped frame completes right away, but reuses the results of its reference frame.
+        // That one is older, so it is taken first as soon as it completes.
+        const frame_metadata_t *oldest = &(ctx->metadata_array[index]);
+        if (!oldest->is_skipped ||
+            oldest->reference_frame_index <= ctx->last_received_frame_index) {
+            break;
+        }
+        frame_ring_wait_more(&ctx->frame_ring, -1);
+    }
+    int frame_index = ctx->metadata_array[index].frame_index;
 
     dnn_results results = ctx->collected_results[index];
     frame_metadata_t image_metadata = ctx->metadata_array[index];
 
-    pipeline_context *pipeline = &(ctx->pipeline_array[index]);
+    pipeline_context *pipeline = &(ctx->pipeline_array[index % ctx->lane_count]);
+
+    if (!image_metadata.is_skipped && frame_index > ctx->last_received_frame_index) {
+        ctx->last_received_frame_index = frame_index;
+    }
 
     if (1 == pipeline->local_only) {
+        if (image_metadata.server >= 0) {
+            server_pool_fail(&ctx->server_pool, image_metadata.server, get_timestamp_ns());
+        }
+        frame_ring_pop(&ctx->frame_ring, index, image_metadata.run_args.release_local_sem);
         return CL_DEVICE_NOT_AVAILABLE;
     }
 
@@ -1098,15 +1667,72 @@ int receive_image(pocl_image_processor_context *const ctx, int32_t *detection_ar
 
     image_metadata.host_ts_ns.before_wait = get_timestamp_ns();
 
+    if (image_metadata.is_skipped) {
+        memcpy(detection_array, ctx->last_detections, DET_COUNT * sizeof(int32_t));
+        if (image_metadata.codec.do_segment) {
+            memcpy(segmentation_array, ctx->last_segmentation, SEG_OUT_COUNT);
+        }
+        move_results(detection_array, image_metadata.codec.do_segment ? segmentation_array : NULL,
+                     image_metadata.codec.rotation, pipeline->width, pipeline->height,
+                     &image_metadata.motion);
+
+        // nothing was sent or received, and there are no events of this frame to collect
+        image_metadata.event_array = NULL;
+        image_metadata.size_bytes_tx = 0;
+        image_metadata.size_bytes_rx = 0;
+        image_metadata.host_ts_ns.fill_ping_duration_ms = 0;
+        image_metadata.host_ts_ns.after_wait = image_metadata.host_ts_ns.before_wait;
+        image_metadata.host_ts_ns.stop = get_timestamp_ns();
+
+        if (ENABLE_PROFILING & config_flags) {
+            log_frame_int(ctx->file_descriptor, image_metadata.frame_index, "skip",
+                          "reference_frame_index", image_metadata.reference_frame_index);
+            log_host_ts_ns(ctx->file_descriptor, image_metadata.frame_index,
+                           image_metadata.host_ts_ns);
+        }
+
+        if (NULL != return_metadata) {
+            memcpy(return_metadata, &image_metadata, sizeof(frame_metadata_t));
+        }
+
+        frame_ring_pop(&ctx->frame_ring, index, image_metadata.run_args.release_local_sem);
+        return CL_SUCCESS;
+    }
+
     int status;
     lane_state_t new_state = LANE_READY;
 
-    // TODO: wrap with pipeline function
-    status = enqueue_read_results_dnn(pipeline->dnn_context, &image_metadata.codec, detection_array,
-                                      segmentation_array, image_metadata.event_array,
-                                      results.event_list_size, results.event_list);
+    // results that are already older than the deadline would be shown too late, so leave the
+    // previous results in the output arrays
+    int expired = BACKPRESSURE_DEADLINE == ctx->backpressure_mode &&
+                  image_metadata.host_ts_ns.before_wait - image_metadata.host_ts_ns.start >
+                  (int64_t) ctx->backpressure_deadline_ms * 1000000;
+
+    // the reads completed already, so this only picks up errors
+    if (0 == results.read_event_count) {
+        status = POCL_IMAGE_PROCESSOR_ERROR;
+    } else {
+        status = clWaitForEvents(results.read_event_count, results.read_events);
+    }
     CHECK_AND_CATCH(status, "could not read results back", new_state);
 
+    if (expired) {
+        ctx->backpressure_stats.expired_frames += 1;
+    } else {
+        memcpy(detection_array, results.detections, DET_COUNT * sizeof(int32_t));
+        if (image_metadata.codec.do_segment) {
+            memcpy(segmentation_array, results.segmentation, SEG_OUT_COUNT);
+        }
+
+        // kept for the frames that get skipped after this one
+        if (SKIP_STATIC_FRAMES & config_flags) {
+            memcpy(ctx->last_detections, results.detections, DET_COUNT * sizeof(int32_t));
+            if (image_metadata.codec.do_segment) {
+                memcpy(ctx->last_segmentation, results.segmentation, SEG_OUT_COUNT);
+            }
+        }
+    }
+
 //    if (image_metadata.latency_offset_ms > 0) {
 //        struct timespec ts;
 //        ts.tv_sec = image_metadata.latency_offset_ms / 1000;
@@ -1130,9 +1756,13 @@ int receive_image(pocl_image_processor_context *const ctx, int32_t *detection_ar
     // to prevent resetting the event array at the beginning of submitting a new image.
     collect_events(image_metadata.event_array, collected_events);
 
-    // Read the size of the compressed image and segmentation data
-    status = get_compression_size(pipeline, &image_metadata);
-    CHECK_AND_CATCH(status, "could not get compression size", new_state);
+    // size of the compressed image and segmentation data
+    image_metadata.size_bytes_tx = results.size_bytes_tx;
+    if (pipeline->config_flags | SEGMENT_4B) {
+        image_metadata.size_bytes_rx = DET_COUNT + MASK_SZ1 * MASK_SZ2 / 2;
+    } else {
+        image_metadata.size_bytes_rx = DET_COUNT + MASK_SZ1 * MASK_SZ2;
+    }
 
     // TODO PING: Don't run ping on each frame
     image_metadata.host_ts_ns.fill_ping_duration_ms = 0;
@@ -1140,7 +1770,8 @@ int receive_image(pocl_image_processor_context *const ctx, int32_t *detection_ar
         // Don't track networking latency if the only available device is local
         image_metadata.host_ts_ns.fill_ping_duration_ms = 0;
     } else {
-        image_metadata.host_ts_ns.fill_ping_duration_ms = ctx->ping_thread->getPing();
+        const int server = (image_metadata.server >= 0) ? image_metadata.server : 0;
+        image_metadata.host_ts_ns.fill_ping_duration_ms = ctx->ping_threads[server]->getPing();
     }
 
 //    if (image_metadata.latency_offset_ms > 0) {
@@ -1162,12 +1793,24 @@ int receive_image(pocl_image_processor_context *const ctx, int32_t *detection_ar
 //            CHECK_AND_CATCH(status, "failed to print eval events", new_state);
 //        }
 
-        dprintf(ctx->file_descriptor, "%d,compression,size_bytes_tx,%lu\n",
-                image_metadata.frame_index, image_metadata.size_bytes_tx);
-        dprintf(ctx->file_descriptor, "%d,compression,size_bytes_rx,%lu\n",
-                image_metadata.frame_index, image_metadata.size_bytes_rx);
+        log_frame_u64(ctx->file_descriptor, image_metadata.frame_index, "compression",
+                      "size_bytes_tx", image_metadata.size_bytes_tx);
+        log_frame_u64(ctx->file_descriptor, image_metadata.frame_index, "compression",
+                      "size_bytes_rx", image_metadata.size_bytes_rx);
 
         log_host_ts_ns(ctx->file_descriptor, image_metadata.frame_index, image_metadata.host_ts_ns);
+        log_frame_int(ctx->file_descriptor, image_metadata.frame_index, "backpressure",
+                      "expired", expired);
+
+        cl_mem_manager_stats_pocl alloc_stats;
+        if (0 == get_alloc_stats(ctx, &alloc_stats)) {
+            log_frame_u64(ctx->file_descriptor, image_metadata.frame_index, "pocl_alloc",
+                          "events", alloc_stats.events_allocated);
+            log_frame_u64(ctx->file_descriptor, image_metadata.frame_index, "pocl_alloc",
+                          "commands", alloc_stats.commands_allocated);
+            log_frame_u64(ctx->file_descriptor, image_metadata.frame_index, "pocl_alloc",
+                          "event_nodes", alloc_stats.event_nodes_allocated);
+        }
     }
 
     // todo: currently pass the data back for the eventual quality algo,
@@ -1178,12 +1821,42 @@ int receive_image(pocl_image_processor_context *const ctx, int32_t *detection_ar
         memcpy(return_metadata, &image_metadata, sizeof(frame_metadata_t));
     }
 
-    snprintf(markId, sizeof(markId), "frame end: %d", ctx->frame_index_tail - 1);
+    if (image_metadata.server >= 0) {
+        server_pool_receive(&ctx->server_pool, image_metadata.server,
+                            (float) (image_metadata.host_ts_ns.stop -
+                                     image_metadata.host_ts_ns.start) / 1e6f);
+    }
+
+    snprintf(markId, sizeof(markId), "frame end: %d", frame_index);
     TracyMessage(markId, strlen(markId));
-    TracyCFrameMarkEnd(pipeline->lane_name);
+    TracyCFrameMarkEnd(pipeline->buffers[index / ctx->lane_count].frame_name);
 
     FINISH:
 
+    if (CL_SUCCESS != status && image_metadata.server >= 0) {
+        const int64_t now_ns = get_timestamp_ns();
+        server_pool_fail(&ctx->server_pool, image_metadata.server, now_ns);
+
+        // while other servers are left, the lane stays up and the frame is reported as
+        // dropped. The output arrays are not its results, and it says nothing about the codec
+        if (ctx->server_pool.server_count > 1 &&
+            0 != server_pool_usable_mask(&ctx->server_pool, now_ns)) {
+            LOGW("frame %d failed on server %d, offloading to the other servers\n", frame_index,
+                 image_metadata.server);
+            new_state = LANE_READY;
+            status = POCL_IMAGE_PROCESSOR_FRAME_DROPPED;
+
+            image_metadata.host_ts_ns.stop = now_ns;
+            if (ENABLE_PROFILING & config_flags) {
+                log_frame_int(ctx->file_descriptor, frame_index, "frame", "dropped_on_server",
+                              image_metadata.server);
+            }
+            if (NULL != return_metadata) {
+                memcpy(return_metadata, &image_metadata, sizeof(frame_metadata_t));
+            }
+        }
+    }
+
     // TODO: Move update_stats() here and revert back the chopped-off finish code
 //    *new_lane_state = new_state;
 
@@ -1191,57 +1864,93 @@ SET_CTX_STATE(pipeline, LANE_ERROR, new_state)
 
 
 #ifdef DEBUG_SEMAPHORES
-    {
-        LOGE("receive_image %d (%d), type : %d", ctx->frame_index_tail - 1, index,
-         image_metadata.codec.device_type);
-        int sem_value;
-        sem_getvalue(&(ctx->pipe_sem), &sem_value);
-        LOGW("receive_image incremented pipe sem to: %d \n", sem_value + 1);
-    }
+    LOGE("receive_image %d (%d), type : %d, release local: %d", frame_index, index,
+         image_metadata.codec.device_type, image_metadata.run_args.release_local_sem);
 #endif
-    // finally release the semaphore
-    sem_post(&(ctx->pipe_sem));
+    // finally hand the lane back, together with the local spot if this frame held it
+    frame_ring_pop(&ctx->frame_ring, index, image_metadata.run_args.release_local_sem);
 
-    if (image_metadata.run_args.release_local_sem) {
+    return status;
+}
 
-#ifdef DEBUG_SEMAPHORES
-        {
-            int sem_value;
-            sem_getvalue(&(ctx->local_sem), &sem_value);
-            LOGW("receive_image incremented local sem to: %d \n", sem_value + 1);
-        }
-#endif
-        sem_post(&(ctx->local_sem));
-    }
+/**
+ * @param ctx
+ * @return number of remote servers that the lanes offload to, see MULTI_SERVER
+ */
+int get_server_count(const pocl_image_processor_context *ctx) {
+    return ctx->server_pool.server_count;
+}
 
-    return status;
+/**
+ * @param ctx
+ * @param server index below get_server_count
+ * @return the load estimate and frame counts of the server
+ */
+server_state_t get_server_state(const pocl_image_processor_context *ctx, const int server) {
+    assert(0 <= server && server < ctx->server_pool.server_count);
+    return server_pool_get(&ctx->server_pool, server);
 }
 
 /**
- * acquire all lane semaphores so that no other lanes are running
+ * reserve all other lanes so that no other lanes are running. Needs to be called from the
+ * thread that submits images, which already holds a spot.
  * @param ctx
  */
 void halt_lanes(pocl_image_processor_context *ctx) {
-    for (int i = 0; i < ctx->lane_count - 1; i++) {
-        sem_wait(&(ctx->pipe_sem));
+    for (int i = 0; i < ctx->slot_count - 1; i++) {
+        frame_ring_reserve(&ctx->frame_ring, 0, -1);
 #ifdef DEBUG_SEMAPHORES
-        LOGI("halt lanes acquired semaphore %d", (i + 1));
+        LOGI("halt lanes reserved lane %d", (i + 1));
 #endif
 
     }
 }
 
 /**
- * release all lane semaphores acquired by halt_lanes
+ * release all lanes reserved by halt_lanes
  * @param ctx
  */
 void resume_lanes(pocl_image_processor_context *ctx) {
-    for (int i = 0; i < ctx->lane_count - 1; i++) {
-        sem_post(&(ctx->pipe_sem));
+    frame_ring_unreserve(&ctx->frame_ring, ctx->slot_count - 1, 0);
 #ifdef DEBUG_SEMAPHORES
-        LOGI("resume lanes released semaphore %d", (i + 1));
+    LOGI("resume lanes released %d lanes", ctx->slot_count - 1);
 #endif
+}
+
+/**
+ * set what happens to frames when all lanes are busy. Meant to be set before images are
+ * submitted, since the receiving thread reads it as well.
+ * @param ctx
+ * @param mode one of backpressure_mode_t
+ * @param deadline_ms age after which frames are not worth showing, used by BACKPRESSURE_DEADLINE
+ */
+void set_backpressure_policy(pocl_image_processor_context *ctx, backpressure_mode_t mode,
+                             int deadline_ms) {
+    assert(BACKPRESSURE_DEADLINE != mode || deadline_ms > 0);
+    ctx->backpressure_deadline_ms = deadline_ms;
+    ctx->backpressure_mode = mode;
+}
+
+/**
+ * @param ctx
+ * @return how many frames were dropped, superseded or expired so far
+ */
+backpressure_stats_t get_backpressure_stats(const pocl_image_processor_context *ctx) {
+    return ctx->backpressure_stats;
+}
+
+/**
+ * read how many runtime objects pocl had to allocate so far. Frames in steady state should
+ * reuse the freed ones, so the counters stop growing after a few hundred frames.
+ * @param ctx
+ * @param stats output
+ * @return 0 if successful, -1 if pocl has no allocation counters
+ */
+int get_alloc_stats(const pocl_image_processor_context *ctx, cl_mem_manager_stats_pocl *stats) {
+    if (NULL == ctx->get_alloc_stats || CL_SUCCESS != ctx->get_alloc_stats(stats)) {
+        return -1;
     }
+    return 0;
 }
 
 /**
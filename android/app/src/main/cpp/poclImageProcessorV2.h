@@ -10,18 +10,24 @@
 #include "jpeg_compression.h"
 #include "poclImageProcessorTypes.h"
 #include "yuv_compression.h"
+#include "frame_ring.h"
+#include "motion_skip.h"
+#include "server_pool.h"
 #include "PingThread.h"
 
 #include "testapps.h"
 #include <stdint.h>
-#include <semaphore.h>
 #include <time.h>
 #include <stdbool.h>
 #include <Tracy.hpp>
 #include <TracyOpenCL.hpp>
 
 #define CSV_HEADER "frame_id,tag,parameter,value\n"
-#define MAX_NUM_CL_DEVICES 4
+// the two local devices and one remote device for each server, see MULTI_SERVER
+#define MAX_NUM_CL_DEVICES (REMOTE_DEVICE + SERVER_POOL_MAX_SERVERS)
+#define MAX_LANE_DEPTH 4 // frames that can be in flight in one lane at the same time
+#define SERVER_RETRY_MS 5000 // how long a lost server gets no frames with MULTI_SERVER
+#define SERVICE_NAME_LEN 32 // length of the service names that pocld advertises
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,21 +35,62 @@ extern "C" {
 
 #define POCL_IMAGE_PROCESSOR_ERROR -100
 #define POCL_IMAGE_PROCESSOR_UNRECOVERABLE_ERROR -101
+// receive_image: the server of the frame failed, but the other servers can take the next frames
+#define POCL_IMAGE_PROCESSOR_FRAME_DROPPED -102
 
 typedef enum {
     LANE_REMOTE_LOST = -3, LANE_SHUTDOWN = -2, LANE_ERROR = -1, LANE_READY = 0, LANE_BUSY = 1,
 } lane_state_t;
 
+/**
+ * what to do with camera frames when all lanes are busy
+ */
+typedef enum {
+    BACKPRESSURE_WAIT = 0, // wait in dequeue_spot until a lane frees up or the timeout passes
+    BACKPRESSURE_LATEST_FRAME = 1, // don't wait, the next camera frame replaces this one
+    BACKPRESSURE_DEADLINE = 2, // wait at most the deadline, and don't read back older results
+} backpressure_mode_t;
+
+typedef struct {
+    uint32_t dropped_frames; // frames that got no lane within the timeout
+    uint32_t superseded_frames; // frames skipped in favor of a newer camera frame
+    uint32_t expired_frames; // frames whose results were past the deadline and not read back
+} backpressure_stats_t;
+
+/**
+ * the buffers that every frame in flight in a lane needs for itself
+ */
+typedef struct {
+    cl_mem inp_yuv_mem;
+    cl_mem comp_to_dnn_buf;
+    event_array_t *event_array;
+    char frame_name[24]; // the name of the frames that use these buffers in tracy
+} lane_buffers_t;
+
 typedef struct {
     event_array_t *event_array;
     int config_flags; // used to configure codecs
     cl_command_queue *enq_queues; // collection of device queues
     int queue_count;
-    cl_mem inp_yuv_mem; // buffer to write the inp yuv image to
-    cl_uchar *host_inp_buf; // where to copy the image to
-    size_t host_inp_buf_size;
+    cl_mem inp_yuv_mem; // host visible nv12 buffer the inp yuv image is mapped and written to
+    size_t inp_yuv_size;
     cl_mem comp_to_dnn_buf;
 
+    // consecutive frames of the lane take turns on the buffer sets, so that a frame can be
+    // uploaded and encoded while the previous one is still in the dnn or being read back.
+    // event_array, inp_yuv_mem and comp_to_dnn_buf point to the set of the frame being submitted.
+    lane_buffers_t buffers[MAX_LANE_DEPTH];
+    int depth;
+    int buffer_index;
+    // queues to upload frames on, so that the upload does not wait behind the previous frame.
+    // NULL with a depth of one, then the frame is uploaded on the queue that reads it.
+    cl_command_queue *upload_queues;
+    // events of the previous frame that the next one waits on before it reuses the codec and
+    // dnn buffers, which are still shared by all frames of the lane
+    cl_event prev_decoded_event;
+    cl_event prev_read_events[3];
+    int prev_read_event_count;
+
     // different codec options
     yuv_codec_context_t *yuv_context;
 #ifndef DISABLE_JPEG
@@ -75,6 +122,17 @@ typedef struct {
 typedef struct {
     cl_event event_list[2];
     int event_list_size;
+
+    // the readback that is enqueued together with the frame, valid once read_events completed
+    int32_t *detections;
+    uint8_t *segmentation;
+    cl_ulong size_bytes_tx;
+    cl_event read_events[3];
+    int read_event_count;
+    // the slot of the frame is completed when this drops to zero
+    uint32_t pending_reads;
+    frame_ring_t *frame_ring;
+    int slot;
 } dnn_results;
 
 typedef struct {
@@ -93,6 +151,7 @@ typedef struct {
     bool is_eval_frame;
     bool codec_selected;
     bool release_local_sem;
+    bool allow_skip; // the frame may reuse the results of an earlier frame with SKIP_STATIC_FRAMES
     int64_t latency_offset_ms; // artificial extra time to spend sleeping in this frame (0 disables it)
 } meta_run_arg_t;
 
@@ -107,6 +166,10 @@ typedef struct {
     codec_config_t codec;
     int release_local_sem;
     meta_run_arg_t run_args;
+    int is_skipped; // the frame did not run, and reuses the results of the reference frame
+    int reference_frame_index; // last frame that ran the dnn when this frame was submitted
+    motion_estimate_t motion; // movement of the scene since the reference frame
+    int server; // remote server that ran the frame, -1 if it did not offload, see MULTI_SERVER
 } frame_metadata_t;
 
 typedef struct {
@@ -114,18 +177,43 @@ typedef struct {
     frame_metadata_t *metadata_array; // metadata on images used for
     pipeline_context *pipeline_array; // collection of pipelines that can run independently from each other
     dnn_results *collected_results; // buffer with processed image results returned with receive_image
-    // TODO: add mutex to index head and tail
-    int frame_index_head; // index of the array to write data to
-    int frame_index_tail; // index of the array to read data from
+    // metadata_array and collected_results have an entry per frame slot, pipeline_array one per
+    // lane. Slot i runs in lane i % lane_count on buffer set i / lane_count of that lane.
+    // head is the index of the arrays to write data to, tail the index to read data from.
+    // also keeps track of how many pipelines are busy, and local execution can't handle many lanes
+    frame_ring_t frame_ring;
+    // dequeue_spot also reserved a local spot for the next frame, which gives it back with its
+    // slot whatever device it ends up running on
+    bool local_spot_reserved;
     int lane_count;
-    sem_t pipe_sem; // keep track of how many pipelines are busy
-    sem_t local_sem; // local execution can't handle many lanes
-    sem_t image_sem; // keep track of how many images are available
+    int slot_count; // frames that can be in flight, lane_count times the depth of the lanes
+    backpressure_mode_t backpressure_mode;
+    int backpressure_deadline_ms;
+    // dropped and superseded frames are counted by the submitting thread,
+    // expired ones by the receiving thread
+    backpressure_stats_t backpressure_stats;
     int file_descriptor; // used to log info
+    // allocation counters of pocl, NULL if pocl was built without its memory manager
+    clGetMemManagerStatsPOCL_fn get_alloc_stats;
+
+    // static frame skipping, see SKIP_STATIC_FRAMES. The submitting thread compares frames to
+    // the last frame that ran the dnn, the receiving thread keeps the last results around.
+    motion_skip_t motion_skip;
+    int reference_frame_index;
+    codec_config_t reference_codec;
+    int32_t *last_detections;
+    uint8_t *last_segmentation;
+    int last_received_frame_index;
+
+    // the remote servers, see MULTI_SERVER. Lane i offloads to server i % server_count, and
+    // server_slots[s] has the slots of the lanes of server s. Without MULTI_SERVER there is one.
+    server_pool_t server_pool;
+    uint32_t server_slots[SERVER_POOL_MAX_SERVERS];
 
     // TODO: see if this should be moved to pingThread
-    cl_command_queue remote_queue; // used to run the ping
-    PingThread *ping_thread; // used to schedule pings
+    // each server is pinged on its own, a frame reads the ping of the server it ran on
+    cl_command_queue remote_queues[SERVER_POOL_MAX_SERVERS]; // used to run the pings
+    PingThread *ping_threads[SERVER_POOL_MAX_SERVERS]; // used to schedule pings
 
     cl_command_queue read_queue; // queue to read the collected results
 
@@ -142,9 +230,10 @@ typedef struct {
 } pocl_image_processor_context;
 
 int create_pocl_image_processor_context(pocl_image_processor_context **ctx, const int max_lanes,
-                                        const int width, const int height, const int config_flags,
-                                        const char **codec_sources, const size_t *src_size, int fd,
-                                        bool enable_eval, char *service_name);
+                                        const int lane_depth, const int width, const int height,
+                                        const int config_flags, const char **codec_sources,
+                                        const size_t *src_size, int fd, bool enable_eval,
+                                        char *service_name);
 
 int dequeue_spot(pocl_image_processor_context *const ctx, const int timeout,
                  const device_type_enum dev_type);
@@ -174,6 +263,17 @@ int check_and_configure_global_hevc(pocl_image_processor_context *ctx, codec_con
 
 void halt_lanes(pocl_image_processor_context *ctx);
 
+void set_backpressure_policy(pocl_image_processor_context *ctx, backpressure_mode_t mode,
+                             int deadline_ms);
+
+backpressure_stats_t get_backpressure_stats(const pocl_image_processor_context *ctx);
+
+int get_alloc_stats(const pocl_image_processor_context *ctx, cl_mem_manager_stats_pocl *stats);
+
+int get_server_count(const pocl_image_processor_context *ctx);
+
+server_state_t get_server_state(const pocl_image_processor_context *ctx, int server);
+
 void resume_lanes(pocl_image_processor_context *ctx);
 
 #ifdef __cplusplus
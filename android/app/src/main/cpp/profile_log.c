@@ -0,0 +1,518 @@
+//
+// Binary profiling log, see profile_log.h
+//
+
+#include "profile_log.h"
+
+#include "platform.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROFILE_LOG_MASK (PROFILE_LOG_CAPACITY - 1)
+#define PROFILE_LOG_BATCH 256 // records written with one system call
+#define PROFILE_LOG_CSV_HEADER "frame_id,tag,parameter,value\n"
+#define PROFILE_KEY_MASK (PROFILE_LOG_KEYS - 1)
+// a batch where every record is the first one to use its pair and its string value
+#define PROFILE_LOG_BATCH_BYTES \
+    (PROFILE_LOG_BATCH * (3 * sizeof(profile_record_t) + 2 * PROFILE_TEXT_LEN))
+
+_Static_assert(0 == (PROFILE_LOG_CAPACITY & PROFILE_LOG_MASK), "capacity is not a power of two");
+_Static_assert(0 == (PROFILE_LOG_KEYS & PROFILE_KEY_MASK), "key count is not a power of two");
+_Static_assert(PROFILE_LOG_KEYS <= UINT16_MAX + 1, "keys do not fit in the record");
+_Static_assert(PROFILE_TEXT_LEN <= UINT8_MAX, "text length does not fit in the record");
+
+typedef enum {
+    PROFILE_KEY_FREE = 0,
+    PROFILE_KEY_FILLING, // claimed by a logging thread that is copying the text in
+    PROFILE_KEY_READY,
+} profile_key_state_t;
+
+typedef struct {
+    uint32_t state; // profile_key_state_t
+    uint32_t hash;
+    uint32_t length;
+    char text[PROFILE_TEXT_LEN];
+} profile_key_t;
+
+typedef struct {
+    profile_record_t record;
+    // equal to the position of the slot while it is free, the position + 1 once it is filled
+    uint32_t sequence;
+} profile_slot_t;
+
+// there is one log per process, the profiling file of the image processor
+static struct {
+    // claimed by the logging threads
+    __attribute__((aligned(64))) uint32_t head;
+    // only touched by the flusher
+    __attribute__((aligned(64))) uint32_t tail;
+    uint32_t dropped; // records that did not fit in the ring
+    int fd; // -1 while no binary log is open
+    int running;
+    pthread_t flusher;
+    profile_slot_t *slots;
+    // only touched by the flusher, set once the text of a key is in the file of this run
+    uint8_t key_written[PROFILE_LOG_KEYS];
+} profile_log = {.fd = -1};
+
+// the id of a string is its index in this hash table. Keys are never removed, so the ids stay
+// the same for the whole process.
+static profile_key_t profile_keys[PROFILE_LOG_KEYS];
+
+/**
+ * write everything, retrying on partial writes
+ * @return 0 if successful, otherwise -1
+ */
+static int write_all(const int fd, const void *data, size_t size) {
+    const char *bytes = (const char *) data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return 0;
+}
+
+/**
+ * append the text of a key to the batch, unless it was written already in this run
+ */
+static void append_key_text(char *batch, size_t *size, const uint32_t key) {
+    if (profile_log.key_written[key]) {
+        return;
+    }
+    profile_log.key_written[key] = 1;
+
+    const profile_key_t *entry = &profile_keys[key];
+    profile_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.frame_index = -1;
+    record.key = (uint16_t) key;
+    record.type = PROFILE_VALUE_TEXT;
+    record.length = (uint8_t) entry->length;
+    memcpy(batch + *size, &record, sizeof(record));
+    memcpy(batch + *size + sizeof(record), entry->text, entry->length);
+    *size += sizeof(record) + entry->length;
+}
+
+/**
+ * write the filled records at the tail of the ring to the file, in batches
+ */
+static void flush_ring(void) {
+    // only the flusher, or the closing thread once the flusher is gone, writes
+    static char batch[PROFILE_LOG_BATCH_BYTES];
+    int count;
+    do {
+        count = 0;
+        size_t size = 0;
+        while (count < PROFILE_LOG_BATCH) {
+            profile_slot_t *slot = &profile_log.slots[profile_log.tail & PROFILE_LOG_MASK];
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != profile_log.tail + 1) {
+                break;
+            }
+            // the texts were filled in before the record that refers to them
+            append_key_text(batch, &size, slot->record.key);
+            if (PROFILE_VALUE_STR == slot->record.type) {
+                append_key_text(batch, &size, (uint32_t) slot->record.value.u64);
+            }
+            memcpy(batch + size, &slot->record, sizeof(profile_record_t));
+            size += sizeof(profile_record_t);
+            count += 1;
+            // the slot is free again for the position one lap later
+            __atomic_store_n(&slot->sequence, profile_log.tail + PROFILE_LOG_CAPACITY,
+                             __ATOMIC_RELEASE);
+            profile_log.tail += 1;
+        }
+        if (size > 0 && 0 != write_all(profile_log.fd, batch, size)) {
+            LOGE("profile log: could not write records: %s\n", strerror(errno));
+        }
+    } while (PROFILE_LOG_BATCH == count);
+}
+
+static void *flusher_function(void *arg) {
+    (void) arg;
+    const struct timespec interval = {0, PROFILE_LOG_FLUSH_MS * 1000000L};
+    while (__atomic_load_n(&profile_log.running, __ATOMIC_ACQUIRE)) {
+        flush_ring();
+        nanosleep(&interval, NULL);
+    }
+    flush_ring();
+    return NULL;
+}
+
+/**
+ * claim a slot of the ring, without waiting. Drops the record if the ring is full.
+ * @return the slot to fill, or NULL
+ */
+static profile_slot_t *claim_slot(uint32_t *position) {
+    uint32_t pos = __atomic_load_n(&profile_log.head, __ATOMIC_RELAXED);
+    while (1) {
+        profile_slot_t *slot = &profile_log.slots[pos & PROFILE_LOG_MASK];
+        int32_t diff = (int32_t) (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+        if (0 == diff) {
+            if (__atomic_compare_exchange_n(&profile_log.head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *position = pos;
+                return slot;
+            }
+        } else if (diff < 0) {
+            // the flusher did not get to this slot since the last lap
+            __atomic_add_fetch(&profile_log.dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&profile_log.head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * find the id of a text, adding it to the table the first time it is seen. Drops the record
+ * if the table is full.
+ * @param text not NUL terminated
+ * @param length at most PROFILE_TEXT_LEN
+ * @return the id, or -1
+ */
+static int intern_text(const char *text, const uint32_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) text[i]) * 16777619u;
+    }
+
+    for (uint32_t probe = 0; probe < PROFILE_LOG_KEYS; probe++) {
+        const uint32_t key = (hash + probe) & PROFILE_KEY_MASK;
+        profile_key_t *entry = &profile_keys[key];
+        uint32_t state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+        if (PROFILE_KEY_FREE == state) {
+            if (__atomic_compare_exchange_n(&entry->state, &state, PROFILE_KEY_FILLING, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                entry->hash = hash;
+                entry->length = length;
+                memcpy(entry->text, text, length);
+                __atomic_store_n(&entry->state, PROFILE_KEY_READY, __ATOMIC_RELEASE);
+                return (int) key;
+            }
+        }
+        // another thread is adding a text here, which only takes a copy
+        while (PROFILE_KEY_FILLING == state) {
+            state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+        }
+        if (hash == entry->hash && length == entry->length &&
+            0 == memcmp(text, entry->text, length)) {
+            return (int) key;
+        }
+    }
+
+    __atomic_add_fetch(&profile_log.dropped, 1, __ATOMIC_RELAXED);
+    return -1;
+}
+
+/**
+ * @return the id of "tag,parameter", or -1 if the table is full
+ */
+static int intern_pair(const char *tag, const char *parameter) {
+    char text[PROFILE_TEXT_LEN];
+    uint32_t length = (uint32_t) strnlen(tag, PROFILE_TAG_LEN - 1);
+    memcpy(text, tag, length);
+    text[length++] = ',';
+    uint32_t parameter_length = (uint32_t) strnlen(parameter, PROFILE_PARAMETER_LEN - 1);
+    memcpy(text + length, parameter, parameter_length);
+    return intern_text(text, length + parameter_length);
+}
+
+/**
+ * @return the id of a string value, or -1 if the table is full
+ */
+static int intern_string(const char *value) {
+    return intern_text(value, (uint32_t) strnlen(value, PROFILE_STR_LEN - 1));
+}
+
+/**
+ * fill in the parts of a record that every value has
+ */
+static void set_record(profile_record_t *record, const int frame_index,
+                       const profile_value_type_t type, const int key) {
+    record->frame_index = frame_index;
+    record->key = (uint16_t) key;
+    record->type = (uint8_t) type;
+    record->length = 0;
+}
+
+/**
+ * declares slot, which is the record to fill in if fd has the binary log, and NULL if fd gets
+ * a csv line instead. Returns from the caller if the record does not fit in the ring or the
+ * tag,parameter pair does not fit in the key table.
+ */
+#define BEGIN_RECORD(fd, frame_index, type, tag, parameter)                       \
+    uint32_t position;                                                            \
+    profile_slot_t *slot = NULL;                                                  \
+    if ((fd) >= 0 && (fd) == profile_log.fd) {                                    \
+        int key = intern_pair(tag, parameter);                                    \
+        if (key < 0) {                                                            \
+            return;                                                               \
+        }                                                                         \
+        slot = claim_slot(&position);                                             \
+        if (NULL == slot) {                                                       \
+            return;                                                               \
+        }                                                                         \
+        set_record(&slot->record, frame_index, type, key);                        \
+    }
+
+// hands the filled record to the flusher
+#define END_RECORD()                                                              \
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+
+/**
+ * start writing binary records to fd, and a thread that flushes them. Only one binary log can
+ * be open at a time.
+ * @param fd file to write to, stays owned by the caller
+ * @return 0 if successful, otherwise -1
+ */
+int profile_log_open(const int fd) {
+    if (-1 != profile_log.fd || fd < 0) {
+        return -1;
+    }
+
+    profile_log.slots = (profile_slot_t *) calloc(PROFILE_LOG_CAPACITY, sizeof(profile_slot_t));
+    if (NULL == profile_log.slots) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < PROFILE_LOG_CAPACITY; i++) {
+        profile_log.slots[i].sequence = i;
+    }
+    profile_log.head = 0;
+    profile_log.tail = 0;
+    profile_log.dropped = 0;
+    // every run in the file defines its own texts, the converter forgets them at a header
+    memset(profile_log.key_written, 0, sizeof(profile_log.key_written));
+
+    // the header tells the converter how the records of this run are laid out
+    struct {
+        profile_record_t record;
+        char magic[sizeof(PROFILE_LOG_MAGIC) - 1];
+    } __attribute__((packed)) header;
+    memset(&header, 0, sizeof(header));
+    header.record.frame_index = -1;
+    header.record.type = PROFILE_VALUE_HEADER;
+    header.record.length = sizeof(header.magic);
+    header.record.value.i64 = sizeof(profile_record_t);
+    memcpy(header.magic, PROFILE_LOG_MAGIC, sizeof(header.magic));
+    if (0 != write_all(fd, &header, sizeof(header))) {
+        free(profile_log.slots);
+        profile_log.slots = NULL;
+        return -1;
+    }
+
+    profile_log.fd = fd;
+    profile_log.running = 1;
+    if (0 != pthread_create(&profile_log.flusher, NULL, flusher_function, NULL)) {
+        profile_log.running = 0;
+        profile_log.fd = -1;
+        free(profile_log.slots);
+        profile_log.slots = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * flush the remaining records and stop the flusher. No other thread may log to fd anymore
+ * while this runs.
+ * @param fd that was passed to profile_log_open
+ */
+void profile_log_close(const int fd) {
+    if (fd != profile_log.fd) {
+        return;
+    }
+
+    __atomic_store_n(&profile_log.running, 0, __ATOMIC_RELEASE);
+    pthread_join(profile_log.flusher, NULL);
+
+    uint32_t dropped = profile_log_dropped();
+    log_frame_int(fd, -1, "profile_log", "dropped_records", (int) dropped);
+    flush_ring();
+    if (dropped > 0) {
+        LOGW("profile log: %u records did not fit in the ring\n", dropped);
+    }
+
+    profile_log.fd = -1;
+    free(profile_log.slots);
+    profile_log.slots = NULL;
+}
+
+/**
+ * @return number of records that were dropped because the ring was full
+ */
+uint32_t profile_log_dropped(void) {
+    return __atomic_load_n(&profile_log.dropped, __ATOMIC_RELAXED);
+}
+
+/**
+ * turn a binary log into the csv that the log used to be written as
+ * @param in_fd binary log, as written after profile_log_open
+ * @param out_fd where to write the csv
+ * @return number of records converted, or -1 if the log is not valid
+ */
+int profile_log_convert(const int in_fd, const int out_fd) {
+    FILE *in = fdopen(dup(in_fd), "rb");
+    FILE *out = fdopen(dup(out_fd), "w");
+    // the texts of the ids that this run defined so far
+    struct {
+        int defined;
+        char text[PROFILE_TEXT_LEN + 1];
+    } *texts = calloc(PROFILE_LOG_KEYS, sizeof(*texts));
+    if (NULL == in || NULL == out || NULL == texts) {
+        if (NULL != in) {
+            fclose(in);
+        }
+        if (NULL != out) {
+            fclose(out);
+        }
+        free(texts);
+        return -1;
+    }
+
+    int count = 0;
+    profile_record_t record;
+    char text[UINT8_MAX + 1];
+    while (1 == fread(&record, sizeof(record), 1, in)) {
+        if (record.length > 0 && 1 != fread(text, record.length, 1, in)) {
+            count = -1;
+            goto FINISH;
+        }
+        text[record.length] = '\0';
+
+        if (record.key >= PROFILE_LOG_KEYS) {
+            count = -1;
+            goto FINISH;
+        }
+        // every value refers to a pair that was defined before it
+        const char *pair = texts[record.key].text;
+        if (PROFILE_VALUE_HEADER != record.type && PROFILE_VALUE_TEXT != record.type &&
+            !texts[record.key].defined) {
+            count = -1;
+            goto FINISH;
+        }
+
+        switch (record.type) {
+            case PROFILE_VALUE_HEADER:
+                // every run that was appended to the file starts with a header
+                if (0 != strcmp(text, PROFILE_LOG_MAGIC) ||
+                    sizeof(profile_record_t) != record.value.i64) {
+                    count = -1;
+                    goto FINISH;
+                }
+                memset(texts, 0, PROFILE_LOG_KEYS * sizeof(*texts));
+                fputs(PROFILE_LOG_CSV_HEADER, out);
+                break;
+            case PROFILE_VALUE_TEXT:
+                if (record.length > PROFILE_TEXT_LEN) {
+                    count = -1;
+                    goto FINISH;
+                }
+                texts[record.key].defined = 1;
+                memcpy(texts[record.key].text, text, record.length + 1);
+                // not a line of the csv
+                continue;
+            case PROFILE_VALUE_INT:
+                fprintf(out, "%d,%s,%d\n", record.frame_index, pair, (int) record.value.i64);
+                break;
+            case PROFILE_VALUE_I64:
+                fprintf(out, "%d,%s,%ld\n", record.frame_index, pair, (long) record.value.i64);
+                break;
+            case PROFILE_VALUE_U64:
+                fprintf(out, "%d,%s,%lu\n", record.frame_index, pair,
+                        (unsigned long) record.value.u64);
+                break;
+            case PROFILE_VALUE_F:
+                fprintf(out, "%d,%s,%f\n", record.frame_index, pair, record.value.f);
+                break;
+            case PROFILE_VALUE_STR:
+                if (record.value.u64 >= PROFILE_LOG_KEYS || !texts[record.value.u64].defined) {
+                    count = -1;
+                    goto FINISH;
+                }
+                fprintf(out, "%d,%s,%s\n", record.frame_index, pair,
+                        texts[record.value.u64].text);
+                break;
+            default:
+                count = -1;
+                goto FINISH;
+        }
+        count += 1;
+    }
+
+    FINISH:
+    fclose(in);
+    fclose(out);
+    free(texts);
+    return count;
+}
+
+void log_frame_int(int fd, int frame_index, const char *tag, const char *parameter, int value) {
+    BEGIN_RECORD(fd, frame_index, PROFILE_VALUE_INT, tag, parameter)
+    if (NULL == slot) {
+        dprintf(fd, "%d,%s,%s,%d\n", frame_index, tag, parameter, value);
+        return;
+    }
+    slot->record.value.i64 = value;
+    END_RECORD()
+}
+
+void log_frame_i64(int fd, int frame_index, const char *tag, const char *parameter,
+                   int64_t value) {
+    BEGIN_RECORD(fd, frame_index, PROFILE_VALUE_I64, tag, parameter)
+    if (NULL == slot) {
+        dprintf(fd, "%d,%s,%s,%ld\n", frame_index, tag, parameter, (long) value);
+        return;
+    }
+    slot->record.value.i64 = value;
+    END_RECORD()
+}
+
+void log_frame_u64(int fd, int frame_index, const char *tag, const char *parameter,
+                   uint64_t value) {
+    BEGIN_RECORD(fd, frame_index, PROFILE_VALUE_U64, tag, parameter)
+    if (NULL == slot) {
+        dprintf(fd, "%d,%s,%s,%lu\n", frame_index, tag, parameter, (unsigned long) value);
+        return;
+    }
+    slot->record.value.u64 = value;
+    END_RECORD()
+}
+
+void log_frame_f(int fd, int frame_index, const char *tag, const char *parameter, float value) {
+    BEGIN_RECORD(fd, frame_index, PROFILE_VALUE_F, tag, parameter)
+    if (NULL == slot) {
+        dprintf(fd, "%d,%s,%s,%f\n", frame_index, tag, parameter, value);
+        return;
+    }
+    slot->record.value.f = value;
+    END_RECORD()
+}
+
+void log_frame_str(int fd, int frame_index, const char *tag, const char *parameter,
+                   const char *value) {
+    // interned before a slot is claimed, a claimed slot can not be given back
+    int value_key = 0;
+    if (fd >= 0 && fd == profile_log.fd && (value_key = intern_string(value)) < 0) {
+        return;
+    }
+    BEGIN_RECORD(fd, frame_index, PROFILE_VALUE_STR, tag, parameter)
+    if (NULL == slot) {
+        dprintf(fd, "%d,%s,%s,%s\n", frame_index, tag, parameter, value);
+        return;
+    }
+    slot->record.value.u64 = (uint64_t) value_key;
+    END_RECORD()
+}
@@ -0,0 +1,83 @@
+//
+// Binary profiling log. Every logged value becomes a small fixed size record that the logging
+// thread copies into a lock-free ring in memory, so that the submit and receive threads do no
+// system calls for logging. A background thread flushes the ring into the log file in batches.
+// The records carry the same frame_id,tag,parameter,value data as the csv log, and
+// profile_log_convert turns a log file back into that csv.
+//
+// A record does not hold strings. Every tag,parameter pair and every string value is interned
+// into a small id the first time it is logged, and the flusher writes the text of an id once
+// per run, right before the first record that refers to it.
+//
+// Values logged to a file descriptor that has no binary log open are written as csv lines
+// right away, like before.
+//
+
+#ifndef POCL_AISA_DEMO_PROFILE_LOG_H
+#define POCL_AISA_DEMO_PROFILE_LOG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROFILE_LOG_CAPACITY 4096 // records in the ring, a power of two
+#define PROFILE_LOG_FLUSH_MS 100 // how often the flusher wakes up to write the ring out
+#define PROFILE_LOG_MAGIC "pcprof2"
+#define PROFILE_LOG_KEYS 1024 // distinct tag,parameter pairs and string values, a power of two
+
+// including the NUL, longer strings are cut off. The longest ones the app logs are event tags
+// like read_compress_size_event and model names like yolov8n-seg:640x480:int8 (24 characters).
+#define PROFILE_TAG_LEN 32
+#define PROFILE_PARAMETER_LEN 40
+#define PROFILE_STR_LEN 32
+// the text of an id, either "tag,parameter" or a string value
+#define PROFILE_TEXT_LEN (PROFILE_TAG_LEN + PROFILE_PARAMETER_LEN)
+
+typedef enum {
+    PROFILE_VALUE_HEADER = 0, // first record written by profile_log_open, the text is the magic
+    PROFILE_VALUE_INT,
+    PROFILE_VALUE_I64,
+    PROFILE_VALUE_U64,
+    PROFILE_VALUE_F,
+    PROFILE_VALUE_STR, // value.u64 is the id of the string
+    PROFILE_VALUE_TEXT, // defines the text of id key, no value
+} profile_value_type_t;
+
+typedef struct {
+    int32_t frame_index;
+    uint16_t key; // id of the tag,parameter pair
+    uint8_t type; // profile_value_type_t
+    uint8_t length; // bytes of text that follow the record in the file, without a NUL
+    union {
+        int64_t i64; // also used for int, and for the record size in the header
+        uint64_t u64;
+        double f;
+    } value;
+} profile_record_t;
+
+int profile_log_open(int fd);
+
+void profile_log_close(int fd);
+
+uint32_t profile_log_dropped(void);
+
+int profile_log_convert(int in_fd, int out_fd);
+
+/** Helpers for logging values into a file **/
+
+void log_frame_int(int fd, int frame_index, const char *tag, const char *parameter, int value);
+void log_frame_i64(int fd, int frame_index, const char *tag, const char *parameter,
+                   int64_t value);
+void log_frame_u64(int fd, int frame_index, const char *tag, const char *parameter,
+                   uint64_t value);
+void log_frame_f(int fd, int frame_index, const char *tag, const char *parameter, float value);
+void log_frame_str(int fd, int frame_index, const char *tag, const char *parameter,
+                   const char *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //POCL_AISA_DEMO_PROFILE_LOG_H
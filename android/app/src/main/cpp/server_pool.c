@@ -0,0 +1,150 @@
+//
+// Remote server bookkeeping of the image processor, see server_pool.h
+//
+
+#include "server_pool.h"
+
+#include <assert.h>
+#include <string.h>
+
+// smoothing of the latency of a server (higher means smoother)
+#define SERVER_LATENCY_ALPHA 0.8f
+
+/**
+ * @param pool to initialize
+ * @param server_count number of servers, 1 to SERVER_POOL_MAX_SERVERS
+ * @param retry_ms how long a lost server gets no frames before it is tried again
+ */
+void server_pool_init(server_pool_t *const pool, const int server_count, const int retry_ms) {
+    assert(server_count >= 1 && server_count <= SERVER_POOL_MAX_SERVERS);
+    memset(pool, 0, sizeof(server_pool_t));
+    pool->server_count = server_count;
+    pool->retry_ns = (int64_t) retry_ms * 1000000;
+}
+
+/**
+ * @param pool
+ * @param server index of the server
+ * @param now_ns current time
+ * @return 1 if frames can be sent to the server, either because it is not lost or because the
+ * retry interval has passed, otherwise 0
+ */
+int server_pool_usable(const server_pool_t *const pool, const int server, const int64_t now_ns) {
+    const int64_t lost_ts_ns = __atomic_load_n(&pool->servers[server].lost_ts_ns, __ATOMIC_ACQUIRE);
+    return 0 == lost_ts_ns || now_ns - lost_ts_ns >= pool->retry_ns;
+}
+
+/**
+ * @param pool
+ * @param now_ns current time
+ * @return mask with bit i set if server i is usable
+ */
+uint32_t server_pool_usable_mask(const server_pool_t *const pool, const int64_t now_ns) {
+    uint32_t mask = 0;
+    for (int i = 0; i < pool->server_count; i++) {
+        if (server_pool_usable(pool, i, now_ns)) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+/**
+ * pick the least loaded of the candidate servers. The load is the time a new frame is expected
+ * to take, the latency of the server times the frames it has to get through before. Servers
+ * without a latency yet go first, the one with the fewest frames in flight, so that every server
+ * is measured early on.
+ * @param pool
+ * @param candidates mask of the servers to choose from, e.g. the ones with a free lane
+ * @param now_ns current time
+ * @return the usable candidate with the lowest load, -1 if no candidate is usable
+ */
+int server_pool_choose(const server_pool_t *const pool, const uint32_t candidates,
+                       const int64_t now_ns) {
+    int best = -1;
+    int best_measured = 0;
+    float best_load = 0.0f;
+    for (int i = 0; i < pool->server_count; i++) {
+        if (0 == (candidates & (1u << i)) || !server_pool_usable(pool, i, now_ns)) {
+            continue;
+        }
+        float latency_ms;
+        __atomic_load(&pool->servers[i].latency_ms, &latency_ms, __ATOMIC_RELAXED);
+        const uint32_t in_flight = __atomic_load_n(&pool->servers[i].in_flight, __ATOMIC_RELAXED);
+        const int measured = latency_ms > 0.0f;
+        const float load = measured ? latency_ms * (float) (in_flight + 1) : (float) in_flight;
+        if (best < 0 || measured < best_measured ||
+            (measured == best_measured && load < best_load)) {
+            best = i;
+            best_measured = measured;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+/**
+ * count a frame in flight on the server. Submitting thread only.
+ */
+void server_pool_submit(server_pool_t *const pool, const int server) {
+    __atomic_fetch_add(&pool->servers[server].in_flight, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * count a frame out that was received from the server, which is not lost anymore if it was.
+ * Receiving thread only.
+ * @param pool
+ * @param server that ran the frame
+ * @param latency_ms of the frame
+ */
+void server_pool_receive(server_pool_t *const pool, const int server, const float latency_ms) {
+    server_state_t *const state = &pool->servers[server];
+    float smoothed = latency_ms;
+    if (state->latency_ms > 0.0f) {
+        smoothed = SERVER_LATENCY_ALPHA * state->latency_ms +
+                   (1.0f - SERVER_LATENCY_ALPHA) * latency_ms;
+    }
+    __atomic_store(&state->latency_ms, &smoothed, __ATOMIC_RELAXED);
+    state->received += 1;
+    __atomic_store_n(&state->lost_ts_ns, 0, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&state->in_flight, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * stop sending frames to the server for the retry interval. Can be called from either thread,
+ * e.g. by the submitting thread when a frame could not be enqueued.
+ * @param pool
+ * @param server that failed
+ * @param now_ns current time, not 0
+ */
+void server_pool_mark_lost(server_pool_t *const pool, const int server, const int64_t now_ns) {
+    assert(0 != now_ns);
+    __atomic_store_n(&pool->servers[server].lost_ts_ns, now_ns, __ATOMIC_RELEASE);
+}
+
+/**
+ * count a frame out that failed on the server and mark the server lost. Receiving thread only.
+ * @param pool
+ * @param server that ran the frame
+ * @param now_ns current time, not 0
+ */
+void server_pool_fail(server_pool_t *const pool, const int server, const int64_t now_ns) {
+    pool->servers[server].failed += 1;
+    server_pool_mark_lost(pool, server, now_ns);
+    __atomic_fetch_sub(&pool->servers[server].in_flight, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @param pool
+ * @param server index of the server
+ * @return a copy of the state of the server, the counters may be a frame behind
+ */
+server_state_t server_pool_get(const server_pool_t *const pool, const int server) {
+    server_state_t state;
+    state.in_flight = __atomic_load_n(&pool->servers[server].in_flight, __ATOMIC_RELAXED);
+    __atomic_load(&pool->servers[server].latency_ms, &state.latency_ms, __ATOMIC_RELAXED);
+    state.received = pool->servers[server].received;
+    state.failed = pool->servers[server].failed;
+    state.lost_ts_ns = __atomic_load_n(&pool->servers[server].lost_ts_ns, __ATOMIC_ACQUIRE);
+    return state;
+}
@@ -0,0 +1,56 @@
+//
+// Load estimates of the remote servers that the lanes of the image processor offload to, see
+// MULTI_SERVER. The submitting thread picks the server for a frame and counts it in flight, the
+// receiving thread counts it out again together with its latency, or marks the server as lost
+// when the frame failed. A lost server gets no frames until the retry interval has passed, then
+// it is given frames again, which either succeed or mark it lost for another interval.
+//
+
+#ifndef POCL_AISA_DEMO_SERVER_POOL_H
+#define POCL_AISA_DEMO_SERVER_POOL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SERVER_POOL_MAX_SERVERS 4
+
+typedef struct {
+    uint32_t in_flight; // frames submitted and not received yet
+    float latency_ms; // smoothed latency of the received frames, 0 before the first one
+    uint32_t received; // frames received successfully
+    uint32_t failed; // frames that failed on the server
+    int64_t lost_ts_ns; // when the server was last marked lost, 0 while it is not lost
+} server_state_t;
+
+typedef struct {
+    int server_count;
+    int64_t retry_ns; // how long a lost server gets no frames
+    server_state_t servers[SERVER_POOL_MAX_SERVERS];
+} server_pool_t;
+
+void server_pool_init(server_pool_t *pool, int server_count, int retry_ms);
+
+int server_pool_usable(const server_pool_t *pool, int server, int64_t now_ns);
+
+uint32_t server_pool_usable_mask(const server_pool_t *pool, int64_t now_ns);
+
+int server_pool_choose(const server_pool_t *pool, uint32_t candidates, int64_t now_ns);
+
+void server_pool_submit(server_pool_t *pool, int server);
+
+void server_pool_receive(server_pool_t *pool, int server, float latency_ms);
+
+void server_pool_mark_lost(server_pool_t *pool, int server, int64_t now_ns);
+
+void server_pool_fail(server_pool_t *pool, int server, int64_t now_ns);
+
+server_state_t server_pool_get(const server_pool_t *pool, int server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //POCL_AISA_DEMO_SERVER_POOL_H
@@ -63,23 +63,6 @@ int64_t get_diff_timespec(const struct timespec *const start,
   return diff * 1000000000 + diff_ns;
 }
 
-void log_frame_int(int fd, int frame_index, const char *tag, const char *parameter, int value) {
-    dprintf(fd, "%d,%s,%s,%d\n", frame_index, tag, parameter, value);
-}
-
-void log_frame_i64(int fd, int frame_index, const char *tag, const char *parameter, int64_t value) {
-    dprintf(fd, "%d,%s,%s,%ld\n", frame_index, tag, parameter, value);
-}
-
-void log_frame_f(int fd, int frame_index, const char *tag, const char *parameter, float value) {
-    dprintf(fd, "%d,%s,%s,%f\n", frame_index, tag, parameter, value);
-}
-
-void
-log_frame_str(int fd, int frame_index, const char *tag, const char *parameter, const char *value) {
-    dprintf(fd, "%d,%s,%s,%s\n", frame_index, tag, parameter, value);
-}
-
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -159,6 +159,92 @@ write_buffer_yuv(const yuv_codec_context_t *ctx, const uint8_t *inp_host_buf, si
 
 }
 
+/**
+ * record the encoding and decoding kernels into a command buffer
+ * @param cxt yuv context
+ * @param inp_buf yuv image to compress
+ * @param out_buf resulting compressed yuv image
+ * @param command_buffer output: the recorded command buffer
+ * @return CL_SUCCESS if everything goes well
+ */
+static cl_int record_yuv_compression(yuv_codec_context_t *cxt, cl_mem inp_buf, cl_mem out_buf,
+                                     cl_command_buffer_khr *command_buffer) {
+    cl_int status;
+
+    status = clSetKernelArg(cxt->enc_y_kernel, 0, sizeof(cl_mem), &inp_buf);
+    status |= clSetKernelArg(cxt->enc_uv_kernel, 0, sizeof(cl_mem), &inp_buf);
+    status |= clSetKernelArg(cxt->dec_y_kernel, 3, sizeof(cl_mem), &out_buf);
+    status |= clSetKernelArg(cxt->dec_uv_kernel, 3, sizeof(cl_mem), &out_buf);
+    CHECK_AND_RETURN(status, "failed to set kernel args");
+
+    cl_command_queue queues[] = {cxt->enc_queue, cxt->dec_queue};
+    cl_uint num_queues = (cxt->enc_queue == cxt->dec_queue) ? 1 : 2;
+    cl_command_buffer_properties_khr properties[] = {CL_COMMAND_BUFFER_FLAGS_KHR,
+                                                     CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR, 0};
+    cl_command_buffer_khr recording = clCreateCommandBufferKHR(num_queues, queues, properties,
+                                                               &status);
+    CHECK_AND_RETURN(status, "could not create yuv command buffer");
+
+    cl_sync_point_khr enc_y_sync, enc_uv_sync, dec_uv_wait_syncs[2];
+    status = clCommandNDRangeKernelKHR(recording, cxt->enc_queue, NULL, cxt->enc_y_kernel,
+                                       cxt->work_dim, NULL, cxt->y_global_size, NULL, 0, NULL,
+                                       &enc_y_sync, NULL);
+    status |= clCommandNDRangeKernelKHR(recording, cxt->enc_queue, NULL, cxt->enc_uv_kernel,
+                                        cxt->work_dim, NULL, cxt->uv_global_size, NULL, 0, NULL,
+                                        &enc_uv_sync, NULL);
+    // same dependencies as when enqueueing the kernels one by one
+    dec_uv_wait_syncs[0] = enc_uv_sync;
+    status |= clCommandNDRangeKernelKHR(recording, cxt->dec_queue, NULL, cxt->dec_y_kernel,
+                                        cxt->work_dim, NULL, cxt->y_global_size, NULL, 1,
+                                        &enc_y_sync, &dec_uv_wait_syncs[1], NULL);
+    status |= clCommandNDRangeKernelKHR(recording, cxt->dec_queue, NULL, cxt->dec_uv_kernel,
+                                        cxt->work_dim, NULL, cxt->uv_global_size, NULL, 2,
+                                        dec_uv_wait_syncs, NULL, NULL);
+    if (CL_SUCCESS == status) {
+        status = clFinalizeCommandBufferKHR(recording);
+    }
+    if (CL_SUCCESS != status) {
+        clReleaseCommandBufferKHR(recording);
+    }
+    CHECK_AND_RETURN(status, "could not record yuv compression");
+
+    *command_buffer = recording;
+    return CL_SUCCESS;
+}
+
+/**
+ * get the command buffer of a pair of buffers, recording it the first time the pair is used
+ * @param cxt yuv context with the recordings
+ * @param inp_buf yuv image to compress
+ * @param out_buf resulting compressed yuv image
+ * @param command_buffer output: command buffer to replay, NULL if there is no room to record
+ * @return CL_SUCCESS if everything goes well
+ */
+static cl_int get_yuv_recording(yuv_codec_context_t *cxt, cl_mem inp_buf, cl_mem out_buf,
+                                cl_command_buffer_khr *command_buffer) {
+    for (int i = 0; i < cxt->num_recordings; i++) {
+        if (cxt->recordings[i].inp_buf == inp_buf && cxt->recordings[i].out_buf == out_buf) {
+            *command_buffer = cxt->recordings[i].command_buffer;
+            return CL_SUCCESS;
+        }
+    }
+
+    *command_buffer = NULL;
+    if (YUV_MAX_RECORDINGS == cxt->num_recordings) {
+        return CL_SUCCESS;
+    }
+
+    yuv_recording_t *rec = &(cxt->recordings[cxt->num_recordings]);
+    cl_int status = record_yuv_compression(cxt, inp_buf, out_buf, &(rec->command_buffer));
+    CHECK_AND_RETURN(status, "failed to record yuv compression");
+    rec->inp_buf = inp_buf;
+    rec->out_buf = out_buf;
+    cxt->num_recordings++;
+
+    *command_buffer = rec->command_buffer;
+    return CL_SUCCESS;
+}
+
 /**
  * compress the image with the given context
  * @param cxt yuv context
@@ -169,40 +255,53 @@ write_buffer_yuv(const yuv_codec_context_t *ctx, const uint8_t *inp_host_buf, si
  * @param result_event event that can be waited on when compression is done
  * @return CL_SUCCESS if everything goes well
  */
-cl_int enqueue_yuv_compression(const yuv_codec_context_t *cxt, cl_event wait_event, cl_mem inp_buf,
+cl_int enqueue_yuv_compression(yuv_codec_context_t *cxt, cl_event wait_event, cl_mem inp_buf,
                                cl_mem out_buf, event_array_t *event_array, cl_event *result_event) {
     cl_int status;
     cl_event enc_y_event, enc_uv_event, dec_y_event, dec_uv_event, mig_event;
 
-    status = clSetKernelArg(cxt->enc_y_kernel, 0, sizeof(cl_mem), &inp_buf);
-    status |= clSetKernelArg(cxt->enc_uv_kernel, 0, sizeof(cl_mem), &inp_buf);
-    status |= clSetKernelArg(cxt->dec_y_kernel, 3, sizeof(cl_mem), &out_buf);
-    status |= clSetKernelArg(cxt->dec_uv_kernel, 3, sizeof(cl_mem), &out_buf);
-    CHECK_AND_RETURN(status, "failed to set kernel args");
+    cl_command_buffer_khr command_buffer = NULL;
+    if (cxt->replay_command_buffer) {
+        status = get_yuv_recording(cxt, inp_buf, out_buf, &command_buffer);
+        CHECK_AND_RETURN(status, "failed to get yuv command buffer");
+    }
 
-    status = clEnqueueNDRangeKernel(cxt->enc_queue, cxt->enc_y_kernel, cxt->work_dim, NULL,
-                                    cxt->y_global_size, NULL, 1, &wait_event, &enc_y_event);
-    CHECK_AND_RETURN(status, "failed to enqueue enc_y_kernel");
-    append_to_event_array(event_array, enc_y_event, VAR_NAME(enc_y_event));
-
-    status = clEnqueueNDRangeKernel(cxt->enc_queue, cxt->enc_uv_kernel, cxt->work_dim, NULL,
-                                    cxt->uv_global_size, NULL, 1, &wait_event, &enc_uv_event);
-    CHECK_AND_RETURN(status, "failed to enqueue enc_uv_kernel");
-    append_to_event_array(event_array, enc_uv_event, VAR_NAME(enc_uv_event));
-
-    status = clEnqueueNDRangeKernel(cxt->dec_queue, cxt->dec_y_kernel, cxt->work_dim, NULL,
-                                    cxt->y_global_size, NULL, 1, &enc_y_event, &dec_y_event);
-    CHECK_AND_RETURN(status, "failed to enqueue dec_y_kernel");
-    append_to_event_array(event_array, dec_y_event, VAR_NAME(dec_y_event));
-
-    // we have to wait for both since dec_y and dec_uv write to the same buffer and there is
-    // no guarantee what happens if both dec_y and dec_uv write at the same time.
-    cl_event dec_uv_wait_events[] = {enc_uv_event, dec_y_event};
-    status = clEnqueueNDRangeKernel(cxt->dec_queue, cxt->dec_uv_kernel, cxt->work_dim, NULL,
-                                    cxt->uv_global_size, NULL, 2, dec_uv_wait_events,
-                                    &dec_uv_event);
-    CHECK_AND_RETURN(status, "failed to enqueue dec_uv_kernel");
-    append_to_event_array(event_array, dec_uv_event, VAR_NAME(dec_uv_event));
+    if (NULL != command_buffer) {
+        status = clEnqueueCommandBufferKHR(0, NULL, command_buffer, 1, &wait_event,
+                                           &dec_uv_event);
+        CHECK_AND_RETURN(status, "failed to replay yuv compression");
+        append_to_event_array(event_array, dec_uv_event, VAR_NAME(replay_event));
+    } else {
+        status = clSetKernelArg(cxt->enc_y_kernel, 0, sizeof(cl_mem), &inp_buf);
+        status |= clSetKernelArg(cxt->enc_uv_kernel, 0, sizeof(cl_mem), &inp_buf);
+        status |= clSetKernelArg(cxt->dec_y_kernel, 3, sizeof(cl_mem), &out_buf);
+        status |= clSetKernelArg(cxt->dec_uv_kernel, 3, sizeof(cl_mem), &out_buf);
+        CHECK_AND_RETURN(status, "failed to set kernel args");
+
+        status = clEnqueueNDRangeKernel(cxt->enc_queue, cxt->enc_y_kernel, cxt->work_dim, NULL,
+                                        cxt->y_global_size, NULL, 1, &wait_event, &enc_y_event);
+        CHECK_AND_RETURN(status, "failed to enqueue enc_y_kernel");
+        append_to_event_array(event_array, enc_y_event, VAR_NAME(enc_y_event));
+
+        status = clEnqueueNDRangeKernel(cxt->enc_queue, cxt->enc_uv_kernel, cxt->work_dim, NULL,
+                                        cxt->uv_global_size, NULL, 1, &wait_event, &enc_uv_event);
+        CHECK_AND_RETURN(status, "failed to enqueue enc_uv_kernel");
+        append_to_event_array(event_array, enc_uv_event, VAR_NAME(enc_uv_event));
+
+        status = clEnqueueNDRangeKernel(cxt->dec_queue, cxt->dec_y_kernel, cxt->work_dim, NULL,
+                                        cxt->y_global_size, NULL, 1, &enc_y_event, &dec_y_event);
+        CHECK_AND_RETURN(status, "failed to enqueue dec_y_kernel");
+        append_to_event_array(event_array, dec_y_event, VAR_NAME(dec_y_event));
+
+        // we have to wait for both since dec_y and dec_uv write to the same buffer and there is
+        // no guarantee what happens if both dec_y and dec_uv write at the same time.
+        cl_event dec_uv_wait_events[] = {enc_uv_event, dec_y_event};
+        status = clEnqueueNDRangeKernel(cxt->dec_queue, cxt->dec_uv_kernel, cxt->work_dim, NULL,
+                                        cxt->uv_global_size, NULL, 2, dec_uv_wait_events,
+                                        &dec_uv_event);
+        CHECK_AND_RETURN(status, "failed to enqueue dec_uv_kernel");
+        append_to_event_array(event_array, dec_uv_event, VAR_NAME(dec_uv_event));
+    }
 
     // move the intermediate buffers back to the phone after decompression.
     // Since we don't care about the contents, the latest state of the buffer is not moved
@@ -238,6 +337,10 @@ cl_int destroy_yuv_context(yuv_codec_context_t **context) {
         return 0;
     }
 
+    for (int i = 0; i < c->num_recordings; i++) {
+        clReleaseCommandBufferKHR(c->recordings[i].command_buffer);
+    }
+
     COND_REL_MEM(c->out_enc_y_buf)
 
     COND_REL_MEM(c->out_enc_uv_buf)
@@ -11,8 +11,21 @@ extern "C" {
 
 #include <rename_opencl.h>
 #include <CL/cl.h>
+#include <CL/cl_ext.h>
 #include "event_logger.h"
 
+// enough for every buffer set of a lane, see MAX_LANE_DEPTH
+#define YUV_MAX_RECORDINGS 4
+
+/**
+ * the kernels recorded as a command buffer for one pair of input and output buffers
+ */
+typedef struct {
+    cl_command_buffer_khr command_buffer;
+    cl_mem inp_buf;
+    cl_mem out_buf;
+} yuv_recording_t;
+
 typedef struct {
     cl_mem out_enc_y_buf;
     cl_mem out_enc_uv_buf;
@@ -34,6 +47,12 @@ typedef struct {
     // compressing
     int profile_compressed_size;
     size_t compressed_size;
+
+    // replay the kernels from a command buffer recorded once per pair of inp and out buffers,
+    // the buffer sets of a lane take turns
+    int replay_command_buffer;
+    yuv_recording_t recordings[YUV_MAX_RECORDINGS];
+    int num_recordings;
 } yuv_codec_context_t;
 
 yuv_codec_context_t *create_yuv_context();
@@ -49,7 +68,7 @@ write_buffer_yuv(const yuv_codec_context_t *ctx, const uint8_t *inp_host_buf, si
                  event_array_t *event_array, cl_event *result_event);
 
 cl_int
-enqueue_yuv_compression(const yuv_codec_context_t *cxt, cl_event wait_event, cl_mem inp_buf,
+enqueue_yuv_compression(yuv_codec_context_t *cxt, cl_event wait_event, cl_mem inp_buf,
                         cl_mem out_buf, event_array_t *event_array,
                         cl_event *result_event);
 
@@ -264,6 +264,7 @@ public class BenchmarkService extends Service {
                 ImageFormat.YUV_420_888, imageAvailableLock, configFlags, null, deviceIndex,
                 enableSegmentation, uris[0], null, enableQualityAlgorithm, runtimeEval,
                 lockCodec, 30, 1, null);
+        poclImageProcessor.setSelectionAlgorithm(configStore.getSelectionAlgorithm());
 
         poclImageProcessor.setOrientation(false);
 
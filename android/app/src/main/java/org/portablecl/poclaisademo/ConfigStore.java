@@ -2,6 +2,7 @@ package org.portablecl.poclaisademo;
 
 import static org.portablecl.poclaisademo.DevelopmentVariables.VERBOSITY;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.NO_COMPRESSION;
+import static org.portablecl.poclaisademo.JNIPoclImageProcessor.SELECT_ALGORITHM_STAGED;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.YUV_COMPRESSION;
 
 import android.content.Context;
@@ -34,6 +35,7 @@ public class ConfigStore {
     private final static String ipAddressTextKey = keyPrefix + "ipaddresstextkey";
 
     private final static String qualityAlgorithmKey = keyPrefix + "qualityalgorithmkey";
+    private final static String selectionAlgorithmKey = keyPrefix + "selectionalgorithmkey";
     private final static String runtimeEvalKey = keyPrefix + "runtimeevalkey";
     private final static String lockCodecKey = keyPrefix + "lockcodeckey";
 
@@ -139,6 +141,18 @@ public class ConfigStore {
         editor.putBoolean(qualityAlgorithmKey, value);
     }
 
+    public int getSelectionAlgorithm() {
+        return preferences.getInt(selectionAlgorithmKey, SELECT_ALGORITHM_STAGED);
+    }
+
+    public void setSelectionAlgorithm(int algorithm) {
+        if (VERBOSITY >= 2) {
+            Log.println(Log.INFO, logTag, String.format(Locale.US, "storing selection algorithm " +
+                    "as: %d", algorithm));
+        }
+        editor.putInt(selectionAlgorithmKey, algorithm);
+    }
+
     public boolean getRuntimeEvalOption() {
         return preferences.getBoolean(runtimeEvalKey, false);
     }
@@ -26,6 +26,8 @@ public class JNIPoclImageProcessor {
             populateCompressionOptions();
     public final static int ENABLE_PROFILING = (1 << 8);
     public final static int LOCAL_ONLY = (1 << 9);
+    public final static int REPLAY_COMMAND_BUFFERS = (1 << 10);
+    public final static int SKIP_STATIC_FRAMES = (1 << 11);
     public final static int LOCAL_DEVICE = 0;
     public final static int PASSTHRU_DEVICE = 1;
     public final static int REMOTE_DEVICE = 2;
@@ -33,6 +35,29 @@ public class JNIPoclImageProcessor {
 
     public final static int SEGMENT_4B = (1 << 12);
     public final static int SEGMENT_RLE = (1 << 13);
+    public final static int RATE_CONTROL = (1 << 14);
+    public final static int MULTI_SERVER = (1 << 15);
+    public final static int LOW_RES_MODEL = (1 << 16);
+
+    // how the codec is selected with auto codec select on, passed as doAlgorithm
+    public final static int SELECT_ALGORITHM_NONE = 0;
+    public final static int SELECT_ALGORITHM_STAGED = 1;
+    public final static int SELECT_ALGORITHM_BANDIT = 2;
+    public final static int SELECT_ALGORITHM_PREDICT = 3;
+    /**
+     * names of the selection algorithms that can be picked, indexed by algorithm
+     */
+    public final static String[] selectionAlgorithmNames = {"none", "staged", "bandit",
+            "predict"};
+
+    // what to do with camera frames when all lanes are busy, see setBackpressurePolicy
+    public final static int BACKPRESSURE_WAIT = 0;
+    public final static int BACKPRESSURE_LATEST_FRAME = 1;
+    public final static int BACKPRESSURE_DEADLINE = 2;
+
+    // receiveImage: the frame failed on its server, but the other servers take the next frames.
+    // Must match poclImageProcessorV2.h
+    public final static int FRAME_DROPPED = -102;
 
     /**
      * function that maps a compression option to its string representation
@@ -115,7 +140,7 @@ public class JNIPoclImageProcessor {
 
     public static native int initPoclImageProcessorV2(int configFlags, AssetManager jAssetManager,
                                                       int width, int height, int fd, int max_lanes,
-                                                      int doAlgorithm, int runtimeEval,
+                                                      int laneDepth, int doAlgorithm, int runtimeEval,
                                                       int lockCodec, String serviceName,
                                                       int calibrate);
 
@@ -125,6 +150,8 @@ public class JNIPoclImageProcessor {
 
     public static native int dequeue_spot(int timeout, int dev_type);
 
+    public static native void setBackpressurePolicy(int mode, int deadlineMs);
+
     public static native int poclSelectCodecAuto();
 
     public static native int poclSubmitYUVImage(int deviceIndex, int doSegment, int compressionType,
@@ -465,6 +465,7 @@ public class MainActivity extends AppCompatActivity {
                 imageAvailableLock, configFlags, counter, LOCAL_DEVICE,
                 segmentationSwitch.isChecked(), uris[0], statLogger, enableQualityAlgorithm,
                 runtimeEval, lockCodec, targetFPS, pipelineLanes, calibrateUri);
+        poclImageProcessor.setSelectionAlgorithm(configStore.getSelectionAlgorithm());
 
         // code to handle the quality input
         qualityText = binding.compressionEditText;
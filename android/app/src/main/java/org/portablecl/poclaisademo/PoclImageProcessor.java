@@ -4,12 +4,16 @@ import static org.portablecl.poclaisademo.DevelopmentVariables.DEBUGEXECUTION;
 import static org.portablecl.poclaisademo.DevelopmentVariables.ENABLEFALLBACK;
 import static org.portablecl.poclaisademo.DevelopmentVariables.VERBOSITY;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.ENABLE_PROFILING;
+import static org.portablecl.poclaisademo.JNIPoclImageProcessor.FRAME_DROPPED;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.HEVC_COMPRESSION;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.JPEG_COMPRESSION;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.JPEG_IMAGE;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.LOCAL_DEVICE;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.LOCAL_ONLY;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.NO_COMPRESSION;
+import static org.portablecl.poclaisademo.JNIPoclImageProcessor.SELECT_ALGORITHM_NONE;
+import static org.portablecl.poclaisademo.JNIPoclImageProcessor.SELECT_ALGORITHM_STAGED;
+import static org.portablecl.poclaisademo.JNIPoclImageProcessor.selectionAlgorithmNames;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.SOFTWARE_HEVC_COMPRESSION;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.YUV_COMPRESSION;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.dequeue_spot;
@@ -42,6 +46,7 @@ public class PoclImageProcessor {
 
     public final static int MAX_FPS = 30;
     public final static int MAX_LANES = 64;
+    public final static int MAX_LANE_DEPTH = 4;
     /**
      * a semaphore used to sync the image process loop with available images.
      * zero starting permits, so a lock can only be acquired when the
@@ -69,6 +74,10 @@ public class PoclImageProcessor {
     private final int configFlags;
     private final StatLogger statLogger;
     private final boolean enableQualityAlgorithm;
+    /**
+     * algorithm that selects the codec when enableQualityAlgorithm is set
+     */
+    private int selectionAlgorithm = SELECT_ALGORITHM_STAGED;
     private final boolean runtimeEval;
     private final boolean lockCodec;
     public int inferencingDevice;
@@ -89,6 +98,10 @@ public class PoclImageProcessor {
     private float lastIou = -4.0f;
     private int targetFPS;
     private int pipelineLanes;
+    /**
+     * frames that can be in flight in each lane, each with its own device buffers
+     */
+    private int laneDepth = 1;
 
     private final Uri vidUri;
 
@@ -227,6 +240,19 @@ public class PoclImageProcessor {
         return lanes;
     }
 
+    public static int sanitizeLaneDepth(int depth) {
+        if (depth > MAX_LANE_DEPTH) {
+            Log.println(Log.WARN, "PoclImageProcessor.java", "higher lane depth than allowed, " +
+                    "capping to MAX_LANE_DEPTH");
+            depth = MAX_LANE_DEPTH;
+        } else if (depth < 1) {
+            Log.println(Log.WARN, "PoclImageProcessor.java", "lower lane depth than allowed, " +
+                    "capping to 1");
+            depth = 1;
+        }
+        return depth;
+    }
+
     /**
      * indicate that the orientations are swapped
      *
@@ -268,6 +294,24 @@ public class PoclImageProcessor {
         this.pipelineLanes = sanitizePipelineLanes(lanes);
     }
 
+    public void setLaneDepth(int depth) {
+
+        this.laneDepth = sanitizeLaneDepth(depth);
+    }
+
+    /**
+     * Set how the codec is selected when the quality algorithm is enabled, unknown algorithms
+     * fall back to the staged one. Takes effect when the processor is started.
+     *
+     * @param algorithm one of the SELECT_ALGORITHM values
+     */
+    public void setSelectionAlgorithm(int algorithm) {
+        if (algorithm <= SELECT_ALGORITHM_NONE || algorithm >= selectionAlgorithmNames.length) {
+            algorithm = SELECT_ALGORITHM_STAGED;
+        }
+        this.selectionAlgorithm = algorithm;
+    }
+
     /**
      * Set the imageReader to use
      *
@@ -389,13 +433,13 @@ public class PoclImageProcessor {
             try {
 
                 AssetManager assetManager = context.getAssets();
-                do_algorithm = enableQualityAlgorithm ? 1 : 0;
+                do_algorithm = enableQualityAlgorithm ? selectionAlgorithm : SELECT_ALGORITHM_NONE;
                 runtime_eval = runtimeEval ? 1 : 0;
                 lock_codec = lockCodec ? 1 : 0;
                 status = initPoclImageProcessorV2(runtimeConfigFlags, assetManager,
                         captureSize.getWidth(), captureSize.getHeight(), logFd,
-                        this.pipelineLanes, do_algorithm, runtime_eval, lock_codec,
-                        runtimeServiceName, calibrateFd);
+                        this.pipelineLanes, this.laneDepth, do_algorithm, runtime_eval,
+                        lock_codec, runtimeServiceName, calibrateFd);
 
 
                 Log.println(Log.WARN, "temp ", " init return status: " + status);
@@ -496,7 +540,8 @@ public class PoclImageProcessor {
 
                     rotation = orientationsSwapped ? 90 : 0;
                     do_segment = this.doSegment ? 1 : 0;
-                    do_algorithm = enableQualityAlgorithm ? 1 : 0;
+                    do_algorithm = enableQualityAlgorithm ? selectionAlgorithm :
+                            SELECT_ALGORITHM_NONE;
 
                     Image.Plane[] planes = image.getPlanes();
 
@@ -695,6 +740,11 @@ public class PoclImageProcessor {
             energy = statLogger.getCurrentEnergy();
             status = receiveImage(detection_results, segmentation_results, dataExchange, energy);
 
+            // there are no results to draw, the next frames go to the other servers
+            if (status == FRAME_DROPPED) {
+                continue;
+            }
+
             if (status != 0) {
                 Log.println(Log.WARN, "poclimageprocessor",
                         "jni receive image returned error: " + status);
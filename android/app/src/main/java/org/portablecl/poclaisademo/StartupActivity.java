@@ -12,8 +12,10 @@ import static org.portablecl.poclaisademo.JNIPoclImageProcessor.JPEG_IMAGE;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.LOCAL_ONLY;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.NO_COMPRESSION;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.SEGMENT_4B;
+import static org.portablecl.poclaisademo.JNIPoclImageProcessor.SELECT_ALGORITHM_STAGED;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.SOFTWARE_HEVC_COMPRESSION;
 import static org.portablecl.poclaisademo.JNIPoclImageProcessor.YUV_COMPRESSION;
+import static org.portablecl.poclaisademo.JNIPoclImageProcessor.selectionAlgorithmNames;
 import static org.portablecl.poclaisademo.PoclImageProcessor.sanitizePipelineLanes;
 import static org.portablecl.poclaisademo.PoclImageProcessor.sanitizeTargetFPS;
 import static java.lang.Character.isDigit;
@@ -44,6 +46,7 @@ import org.portablecl.poclaisademo.databinding.ActivityStartupBinding;
 
 import java.time.LocalDateTime;
 import java.time.format.DateTimeFormatter;
+import java.util.Arrays;
 
 
 public class StartupActivity extends AppCompatActivity {
@@ -355,6 +358,10 @@ public class StartupActivity extends AppCompatActivity {
     private Button startButton;
     private Button benchmarkButton;
     private Switch qualityAlgorithmSwitch;
+    /**
+     * which algorithm the auto codec select runs
+     */
+    private Spinner selectionAlgorithmSpinner;
     /**
      * A listener that hands interactions with the mode switch.
      * This switch sets the option to disable remote
@@ -472,8 +479,9 @@ public class StartupActivity extends AppCompatActivity {
                     "'HH_mm_ss"));
 
             if (enableLoggingSwitch.isChecked()) {
-                String pocl_file = "pocl_log_" + datetimeText + ".csv";
-                Uri uri = createLogFile(pocl_file);
+                // binary records, turned into csv with pcapp's profileToCsv
+                String pocl_file = "pocl_log_" + datetimeText + ".bin";
+                Uri uri = createLogFile(pocl_file, "application/octet-stream");
                 i.putExtra(POCLLOGFILEURIKEY, uri.toString());
 
                 String monitor_file = "monitor_log_" + datetimeText + ".csv";
@@ -490,6 +498,8 @@ public class StartupActivity extends AppCompatActivity {
             configStore.setJpegQuality(jpegQuality);
             configStore.setIpAddressText(value);
             configStore.setQualityAlgorithmOption(qualityAlgorithmSwitch.isChecked());
+            configStore.setSelectionAlgorithm(selectionAlgorithmSpinner.getSelectedItemPosition()
+                    + SELECT_ALGORITHM_STAGED);
             configStore.setRuntimeEvalOption(runtimeEvalSwitch.isChecked());
             configStore.setLockCodecOption(lockCodecSwitch.isChecked());
             configStore.setTargetFPS(targetFPS);
@@ -536,10 +546,14 @@ public class StartupActivity extends AppCompatActivity {
      * @return an uri to the log file
      */
     private Uri createLogFile(String fileName) {
+        return createLogFile(fileName, "text/comma-separated-values");
+    }
+
+    private Uri createLogFile(String fileName, String mimeType) {
         ContentValues values = new ContentValues();
         values.put(MediaStore.MediaColumns.DISPLAY_NAME, fileName); // this is the name
         // of the file
-        values.put(MediaStore.MediaColumns.MIME_TYPE, "text/comma-separated-values");
+        values.put(MediaStore.MediaColumns.MIME_TYPE, mimeType);
         values.put(MediaStore.MediaColumns.RELATIVE_PATH, Environment.DIRECTORY_DOWNLOADS);
         Uri uri = getContentResolver().insert(MediaStore.Files.getContentUri("external"),
                 values);
@@ -613,6 +627,19 @@ public class StartupActivity extends AppCompatActivity {
             qualityAlgorithmSwitch.performClick();
         }
 
+        // no algorithm is the switch being off, so the entries start at the staged one
+        selectionAlgorithmSpinner = binding.selectionAlgorithmSpinner;
+        ArrayAdapter<String> algorithmEntries = new ArrayAdapter<>(this,
+                android.R.layout.simple_spinner_dropdown_item,
+                Arrays.copyOfRange(selectionAlgorithmNames, SELECT_ALGORITHM_STAGED,
+                        selectionAlgorithmNames.length));
+        selectionAlgorithmSpinner.setAdapter(algorithmEntries);
+        int selectionAlgorithm = configStore.getSelectionAlgorithm();
+        if (selectionAlgorithm >= SELECT_ALGORITHM_STAGED &&
+                selectionAlgorithm < selectionAlgorithmNames.length) {
+            selectionAlgorithmSpinner.setSelection(selectionAlgorithm - SELECT_ALGORITHM_STAGED);
+        }
+
         runtimeEvalSwitch = binding.runtimeEvalSwitch;
         runtimeEvalSwitch.setOnClickListener(runtimeEvalSwitchListener);
         if (configStore.getRuntimeEvalOption()) {
@@ -85,6 +85,38 @@ typedef CL_API_ENTRY cl_int
     void *driver_id
 );
 
+/***************************************************************
+cl_pocl_mem_manager_stats
+***************************************************************/
+#define cl_pocl_mem_manager_stats 1
+#define CL_POCL_MEM_MANAGER_STATS_EXTENSION_NAME \
+    "cl_pocl_mem_manager_stats"
+
+/* Counters of the runtime object allocator, only available when pocl is
+   built with USE_POCL_MEMMANAGER. Once the free lists are warm, the
+   allocated counters stay constant. */
+typedef struct _cl_mem_manager_stats_pocl
+{
+  /* objects that had to be allocated from the heap */
+  cl_ulong events_allocated;
+  cl_ulong commands_allocated;
+  cl_ulong event_nodes_allocated;
+  /* batches of free objects moved between a thread and the shared depot */
+  cl_ulong depot_transfers;
+  /* free objects given back to the heap because the depot was full */
+  cl_ulong objects_freed;
+} cl_mem_manager_stats_pocl;
+
+extern CL_API_ENTRY cl_int CL_API_CALL
+clGetMemManagerStatsPOCL(
+    cl_mem_manager_stats_pocl *stats
+);
+
+typedef CL_API_ENTRY cl_int
+(CL_API_CALL *clGetMemManagerStatsPOCL_fn)(
+    cl_mem_manager_stats_pocl *stats
+);
+
 /* cl_ext_buffer_device_address (experimental stage)
 
    TODO:
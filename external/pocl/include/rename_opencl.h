@@ -138,6 +138,7 @@
 
 /* cl_khr_command_buffer */
 #define clCreateCommandBufferKHR POclCreateCommandBufferKHR
+#define clFinalizeCommandBufferKHR POclFinalizeCommandBufferKHR
 #define clRetainCommandBufferKHR POclRetainCommandBufferKHR
 #define clReleaseCommandBufferKHR POclReleaseCommandBufferKHR
 #define clGetCommandBufferInfoKHR POclGetCommandBufferInfoKHR
@@ -155,5 +156,6 @@
 /* PoCL extensions */
 #define clSetContentSizeBufferPoCL POclSetContentSizeBufferPoCL
 #define clAddDevicePOCL POclAddDevicePOCL
+#define clGetMemManagerStatsPOCL POclGetMemManagerStatsPOCL
 
 #endif
@@ -213,6 +213,10 @@ CL_API_SUFFIX__VERSION_1_2
   if (strcmp (func_name, "clAddDevicePOCL") == 0)
     return (void *)&POname (clAddDevicePOCL);
 
+  /* cl_pocl_mem_manager_stats */
+  if (strcmp (func_name, "clGetMemManagerStatsPOCL") == 0)
+    return (void *)&POname (clGetMemManagerStatsPOCL);
+
   POCL_MSG_ERR ("unknown platform extension requested: %s\n", func_name);
   return NULL;
 }
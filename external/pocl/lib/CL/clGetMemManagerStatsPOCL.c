@@ -0,0 +1,42 @@
+/* OpenCL runtime library: clGetMemManagerStatsPOCL()
+
+   Copyright (c) 2026 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#include "pocl_cl.h"
+#include "pocl_mem_management.h"
+
+CL_API_ENTRY cl_int CL_API_CALL
+POname(clGetMemManagerStatsPOCL) (cl_mem_manager_stats_pocl *stats)
+CL_API_SUFFIX__VERSION_1_2
+{
+  POCL_RETURN_ERROR_COND ((stats == NULL), CL_INVALID_VALUE);
+
+#ifdef USE_POCL_MEMMANAGER
+  pocl_mem_manager_get_stats (stats);
+  return CL_SUCCESS;
+#else
+  POCL_MSG_ERR ("pocl was built without USE_POCL_MEMMANAGER\n");
+  return CL_INVALID_OPERATION;
+#endif
+}
+
+POsym (clGetMemManagerStatsPOCL)
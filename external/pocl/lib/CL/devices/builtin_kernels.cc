@@ -325,6 +325,7 @@ BIKD pocl_BIDescriptors[BIKERNELS] = {
              BIArg("int", "inp_format", POD_ARG_32b),
              BIArg("unsigned int*", "output", WRITE_BUF),
              BIArg("unsigned char*", "out_mask", WRITE_BUF),
+             BIArg("int", "model_id", POD_ARG_32b),
          }),
     BIKD(POCL_CDBI_DNN_SEGMENTATION_POSTPROCESS_U8,
         "pocl.dnn.segmentation.postprocess.u8",
@@ -332,6 +333,9 @@ BIKD pocl_BIDescriptors[BIKERNELS] = {
              BIArg("unsigned int*", "detection_data", READ_BUF),
              BIArg("unsigned char*", "segmentation_data", READ_BUF),
              BIArg("unsigned char*", "output", WRITE_BUF),
+             BIArg("int", "rotate_cw_degrees", POD_ARG_32b),
+             BIArg("int", "width", POD_ARG_32b),
+             BIArg("int", "height", POD_ARG_32b),
          }),
     BIKD(POCL_CDBI_DNN_SEGMENTATION_RECONSTRUCT_U8,
         "pocl.dnn.segmentation.reconstruct.u8",
@@ -450,6 +454,7 @@ BIKD pocl_BIDescriptors[BIKERNELS] = {
                      BIArg("int", "inp_format", POD_ARG_32b),
                      BIArg("unsigned int*", "output", WRITE_BUF),
                      BIArg("unsigned char*", "out_mask", WRITE_BUF),
+                     BIArg("int", "model_id", POD_ARG_32b),
              }),
         BIKD(POCL_CDBI_DNN_CTX_SEGMENTATION_POSTPROCESS_U8,
              "pocl.dnn.ctx.segmentation.postprocess.u8",
@@ -458,6 +463,9 @@ BIKD pocl_BIDescriptors[BIKERNELS] = {
                      BIArg("unsigned int*", "detection_data", READ_BUF),
                      BIArg("unsigned char*", "segmentation_data", READ_BUF),
                      BIArg("unsigned char*", "output", WRITE_BUF),
+                     BIArg("int", "rotate_cw_degrees", POD_ARG_32b),
+                     BIArg("int", "width", POD_ARG_32b),
+                     BIArg("int", "height", POD_ARG_32b),
              }),
         BIKD(POCL_CDBI_DNN_CTX_SEGMENTATION_RECONSTRUCT_U8,
              "pocl.dnn.ctx.segmentation.reconstruct.u8",
@@ -487,6 +495,22 @@ BIKD pocl_BIDescriptors[BIKERNELS] = {
                      BIArg("unsigned char*", "output", WRITE_BUF),
                      BIArg("uint64_t *", "output_size", WRITE_BUF)
              }),
+        BIKD(POCL_CDBI_DNN_EVAL_CONFUSION_U32,
+             "pocl.dnn.eval.confusion.u32",
+             {
+                     BIArg("unsigned char*", "det_data", READ_BUF),
+                     BIArg("unsigned char*", "seg_data", READ_BUF),
+                     BIArg("unsigned char*", "ref_det_data", READ_BUF),
+                     BIArg("unsigned char*", "ref_seg_data", READ_BUF),
+                     BIArg("int", "do_segment", POD_ARG_32b),
+                     BIArg("float*", "iou", WRITE_BUF),
+                     BIArg("unsigned int*", "confusion", WRITE_BUF),
+             }),
+        BIKD(POCL_CDBI_DNN_STATS_U64,
+             "pocl.dnn.stats.u64",
+             {
+                     BIArg("uint64_t *", "stats", WRITE_BUF),
+             }),
 };
 
 BIKD::BIKD(BuiltinKernelId KernelIdentifier, const char *KernelName,
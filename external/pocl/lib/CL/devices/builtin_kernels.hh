@@ -101,7 +101,9 @@ enum BuiltinKernelId : uint16_t {
   POCL_CDBI_DNN_CTX_SEGMENTATION_RECONSTRUCT_U8 = 56,
   POCL_CDBI_DNN_CTX_EVAL_IOU_F32 = 57,
   POCL_CDBI_COMPRESS_TO_JPEG_YUV420NV21 = 58,
-  POCL_CDBI_LAST = 59,
+  POCL_CDBI_DNN_EVAL_CONFUSION_U32 = 59,
+  POCL_CDBI_DNN_STATS_U64 = 60,
+  POCL_CDBI_LAST = 61,
   POCL_CDBI_JIT_COMPILER = 0xFFFF
 };
 
@@ -6,7 +6,7 @@
 #ifndef POCL_METADATA_H
 #define POCL_METADATA_H
 
-#define NUM_PTHREAD_BUILTIN_HOST_KERNELS 21
+#define NUM_PTHREAD_BUILTIN_HOST_KERNELS 23
 static char *const kernel_names[NUM_PTHREAD_BUILTIN_HOST_KERNELS] = {
         "pocl.add.i8",
         "pocl.dnn.detection.u8",
@@ -29,6 +29,8 @@ static char *const kernel_names[NUM_PTHREAD_BUILTIN_HOST_KERNELS] = {
         "pocl.dnn.ctx.segmentation.postprocess.u8",
         "pocl.dnn.ctx.segmentation.reconstruct.u8",
         "pocl.dnn.ctx.eval.iou.f32",
+        "pocl.dnn.eval.confusion.u32",
+        "pocl.dnn.stats.u64",
 };
 
 // Make sure LD_LIBRARY_PATH is set to contain the .so files
@@ -54,6 +56,8 @@ static char *const dylib_names[NUM_PTHREAD_BUILTIN_HOST_KERNELS] = {
         "libpocl_pthread_opencv_onnx.so",
         "libpocl_pthread_opencv_onnx.so",
         "libpocl_pthread_opencv_onnx.so",
+        "libpocl_pthread_opencv_onnx.so",
+        "libpocl_pthread_opencv_onnx.so",
 };
 
 static const char *const init_fn_names[NUM_PTHREAD_BUILTIN_HOST_KERNELS] = {
@@ -78,6 +82,8 @@ static const char *const init_fn_names[NUM_PTHREAD_BUILTIN_HOST_KERNELS] = {
         "init_onnx_ctx",
         "init_onnx_ctx",
         "init_onnx_ctx",
+        "",
+        "",
 };
 
 static const char *const free_fn_names[NUM_PTHREAD_BUILTIN_HOST_KERNELS] = {
@@ -102,6 +108,8 @@ static const char *const free_fn_names[NUM_PTHREAD_BUILTIN_HOST_KERNELS] = {
         "finish_onnx_ctx",
         "finish_onnx_ctx",
         "finish_onnx_ctx",
+        "",
+        "",
 };
 
 #endif //POCL_METADATA_H
@@ -0,0 +1,143 @@
+//
+// Segmentation quality evaluation for the ONNX kernels.
+//
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef TRACY_ENABLE
+#include <Tracy.hpp>
+#endif
+
+#include "onnx_eval.h"
+
+int eval_confusion_matrix(const uint8_t *seg_data, const uint8_t *ref_seg_data,
+                          int npixels, int num_classes, int no_class_id,
+                          uint32_t *confusion) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    const size_t nclasses = (size_t) num_classes;
+    memset(confusion, 0, nclasses * nclasses * sizeof(uint32_t));
+
+    // most of a frame is background in both maps, skip those pixels a
+    // word at a time and count them at the end
+    const uint64_t background = 0x0101010101010101ull * (uint8_t) no_class_id;
+    uint32_t background_pixels = 0;
+    int i = 0;
+    for (; i + 8 <= npixels; i += 8) {
+        uint64_t predicted, ground_truth;
+        memcpy(&predicted, seg_data + i, sizeof(predicted));
+        memcpy(&ground_truth, ref_seg_data + i, sizeof(ground_truth));
+        if (predicted == background && ground_truth == background) {
+            background_pixels += 8;
+            continue;
+        }
+        for (int k = i; k < i + 8; ++k) {
+            if (seg_data[k] >= num_classes || ref_seg_data[k] >= num_classes) {
+                return k;
+            }
+            confusion[ref_seg_data[k] * nclasses + seg_data[k]]++;
+        }
+    }
+    for (; i < npixels; ++i) {
+        if (seg_data[i] >= num_classes || ref_seg_data[i] >= num_classes) {
+            return i;
+        }
+        confusion[ref_seg_data[i] * nclasses + seg_data[i]]++;
+    }
+    confusion[no_class_id * nclasses + no_class_id] += background_pixels;
+
+    return -1;
+}
+
+void eval_class_counts(const uint32_t *confusion, int num_classes, int no_class_id,
+                       EvalClassCounts *counts) {
+    memset(counts, 0, num_classes * sizeof(EvalClassCounts));
+
+    for (int ground_truth = 0; ground_truth < num_classes; ++ground_truth) {
+        const uint32_t *row = confusion + (size_t) ground_truth * num_classes;
+        for (int predicted = 0; predicted < num_classes; ++predicted) {
+            const uint32_t n = row[predicted];
+            if (n == 0) {
+                continue;
+            }
+
+            if (ground_truth == no_class_id) {
+                if (predicted != no_class_id) {
+                    // false positive
+                    counts[predicted].wrong += n;
+                }
+            } else if (ground_truth == predicted) {
+                // true positive
+                counts[predicted].correct += n;
+            } else if (predicted == no_class_id) {
+                // false negative
+                counts[ground_truth].wrong += n;
+            } else {
+                // false positive
+                counts[predicted].wrong += n;
+            }
+        }
+    }
+}
+
+int eval_mean_iou(const EvalClassCounts *counts, int num_classes, float *iou) {
+    float iou_sum = 0.0f;
+    int num_present = 0;
+
+    for (int cls = 0; cls < num_classes; ++cls) {
+        const uint32_t total = counts[cls].correct + counts[cls].wrong;
+        if (total != 0) {
+            iou_sum += (float) (counts[cls].correct) / (float) (total);
+            num_present += 1;
+        }
+    }
+
+    if (num_present > 0) {
+        *iou = iou_sum / (float) (num_present);
+    }
+    return num_present;
+}
+
+int eval_class_counts_reference(const uint8_t *seg_data, const uint8_t *ref_seg_data,
+                                int npixels, int num_classes, int no_class_id,
+                                EvalClassCounts *counts) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    memset(counts, 0, num_classes * sizeof(EvalClassCounts));
+
+    for (int i = 0; i < npixels; ++i) {
+        int ground_truth_class = ref_seg_data[i];
+        int predicted_class = seg_data[i];
+
+        if (predicted_class >= num_classes || ground_truth_class >= num_classes) {
+            return i;
+        }
+
+        if (ground_truth_class == no_class_id) {
+            if (predicted_class == no_class_id) {
+                // correct no prediction, true negative, not interested
+            } else {
+                // false positive
+                counts[predicted_class].wrong += 1;
+            }
+        } else {
+            if (ground_truth_class == predicted_class) {
+                // true positive
+                counts[predicted_class].correct += 1;
+            } else if (predicted_class == no_class_id) {
+                // false negative
+                counts[ground_truth_class].wrong += 1;
+            } else {
+                // false positive
+                counts[predicted_class].wrong += 1;
+            }
+        }
+    }
+
+    return -1;
+}
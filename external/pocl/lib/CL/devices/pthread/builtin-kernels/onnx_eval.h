@@ -0,0 +1,65 @@
+//
+// Segmentation quality evaluation for the ONNX kernels. Kept free of pocl
+// and onnxruntime dependencies so that it can be benchmarked on its own.
+//
+
+#ifndef POCL_ONNX_EVAL_H
+#define POCL_ONNX_EVAL_H
+
+#include <stdint.h>
+
+/**
+ * Pixels of a class that were segmented correctly and wrongly. A pixel
+ * counts as wrong for the predicted class if it was misclassified, and
+ * for the ground truth class if nothing was predicted there.
+ */
+struct EvalClassCounts {
+    uint32_t correct;
+    uint32_t wrong;
+};
+
+/**
+ * Histogram the (ground truth, predicted) class pairs of two class maps
+ * into 32-bit counters. Runs of background in both maps are checked and
+ * counted 8 pixels at a time.
+ * @param seg_data predicted class map
+ * @param ref_seg_data ground truth class map
+ * @param npixels number of pixels in the maps
+ * @param num_classes number of classes including the background class
+ * @param no_class_id background class
+ * @param confusion output: num_classes x num_classes counts, the row is the
+ * ground truth and the column the predicted class
+ * @return index of the first pixel with a class >= num_classes, or -1 if
+ * all pixels are valid. The confusion matrix is undefined in that case.
+ */
+int eval_confusion_matrix(const uint8_t *seg_data, const uint8_t *ref_seg_data,
+                          int npixels, int num_classes, int no_class_id,
+                          uint32_t *confusion);
+
+/**
+ * Reduce a confusion matrix to the correct and wrong pixels of each class.
+ * The background class never has any.
+ * @param counts output: num_classes entries
+ */
+void eval_class_counts(const uint32_t *confusion, int num_classes, int no_class_id,
+                       EvalClassCounts *counts);
+
+/**
+ * Mean IoU over the classes that appear in either map.
+ * @param counts of each class
+ * @param num_classes number of classes
+ * @param iou output: mean IoU, untouched if no class appears
+ * @return number of classes that appear
+ */
+int eval_mean_iou(const EvalClassCounts *counts, int num_classes, float *iou);
+
+/**
+ * Reference implementation of eval_confusion_matrix followed by
+ * eval_class_counts, with one branchy pass over the pixels.
+ * @return index of the first invalid pixel, or -1
+ */
+int eval_class_counts_reference(const uint8_t *seg_data, const uint8_t *ref_seg_data,
+                                int npixels, int num_classes, int no_class_id,
+                                EvalClassCounts *counts);
+
+#endif // POCL_ONNX_EVAL_H
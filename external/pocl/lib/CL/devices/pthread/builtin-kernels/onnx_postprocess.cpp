@@ -0,0 +1,228 @@
+//
+// Output decoding for the ONNX detection kernel.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+
+#ifdef TRACY_ENABLE
+#include <Tracy.hpp>
+#endif
+
+#include "onnx_postprocess.h"
+
+namespace {
+
+/**
+ * order by descending score, ties in row order. This is the order
+ * NMSBoxes visits boxes in since it uses a stable sort on row ordered
+ * boxes.
+ */
+inline bool candidate_before(const DetectionCandidate &a,
+                             const DetectionCandidate &b) {
+    return (a.score > b.score) || (a.score == b.score && a.row < b.row);
+}
+
+/**
+ * intersection over union of two boxes, the same way cv::Rect does it
+ */
+inline float box_iou(const DetectionCandidate &a, const DetectionCandidate &b) {
+    const int area_a = a.w * a.h;
+    const int area_b = b.w * b.h;
+    if (area_a + area_b <= 0) {
+        return 1.0f;
+    }
+    const int x1 = std::max(a.x, b.x);
+    const int y1 = std::max(a.y, b.y);
+    const int iw = std::min(a.x + a.w, b.x + b.w) - x1;
+    const int ih = std::min(a.y + a.h, b.y + b.h) - y1;
+    const int inter = (iw > 0 && ih > 0) ? iw * ih : 0;
+    return (float) ((double) inter / (double) (area_a + area_b - inter));
+}
+
+/**
+ * fill in the class and box of a row that passed the threshold
+ */
+inline void make_candidate(const float *output0, int rows, int num_classes,
+                           int row, float score, float resize_scale,
+                           DetectionCandidate *c) {
+    // first class with the max score, like cv::minMaxLoc
+    const float *scores = output0 + 4 * rows + row;
+    int class_id = 0;
+    for (int k = 0; k < num_classes; ++k) {
+        if (scores[k * rows] == score) {
+            class_id = k;
+            break;
+        }
+    }
+
+    const float x = output0[0 * rows + row];
+    const float y = output0[1 * rows + row];
+    const float w = output0[2 * rows + row];
+    const float h = output0[3 * rows + row];
+
+    c->score = score;
+    c->class_id = class_id;
+    c->row = row;
+    c->x = (int) ((x - 0.5 * w) * resize_scale);
+    c->y = (int) ((y - 0.5 * h) * resize_scale);
+    c->w = (int) (w * resize_scale);
+    c->h = (int) (h * resize_scale);
+}
+
+} // namespace
+
+int decode_detections(const float *output0, int dimensions, int rows,
+                      int num_classes, float score_threshold,
+                      float resize_scale, DetectionCandidate *candidates) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    // kept around so that steady state decoding doesn't allocate
+    static thread_local std::vector<float> max_scores;
+    max_scores.resize(rows);
+    float *__restrict best = max_scores.data();
+
+    // max over the classes, one contiguous channel at a time
+    memcpy(best, output0 + 4 * rows, rows * sizeof(float));
+    for (int k = 1; k < num_classes; ++k) {
+        const float *__restrict channel = output0 + (4 + k) * rows;
+        for (int i = 0; i < rows; ++i) {
+            best[i] = (channel[i] > best[i]) ? channel[i] : best[i];
+        }
+    }
+
+    int ncandidates = 0;
+    int min_index = -1;
+    for (int i = 0; i < rows; ++i) {
+        if (best[i] <= score_threshold) {
+            continue;
+        }
+
+        if (ncandidates < DNN_CANDIDATE_CAPACITY) {
+            make_candidate(output0, rows, num_classes, i, best[i], resize_scale,
+                           &candidates[ncandidates++]);
+            continue;
+        }
+
+        // full, replace the lowest scoring candidate if this one is better
+        if (min_index < 0) {
+            min_index = 0;
+            for (int j = 1; j < ncandidates; ++j) {
+                if (candidate_before(candidates[min_index], candidates[j])) {
+                    min_index = j;
+                }
+            }
+        }
+        if (best[i] > candidates[min_index].score) {
+            make_candidate(output0, rows, num_classes, i, best[i], resize_scale,
+                           &candidates[min_index]);
+            min_index = -1;
+        }
+    }
+
+    return ncandidates;
+}
+
+int nms_top_k(DetectionCandidate *candidates, int ncandidates,
+              float nms_threshold, int max_detections, int *keep) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    // Pop candidates best first from a heap instead of sorting all of them,
+    // usually only a few are needed to find max_detections boxes.
+    auto heap_cmp = [](const DetectionCandidate &a, const DetectionCandidate &b) {
+        return candidate_before(b, a);
+    };
+    std::make_heap(candidates, candidates + ncandidates, heap_cmp);
+
+    int nkept = 0;
+    int end = ncandidates;
+    while (end > 0 && nkept < max_detections) {
+        std::pop_heap(candidates, candidates + end, heap_cmp);
+        end--;
+        const DetectionCandidate &c = candidates[end];
+
+        bool keep_box = true;
+        for (int k = 0; k < nkept && keep_box; ++k) {
+            keep_box = box_iou(c, candidates[keep[k]]) <= nms_threshold;
+        }
+        if (keep_box) {
+            keep[nkept++] = end;
+        }
+    }
+
+    return nkept;
+}
+
+int decode_detections_opencv(const float *output0, int dimensions, int rows,
+                             int num_classes, float score_threshold,
+                             float nms_threshold, float resize_scale,
+                             int max_detections, DetectionCandidate *detections) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    cv::Mat detection_output =
+        cv::Mat(dimensions, rows, CV_32FC1, (void *) output0);
+    // transpose to correct shape
+    cv::transpose(detection_output, detection_output);
+    float *data = reinterpret_cast<float *>(detection_output.data);
+
+    std::vector<int> class_ids;
+    std::vector<float> confidences;
+    std::vector<cv::Rect> boxes;
+    std::vector<int> row_ids;
+
+    for (int i = 0; i < rows; ++i) {
+        float *classes_scores = data + 4;
+
+        cv::Mat scores(1, num_classes, CV_32FC1, classes_scores);
+        cv::Point class_id;
+        double maxClassScore;
+
+        cv::minMaxLoc(scores, 0, &maxClassScore, 0, &class_id);
+
+        if (maxClassScore > score_threshold) {
+            confidences.push_back(maxClassScore);
+            class_ids.push_back(class_id.x);
+            row_ids.push_back(i);
+
+            float x = data[0];
+            float y = data[1];
+            float w = data[2];
+            float h = data[3];
+
+            boxes.push_back(cv::Rect((int) ((x - 0.5 * w) * resize_scale),
+                                     (int) ((y - 0.5 * h) * resize_scale),
+                                     (int) (w * resize_scale),
+                                     (int) (h * resize_scale)));
+        }
+
+        data += dimensions;
+    }
+
+    std::vector<int> nms_result;
+    cv::dnn::NMSBoxes(boxes, confidences, score_threshold, nms_threshold,
+                      nms_result);
+    nms_result.resize(std::min((size_t) max_detections, nms_result.size()));
+
+    for (size_t i = 0; i < nms_result.size(); ++i) {
+        int idx = nms_result[i];
+        detections[i].score = confidences[idx];
+        detections[i].class_id = class_ids[idx];
+        detections[i].row = row_ids[idx];
+        detections[i].x = boxes[idx].x;
+        detections[i].y = boxes[idx].y;
+        detections[i].w = boxes[idx].width;
+        detections[i].h = boxes[idx].height;
+    }
+
+    return (int) nms_result.size();
+}
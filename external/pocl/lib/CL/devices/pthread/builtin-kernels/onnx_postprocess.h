@@ -0,0 +1,75 @@
+//
+// Output decoding for the ONNX detection kernel. Kept free of pocl
+// and onnxruntime dependencies so that it can be benchmarked on its own.
+//
+
+#ifndef POCL_ONNX_POSTPROCESS_H
+#define POCL_ONNX_POSTPROCESS_H
+
+#include <stdint.h>
+
+// max number of detections returned per frame
+#define DNN_MAX_DETECTIONS 10
+// max number of boxes above the score threshold that are kept for NMS,
+// the lowest scoring ones are dropped when there are more
+#define DNN_CANDIDATE_CAPACITY 1024
+
+/**
+ * A box that passed the score threshold. The box is in pixels of the
+ * (rotated) input image.
+ */
+struct DetectionCandidate {
+    float score;
+    int class_id;
+    int row; // index into the model output, used to find the mask coefficients
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+/**
+ * Decode the yolov8 detection output in its native channel-major layout,
+ * i.e. dimensions x rows where dimension 0-3 is the box and the next
+ * num_classes are the class scores. The max score of each row is found
+ * with a vectorizable pass over the classes, and only rows above the
+ * threshold look up their class and box.
+ * @param output0 detection output of one frame
+ * @param dimensions number of channels per row
+ * @param rows number of candidate boxes
+ * @param num_classes number of class score channels
+ * @param score_threshold rows with a max score at or below this are dropped
+ * @param resize_scale scale from model to input image coordinates
+ * @param candidates output: DNN_CANDIDATE_CAPACITY entries
+ * @return number of candidates written
+ */
+int decode_detections(const float *output0, int dimensions, int rows,
+                      int num_classes, float score_threshold,
+                      float resize_scale, DetectionCandidate *candidates);
+
+/**
+ * Greedy class agnostic non-max suppression that stops once
+ * max_detections boxes have been kept. Gives the same result as
+ * cv::dnn::NMSBoxes followed by truncation to max_detections.
+ * @param candidates boxes to filter, reordered by descending score
+ * @param ncandidates number of candidates
+ * @param nms_threshold boxes overlapping a kept box by more than this are dropped
+ * @param max_detections max number of boxes to keep
+ * @param keep output: indices into candidates of the kept boxes
+ * @return number of kept boxes
+ */
+int nms_top_k(DetectionCandidate *candidates, int ncandidates,
+              float nms_threshold, int max_detections, int *keep);
+
+/**
+ * Reference implementation of decode_detections followed by nms_top_k,
+ * built from cv::transpose, cv::minMaxLoc and cv::dnn::NMSBoxes.
+ * @param detections output: max_detections entries
+ * @return number of detections
+ */
+int decode_detections_opencv(const float *output0, int dimensions, int rows,
+                             int num_classes, float score_threshold,
+                             float nms_threshold, float resize_scale,
+                             int max_detections, DetectionCandidate *detections);
+
+#endif // POCL_ONNX_POSTPROCESS_H
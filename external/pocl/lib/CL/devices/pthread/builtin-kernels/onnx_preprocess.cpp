@@ -0,0 +1,509 @@
+//
+// Input preprocessing for the ONNX detection kernel.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <opencv2/dnn.hpp>
+#include <opencv2/imgproc.hpp>
+
+#ifdef TRACY_ENABLE
+#include <Tracy.hpp>
+#endif
+
+#include "onnx_preprocess.h"
+
+namespace {
+
+// BT.601 video range coefficients, the same ones OpenCV uses for
+// the yuv420 to rgb conversions
+constexpr float YUV_CY = 1.164f;
+constexpr float YUV_CUB = 2.018f;
+constexpr float YUV_CUG = -0.391f;
+constexpr float YUV_CVG = -0.813f;
+constexpr float YUV_CVR = 1.596f;
+constexpr float INV_255 = 1.0f / 255.0f;
+
+/**
+ * Bilinear tap along one axis, matching the pixel center convention
+ * of cv::resize with INTER_LINEAR.
+ */
+struct AxisTap {
+    int i0;
+    int i1;
+    float w1;    // weight of i1, the weight of i0 is 1 - w1
+    int nearest; // used to sample the subsampled chroma planes
+};
+
+void compute_taps(int dst_len, int src_len, std::vector<AxisTap> &taps) {
+    taps.resize(dst_len);
+    const float scale = (float) src_len / (float) dst_len;
+    for (int d = 0; d < dst_len; ++d) {
+        float s = ((float) d + 0.5f) * scale - 0.5f;
+        int i0 = (int) std::floor(s);
+        float w1 = s - (float) i0;
+        if (i0 < 0) {
+            i0 = 0;
+            w1 = 0.0f;
+        }
+        if (i0 >= src_len - 1) {
+            i0 = src_len - 1;
+            w1 = 0.0f;
+        }
+        taps[d].i0 = i0;
+        taps[d].i1 = std::min(i0 + 1, src_len - 1);
+        taps[d].w1 = w1;
+        taps[d].nearest = (w1 < 0.5f) ? i0 : taps[d].i1;
+    }
+}
+
+/**
+ * Maps a pixel (rx, ry) of the rotated image to the source image:
+ * x = x0 + rx * dxx + ry * dxy and y = y0 + rx * dyx + ry * dyy
+ */
+struct RotationMap {
+    int x0, dxx, dxy;
+    int y0, dyx, dyy;
+};
+
+RotationMap get_rotation_map(int width, int height, int rotate_cw_degrees) {
+    switch (rotate_cw_degrees) {
+    case 90:
+    case -270:
+        return {0, 0, 1, height - 1, -1, 0};
+    case 180:
+    case -180:
+        return {width - 1, -1, 0, height - 1, 0, -1};
+    case 270:
+    case -90:
+        return {width - 1, 0, -1, 0, 1, 0};
+    default:
+        return {0, 1, 0, 0, 0, 1};
+    }
+}
+
+/**
+ * One pixel of a plane, kept as bytes so that planes of any alignment can
+ * be copied: 1 for luma and planar chroma, 2 for the interleaved chroma of
+ * NV21 and 3 for RGB.
+ */
+template <int N> struct Pixel {
+    uint8_t c[N];
+};
+
+// side of the square tiles a plane is rotated in, so that the reads and the
+// writes of a tile both stay within a few cache lines
+constexpr int ROTATE_TILE = 32;
+
+/**
+ * copy a plane rotated clockwise, so that the passes after it read whole
+ * rows with unit stride whatever the rotation
+ * @param src plane of width x height pixels, src_stride pixels per row
+ * @param dst rotated plane, rows as long as the rotated width
+ */
+template <int N>
+void rotate_plane(const Pixel<N> *src, int width, int height, int src_stride,
+                  int rotate_cw_degrees, Pixel<N> *dst) {
+    int rot_w, rot_h;
+    preprocess_rotated_size(width, height, rotate_cw_degrees, &rot_w, &rot_h);
+    const RotationMap m = get_rotation_map(width, height, rotate_cw_degrees);
+
+    for (int ty = 0; ty < rot_h; ty += ROTATE_TILE) {
+        const int ty_end = std::min(ty + ROTATE_TILE, rot_h);
+        for (int tx = 0; tx < rot_w; tx += ROTATE_TILE) {
+            const int tx_end = std::min(tx + ROTATE_TILE, rot_w);
+            for (int ry = ty; ry < ty_end; ++ry) {
+                Pixel<N> *dst_row = dst + (size_t) ry * rot_w;
+                for (int rx = tx; rx < tx_end; ++rx) {
+                    const int x = m.x0 + rx * m.dxx + ry * m.dxy;
+                    const int y = m.y0 + rx * m.dyx + ry * m.dyy;
+                    dst_row[rx] = src[(size_t) y * src_stride + x];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Plane pointers of a yuv420 image. Chroma of pixel (x, y) is at
+ * (y / 2) * uv_stride + (x / 2) * uv_step.
+ */
+struct YuvPlanes {
+    const uint8_t *y;
+    const uint8_t *u;
+    const uint8_t *v;
+    int uv_stride;
+    int uv_step;
+};
+
+/**
+ * rotate all the planes of a yuv420 image into buffer
+ * @return the planes of the rotated image
+ */
+YuvPlanes rotate_yuv(const YuvPlanes &p, int width, int height, int inp_format,
+                     int rotate_cw_degrees, std::vector<uint8_t> &buffer) {
+    int rot_w, rot_h;
+    preprocess_rotated_size(width, height, rotate_cw_degrees, &rot_w, &rot_h);
+    const int chroma_count = (width / 2) * (height / 2);
+    buffer.resize((size_t) width * height + 2 * chroma_count);
+
+    YuvPlanes rot;
+    uint8_t *y = buffer.data();
+    uint8_t *chroma = y + (size_t) width * height;
+    rotate_plane((const Pixel<1> *) p.y, width, height, width, rotate_cw_degrees,
+                 (Pixel<1> *) y);
+    rot.y = y;
+    if (inp_format == PREPROCESS_NV21) {
+        rotate_plane((const Pixel<2> *) p.v, width / 2, height / 2, p.uv_stride / 2,
+                     rotate_cw_degrees, (Pixel<2> *) chroma);
+        rot.v = chroma;
+        rot.u = chroma + 1;
+        rot.uv_stride = rot_w;
+        rot.uv_step = 2;
+    } else {
+        rotate_plane((const Pixel<1> *) p.v, width / 2, height / 2, p.uv_stride,
+                     rotate_cw_degrees, (Pixel<1> *) chroma);
+        rotate_plane((const Pixel<1> *) p.u, width / 2, height / 2, p.uv_stride,
+                     rotate_cw_degrees, (Pixel<1> *) (chroma + chroma_count));
+        rot.v = chroma;
+        rot.u = chroma + chroma_count;
+        rot.uv_stride = rot_w / 2;
+        rot.uv_step = 1;
+    }
+    return rot;
+}
+
+// written as selects, which the compiler turns into vector min and max as long as
+// the file is built with -fno-trapping-math
+inline float clamp_255(float val) {
+    val = (val > 0.0f) ? val : 0.0f;
+    return (val < 255.0f) ? val : 255.0f;
+}
+
+/**
+ * Convert one row to the three output planes in the channel order
+ * produced by cvtColor(COLOR_YUV2BGR_*). All the arrays have unit
+ * stride and the loop has no branches, so that it is vectorized.
+ */
+template <typename T>
+void yuv_store_row(const T *__restrict y, const float *__restrict u,
+                   const float *__restrict v, int n, float *__restrict out_b,
+                   float *__restrict out_g, float *__restrict out_r) {
+    for (int i = 0; i < n; ++i) {
+        const float c = YUV_CY * ((float) y[i] - 16.0f);
+        const float d = u[i] - 128.0f;
+        const float e = v[i] - 128.0f;
+        out_b[i] = clamp_255(c + YUV_CUB * d) * INV_255;
+        out_g[i] = clamp_255(c + YUV_CUG * d + YUV_CVG * e) * INV_255;
+        out_r[i] = clamp_255(c + YUV_CVR * e) * INV_255;
+    }
+}
+
+/**
+ * Fast path for images that don't need to be resized, i.e. the common
+ * case of a camera frame matching the model shape. The chroma of a row
+ * is spread to one value per pixel once for every two rows.
+ */
+void yuv_copy_rows(const YuvPlanes &p, int width, int rows, int model_w,
+                   float *out_b, float *out_g, float *out_r) {
+    static thread_local std::vector<float> chroma;
+    chroma.resize(2 * (size_t) width);
+    float *__restrict u = chroma.data();
+    float *__restrict v = u + width;
+
+    for (int oy = 0; oy < rows; ++oy) {
+        if ((oy & 1) == 0) {
+            const uint8_t *u_row = p.u + (oy >> 1) * p.uv_stride;
+            const uint8_t *v_row = p.v + (oy >> 1) * p.uv_stride;
+            for (int ox = 0; ox < width; ++ox) {
+                u[ox] = u_row[(ox >> 1) * p.uv_step];
+                v[ox] = v_row[(ox >> 1) * p.uv_step];
+            }
+        }
+        yuv_store_row(p.y + (size_t) oy * width, u, v, width, out_b + oy * model_w,
+                      out_g + oy * model_w, out_r + oy * model_w);
+    }
+}
+
+/**
+ * Vertical step of the bilinear scaling: blend the two source rows of an
+ * output row with unit stride over the whole row. The horizontal step then
+ * samples the blended row at the horizontal taps.
+ * @param src unrotated plane with nch values per pixel
+ * @param blend output: src_w x nch values
+ */
+void blend_rows(const uint8_t *src, int src_w, int nch, const AxisTap &ty,
+                float *__restrict blend) {
+    const uint8_t *__restrict r0 = src + (size_t) ty.i0 * src_w * nch;
+    const uint8_t *__restrict r1 = src + (size_t) ty.i1 * src_w * nch;
+    const float w1 = ty.w1;
+    const int n = src_w * nch;
+    for (int i = 0; i < n; ++i) {
+        blend[i] = (float) r0[i] + w1 * ((float) r1[i] - (float) r0[i]);
+    }
+}
+
+/**
+ * General path on an unrotated image: bilinear scaling of the luma
+ * plane, nearest neighbour sampling of the (already subsampled) chroma
+ * planes.
+ */
+void yuv_resample_rows(const YuvPlanes &p, int width,
+                       const std::vector<AxisTap> &xtaps,
+                       const std::vector<AxisTap> &ytaps, int model_w,
+                       float *out_b, float *out_g, float *out_r) {
+    const int cols = (int) xtaps.size();
+    const int rows = (int) ytaps.size();
+    static thread_local std::vector<float> buffer;
+    buffer.resize((size_t) width + 3 * cols);
+    float *blend = buffer.data();
+    float *__restrict luma = blend + width;
+    float *__restrict u = luma + cols;
+    float *__restrict v = u + cols;
+
+    int chroma_row = -1;
+    for (int oy = 0; oy < rows; ++oy) {
+        const AxisTap &ty = ytaps[oy];
+        blend_rows(p.y, width, 1, ty, blend);
+        for (int ox = 0; ox < cols; ++ox) {
+            const AxisTap &tx = xtaps[ox];
+            luma[ox] = blend[tx.i0] + tx.w1 * (blend[tx.i1] - blend[tx.i0]);
+        }
+
+        if ((ty.nearest >> 1) != chroma_row) {
+            chroma_row = ty.nearest >> 1;
+            const uint8_t *u_row = p.u + chroma_row * p.uv_stride;
+            const uint8_t *v_row = p.v + chroma_row * p.uv_stride;
+            for (int ox = 0; ox < cols; ++ox) {
+                const int uv = (xtaps[ox].nearest >> 1) * p.uv_step;
+                u[ox] = u_row[uv];
+                v[ox] = v_row[uv];
+            }
+        }
+
+        yuv_store_row(luma, u, v, cols, out_b + oy * model_w, out_g + oy * model_w,
+                      out_r + oy * model_w);
+    }
+}
+
+/**
+ * bilinear scaling of an unrotated interleaved 8-bit rgb image
+ */
+void rgb_resample_rows(const uint8_t *input, int width,
+                       const std::vector<AxisTap> &xtaps,
+                       const std::vector<AxisTap> &ytaps, int model_w,
+                       float *const out[3]) {
+    const int cols = (int) xtaps.size();
+    const int rows = (int) ytaps.size();
+    static thread_local std::vector<float> buffer;
+    buffer.resize(3 * (size_t) width);
+    float *blend = buffer.data();
+
+    for (int oy = 0; oy < rows; ++oy) {
+        blend_rows(input, width, 3, ytaps[oy], blend);
+        for (int c = 0; c < 3; ++c) {
+            float *__restrict dst = out[c] + oy * model_w;
+            for (int ox = 0; ox < cols; ++ox) {
+                const AxisTap &tx = xtaps[ox];
+                const float p0 = blend[3 * tx.i0 + c];
+                const float p1 = blend[3 * tx.i1 + c];
+                dst[ox] = (p0 + tx.w1 * (p1 - p0)) * INV_255;
+            }
+        }
+    }
+}
+
+/**
+ * compute the letterboxed size the same way the OpenCV path does
+ * @return resize scale
+ */
+float letterbox_size(int rot_w, int rot_h, int model_w, int model_h,
+                     int *scaled_w, int *scaled_h) {
+    float resize_scale;
+    if (rot_w >= rot_h) {
+        resize_scale = (float) (rot_w) / (float) (model_w);
+        *scaled_w = model_w;
+        *scaled_h = (int) (rot_h / resize_scale);
+    } else {
+        resize_scale = (float) (rot_h) / (float) (model_h);
+        *scaled_w = (int) (rot_w / resize_scale);
+        *scaled_h = model_h;
+    }
+    *scaled_w = std::min(*scaled_w, model_w);
+    *scaled_h = std::min(*scaled_h, model_h);
+    return resize_scale;
+}
+
+} // namespace
+
+void preprocess_rotated_size(int width, int height, int rotate_cw_degrees,
+                             int *rot_width, int *rot_height) {
+    if (rotate_cw_degrees % 180 != 0 && rotate_cw_degrees % 90 == 0) {
+        *rot_width = height;
+        *rot_height = width;
+    } else {
+        *rot_width = width;
+        *rot_height = height;
+    }
+}
+
+float preprocess_fused(const uint8_t *input, int width, int height,
+                       int rotate_cw_degrees, int inp_format, int model_w,
+                       int model_h, float *output) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    if (rotate_cw_degrees % 90 != 0) {
+        rotate_cw_degrees = 0;
+    }
+
+    int rot_w, rot_h;
+    preprocess_rotated_size(width, height, rotate_cw_degrees, &rot_w, &rot_h);
+
+    int scaled_w, scaled_h;
+    const float resize_scale = letterbox_size(rot_w, rot_h, model_w, model_h,
+                                              &scaled_w, &scaled_h);
+
+    const size_t plane_count = (size_t) model_w * model_h;
+    float *const planes[3] = {output, output + plane_count,
+                              output + 2 * plane_count};
+
+    // zero only the letterbox padding, the rest is overwritten below
+    for (int c = 0; c < 3; ++c) {
+        if (scaled_w < model_w) {
+            for (int oy = 0; oy < scaled_h; ++oy) {
+                memset(planes[c] + oy * model_w + scaled_w, 0,
+                       (model_w - scaled_w) * sizeof(float));
+            }
+        }
+        memset(planes[c] + scaled_h * model_w, 0,
+               (size_t) (model_h - scaled_h) * model_w * sizeof(float));
+    }
+
+    YuvPlanes p;
+    p.y = input;
+    switch (inp_format) {
+    case PREPROCESS_NV21:
+        p.v = input + width * height;
+        p.u = p.v + 1;
+        p.uv_stride = width;
+        p.uv_step = 2;
+        break;
+    case PREPROCESS_YV12:
+        p.v = input + width * height;
+        p.u = p.v + (width / 2) * (height / 2);
+        p.uv_stride = width / 2;
+        p.uv_step = 1;
+        break;
+    case PREPROCESS_RGB:
+        break;
+    default:
+        for (int c = 0; c < 3; ++c) {
+            memset(planes[c], 0, plane_count * sizeof(float));
+        }
+        return -1.0f;
+    }
+
+    // rotate first, so that all the passes below read rows with unit stride
+    static thread_local std::vector<uint8_t> rotated;
+    const uint8_t *rgb = input;
+    if (rotate_cw_degrees % 360 != 0) {
+        if (inp_format == PREPROCESS_RGB) {
+            rotated.resize(3 * (size_t) width * height);
+            rotate_plane((const Pixel<3> *) input, width, height, width, rotate_cw_degrees,
+                         (Pixel<3> *) rotated.data());
+            rgb = rotated.data();
+        } else {
+            p = rotate_yuv(p, width, height, inp_format, rotate_cw_degrees, rotated);
+        }
+    }
+
+    const bool identity = (scaled_w == rot_w) && (scaled_h == rot_h);
+    if (inp_format != PREPROCESS_RGB && identity) {
+        yuv_copy_rows(p, rot_w, scaled_h, model_w, planes[0], planes[1], planes[2]);
+        return resize_scale;
+    }
+
+    // kept around so that steady state processing doesn't allocate
+    static thread_local std::vector<AxisTap> xtaps;
+    static thread_local std::vector<AxisTap> ytaps;
+    compute_taps(scaled_w, rot_w, xtaps);
+    compute_taps(scaled_h, rot_h, ytaps);
+
+    if (inp_format == PREPROCESS_RGB) {
+        rgb_resample_rows(rgb, rot_w, xtaps, ytaps, model_w, planes);
+    } else {
+        yuv_resample_rows(p, rot_w, xtaps, ytaps, model_w, planes[0], planes[1], planes[2]);
+    }
+
+    return resize_scale;
+}
+
+float preprocess_opencv(const uint8_t *input, int width, int height,
+                        int rotate_cw_degrees, int inp_format, int model_w,
+                        int model_h, float *output) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    cv::Mat img_rgb;
+    switch (inp_format) {
+    case PREPROCESS_RGB:
+        img_rgb = cv::Mat(height, width, CV_8UC3, (unsigned char *) input);
+        break;
+    case PREPROCESS_NV21: {
+        cv::Mat img(height + height / 2, width, CV_8UC1,
+                    (unsigned char *) input);
+        cvtColor(img, img_rgb, cv::COLOR_YUV2BGR_NV21);
+        break;
+    }
+    case PREPROCESS_YV12: {
+        cv::Mat img(height + height / 2, width, CV_8UC1,
+                    (unsigned char *) input);
+        cvtColor(img, img_rgb, cv::COLOR_YUV2BGR_YV12);
+        break;
+    }
+    default:
+        memset(output, 0, 3 * (size_t) model_w * model_h * sizeof(float));
+        return -1.0f;
+    }
+
+    switch (rotate_cw_degrees) {
+    case 90:
+    case -270:
+        cv::rotate(img_rgb, img_rgb, cv::ROTATE_90_CLOCKWISE);
+        break;
+    case 180:
+    case -180:
+        cv::rotate(img_rgb, img_rgb, cv::ROTATE_180);
+        break;
+    case 270:
+    case -90:
+        cv::rotate(img_rgb, img_rgb, cv::ROTATE_90_COUNTERCLOCKWISE);
+        break;
+    default:
+        break;
+    }
+
+    cv::Mat modelInput;
+    img_rgb.convertTo(modelInput, CV_32F);
+
+    int scaled_w, scaled_h;
+    const float resize_scale = letterbox_size(img_rgb.cols, img_rgb.rows, model_w,
+                                              model_h, &scaled_w, &scaled_h);
+    cv::resize(modelInput, modelInput, cv::Size(scaled_w, scaled_h));
+
+    cv::Mat tmp_img = cv::Mat::zeros(model_h, model_w, CV_8UC3);
+    modelInput.copyTo(tmp_img(cv::Rect(0, 0, modelInput.cols, modelInput.rows)));
+
+    cv::Mat blob;
+    cv::dnn::blobFromImage(tmp_img, blob, 1.0 / 255.0, cv::Size(model_w, model_h),
+                           cv::Scalar(), false, false);
+    memcpy(output, blob.ptr<float>(), blob.total() * sizeof(float));
+
+    return resize_scale;
+}
@@ -0,0 +1,61 @@
+//
+// Input preprocessing for the ONNX detection kernel. Kept free of pocl
+// and onnxruntime dependencies so that it can be benchmarked on its own.
+//
+
+#ifndef POCL_ONNX_PREPROCESS_H
+#define POCL_ONNX_PREPROCESS_H
+
+#include <stdint.h>
+
+/**
+ * Input formats of the detection kernel.
+ */
+enum PreprocessFormat {
+    PREPROCESS_RGB = 0,  // interleaved 8-bit RGB
+    PREPROCESS_NV21 = 1, // Y plane followed by an interleaved V/U plane
+    PREPROCESS_YV12 = 2, // Y plane followed by separate V and U planes
+};
+
+/**
+ * compute the size of the image after rotation
+ * @param width of the input image
+ * @param height of the input image
+ * @param rotate_cw_degrees clockwise rotation
+ * @param rot_width output: width after rotation
+ * @param rot_height output: height after rotation
+ */
+void preprocess_rotated_size(int width, int height, int rotate_cw_degrees,
+                             int *rot_width, int *rot_height);
+
+/**
+ * Convert, rotate and letterbox an image into a planar float tensor in
+ * one pass. The image is scaled to fit the model shape while keeping its
+ * aspect ratio, placed in the top left corner and the rest is zeroed.
+ * Values are scaled to [0, 1]. The channel order matches the OpenCV path,
+ * i.e. the output of cvtColor(COLOR_YUV2BGR_*) for yuv inputs.
+ * @param input image data
+ * @param width of the input image
+ * @param height of the input image
+ * @param rotate_cw_degrees multiple of 90, anything else is treated as 0
+ * @param inp_format one of PreprocessFormat
+ * @param model_w width of the model input
+ * @param model_h height of the model input
+ * @param output 3 x model_h x model_w floats
+ * @return the resize scale (rotated size / letterboxed size),
+ * negative if the input format is not supported
+ */
+float preprocess_fused(const uint8_t *input, int width, int height,
+                       int rotate_cw_degrees, int inp_format, int model_w,
+                       int model_h, float *output);
+
+/**
+ * Reference implementation of preprocess_fused built from separate
+ * OpenCV passes.
+ * @see preprocess_fused
+ */
+float preprocess_opencv(const uint8_t *input, int width, int height,
+                        int rotate_cw_degrees, int inp_format, int model_w,
+                        int model_h, float *output);
+
+#endif // POCL_ONNX_PREPROCESS_H
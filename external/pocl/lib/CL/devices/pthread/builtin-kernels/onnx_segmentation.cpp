@@ -0,0 +1,183 @@
+//
+// Segmentation postprocess and reconstruct for the ONNX kernels.
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include <opencv2/core.hpp>
+
+#ifdef TRACY_ENABLE
+#include <Tracy.hpp>
+#endif
+
+#include "onnx_segmentation.h"
+
+namespace {
+
+const int SEGMENTATION_COLORS[256] = {
+    -1651865, -6634562, -5921894, -9968734, -1277957, -2838283,
+    -9013359, -9634954, -470042, -8997255, -4620585, -2953862,
+    -3811878, -8603498, -2455171, -5325920, -6757258, -8214427,
+    -5903423, -4680978, -4146958, -602947, -5396049, -9898511,
+    -8346466, -2122577, -2304523, -4667802, -222837, -4983945,
+    -234790, -8865559, -4660525, -3744578, -8720427, -9778035,
+    -680538, -7942224, -7162754, -2986121, -8795194, -2772629,
+    -4820488, -9401960, -3443339, -1781041, -4494168, -3167240,
+    -7629631, -6685500, -6901785, -2968136, -3953703, -4545430,
+    -6558846, -2631687, -5011272, -4983118, -9804322, -2593374,
+    -8473686, -4006938, -7801488, -7161859, -4854121, -5654350,
+    -817410, -8013957, -9252928, -2240041, -3625560, -6381719,
+    -4674608, -5704237, -8466309, -1788449, -7283030, -5781889,
+    -4207444, -8225948, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0
+};
+
+/**
+ * SEGMENTATION_COLORS with every channel halved, in the byte order the
+ * colors are written in. Halving each byte of the packed color is a shift
+ * of the whole word that drops the bits carried over from the next byte.
+ */
+struct ColorTable {
+    uint32_t rgba[256];
+
+    ColorTable() {
+        for (int i = 0; i < 256; ++i) {
+            rgba[i] = ((uint32_t) SEGMENTATION_COLORS[i] >> 1) & 0x7F7F7F7Fu;
+        }
+    }
+};
+
+const ColorTable COLOR_TABLE;
+
+} // namespace
+
+void segmentation_postprocess(const unsigned int *detection_data,
+                              const unsigned char *segmentation_data,
+                              int mask_w, int mask_h, int img_w, int img_h,
+                              unsigned char no_class_id, unsigned char *output) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    const size_t mask_count = (size_t) mask_w * mask_h;
+    memset(output, no_class_id, mask_count);
+
+    const unsigned int num_detections = detection_data[0];
+    for (unsigned int i = 0; i < num_detections; ++i) {
+        const unsigned int *det = detection_data + 1 + 6 * i;
+        const unsigned char class_id = (unsigned char) det[0];
+
+        int box_x = (int) ((float) (det[2]) / (float) (img_w) * (float) (mask_w));
+        int box_y = (int) ((float) (det[3]) / (float) (img_h) * (float) (mask_h));
+        int box_w = (int) ((float) (det[4]) / (float) (img_w) * (float) (mask_w));
+        int box_h = (int) ((float) (det[5]) / (float) (img_h) * (float) (mask_h));
+
+        box_x = std::min(std::max(box_x, 0), mask_w);
+        box_y = std::min(std::max(box_y, 0), mask_h);
+        box_w = std::min(box_w, mask_w - box_x);
+        box_h = std::min(box_h, mask_h - box_y);
+        if (box_w <= 0 || box_h <= 0) {
+            continue;
+        }
+
+        // only the box is visited, set pixels take the class without a branch
+        const unsigned char *mask = segmentation_data + i * mask_count;
+        for (int y = box_y; y < box_y + box_h; ++y) {
+            const unsigned char *__restrict src = mask + (size_t) y * mask_w + box_x;
+            unsigned char *__restrict dst = output + (size_t) y * mask_w + box_x;
+            for (int x = 0; x < box_w; ++x) {
+                dst[x] = src[x] ? class_id : dst[x];
+            }
+        }
+    }
+}
+
+void segmentation_postprocess_opencv(const unsigned int *detection_data,
+                                     const unsigned char *segmentation_data,
+                                     int mask_w, int mask_h, int img_w, int img_h,
+                                     unsigned char no_class_id,
+                                     unsigned char *output) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    unsigned int num_detections = detection_data[0];
+    cv::Mat color_mask(mask_h, mask_w, CV_8UC1, cv::Scalar(no_class_id));
+
+    for (int i = 0; i < num_detections; ++i) {
+        unsigned char class_id = (unsigned char)(detection_data[1 + 6 * i]);
+
+        int box_x =
+            (int)((float)(detection_data[1 + 6 * i + 2]) / (float)(img_w) * (float)(mask_w));
+        int box_y =
+            (int)((float)(detection_data[1 + 6 * i + 3]) / (float)(img_h) * (float)(mask_h));
+        int box_w =
+            (int)((float)(detection_data[1 + 6 * i + 4]) / (float)(img_w) * (float)(mask_w));
+        int box_h =
+            (int)((float)(detection_data[1 + 6 * i + 5]) / (float)(img_h) * (float)(mask_h));
+
+        box_x = std::min(std::max(box_x, 0), mask_w);
+        box_y = std::min(std::max(box_y, 0), mask_h);
+        box_w = std::min(box_w, mask_w - box_x);
+        box_h = std::min(box_h, mask_h - box_y);
+
+        if (box_w > 0 && box_h > 0) {
+            cv::Mat raw_mask(mask_h, mask_w, CV_8UC1,
+                             (void *)(segmentation_data + i * mask_w * mask_h));
+            cv::Rect roi(box_x, box_y, box_w, box_h);
+            cv::Mat raw_mask_roi = cv::Mat::zeros(mask_h, mask_w, CV_8UC1);
+            raw_mask(roi).copyTo(raw_mask_roi(roi));
+            color_mask.setTo(cv::Scalar(class_id), raw_mask_roi);
+        }
+    }
+
+    memcpy(output, color_mask.data, mask_w * mask_h);
+}
+
+void segmentation_reconstruct(const unsigned char *class_map, int nsamples,
+                              unsigned char *output) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    const uint32_t *lut = COLOR_TABLE.rgba;
+    int i = 0;
+    for (; i + 4 <= nsamples; i += 4) {
+        const uint32_t pixels[4] = {lut[class_map[i]], lut[class_map[i + 1]],
+                                    lut[class_map[i + 2]], lut[class_map[i + 3]]};
+        memcpy(output + 4 * i, pixels, sizeof(pixels));
+    }
+    for (; i < nsamples; ++i) {
+        memcpy(output + 4 * i, &lut[class_map[i]], sizeof(uint32_t));
+    }
+}
+
+void segmentation_reconstruct_reference(const unsigned char *class_map,
+                                        int nsamples, unsigned char *output) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    for (int i = 0; i < nsamples; ++i) {
+        const uint8_t class_id = class_map[i];
+
+        const int color_int = SEGMENTATION_COLORS[class_id];
+        const unsigned char *channels =
+            reinterpret_cast<const unsigned char *>(&color_int);
+
+        // RGBA image
+        output[4 * i] = channels[0] / 2;
+        output[4 * i + 1] = channels[1] / 2;
+        output[4 * i + 2] = channels[2] / 2;
+        output[4 * i + 3] = channels[3] / 2;
+    }
+}
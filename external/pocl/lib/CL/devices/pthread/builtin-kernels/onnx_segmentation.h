@@ -0,0 +1,58 @@
+//
+// Segmentation postprocess and reconstruct for the ONNX kernels. Kept free
+// of pocl and onnxruntime dependencies so that it can be benchmarked on its
+// own.
+//
+
+#ifndef POCL_ONNX_SEGMENTATION_H
+#define POCL_ONNX_SEGMENTATION_H
+
+#include <stdint.h>
+
+/**
+ * Paint the masks of the detections into a class map. Every detection sets
+ * the pixels of its mask that are inside its box to its class, later
+ * detections overwrite earlier ones, everything else is no_class_id.
+ * Works directly on the output without temporaries.
+ * @param detection_data [count, then class, score, x, y, w, h per detection]
+ * @param segmentation_data mask_w x mask_h mask per detection
+ * @param mask_w width of the masks and the class map
+ * @param mask_h height of the masks and the class map
+ * @param img_w width of the image the boxes are in
+ * @param img_h height of the image the boxes are in
+ * @param no_class_id class of pixels without a detection
+ * @param output mask_w x mask_h class map
+ */
+void segmentation_postprocess(const unsigned int *detection_data,
+                              const unsigned char *segmentation_data,
+                              int mask_w, int mask_h, int img_w, int img_h,
+                              unsigned char no_class_id, unsigned char *output);
+
+/**
+ * Reference implementation of segmentation_postprocess with a zeroed
+ * cv::Mat per detection to apply the box.
+ */
+void segmentation_postprocess_opencv(const unsigned int *detection_data,
+                                     const unsigned char *segmentation_data,
+                                     int mask_w, int mask_h, int img_w, int img_h,
+                                     unsigned char no_class_id,
+                                     unsigned char *output);
+
+/**
+ * Map a class map to RGBA colors at half intensity with a 256 entry
+ * lookup table, four pixels per store.
+ * @param class_map class of each pixel
+ * @param nsamples number of pixels
+ * @param output 4 x nsamples RGBA bytes
+ */
+void segmentation_reconstruct(const unsigned char *class_map, int nsamples,
+                              unsigned char *output);
+
+/**
+ * Reference implementation of segmentation_reconstruct that converts
+ * one channel at a time.
+ */
+void segmentation_reconstruct_reference(const unsigned char *class_map,
+                                        int nsamples, unsigned char *output);
+
+#endif // POCL_ONNX_SEGMENTATION_H
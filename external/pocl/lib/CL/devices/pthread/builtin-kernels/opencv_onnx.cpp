@@ -1,8 +1,16 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <limits.h>
+#include <mutex>
 #include <optional>
 #include <random>
+#include <set>
+#include <sstream>
 #include <string>
 #include <sys/time.h>
+#include <thread>
 #include <vector>
 #include <cstdio>
 
@@ -26,6 +34,11 @@
 // #include <tensorrt_provider_factory.h>
 #endif
 
+#if defined(__linux__) && defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
 #include <pocl_cl.h>
 #include <pocl_debug.h>
 
@@ -33,36 +46,53 @@
 #include <Tracy.hpp>
 #endif
 
+#include "onnx_eval.h"
+#include "onnx_postprocess.h"
+#include "onnx_preprocess.h"
+#include "onnx_segmentation.h"
 #include "opencv_onnx.h"
 
 #define NUM_CLASSES 81
 #define NO_CLASS_ID (NUM_CLASSES - 1)  // last ID signalizes no detection
 
-static const int SEGMENTATION_COLORS[256] = {
-    -1651865, -6634562, -5921894, -9968734, -1277957, -2838283,
-    -9013359, -9634954, -470042, -8997255, -4620585, -2953862,
-    -3811878, -8603498, -2455171, -5325920, -6757258, -8214427,
-    -5903423, -4680978, -4146958, -602947, -5396049, -9898511,
-    -8346466, -2122577, -2304523, -4667802, -222837, -4983945,
-    -234790, -8865559, -4660525, -3744578, -8720427, -9778035,
-    -680538, -7942224, -7162754, -2986121, -8795194, -2772629,
-    -4820488, -9401960, -3443339, -1781041, -4494168, -3167240,
-    -7629631, -6685500, -6901785, -2968136, -3953703, -4545430,
-    -6558846, -2631687, -5011272, -4983118, -9804322, -2593374,
-    -8473686, -4006938, -7801488, -7161859, -4854121, -5654350,
-    -817410, -8013957, -9252928, -2240041, -3625560, -6381719,
-    -4674608, -5704237, -8466309, -1788449, -7283030, -5781889,
-    -4207444, -8225948, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0
-};
+// The model outputs are scaled back to the input frame, so models with any
+// input shape write masks at a quarter of the frame. The buffers of the
+// masks are sized for the usual 640x480 frames.
+#define DNN_MASK_W 160
+#define DNN_MASK_H 120
+
+const std::vector<std::string> DNN_CLASSES{
+        "person", "bicycle", "car",
+        "motorcycle", "airplane", "bus",
+        "train", "truck", "boat",
+        "traffic light", "fire hydrant", "stop sign",
+        "parking meter", "bench", "bird",
+        "cat", "dog", "horse",
+        "sheep", "cow", "elephant",
+        "bear", "zebra", "giraffe",
+        "backpack", "umbrella", "handbag",
+        "tie", "suitcase", "frisbee",
+        "skis", "snowboard", "sports ball",
+        "kite", "baseball bat", "baseball glove",
+        "skateboard", "surfboard", "tennis racket",
+        "bottle", "wine glass", "cup",
+        "fork", "knife", "spoon",
+        "bowl", "banana", "apple",
+        "sandwich", "orange", "broccoli",
+        "carrot", "hot dog", "pizza",
+        "donut", "cake", "chair",
+        "couch", "potted plant", "bed",
+        "dining table", "toilet", "tv",
+        "laptop", "mouse", "remote",
+        "keyboard", "cell phone", "microwave",
+        "oven", "toaster", "sink",
+        "refrigerator", "book", "clock",
+        "vase", "scissors", "teddy bear",
+        "hair drier", "toothbrush"};
+
+// TODO: query input/output names from net
+static const char *const ONNX_INPUT_NAMES[] = {"images"};
+static const char *const ONNX_OUTPUT_NAMES[] = {"output0", "output1"};
 
 struct Detection {
     int class_id{0};
@@ -74,22 +104,18 @@ struct Detection {
 
 OnnxCtx::OnnxCtx(const std::string &onnxModelPath, Task task,
                  const cv::Size &modelInputShape,
-                 const cv::Size &segmentationMaskShape,
-                 const bool &runWithCuda) {
+                 const bool &runWithCuda,
+                 Precision precision) {
     this->modelPath = onnxModelPath;
     this->task = task;
     this->modelShape = modelInputShape;
-    this->segmentationMaskShape = segmentationMaskShape;
     this->cudaEnabled = runWithCuda;
+    this->precision = precision;
     this->ortEnv = Ort::Env{ORT_LOGGING_LEVEL_ERROR, "Default"};
 
     this->loadOnnxNetwork();
 }
 
-void OnnxCtx::setRotationCwDegrees(int degrees) {
-    this->rotationCwDegrees = degrees;
-}
-
 // Smuggling-related code for the basic device
 // #ifdef __ANDROID__
 // // Defined and initialized from JNI code since it has to go through
@@ -100,52 +126,396 @@ void OnnxCtx::setRotationCwDegrees(int degrees) {
 
 void OnnxCtx::loadOnnxNetwork() {
 
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+#ifndef __ANDROID__
+    if (this->cudaEnabled) {
+        POCL_MSG_PRINT_INFO("DNN: Running on CUDA\n");
+        if (this->precision == INT8) {
+            POCL_MSG_WARN("DNN: Most quantized operators have no CUDA kernels "
+                          "and run on the CPU\n");
+        }
+    } else {
+        POCL_MSG_PRINT_INFO("DNN: Running on CPU\n");
+    }
+#endif
+
+    // a single session until setSessionPool is called
+    this->sessions.clear();
+    this->sessions.push_back(this->createSession(0));
+    this->net = this->sessions[0].get();
+    this->sessionActiveRuns.assign(1, 0);
+    this->sessionRuns.assign(1, 0);
+    this->checkFloatIO();
+
+    // TODO: check that this is needed
+    this->onnxInputNames.reserve(this->net->GetInputCount());
+    for (size_t i = 0; i < this->onnxInputNames.size(); ++i) {
+        this->onnxInputNames.push_back(
+            this->net->GetInputNameAllocated(i, this->ortAllocator));
+    }
+    this->onnxOutputNames.reserve(this->net->GetOutputCount());
+    for (size_t i = 0; i < this->onnxOutputNames.size(); ++i) {
+        this->onnxOutputNames.push_back(
+            this->net->GetOutputNameAllocated(i, this->ortAllocator));
+    }
+
+    // models exported with a fixed batch size of 1 can't be batched
+    auto input_shape =
+        this->net->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    this->dynamicBatch = !input_shape.empty() && input_shape[0] < 0;
+
+    this->probeOutputShapes();
+}
+
+/**
+ * run a session once on an all zero frame
+ * @param ctx context of the model
+ * @param session to run
+ * @return outputs of the session
+ */
+static std::vector<Ort::Value> run_empty_frame(const OnnxCtx *ctx, Ort::Session *session) {
+    const cv::Size &shape = ctx->modelShape;
+    const size_t frame_count = 3 * (size_t) shape.width * shape.height;
+    std::vector<float> probe_input(frame_count, 0.0f);
+    const int64_t input_shape[] = {1, 3, shape.height, shape.width};
+    auto memory_info =
+        Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
+        memory_info, probe_input.data(), frame_count, input_shape, 4);
+
+    const size_t output_count = (ctx->task == Task::SEGMENT) ? 2 : 1;
+    return session->Run(Ort::RunOptions{}, ONNX_INPUT_NAMES, &input_tensor, 1,
+                        ONNX_OUTPUT_NAMES, output_count);
+}
+
+/**
+ * Intra-op thread affinities of a session in the onnxruntime format, e.g.
+ * "8;9" for the third session with 3 threads. Sessions get consecutive
+ * blocks of cores. The first core of a block is left to the pocl worker
+ * thread that calls Run(), since it takes part in the work as well.
+ * @param session index of the session
+ * @param threads intra-op threads per session
+ * @return affinities of the threads onnxruntime creates, 1-based core ids
+ */
+static std::string intraOpAffinities(int session, int threads) {
+    const int ncores = (int) std::max(std::thread::hardware_concurrency(), 1u);
+    std::string affinities;
+    for (int t = 1; t < threads; ++t) {
+        if (!affinities.empty()) {
+            affinities += ";";
+        }
+        affinities += std::to_string((session * threads + t) % ncores + 1);
+    }
+    return affinities;
+}
+
+/**
+ * load a new session of the model with the configured threading
+ * @param index of the session in the pool, picks the cores it is pinned to
+ * @return the session
+ */
+std::unique_ptr<Ort::Session> OnnxCtx::createSession(int index) const {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
 
     Ort::SessionOptions so;
+    if (this->intraOpThreads > 0) {
+        so.SetIntraOpNumThreads(this->intraOpThreads);
+    }
+    if (this->pinThreads && this->intraOpThreads > 1) {
+        const std::string affinities = intraOpAffinities(index, this->intraOpThreads);
+        so.AddConfigEntry("session.intra_op_thread_affinities", affinities.c_str());
+        POCL_MSG_PRINT_INFO("DNN: session %d intra-op threads pinned to cores %s\n",
+                            index, affinities.c_str());
+    }
 
 #ifdef __ANDROID__
     uint32_t nnapi_flags = 0;
+    if (this->precision == FP16) {
+        // let nnapi run the float32 parts of the graph in fp16 as well
+        nnapi_flags |= NNAPI_FLAG_USE_FP16;
+    }
     Ort::ThrowOnError(
         OrtSessionOptionsAppendExecutionProvider_Nnapi(so, nnapi_flags));
     //this->net = std::make_unique<Ort::Session>(ortEnv, pocl_onnx_blob,
     //                                           pocl_onnx_blob_size, so);
 #else
     if (this->cudaEnabled) {
-
-        POCL_MSG_PRINT_INFO("DNN: Running on CUDA\n");
-
         // We can later try TensorRT provider
         // const OrtTensorRTProviderOptions opts{};
         // so.AppendExecutionProvider_TensorRT(opts);
         const OrtCUDAProviderOptions opts;
         so.AppendExecutionProvider_CUDA(opts);
-    } else {
-        POCL_MSG_PRINT_INFO("DNN: Running on CPU\n");
     }
-    //this->net =
-    //    std::make_unique<Ort::Session>(ortEnv, this->modelPath.c_str(), so);
 #endif
-    this->net =
-        std::make_unique<Ort::Session>(ortEnv, this->modelPath.c_str(), so);
+    return std::make_unique<Ort::Session>(this->ortEnv, this->modelPath.c_str(), so);
+}
 
-    // TODO: check that this is needed
-    this->onnxInputNames.reserve(this->net->GetInputCount());
-    for (size_t i = 0; i < this->onnxInputNames.size(); ++i) {
-        this->onnxInputNames.push_back(
-            this->net->GetInputNameAllocated(i, this->ortAllocator));
+/**
+ * Set up the pool of sessions that detection launches are spread over.
+ * Must not be called while inference is running.
+ * @param numSessions number of sessions, each holds its own copy of the model
+ * @param intraOpThreads threads per session, 0 splits the cores evenly
+ * between the sessions, or lets onnxruntime decide for a single session
+ * @param pinThreads pin the threads of each session to their own cores
+ */
+void OnnxCtx::setSessionPool(int numSessions, int intraOpThreads, bool pinThreads) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    const int ncores = (int) std::max(std::thread::hardware_concurrency(), 1u);
+    numSessions = std::max(numSessions, 1);
+    if (intraOpThreads <= 0 && numSessions > 1) {
+        intraOpThreads = std::max(ncores / numSessions, 1);
     }
-    this->onnxOutputNames.reserve(this->net->GetOutputCount());
-    for (size_t i = 0; i < this->onnxOutputNames.size(); ++i) {
-        this->onnxOutputNames.push_back(
-            this->net->GetOutputNameAllocated(i, this->ortAllocator));
+    intraOpThreads = std::max(intraOpThreads, 0);
+    if (pinThreads && numSessions * intraOpThreads > ncores) {
+        POCL_MSG_WARN("DNN: %d sessions with %d threads each share %d cores\n",
+                      numSessions, intraOpThreads, ncores);
+    }
+
+    std::lock_guard<std::mutex> lock(this->inferenceSlotsMutex);
+    // loaded sessions are only kept if their threads are set up the same way
+    if (intraOpThreads != this->intraOpThreads || pinThreads != this->pinThreads) {
+        this->sessions.clear();
+    }
+    this->intraOpThreads = intraOpThreads;
+    this->pinThreads = pinThreads;
+    if ((int) this->sessions.size() > numSessions) {
+        this->sessions.resize(numSessions);
+    }
+    while ((int) this->sessions.size() < numSessions) {
+        this->sessions.push_back(this->createSession((int) this->sessions.size()));
+        // get the first run costs out of the way like the probe run does
+        run_empty_frame(this, this->sessions.back().get());
+    }
+    this->net = this->sessions[0].get();
+    this->sessionActiveRuns.assign(numSessions, 0);
+    this->sessionRuns.assign(numSessions, 0);
+
+    // slots are bound to a session
+    this->freeInferenceSlots.clear();
+    this->inferenceSlots.clear();
+    POCL_MSG_PRINT_INFO("DNN: %d sessions with %d intra-op threads each%s\n",
+                        numSessions, intraOpThreads, pinThreads ? ", pinned" : "");
+}
+
+/**
+ * Make sure the model takes and returns float32 tensors. Quantized models
+ * have to be exported with float32 inputs and outputs (e.g. keep_io_types
+ * for fp16) since the buffers and pre- and postprocessing are float32.
+ * Throws an Ort::Exception otherwise.
+ */
+void OnnxCtx::checkFloatIO() const {
+    const size_t output_count = (task == Task::SEGMENT) ? 2 : 1;
+    bool is_float =
+        this->net->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetElementType() ==
+        ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    for (size_t i = 0; i < output_count; ++i) {
+        is_float &=
+            this->net->GetOutputTypeInfo(i).GetTensorTypeAndShapeInfo().GetElementType() ==
+            ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    }
+
+    if (!is_float) {
+        throw Ort::Exception("model " + this->modelPath +
+                             " has non float32 inputs or outputs",
+                             ORT_INVALID_ARGUMENT);
+    }
+}
+
+/**
+ * Run the network once on an empty frame to find the output shapes.
+ * Also gets the one time setup costs of the session out of the way.
+ */
+void OnnxCtx::probeOutputShapes() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    std::vector<Ort::Value> net_outputs = run_empty_frame(this, this->net);
+
+    detectionShape = net_outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+    detectionShape.erase(detectionShape.begin());
+    if (task == Task::SEGMENT) {
+        protoShape = net_outputs[1].GetTensorTypeAndShapeInfo().GetShape();
+        protoShape.erase(protoShape.begin());
+    }
+}
+
+/**
+ * configure server-side batching of detection launches
+ * @param maxBatchSize max number of frames run in one batch, 1 disables batching
+ * @param batchWindowUs time the first frame of a batch waits for others to arrive
+ */
+void OnnxCtx::setBatching(int maxBatchSize, int batchWindowUs) {
+    if (maxBatchSize > 1 && !this->dynamicBatch) {
+        POCL_MSG_WARN("DNN: model %s has a fixed batch size, "
+                      "batching disabled\n", this->modelPath.c_str());
+        maxBatchSize = 1;
+    }
+    this->maxBatchSize = std::max(maxBatchSize, 1);
+    this->batchWindowUs = std::max(batchWindowUs, 0);
+    {
+        // slots are bound for a fixed batch capacity
+        std::lock_guard<std::mutex> lock(this->inferenceSlotsMutex);
+        this->freeInferenceSlots.clear();
+        this->inferenceSlots.clear();
+    }
+    POCL_MSG_PRINT_INFO("DNN: max batch size %d, batch window %d us\n",
+                        this->maxBatchSize, this->batchWindowUs);
+}
+
+/**
+ * get a model input frame to preprocess into, only allocates if all
+ * frames are in use.
+ * @return 3 x H x W floats
+ */
+float *OnnxCtx::acquireInputFrame() {
+    std::lock_guard<std::mutex> lock(this->inputFramesMutex);
+    if (this->freeInputFrames.empty()) {
+        size_t count = 3 * (size_t) this->modelShape.width * this->modelShape.height;
+        this->inputFrames.emplace_back(new float[count]);
+        this->bufferAllocations++;
+        POCL_MSG_PRINT_INFO("DNN: allocated input frame %zu after %lu runs\n",
+                            this->inputFrames.size() - 1,
+                            (unsigned long) this->inferenceRuns.load());
+        return this->inputFrames.back().get();
+    }
+    float *frame = this->freeInputFrames.back();
+    this->freeInputFrames.pop_back();
+    return frame;
+}
+
+void OnnxCtx::releaseInputFrame(float *frame) {
+    std::lock_guard<std::mutex> lock(this->inputFramesMutex);
+    this->freeInputFrames.push_back(frame);
+}
+
+static size_t shape_count(const std::vector<int64_t> &shape) {
+    size_t count = 1;
+    for (int64_t dim : shape) {
+        count *= (size_t) dim;
+    }
+    return count;
+}
+
+/**
+ * get an inference slot with room for maxBatchSize frames on the session
+ * with the fewest runs in flight, only allocates and binds a new one if all
+ * slots of that session are in use.
+ * @return slot to run with, give it back with releaseInferenceSlot
+ */
+InferenceSlot *OnnxCtx::acquireInferenceSlot() {
+    std::lock_guard<std::mutex> lock(this->inferenceSlotsMutex);
+    const int session = (int) (std::min_element(this->sessionActiveRuns.begin(),
+                                                this->sessionActiveRuns.end()) -
+                               this->sessionActiveRuns.begin());
+    this->sessionActiveRuns[session]++;
+    this->sessionRuns[session]++;
+
+    for (auto it = this->freeInferenceSlots.begin();
+         it != this->freeInferenceSlots.end(); ++it) {
+        if ((*it)->session == session) {
+            InferenceSlot *slot = *it;
+            this->freeInferenceSlots.erase(it);
+            return slot;
+        }
+    }
+
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    const int capacity = this->maxBatchSize;
+    const size_t frame_count = 3 * (size_t) modelShape.width * modelShape.height;
+    const size_t det_count = shape_count(this->detectionShape);
+    const size_t proto_count = shape_count(this->protoShape);
+
+    std::unique_ptr<InferenceSlot> slot(new InferenceSlot);
+    slot->batchCapacity = capacity;
+    slot->session = session;
+    slot->input.reset(new float[capacity * frame_count]);
+    slot->output0.reset(new float[capacity * det_count]);
+    if (task == Task::SEGMENT) {
+        slot->output1.reset(new float[capacity * proto_count]);
+    }
+
+    auto memory_info =
+        Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+    for (int n = 1; n <= capacity; ++n) {
+        Ort::IoBinding binding(*this->sessions[session]);
+
+        const int64_t input_shape[] = {n, 3, modelShape.height, modelShape.width};
+        slot->values.push_back(Ort::Value::CreateTensor<float>(
+            memory_info, slot->input.get(), n * frame_count, input_shape, 4));
+        binding.BindInput(ONNX_INPUT_NAMES[0], slot->values.back());
+
+        std::vector<int64_t> det_shape = this->detectionShape;
+        det_shape.insert(det_shape.begin(), n);
+        slot->values.push_back(Ort::Value::CreateTensor<float>(
+            memory_info, slot->output0.get(), n * det_count, det_shape.data(),
+            det_shape.size()));
+        binding.BindOutput(ONNX_OUTPUT_NAMES[0], slot->values.back());
+
+        if (task == Task::SEGMENT) {
+            std::vector<int64_t> proto_shape = this->protoShape;
+            proto_shape.insert(proto_shape.begin(), n);
+            slot->values.push_back(Ort::Value::CreateTensor<float>(
+                memory_info, slot->output1.get(), n * proto_count,
+                proto_shape.data(), proto_shape.size()));
+            binding.BindOutput(ONNX_OUTPUT_NAMES[1], slot->values.back());
+        }
+
+        slot->bindings.push_back(std::move(binding));
+    }
+
+    this->bufferAllocations++;
+    POCL_MSG_PRINT_INFO("DNN: bound inference slot %zu to session %d for %d frames "
+                        "after %lu runs\n", this->inferenceSlots.size(), session, capacity,
+                        (unsigned long) this->inferenceRuns.load());
+    this->inferenceSlots.push_back(std::move(slot));
+    return this->inferenceSlots.back().get();
+}
+
+void OnnxCtx::releaseInferenceSlot(InferenceSlot *slot) {
+    std::lock_guard<std::mutex> lock(this->inferenceSlotsMutex);
+    this->sessionActiveRuns[slot->session]--;
+    this->freeInferenceSlots.push_back(slot);
+}
+
+OnnxCtx::~OnnxCtx() {
+    POCL_MSG_PRINT_INFO("DNN: %lu inference runs, %lu buffer allocations\n",
+                        (unsigned long) this->inferenceRuns.load(),
+                        (unsigned long) this->bufferAllocations.load());
+    for (size_t i = 0; i < this->sessionRuns.size(); ++i) {
+        POCL_MSG_PRINT_INFO("DNN: session %zu ran %lu times\n", i,
+                            (unsigned long) this->sessionRuns[i]);
     }
 }
 
 namespace {
-OnnxCtx *global_onnx_ctx = nullptr;
+OnnxModelRegistry *global_onnx_models = nullptr;
+}
+
+/**
+ * run the detection with the requested model of the registry
+ * @param registry loaded models
+ * @param model_id position of the model in the registry, unknown ids fall
+ * back to the default model
+ */
+static void run_registry_inference(OnnxModelRegistry *const registry, int model_id,
+                                   const unsigned char *data, int width, int height,
+                                   int rotate_cw_degrees, int inp_format,
+                                   unsigned int *output, unsigned char *out_mask) {
+    OnnxCtx *ctx = registry->get(model_id);
+    run_onnx_inference(ctx, data, width, height, rotate_cw_degrees, inp_format,
+                       output, out_mask);
 }
 
 // Check pthread_utils.c setup_kernel_arg_array() to figure out how to get the
@@ -166,9 +536,10 @@ void _pocl_kernel_pocl_dnn_detection_u8_workgroup(
     int inp_format = *(int*)(arguments2[nargs++]);
     unsigned int *output = (unsigned int *)(arguments[nargs++]);
     unsigned char *out_mask  = (unsigned char *)(arguments[nargs++]);
+    int model_id = *(int*)(arguments2[nargs++]);
 
-    run_onnx_inference(global_onnx_ctx, data, width, height, rotate_cw_degrees, inp_format,
-                       output, out_mask);
+    run_registry_inference(global_onnx_models, model_id, data, width, height,
+                           rotate_cw_degrees, inp_format, output, out_mask);
 }
 
 void _pocl_kernel_pocl_dnn_segmentation_postprocess_u8_workgroup(
@@ -177,13 +548,18 @@ void _pocl_kernel_pocl_dnn_segmentation_postprocess_u8_workgroup(
     ulong group_z
 ) {
     void **arguments = *(void ***)(args);
+    void **arguments2 = (void **)(args);
 
     int nargs = 0;
     const unsigned int *detection_data = (const unsigned int *)(arguments[nargs++]);
     const unsigned char *segmentation_data = (const unsigned char *)(arguments[nargs++]);
     unsigned char *output = (unsigned char*)(arguments[nargs++]);
+    int rotate_cw_degrees = *(int*)(arguments2[nargs++]);
+    int width = *(int*)(arguments2[nargs++]);
+    int height = *(int*)(arguments2[nargs++]);
 
-    run_segmentation_postprocess(global_onnx_ctx, detection_data, segmentation_data, output);
+    run_segmentation_postprocess(detection_data, segmentation_data, width, height,
+                                 rotate_cw_degrees, output);
 }
 
 void _pocl_kernel_pocl_dnn_segmentation_reconstruct_u8_workgroup(
@@ -197,7 +573,7 @@ void _pocl_kernel_pocl_dnn_segmentation_reconstruct_u8_workgroup(
     const unsigned char *postprocess_data = (const unsigned char *)(arguments[nargs++]);
     unsigned char *output = (unsigned char*)(arguments[nargs++]);
 
-    run_segmentation_reconstruct(global_onnx_ctx, postprocess_data, output);
+    run_segmentation_reconstruct(postprocess_data, output);
 }
 
 void _pocl_kernel_pocl_decompress_from_jpeg_rgb888_workgroup(
@@ -234,7 +610,55 @@ void _pocl_kernel_pocl_dnn_eval_iou_f32_workgroup(
     int do_segment = *(int*)(arguments2[nargs++]);
     float *iou = (float*)(arguments[nargs++]);
 
-    eval_iou(global_onnx_ctx, det_data, seg_data, ref_det_data, ref_seg_data, do_segment, iou);
+    eval_iou(det_data, seg_data, ref_det_data, ref_seg_data, do_segment, iou, nullptr);
+}
+
+void _pocl_kernel_pocl_dnn_eval_confusion_u32_workgroup(
+    cl_uchar *args, cl_uchar *context,
+    ulong group_x, ulong group_y,
+    ulong group_z
+) {
+    void **arguments = *(void ***)(args);
+    void **arguments2 = (void **)(args);
+
+    int nargs = 0;
+    const uint8_t *det_data = (const uint8_t *)(arguments[nargs++]);
+    const uint8_t *seg_data = (const uint8_t *)(arguments[nargs++]);
+    const uint8_t *ref_det_data = (const uint8_t *)(arguments[nargs++]);
+    const uint8_t *ref_seg_data = (const uint8_t *)(arguments[nargs++]);
+    int do_segment = *(int*)(arguments2[nargs++]);
+    float *iou = (float*)(arguments[nargs++]);
+    uint32_t *confusion = (uint32_t *)(arguments[nargs++]);
+
+    eval_iou(det_data, seg_data, ref_det_data, ref_seg_data, do_segment, iou, confusion);
+}
+
+/**
+ * write the counters of the models that pocl.dnn.detection.u8 runs, summed
+ * over the loaded models: the inference runs and the model input and
+ * inference slot allocations. Zeros if no detection program was built.
+ */
+void _pocl_kernel_pocl_dnn_stats_u64_workgroup(
+    cl_uchar *args, cl_uchar *context,
+    ulong group_x, ulong group_y,
+    ulong group_z
+) {
+    void **arguments = *(void ***)(args);
+
+    int nargs = 0;
+    uint64_t *stats = (uint64_t *)(arguments[nargs++]);
+
+    stats[0] = 0;
+    stats[1] = 0;
+    if (nullptr == global_onnx_models) {
+        return;
+    }
+    for (const OnnxModel &model : global_onnx_models->models) {
+        if (model.ctx) {
+            stats[0] += model.ctx->inferenceRuns.load();
+            stats[1] += model.ctx->bufferAllocations.load();
+        }
+    }
 }
 
 std::string getDNNPath() {
@@ -252,36 +676,247 @@ std::string getDNNPath() {
     return ret;
 }
 
+/**
+ * read an integer setting from the environment
+ * @param name of the env variable
+ * @param default_value returned if the variable is not set
+ * @return value of the setting
+ */
+int getDNNEnvInt(const char *name, int default_value) {
+    const char *value = getenv(name);
+    if (NULL == value) {
+        return default_value;
+    }
+    return atoi(value);
+}
+
+/**
+ * apply the POCL_DNN_MAX_BATCH and POCL_DNN_BATCH_WINDOW_US settings
+ * to the given context. Batching is off by default.
+ * @param ctx to configure
+ */
+void configureDNNBatching(OnnxCtx *ctx) {
+    ctx->setBatching(getDNNEnvInt("POCL_DNN_MAX_BATCH", 1),
+                     getDNNEnvInt("POCL_DNN_BATCH_WINDOW_US", 2000));
+}
+
+/**
+ * apply the POCL_DNN_SESSIONS, POCL_DNN_INTRA_OP_THREADS and
+ * POCL_DNN_PIN_THREADS settings to the given context. Defaults to one
+ * session with onnxruntime's own threading.
+ * @param ctx to configure
+ */
+void configureDNNSessions(OnnxCtx *ctx) {
+    ctx->setSessionPool(getDNNEnvInt("POCL_DNN_SESSIONS", 1),
+                        getDNNEnvInt("POCL_DNN_INTRA_OP_THREADS", 0),
+                        getDNNEnvInt("POCL_DNN_PIN_THREADS", 0) != 0);
+}
+
+static const char *precisionName(Precision precision) {
+    switch (precision) {
+    case INT8:
+        return "int8";
+    case FP16:
+        return "fp16";
+    default:
+        return "fp32";
+    }
+}
+
+/**
+ * @param name of the model
+ * @param precision of the model
+ * @return file name of the model, quantized models have a suffix
+ */
+static std::string modelFileName(const std::string &name, Precision precision) {
+    if (precision == FP32) {
+        return name + ".onnx";
+    }
+    return name + "-" + precisionName(precision) + ".onnx";
+}
+
+/**
+ * Whether fp16 models are worth running. NNAPI and CUDA handle them, on the
+ * CPU they are only faster with native fp16 arithmetic (armv8.2 and up).
+ * Elsewhere onnxruntime converts everything back to fp32 on every run.
+ */
+static bool fp16Supported(bool runWithCuda) {
+#ifdef __ANDROID__
+    return true;
+#else
+    if (runWithCuda) {
+        return true;
+    }
+#if defined(__linux__) && defined(__aarch64__)
+    return (getauxval(AT_HWCAP) & HWCAP_ASIMDHP) != 0;
+#else
+    return false;
+#endif
+#endif
+}
+
+OnnxModelRegistry::OnnxModelRegistry(const std::string &dnnPath,
+                                     const std::string &modelList, Task task,
+                                     bool runWithCuda) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    std::stringstream list(modelList);
+    std::string entry;
+    while (std::getline(list, entry, ',')) {
+        if (entry.empty()) {
+            continue;
+        }
+
+        // name[:WxH[:precision]]
+        std::vector<std::string> fields;
+        std::stringstream entry_stream(entry);
+        std::string field;
+        while (std::getline(entry_stream, field, ':')) {
+            fields.push_back(field);
+        }
+
+        OnnxModel model;
+        model.name = fields[0];
+        model.inputShape = cv::Size(640, 480);
+        model.precision = FP32;
+        if (fields.size() > 1) {
+            int w, h;
+            if (sscanf(fields[1].c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+                model.inputShape = cv::Size(w, h);
+            } else {
+                POCL_MSG_ERR("DNN: Invalid input shape in model entry '%s', "
+                             "using 640x480\n", entry.c_str());
+            }
+        }
+        if (fields.size() > 2) {
+            if (fields[2] == "int8") {
+                model.precision = INT8;
+            } else if (fields[2] == "fp16") {
+                model.precision = FP16;
+            } else if (fields[2] != "fp32") {
+                POCL_MSG_ERR("DNN: Invalid precision in model entry '%s', "
+                             "using fp32\n", entry.c_str());
+            }
+        }
+
+        Precision load_precision = model.precision;
+        if (load_precision == FP16 && !fp16Supported(runWithCuda)) {
+            POCL_MSG_WARN("DNN: No fp16 support, loading %s %dx%d as fp32\n",
+                          model.name.c_str(), model.inputShape.width,
+                          model.inputShape.height);
+            load_precision = FP32;
+        }
+        const std::string path = dnnPath + "/" + modelFileName(model.name, load_precision);
+
+        const int model_id = (int) this->models.size();
+        // ids are positions in the list, so failed models keep their slot
+        if (this->find(model.name, model.inputShape, model.precision) >= 0) {
+            POCL_MSG_WARN("DNN: Model %s %dx%d %s listed twice, ignoring id %d\n",
+                          model.name.c_str(), model.inputShape.width,
+                          model.inputShape.height, precisionName(model.precision),
+                          model_id);
+        } else if (model_id == 0) {
+            // the default model has to load
+            model.ctx.reset(new OnnxCtx(path, task, model.inputShape, runWithCuda,
+                                        load_precision));
+        } else {
+            try {
+                model.ctx.reset(new OnnxCtx(path, task, model.inputShape, runWithCuda,
+                                            load_precision));
+            } catch (const Ort::Exception &e) {
+                POCL_MSG_ERR("DNN: Could not load model %s: %s\n", path.c_str(),
+                             e.what());
+            }
+        }
+
+        if (model.ctx) {
+            configureDNNSessions(model.ctx.get());
+            configureDNNBatching(model.ctx.get());
+            POCL_MSG_PRINT_INFO("DNN: Loaded model %d: %s %dx%d %s\n", model_id,
+                                model.name.c_str(), model.inputShape.width,
+                                model.inputShape.height, precisionName(load_precision));
+        }
+        this->models.push_back(std::move(model));
+    }
+
+    if (this->models.empty() || !this->models[0].ctx) {
+        POCL_ABORT("DNN: No default model in '%s'\n", modelList.c_str());
+    }
+}
+
+/**
+ * @param modelId position of the model in the registry
+ * @return context of the model, or of the default model if the id is
+ * unknown or the model failed to load
+ */
+OnnxCtx *OnnxModelRegistry::get(int modelId) {
+    if (modelId >= 0 && modelId < (int) this->models.size() &&
+        this->models[modelId].ctx) {
+        return this->models[modelId].ctx.get();
+    }
+
+    std::lock_guard<std::mutex> lock(this->fallbackMutex);
+    if (this->fallbackWarned.insert(modelId).second) {
+        POCL_MSG_WARN("DNN: Model %d is not available, using the default model\n",
+                      modelId);
+    }
+    return this->getDefault();
+}
+
+OnnxCtx *OnnxModelRegistry::getDefault() const {
+    return this->models[0].ctx.get();
+}
+
+/**
+ * @return id of the model with the given name, input shape and precision, or -1
+ */
+int OnnxModelRegistry::find(const std::string &name, const cv::Size &inputShape,
+                            Precision precision) const {
+    for (size_t i = 0; i < this->models.size(); ++i) {
+        if (this->models[i].name == name && this->models[i].inputShape == inputShape &&
+            this->models[i].precision == precision) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @return the POCL_DNN_MODELS setting, a comma separated list of
+ * name:WxH[:fp32|int8|fp16] entries. Defaults to yolov8n-seg at 640x480.
+ */
+std::string getDNNModelList() {
+    const char *models = getenv("POCL_DNN_MODELS");
+    if (NULL == models || '\0' == models[0]) {
+        models = "yolov8n-seg:640x480";
+    }
+    return std::string(models);
+}
+
 void init_onnx(cl_program program, cl_uint device_i) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
 
-    if(nullptr != global_onnx_ctx) {
+    if(nullptr != global_onnx_models) {
         POCL_MSG_PRINT_INFO("onnx init already performed once\n");
         return;
     }
 
-    constexpr int MODEL_W = 640;
-    constexpr int MODEL_H = 480;
     constexpr Task task = Task::SEGMENT;
-    constexpr int MASK_W = 160;
-    constexpr int MASK_H = 120;
-
-    std::string DNNPath = getDNNPath();
     bool runOnGPU = true;
 
-    global_onnx_ctx = new OnnxCtx(DNNPath + "/yolov8n-seg.onnx" , task,
-                                  cv::Size(MODEL_W, MODEL_H),
-                                  cv::Size(MASK_W, MASK_H),
-                                  runOnGPU);
+    global_onnx_models = new OnnxModelRegistry(getDNNPath(), getDNNModelList(),
+                                               task, runOnGPU);
 }
 
 void finish_onnx(cl_device_id device, cl_program program,
                  unsigned dev_i) {
-    if (global_onnx_ctx != nullptr) {
-        delete global_onnx_ctx;
-        global_onnx_ctx = nullptr;
+    if (global_onnx_models != nullptr) {
+        delete global_onnx_models;
+        global_onnx_models = nullptr;
     }
 }
 
@@ -324,350 +959,345 @@ std::string type2str(int type) {
     return r;
 }
 
-cv::Mat sigmoid(const cv::Mat &input) {
-#ifdef TRACY_ENABLE
-    ZoneScoped;
-#endif
-    cv::Mat output;
-    cv::exp(-input, output);
-    cv::divide(1, 1 + output, output);
-    return output;
-}
+/**
+ * A single launch of the detection kernel. Preprocessing and postprocessing
+ * happen on the thread of the launch, only the network run can be shared
+ * with other launches through batching.
+ */
+struct DetectionRequest {
+    unsigned int *output;
+    unsigned char *out_mask;
+    float *input;        // 3xHxW letterboxed model input, owned by the OnnxCtx
+    float resize_scale;  // input image size / letterboxed size
+    int out_mask_w;
+    int out_mask_h;
+    bool done;
+};
 
-void run_onnx_inference(OnnxCtx *const onnx_ctx, const unsigned char *input, int width, int height,
-                        int rotate_cw_degrees, int inp_format,
-                        unsigned int *output, unsigned char *out_mask) {
+/**
+ * convert the input image to a letterboxed planar float model input
+ * @param onnx_ctx context of the model
+ * @param input image data
+ * @param width of the input image
+ * @param height of the input image
+ * @param rotate_cw_degrees rotation to apply to the input image
+ * @param inp_format 0 for RGB, 1 for NV21, 2 for YV12
+ * @param req request to write the letterbox parameters to, req->input
+ * has to point to a frame of the model input size
+ */
+static void preprocess_onnx_input(OnnxCtx *const onnx_ctx, const unsigned char *input,
+                                  int width, int height, int rotate_cw_degrees,
+                                  int inp_format, DetectionRequest *req) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
 
-    assert(onnx_ctx);
-
-    cv::Mat img_rgb;
-    switch (inp_format) {
-    case 0: {
-        // Plain ol' RGB
-        POCL_MSG_PRINT_INFO("DNN: already RGB, no color transform done\n");
-        img_rgb = cv::Mat(height, width, CV_8UC3, (unsigned char *) input);
-        break;
-    }
-    case 1: {
-        // Android format with interleaved U/V samples
-        POCL_MSG_PRINT_INFO("DNN: NV21 -> RGB transform\n");
-        cv::Mat img(height + height / 2, width, CV_8UC1,
-                    (unsigned char *) input);
-        // For some reason, converting to BGR, not RGB, gives the correct RGB layout:
-        cvtColor(img, img_rgb, cv::COLOR_YUV2BGR_NV21);
-        break;
-    }
-    case 2: {
-        // Android format with separate U/V planes
-        POCL_MSG_PRINT_INFO("DNN: YV12 -> RGB transform\n");
-        cv::Mat img(height + height / 2, width, CV_8UC1,
-                    (unsigned char *) input);
-        // For some reason, converting to BGR, not RGB, gives the correct RGB layout:
-        cvtColor(img, img_rgb, cv::COLOR_YUV2BGR_YV12);
-        break;
+    if (rotate_cw_degrees % 90 != 0) {
+        POCL_MSG_ERR(
+                "DNN: Unsupported rotation of %d degrees, no rotation performed.\n",
+                rotate_cw_degrees);
+        rotate_cw_degrees = 0;
     }
-    default:
+
+    int rot_w, rot_h;
+    preprocess_rotated_size(width, height, rotate_cw_degrees, &rot_w, &rot_h);
+    req->out_mask_w = rot_w / 4;  // 160 or 120
+    req->out_mask_h = rot_h / 4;  // 120 or 160
+
+    // Color transform, rotation, letter box and scaling to [0, 1] in one pass.
+    // Note: The data layout of the input is CHW with C=3, H=480, W=640.
+    req->resize_scale = preprocess_fused(input, width, height, rotate_cw_degrees,
+                                         inp_format, onnx_ctx->modelShape.width,
+                                         onnx_ctx->modelShape.height, req->input);
+    if (req->resize_scale < 0) {
         POCL_MSG_ERR(
                 "DNN: Unsupported input format %d, no input transform performed.\n",
                 inp_format);
+        req->resize_scale = 1.0f;
     }
+}
 
-    switch (rotate_cw_degrees) {
-        case 0:
-            POCL_MSG_PRINT_INFO("DNN: No rotation\n");
-        break;
-        case 90:
-        case -270:
-            POCL_MSG_PRINT_INFO("DNN: Rotate 90 degrees clockwise\n");
-        cv::rotate(img_rgb, img_rgb, cv::ROTATE_90_CLOCKWISE);
-        break;
-        case 180:
-        case -180:
-            POCL_MSG_PRINT_INFO("DNN: Rotate 180 degrees\n");
-        cv::rotate(img_rgb, img_rgb, cv::ROTATE_180);
-        break;
-        case 270:
-        case -90:
-            POCL_MSG_PRINT_INFO("DNN: Rotate 90 degrees counter-clockwise\n");
-        cv::rotate(img_rgb, img_rgb, cv::ROTATE_90_COUNTERCLOCKWISE);
-        break;
-        default:
-            POCL_MSG_ERR(
-                    "DNN: Unsupported rotation of %d degrees, no rotation performed.\n",
-                    rotate_cw_degrees);
-    }
-
-    const int out_mask_w = img_rgb.cols / 4;  // 160 or 120
-    const int out_mask_h = img_rgb.rows / 4;  // 120 or 160
-
-    onnx_ctx->setRotationCwDegrees(rotate_cw_degrees);
-
-    cv::Mat modelInput;
-    img_rgb.convertTo(modelInput, CV_32F);
-
-    // Letter box: Shrink image to model input size (640x480), preserving aspect ratio,
-    // and fill the rest with zeros.
-    float resize_scale;
-
-    if (img_rgb.cols >= img_rgb.rows) {
-        resize_scale = (float)(img_rgb.cols) / (float)(onnx_ctx->modelShape.width);
-        cv::resize(modelInput, modelInput, cv::Size(onnx_ctx->modelShape.width,
-          (int)(img_rgb.rows / resize_scale)));
-    } else {
-        resize_scale = (float)(img_rgb.rows) / (float)(onnx_ctx->modelShape.height);
-        cv::resize(modelInput, modelInput,
-          cv::Size((int)(img_rgb.cols / resize_scale), onnx_ctx->modelShape.height));
-    }
-    cv::Mat tmp_img = cv::Mat::zeros(onnx_ctx->modelShape.height, onnx_ctx->modelShape.width, CV_8UC3);
-    modelInput.copyTo(tmp_img(cv::Rect(0, 0, modelInput.cols, modelInput.rows)));
-    modelInput = tmp_img;
-
-    cv::Mat blob;
-    cv::dnn::blobFromImage(modelInput, blob, 1.0 / 255.0, onnx_ctx->modelShape,
-                           cv::Scalar(), false, false);
-    assert(blob.isContinuous());
+/**
+ * decode the network outputs of one frame of a batch into the detection
+ * and segmentation mask buffers of the request.
+ * @param onnx_ctx context of the model
+ * @param req request to write the results of
+ * @param det_data output0 of this frame, dimensions x rows
+ * @param dimensions number of values per candidate box
+ * @param rows number of candidate boxes
+ * @param proto_data output1 of this frame, num_protos x mask_h x mask_w
+ */
+static void postprocess_onnx_output(OnnxCtx *const onnx_ctx, const DetectionRequest *req,
+                                    float *det_data, int dimensions, int rows,
+                                    float *proto_data) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
 
-    // Note: The data layout of the blob is NCHW with N=1, C=3, H=480, W=640.
-    // The image channels are arranged in R,G,B order.
+    unsigned int *output = req->output;
+    unsigned char *out_mask = req->out_mask;
+    const float resize_scale = req->resize_scale;
+    const int out_mask_w = req->out_mask_w;
+    const int out_mask_h = req->out_mask_h;
 
-    auto memory_info =
-        Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    std::vector<int64_t> blob_size;
-    for (int i = 0; i < blob.dims; ++i) {
-        blob_size.push_back(blob.size[i]);
-    }
-    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
-        memory_info, blob.ptr<float>(), blob.total(), blob_size.data(),
-        blob.dims);
-
-    // TODO: query input/output names from net
-    const std::vector<const char *> input_names = {"images"};
-    const std::vector<const char *> output_names = {"output0", "output1"};
-    std::vector<Ort::Value> net_outputs = onnx_ctx->net->Run(
-        Ort::RunOptions{}, input_names.data(), &input_tensor,
-        input_names.size(), output_names.data(), output_names.size());
-
-    // Process detection results
-    auto type_info = onnx_ctx->net->GetOutputTypeInfo(0);
-    auto tensor_info = type_info.GetTensorTypeAndShapeInfo();
-    int dimensions = tensor_info.GetShape()[1];
-    int rows = tensor_info.GetShape()[2];
-
-    cv::Mat detection_output =
-        cv::Mat(dimensions, rows, CV_32FC1,
-                net_outputs[0].GetTensorMutableData<float>());
-    // transpose to correct shape
-    cv::transpose(detection_output, detection_output);
-    float *data = reinterpret_cast<float *>(detection_output.data);
-
-    std::vector<int> class_ids;
-    std::vector<float> confidences;
-    std::vector<cv::Rect> boxes;
-    std::vector<float *> mask_coeffs;
-
-    for (int i = 0; i < rows; ++i) {
-        float *classes_scores = data + 4;
-
-        cv::Mat scores(1, onnx_ctx->classes.size(), CV_32FC1, classes_scores);
-        cv::Point class_id;
-        double maxClassScore;
-
-        cv::minMaxLoc(scores, 0, &maxClassScore, 0, &class_id);
-
-        if (maxClassScore > onnx_ctx->modelScoreThreshold) {
-            confidences.push_back(maxClassScore);
-            class_ids.push_back(class_id.x);
-
-            float x = data[0];
-            float y = data[1];
-            float w = data[2];
-            float h = data[3];
-
-            unsigned int left = (unsigned int)((x - 0.5 * w) * resize_scale);
-            unsigned int top = (unsigned int)((y - 0.5 * h) * resize_scale);
-
-            unsigned int width = (unsigned int)(w * resize_scale);
-            unsigned int height = (unsigned int)(h * resize_scale);
-
-            boxes.push_back(cv::Rect(left, top, width, height));
-            if (onnx_ctx->task == Task::SEGMENT) {
-                mask_coeffs.push_back(data + 4 + onnx_ctx->classes.size());
-            }
-        }
+    const int num_classes = (int) DNN_CLASSES.size();
 
-        data += dimensions;
-    }
+    // decoded straight from the channel-major output, no transpose needed
+    static thread_local DetectionCandidate candidates[DNN_CANDIDATE_CAPACITY];
+    int ncandidates = decode_detections(det_data, dimensions, rows, num_classes,
+                                        onnx_ctx->modelScoreThreshold,
+                                        resize_scale, candidates);
 
     // Non-max suppression: Prune overlapping bounding boxes
-    std::vector<int> nms_result;
-    cv::dnn::NMSBoxes(boxes, confidences, onnx_ctx->modelScoreThreshold,
-                      onnx_ctx->modelNMSThreshold, nms_result);
+    int nms_result[DNN_MAX_DETECTIONS];
+    int ndetections = nms_top_k(candidates, ncandidates, onnx_ctx->modelNMSThreshold,
+                                DNN_MAX_DETECTIONS, nms_result);
 
-    nms_result.resize(MIN(10, nms_result.size()));
-    output[0] = (unsigned int) (nms_result.size());
-    POCL_MSG_PRINT_INFO("DNN: Number of detections: %ld\n", nms_result.size());
+    output[0] = (unsigned int) ndetections;
+    POCL_MSG_PRINT_INFO("DNN: Number of detections: %d (%d candidates)\n",
+                        ndetections, ncandidates);
 
-    for (unsigned int i = 0; i < nms_result.size(); ++i) {
-        int idx = nms_result[i];
+    for (int i = 0; i < ndetections; ++i) {
+        const DetectionCandidate &det = candidates[nms_result[i]];
 
-        // TODO: Don't write beyond MAX_DETECTIONS
-        output[1 + 6 * i + 0] = (unsigned int) (class_ids[idx]);
+        output[1 + 6 * i + 0] = (unsigned int) (det.class_id);
         output[1 + 6 * i + 1] =
-                *reinterpret_cast<unsigned int *>(&confidences[idx]);
-        output[1 + 6 * i + 2] = (unsigned int) (boxes[idx].x);
-        output[1 + 6 * i + 3] = (unsigned int) (boxes[idx].y);
-        output[1 + 6 * i + 4] = (unsigned int) (boxes[idx].width);
-        output[1 + 6 * i + 5] = (unsigned int) (boxes[idx].height);
+                *reinterpret_cast<const unsigned int *>(&det.score);
+        output[1 + 6 * i + 2] = (unsigned int) (det.x);
+        output[1 + 6 * i + 3] = (unsigned int) (det.y);
+        output[1 + 6 * i + 4] = (unsigned int) (det.w);
+        output[1 + 6 * i + 5] = (unsigned int) (det.h);
 
         POCL_MSG_PRINT_INFO("DNN: detection %d: box %dx%d at (%d, %d), "
                             "class %d, conf %.3f\n",
-                            i, boxes[idx].width, boxes[idx].height,
-                            boxes[idx].x, boxes[idx].y, class_ids[idx],
-                            confidences[idx]);
+                            i, det.w, det.h, det.x, det.y, det.class_id,
+                            det.score);
     }
 
     // Process segmentation results
     if (onnx_ctx->task == Task::SEGMENT) {
-        auto type_info = onnx_ctx->net->GetOutputTypeInfo(1);
-        auto tensor_info = type_info.GetTensorTypeAndShapeInfo();
-        int mask_w = tensor_info.GetShape()[3];
-        int mask_h = tensor_info.GetShape()[2];
+        const std::vector<int64_t> &proto_shape = onnx_ctx->protoShape;
+        int mask_w = proto_shape[2];
+        int mask_h = proto_shape[1];
 
-        if ((mask_w != onnx_ctx->segmentationMaskShape.width) ||
-            (mask_h != onnx_ctx->segmentationMaskShape.height)) {
+        // the prototypes are at a quarter of the model input resolution
+        if ((mask_w != onnx_ctx->modelShape.width / 4) ||
+            (mask_h != onnx_ctx->modelShape.height / 4)) {
             POCL_MSG_ERR("DNN: Unexpected segmentation mask shape. Got %dx%d, "
                          "expected %dx%d\n",
                          mask_w, mask_h,
-                         (int) (onnx_ctx->segmentationMaskShape.width),
-                         (int) (onnx_ctx->segmentationMaskShape.height));
+                         (int) (onnx_ctx->modelShape.width / 4),
+                         (int) (onnx_ctx->modelShape.height / 4));
 
         }
 
+        // sigmoid(x) > 0.60 is the same as x > log(0.60 / 0.40), which
+        // saves evaluating the sigmoid for every mask pixel
         const float threshold = 0.60;
-
-        const std::vector<int> squeezed_size{
-            (int)tensor_info.GetShape()[1],
-            mask_h * mask_w,
-        };
-
-        std::vector<int> intshape;
-        for (int i = 0; i < tensor_info.GetShape().size(); ++i) {
-            intshape.push_back((int)tensor_info.GetShape()[i]);
-        }
-        cv::Mat proto_squeezed = cv::Mat(
-            intshape, CV_32FC1, net_outputs[1].GetTensorMutableData<float>());
-        proto_squeezed = proto_squeezed.reshape(0, squeezed_size);
-        int num_mask_coeffs = dimensions - onnx_ctx->classes.size() - 4;
-
-        for (unsigned int i = 0; i < nms_result.size(); ++i) {
-            int idx = nms_result[i];
-
-            cv::Mat mc(1, num_mask_coeffs, CV_32FC1, mask_coeffs[idx]);
-            cv::Mat mask = sigmoid(mc * proto_squeezed);
-            cv::Mat binary_mask_1d = mask > threshold;
-            cv::Mat binary_mask_2d(mask_h, mask_w, CV_8UC1, binary_mask_1d.data);
+        const float logit_threshold = logf(threshold / (1.0f - threshold));
+        int num_mask_coeffs = dimensions - num_classes - 4;
+
+        if (ndetections > 0) {
+            cv::Mat proto_squeezed = cv::Mat((int)proto_shape[0], mask_h * mask_w,
+                                             CV_32FC1, proto_data);
+
+            // gather the coefficients of the kept rows from the channel-major
+            // output and compute the masks of all detections with one gemm
+            static thread_local cv::Mat mask_coeffs;
+            static thread_local cv::Mat mask_logits;
+            mask_coeffs.create(ndetections, num_mask_coeffs, CV_32FC1);
+            for (int i = 0; i < ndetections; ++i) {
+                const DetectionCandidate &det = candidates[nms_result[i]];
+                float *mc_data = mask_coeffs.ptr<float>(i);
+                for (int k = 0; k < num_mask_coeffs; ++k) {
+                    mc_data[k] = det_data[(size_t) (4 + num_classes + k) * rows + det.row];
+                }
+            }
+            cv::gemm(mask_coeffs, proto_squeezed, 1.0, cv::noArray(), 0.0, mask_logits);
 
             // Undo the letter box: Crop the section occupied by the actual segmentations
             // and resize it to the output segmentation mask shape with the same aspect ratio
             // as the rotated input image.
-            cv::Mat roi(binary_mask_2d, cv::Rect(0,0,
-              (int)((float)(out_mask_w) / resize_scale),
-              (int)((float)(out_mask_h) / resize_scale)));
-            cv::Mat cropped_binary_mask;
-            roi.copyTo(cropped_binary_mask);
-
-            cv::Mat resized_binary_mask;
-            cv::resize(cropped_binary_mask, resized_binary_mask,
-              cv::Size(out_mask_w, out_mask_h));
-
-            memcpy(out_mask + i * mask_w * mask_h, resized_binary_mask.data,
-                   mask_w * mask_h);
+            const cv::Rect roi(0, 0, (int)((float)(out_mask_w) / resize_scale),
+                               (int)((float)(out_mask_h) / resize_scale));
+            const cv::Size out_mask_size(out_mask_w, out_mask_h);
+            // every mask has a slot of the output mask size, whatever the size of the prototypes
+            const size_t out_mask_count = (size_t) out_mask_w * out_mask_h;
+            static thread_local cv::Mat binary_mask;
+
+            for (int i = 0; i < ndetections; ++i) {
+                cv::Mat logits_2d(mask_h, mask_w, CV_32FC1, mask_logits.ptr<float>(i));
+                cv::compare(logits_2d(roi), logit_threshold, binary_mask, cv::CMP_GT);
+
+                cv::Mat dst_mask(out_mask_size, CV_8UC1, out_mask + i * out_mask_count);
+                cv::resize(binary_mask, dst_mask, out_mask_size);
+            }
         }
     }
 }
 
-void run_segmentation_postprocess(const OnnxCtx *const onnx_ctx, const unsigned int *detection_data,
-                                  const unsigned char *segmentation_data,
-                                  unsigned char *output) {
+/**
+ * run the network once on the stacked inputs of the given requests and
+ * split the outputs back to each request.
+ * @param onnx_ctx context of the model
+ * @param slot bound buffers to run with, requests that didn't preprocess
+ * into the input of the slot are copied there first
+ * @param reqs requests to run, all preprocessed
+ * @param nreqs number of requests, must not exceed the slot capacity
+ */
+static void run_onnx_batch(OnnxCtx *const onnx_ctx, InferenceSlot *slot,
+                           DetectionRequest *const *reqs, int nreqs) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    assert(onnx_ctx);
 
-    unsigned int num_detections = detection_data[0];
-    // TODO: The mask shapes should be set via the out_mask_w/h defined in run_onnx_inference()
-    int mask_w = onnx_ctx->segmentationMaskShape.width;
-    int mask_h = onnx_ctx->segmentationMaskShape.height;
-    int img_w = onnx_ctx->modelShape.width;
-    int img_h = onnx_ctx->modelShape.height;
-
-    if (onnx_ctx->rotationCwDegrees % 180 != 0) {
-      mask_h = onnx_ctx->segmentationMaskShape.width;
-      mask_w = onnx_ctx->segmentationMaskShape.height;
-      img_h = onnx_ctx->modelShape.width;
-      img_w = onnx_ctx->modelShape.height;
-    }
-
-    cv::Mat color_mask(mask_h, mask_w, CV_8UC1, cv::Scalar(NO_CLASS_ID));
-
-    for (int i = 0; i < num_detections; ++i) {
-        unsigned char class_id = (unsigned char)(detection_data[1 + 6 * i]);
-
-        int box_x =
-            (int)((float)(detection_data[1 + 6 * i + 2]) / (float)(img_w) * (float)(mask_w));
-        int box_y =
-            (int)((float)(detection_data[1 + 6 * i + 3]) / (float)(img_h) * (float)(mask_h));
-        int box_w =
-            (int)((float)(detection_data[1 + 6 * i + 4]) / (float)(img_w) * (float)(mask_w));
-        int box_h =
-            (int)((float)(detection_data[1 + 6 * i + 5]) / (float)(img_h) * (float)(mask_h));
-
-        box_x = std::min(std::max(box_x, 0), mask_w);
-        box_y = std::min(std::max(box_y, 0), mask_h);
-        box_w = std::min(box_w, mask_w - box_x);
-        box_h = std::min(box_h, mask_h - box_y);
-
-        if (box_w > 0 && box_h > 0) {
-            cv::Mat raw_mask(mask_h, mask_w, CV_8UC1,
-                             (void *)(segmentation_data + i * mask_w * mask_h));
-            cv::Rect roi(box_x, box_y, box_w, box_h);
-            cv::Mat raw_mask_roi = cv::Mat::zeros(mask_h, mask_w, CV_8UC1);
-            raw_mask(roi).copyTo(raw_mask_roi(roi));
-            color_mask.setTo(cv::Scalar(class_id), raw_mask_roi);
+    assert(nreqs <= slot->batchCapacity);
+
+    const size_t frame_count =
+        3 * (size_t) onnx_ctx->modelShape.width * onnx_ctx->modelShape.height;
+    for (int n = 0; n < nreqs; ++n) {
+        float *slot_input = slot->input.get() + n * frame_count;
+        if (reqs[n]->input != slot_input) {
+            memcpy(slot_input, reqs[n]->input, frame_count * sizeof(float));
         }
     }
 
-    memcpy(output, color_mask.data, mask_w * mask_h);
+    onnx_ctx->sessions[slot->session]->Run(onnx_ctx->runOptions,
+                                           slot->bindings[nreqs - 1]);
+    onnx_ctx->inferenceRuns++;
+
+    const int dimensions = onnx_ctx->detectionShape[0];
+    const int rows = onnx_ctx->detectionShape[1];
+    const size_t proto_count = shape_count(onnx_ctx->protoShape);
+
+    for (int n = 0; n < nreqs; ++n) {
+        float *proto_data = (onnx_ctx->task == Task::SEGMENT)
+                            ? slot->output1.get() + n * proto_count
+                            : nullptr;
+        postprocess_onnx_output(onnx_ctx, reqs[n],
+                                slot->output0.get() + (size_t) n * dimensions * rows,
+                                dimensions, rows, proto_data);
+    }
 }
 
-void run_segmentation_reconstruct(const OnnxCtx *const onnx_ctx,
-                                  const unsigned char *postprocess_data,
-                                  unsigned char *output) {
+/**
+ * Hand the request over to the batcher and return once its results have
+ * been written. The first request to arrive becomes the batch leader: it
+ * waits up to batchWindowUs for more requests, runs the batch and wakes up
+ * the others. Requests that don't fit in the batch are picked up by the
+ * next leader.
+ * @param onnx_ctx context of the model
+ * @param req preprocessed request
+ */
+static void submit_detection_request(OnnxCtx *const onnx_ctx, DetectionRequest *req) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    std::unique_lock<std::mutex> lock(onnx_ctx->batchMutex);
+    onnx_ctx->pendingRequests.push_back(req);
+    onnx_ctx->batchCond.notify_all();
+
+    while (!req->done) {
+        if (onnx_ctx->batchLeaderActive || onnx_ctx->pendingRequests.empty()) {
+            onnx_ctx->batchCond.wait(lock);
+            continue;
+        }
+
+        onnx_ctx->batchLeaderActive = true;
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::microseconds(onnx_ctx->batchWindowUs);
+        onnx_ctx->batchCond.wait_until(lock, deadline, [onnx_ctx] {
+            return onnx_ctx->pendingRequests.size() >= (size_t) onnx_ctx->maxBatchSize;
+        });
+
+        int nreqs = MIN(onnx_ctx->maxBatchSize, (int) onnx_ctx->pendingRequests.size());
+        std::vector<DetectionRequest *> batch(onnx_ctx->pendingRequests.begin(),
+                                              onnx_ctx->pendingRequests.begin() + nreqs);
+        onnx_ctx->pendingRequests.erase(onnx_ctx->pendingRequests.begin(),
+                                        onnx_ctx->pendingRequests.begin() + nreqs);
+        // let one of the remaining requests collect the next batch while
+        // this one runs
+        onnx_ctx->batchLeaderActive = false;
+        onnx_ctx->batchCond.notify_all();
+
+        lock.unlock();
+        POCL_MSG_PRINT_INFO("DNN: running batch of %d frames\n", nreqs);
+        InferenceSlot *slot = onnx_ctx->acquireInferenceSlot();
+        run_onnx_batch(onnx_ctx, slot, batch.data(), nreqs);
+        onnx_ctx->releaseInferenceSlot(slot);
+        lock.lock();
+
+        for (DetectionRequest *r : batch) {
+            r->done = true;
+        }
+        onnx_ctx->batchCond.notify_all();
+    }
+}
+
+void run_onnx_inference(OnnxCtx *const onnx_ctx, const unsigned char *input, int width, int height,
+                        int rotate_cw_degrees, int inp_format,
+                        unsigned int *output, unsigned char *out_mask) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
-    assert(onnx_ctx);
 
-    const int nsamples = onnx_ctx->segmentationMaskShape.width * onnx_ctx->segmentationMaskShape.height;
+    assert(onnx_ctx);
 
-    // map class indices to colors
-    // TODO: This can be done with cv::applyColorMap but I didn't get it to work.
-    for (int i = 0; i < nsamples; ++i) {
-        const uint8_t class_id = postprocess_data[i];
+    DetectionRequest req;
+    req.output = output;
+    req.out_mask = out_mask;
+    req.done = false;
+
+    if (onnx_ctx->maxBatchSize <= 1) {
+        // preprocess straight into the bound input of the slot
+        InferenceSlot *slot = onnx_ctx->acquireInferenceSlot();
+        req.input = slot->input.get();
+        preprocess_onnx_input(onnx_ctx, input, width, height, rotate_cw_degrees,
+                              inp_format, &req);
+        DetectionRequest *reqs[] = {&req};
+        run_onnx_batch(onnx_ctx, slot, reqs, 1);
+        onnx_ctx->releaseInferenceSlot(slot);
+    } else {
+        req.input = onnx_ctx->acquireInputFrame();
+        preprocess_onnx_input(onnx_ctx, input, width, height, rotate_cw_degrees,
+                              inp_format, &req);
+        submit_detection_request(onnx_ctx, &req);
+        onnx_ctx->releaseInputFrame(req.input);
+    }
+}
 
-        const int color_int = SEGMENTATION_COLORS[class_id];
-        const unsigned char *channels =
-            reinterpret_cast<const unsigned char *>(&color_int);
+void run_segmentation_postprocess(const unsigned int *detection_data,
+                                  const unsigned char *segmentation_data, int width, int height,
+                                  int rotate_cw_degrees, unsigned char *output) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
 
-        // RGBA image
-        output[4 * i] = channels[0] / 2;
-        output[4 * i + 1] = channels[1] / 2;
-        output[4 * i + 2] = channels[2] / 2;
-        output[4 * i + 3] = channels[3] / 2;
+    // the same shapes as preprocess_onnx_input() gives the detection masks
+    int img_w, img_h;
+    preprocess_rotated_size(width, height, rotate_cw_degrees, &img_w, &img_h);
+    const int mask_w = img_w / 4;
+    const int mask_h = img_h / 4;
+    if (mask_w * mask_h > DNN_MASK_W * DNN_MASK_H) {
+        POCL_MSG_ERR("DNN: Masks of a %dx%d frame do not fit the %dx%d output\n", width,
+                     height, DNN_MASK_W, DNN_MASK_H);
+        return;
     }
+
+    segmentation_postprocess(detection_data, segmentation_data, mask_w, mask_h,
+                             img_w, img_h, NO_CLASS_ID, output);
+}
+
+void run_segmentation_reconstruct(const unsigned char *postprocess_data,
+                                  unsigned char *output) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+
+    const int nsamples = DNN_MASK_W * DNN_MASK_H;
+
+    segmentation_reconstruct(postprocess_data, nsamples, output);
 }
 
 // TODO: remove this
@@ -695,85 +1325,64 @@ void run_decompress_from_jpeg_rgb888(const uint8_t *input,
   }
 }
 
-void eval_iou(const OnnxCtx *const onnx_ctx,
-              const uint8_t *det_data, const uint8_t *seg_data,
+void eval_iou(const uint8_t *det_data, const uint8_t *seg_data,
               const uint8_t *ref_det_data, const uint8_t *ref_seg_data,
-              int do_segment, float *iou) {
+              int do_segment, float *iou, uint32_t *confusion) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
 
-    assert(onnx_ctx);
+    constexpr size_t CONFUSION_COUNT = NUM_CLASSES * NUM_CLASSES;
 
     if (do_segment) {
-        uint16_t correct[NUM_CLASSES] = {0};
-        uint16_t wrong[NUM_CLASSES] = {0};
+        // kept around so that callers without a confusion buffer don't allocate
+        static thread_local std::vector<uint32_t> local_confusion;
+        if (confusion == nullptr) {
+            local_confusion.resize(CONFUSION_COUNT);
+            confusion = local_confusion.data();
+        }
 
-        const int npx = onnx_ctx->segmentationMaskShape.width
-                        * onnx_ctx->segmentationMaskShape.height;
+        const int npx = DNN_MASK_W * DNN_MASK_H;
 
         POCL_MSG_PRINT_INFO("EVAL IOU: num_pixels: %d, num_classes: %d\n", npx,
                             NUM_CLASSES);
 
-        for (int i = 0; i < npx; ++i) {
-            int ground_truth_class = ref_seg_data[i];
-            int predicted_class = seg_data[i];
-
-            if (predicted_class >= NUM_CLASSES || ground_truth_class >= NUM_CLASSES) {
-                POCL_MSG_ERR(
-                    "EVAL IOU: Pixel %d, invalid class predicted: %d, ground truth: %d. Must be < %d. Setting IoU to -6.0 and skipping.\n",
-                    i, predicted_class, ground_truth_class, NUM_CLASSES
-                );
-
-                *iou = -6.0f;
-                return;
-            }
+        int invalid = eval_confusion_matrix(seg_data, ref_seg_data, npx, NUM_CLASSES,
+                                            NO_CLASS_ID, confusion);
+        if (invalid >= 0) {
+            POCL_MSG_ERR(
+                "EVAL IOU: Pixel %d, invalid class predicted: %d, ground truth: %d. Must be < %d. Setting IoU to -6.0 and skipping.\n",
+                invalid, seg_data[invalid], ref_seg_data[invalid], NUM_CLASSES
+            );
 
-            if (ground_truth_class == NO_CLASS_ID) {
-                if (predicted_class == NO_CLASS_ID) {
-                    // correct no prediction, true negative, not interested
-                } else {
-                    // false positive
-                    wrong[predicted_class] += 1;
-                }
-            } else {
-                if (ground_truth_class == predicted_class) {
-                    // true positive
-                    correct[predicted_class] += 1;
-                } else if (predicted_class == NO_CLASS_ID) {
-                    // false negative
-                    wrong[ground_truth_class] += 1;
-                } else {
-                    // false positive
-                    wrong[predicted_class] += 1;
-                }
-            }
+            memset(confusion, 0, CONFUSION_COUNT * sizeof(uint32_t));
+            *iou = -6.0f;
+            return;
         }
 
-        float tmp_iou = 0.0f;
-        int num_detections = 0;
+        EvalClassCounts counts[NUM_CLASSES];
+        eval_class_counts(confusion, NUM_CLASSES, NO_CLASS_ID, counts);
 
         for (int cls = 0; cls < NUM_CLASSES; ++cls) {
-            if ((correct[cls] + wrong[cls]) != 0) {
-                tmp_iou += (float) (correct[cls])
-                           / (float) (correct[cls] + wrong[cls]);
-                num_detections += 1;
-
+            const uint32_t total = counts[cls].correct + counts[cls].wrong;
+            if (total != 0) {
                 POCL_MSG_PRINT_INFO(
-                        "EVAL IOU: class %3d (%15s), correct: %5d, wrong: %5d, iou: %5.3f\n",
-                        cls, onnx_ctx->classes[cls].c_str(), correct[cls],
-                        wrong[cls], tmp_iou
+                        "EVAL IOU: class %3d (%15s), correct: %5u, wrong: %5u, iou: %5.3f\n",
+                        cls, DNN_CLASSES[cls].c_str(), counts[cls].correct,
+                        counts[cls].wrong, (float) counts[cls].correct / (float) total
                 );
             }
         }
 
-        if (num_detections == 0) {
+        if (eval_mean_iou(counts, NUM_CLASSES, iou) == 0) {
             *iou = -2.0f;
         } else {
-            *iou = tmp_iou / (float) (num_detections);
             POCL_MSG_PRINT_INFO("EVAL IOU: %5.3f\n", *iou);
         }
     } else {
+        if (confusion != nullptr) {
+            memset(confusion, 0, CONFUSION_COUNT * sizeof(uint32_t));
+        }
         *iou = -3.0f;
     }
 }
@@ -797,28 +1406,12 @@ void _pocl_kernel_pocl_dnn_ctx_init_workgroup(
     // TODO: remove this
 //    OnnxCtx **ctx = (OnnxCtx **) (arguments[0]);
 
-
-
-    constexpr int MODEL_W = 640;
-    constexpr int MODEL_H = 480;
-    constexpr int IMG_W = 640;
-    constexpr int IMG_H = 480;
     constexpr Task task = Task::SEGMENT;
-    constexpr int MASK_W = 160;
-    constexpr int MASK_H = 120;
-
-// TODO: get the path from an env variable instead of hardcoding this
-#ifdef __ANDROID__
-    std::string projectBasePath = "/data/user/0/org.portablecl.poclaisademo/files";
-#else
-    std::string projectBasePath = "/tmp";
-#endif
-
     bool runOnGPU = true;
 
-    *((pocl_context *)context)->data = new OnnxCtx(projectBasePath + "/yolov8n-seg.onnx", task,
-                       cv::Size(MODEL_W, MODEL_H), cv::Size(MASK_W, MASK_H),
-                       runOnGPU);
+    OnnxModelRegistry *ctx = new OnnxModelRegistry(getDNNPath(), getDNNModelList(),
+                                                   task, runOnGPU);
+    *((pocl_context *)context)->data = ctx;
 
 }
 
@@ -851,7 +1444,7 @@ void _pocl_kernel_pocl_dnn_ctx_detection_u8_workgroup(
     int nargs = 0;
 //    OnnxCtx **ctx = (OnnxCtx **) (arguments[nargs++]);
     nargs++;
-    OnnxCtx *ctx = (OnnxCtx *) *(((pocl_context *)context)->data);
+    OnnxModelRegistry *ctx = (OnnxModelRegistry *) *(((pocl_context *)context)->data);
     const unsigned char *data = (const unsigned char *) (arguments[nargs++]);
     int width = *(int *) (arguments2[nargs++]);
     int height = *(int *) (arguments2[nargs++]);
@@ -859,9 +1452,10 @@ void _pocl_kernel_pocl_dnn_ctx_detection_u8_workgroup(
     int inp_format = *(int *) (arguments2[nargs++]);
     unsigned int *output = (unsigned int *) (arguments[nargs++]);
     unsigned char *out_mask = (unsigned char *) (arguments[nargs++]);
+    int model_id = *(int *) (arguments2[nargs++]);
 
-    run_onnx_inference(ctx, data, width, height, rotate_cw_degrees, inp_format,
-                       output, out_mask);
+    run_registry_inference(ctx, model_id, data, width, height, rotate_cw_degrees,
+                           inp_format, output, out_mask);
 }
 
 void _pocl_kernel_pocl_dnn_ctx_segmentation_postprocess_u8_workgroup(
@@ -869,16 +1463,20 @@ void _pocl_kernel_pocl_dnn_ctx_segmentation_postprocess_u8_workgroup(
         ulong group_x, ulong group_y,
         ulong group_z) {
     void **arguments = *(void ***) (args);
+    void **arguments2 = (void **) (args);
 
     int nargs = 0;
 //    OnnxCtx **ctx = (OnnxCtx **) (arguments[nargs++]);
     nargs++;
-    OnnxCtx *ctx = (OnnxCtx *) *(((pocl_context *)context)->data);
     const unsigned int *detection_data = (const unsigned int *) (arguments[nargs++]);
     const unsigned char *segmentation_data = (const unsigned char *) (arguments[nargs++]);
     unsigned char *output = (unsigned char *) (arguments[nargs++]);
+    int rotate_cw_degrees = *(int *) (arguments2[nargs++]);
+    int width = *(int *) (arguments2[nargs++]);
+    int height = *(int *) (arguments2[nargs++]);
 
-    run_segmentation_postprocess(ctx, detection_data, segmentation_data, output);
+    run_segmentation_postprocess(detection_data, segmentation_data, width, height,
+                                 rotate_cw_degrees, output);
 }
 
 void _pocl_kernel_pocl_dnn_ctx_segmentation_reconstruct_u8_workgroup(
@@ -891,11 +1489,10 @@ void _pocl_kernel_pocl_dnn_ctx_segmentation_reconstruct_u8_workgroup(
     int nargs = 0;
 //    OnnxCtx **ctx = (OnnxCtx **) (arguments[nargs++]);
     nargs++;
-    OnnxCtx *ctx = (OnnxCtx *) *(((pocl_context *)context)->data);
     const unsigned char *postprocess_data = (const unsigned char *) (arguments[nargs++]);
     unsigned char *output = (unsigned char *) (arguments[nargs++]);
 
-    run_segmentation_reconstruct(ctx, postprocess_data, output);
+    run_segmentation_reconstruct(postprocess_data, output);
 }
 
 void _pocl_kernel_pocl_dnn_ctx_eval_iou_f32_workgroup(
@@ -909,7 +1506,6 @@ void _pocl_kernel_pocl_dnn_ctx_eval_iou_f32_workgroup(
     int nargs = 0;
 //    OnnxCtx **ctx = (OnnxCtx **) (arguments[nargs++]);
     nargs++;
-    OnnxCtx *ctx = (OnnxCtx *) *(((pocl_context *)context)->data);
     const uint8_t *det_data = (const uint8_t *) (arguments[nargs++]);
     const uint8_t *seg_data = (const uint8_t *) (arguments[nargs++]);
     const uint8_t *ref_det_data = (const uint8_t *) (arguments[nargs++]);
@@ -917,7 +1513,7 @@ void _pocl_kernel_pocl_dnn_ctx_eval_iou_f32_workgroup(
     int do_segment = *(int *) (arguments2[nargs++]);
     float *iou = (float *) (arguments[nargs++]);
 
-    eval_iou(ctx, det_data, seg_data, ref_det_data, ref_seg_data, do_segment, iou);
+    eval_iou(det_data, seg_data, ref_det_data, ref_seg_data, do_segment, iou, nullptr);
 }
 
 void init_onnx_ctx(cl_program program, cl_uint device_i) {
@@ -958,7 +1554,7 @@ void init_onnx_ctx(cl_program program, cl_uint device_i) {
 void finish_onnx_ctx(cl_device_id device, cl_program program, unsigned dev_i) {
 
     if (program->data[dev_i] != nullptr) {
-        delete program->data[dev_i];
+        delete (OnnxModelRegistry *) program->data[dev_i];
         program->data[dev_i] = nullptr;
     }
 }
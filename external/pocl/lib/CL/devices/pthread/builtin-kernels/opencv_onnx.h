@@ -40,6 +40,18 @@ void _pocl_kernel_pocl_dnn_eval_iou_f32_workgroup(
         ulong group_z);
 
 
+POCL_EXPORT
+void _pocl_kernel_pocl_dnn_eval_confusion_u32_workgroup(
+        cl_uchar *args, cl_uchar *context,
+        ulong group_x, ulong group_y,
+        ulong group_z);
+
+POCL_EXPORT
+void _pocl_kernel_pocl_dnn_stats_u64_workgroup(
+        cl_uchar *args, cl_uchar *context,
+        ulong group_x, ulong group_y,
+        ulong group_z);
+
 POCL_EXPORT
 void init_onnx(cl_program program, cl_uint device_i);
 
@@ -52,83 +64,190 @@ enum Task {
     SEGMENT,
 };
 
+/**
+ * Numeric precision of a model. Quantized models are separate files with
+ * float32 inputs and outputs, so they run through the same pre- and
+ * postprocessing.
+ */
+enum Precision {
+    FP32,
+    INT8, // statically quantized, <name>-int8.onnx
+    FP16, // <name>-fp16.onnx, only where the execution provider supports it
+};
+
+struct DetectionRequest;
+
+/**
+ * Model inputs and outputs that are allocated and bound to the session
+ * once, so that a run doesn't need to allocate anything. Binding n - 1
+ * covers the first n frames of the buffers.
+ */
+struct InferenceSlot {
+    int batchCapacity;
+    int session; // index of the session the bindings belong to
+    std::unique_ptr<float[]> input;   // batchCapacity x 3 x H x W
+    std::unique_ptr<float[]> output0; // batchCapacity x detectionShape
+    std::unique_ptr<float[]> output1; // batchCapacity x protoShape
+    std::vector<Ort::Value> values;   // kept alive for the bindings
+    std::vector<Ort::IoBinding> bindings;
+};
+
 class OnnxCtx {
 public:
     OnnxCtx(const std::string &onnxModelPath, Task task,
             const cv::Size &modelInputShape = {640, 480},
-            const cv::Size &segmentationMaskShape = {160, 120},
-            const bool &runWithCuda = true);
+            const bool &runWithCuda = true,
+            Precision precision = FP32);
 
     void loadOnnxNetwork();
 
-    void setRotationCwDegrees(int degrees);
+    std::unique_ptr<Ort::Session> createSession(int index) const;
+
+    void setSessionPool(int numSessions, int intraOpThreads, bool pinThreads);
+
+    void checkFloatIO() const;
+
+    void probeOutputShapes();
+
+    void setBatching(int maxBatchSize, int batchWindowUs);
+
+    float *acquireInputFrame();
+
+    void releaseInputFrame(float *frame);
+
+    InferenceSlot *acquireInferenceSlot();
+
+    void releaseInferenceSlot(InferenceSlot *slot);
+
+    ~OnnxCtx();
 
     std::string modelPath;
     Task task;
     cv::Size modelShape;
-    cv::Size segmentationMaskShape;
     bool cudaEnabled;
+    Precision precision;
     Ort::AllocatorWithDefaultOptions ortAllocator;
     std::vector<cv::Mat> outputs;
-    std::unique_ptr<Ort::Session> net;
     Ort::Env ortEnv;
+    // Session pool: detection launches that run at the same time, e.g. from
+    // several clients, go to the least busy session instead of all queueing
+    // up behind one. Each session has its own intra-op thread pool which can
+    // be pinned to its own set of cores.
+    std::vector<std::unique_ptr<Ort::Session>> sessions;
+    Ort::Session *net = nullptr; // first session, used to query the model
+    int intraOpThreads = 0;      // per session, 0 lets onnxruntime decide
+    bool pinThreads = false;
+    std::vector<int> sessionActiveRuns;   // guarded by inferenceSlotsMutex
+    std::vector<uint64_t> sessionRuns;    // guarded by inferenceSlotsMutex
     std::vector<Ort::AllocatedStringPtr> onnxInputNames;
     std::vector<Ort::AllocatedStringPtr> onnxOutputNames;
 
-    int rotationCwDegrees = 0;
+    // Server-side batching: detection launches that arrive within
+    // batchWindowUs of each other are run as one NCHW batch of at most
+    // maxBatchSize frames. Only possible if the model has a dynamic batch dim.
+    bool dynamicBatch = false;
+    int maxBatchSize = 1;
+    int batchWindowUs = 0;
+    std::mutex batchMutex;
+    std::condition_variable batchCond;
+    std::vector<DetectionRequest *> pendingRequests;
+    bool batchLeaderActive = false;
+
+    // Preallocated 3 x H x W planar float model inputs, one per detection
+    // launch in flight. Grows to the number of concurrent launches.
+    std::vector<std::unique_ptr<float[]>> inputFrames;
+    std::vector<float *> freeInputFrames;
+    std::mutex inputFramesMutex;
+
+    // Output shapes of a single frame, without the batch dim. Probed with a
+    // run at load time since they are dynamic in some exported models.
+    std::vector<int64_t> detectionShape;
+    std::vector<int64_t> protoShape;
+    Ort::RunOptions runOptions;
+    std::vector<std::unique_ptr<InferenceSlot>> inferenceSlots;
+    std::vector<InferenceSlot *> freeInferenceSlots;
+    std::mutex inferenceSlotsMutex;
+    // should stop growing once all lanes have sent a frame
+    std::atomic<uint64_t> bufferAllocations{0};
+    std::atomic<uint64_t> inferenceRuns{0};
+
     float modelConfidenseThreshold{0.25};
     float modelScoreThreshold{0.45};
     float modelNMSThreshold{0.50};
+};
+
+// names of the classes that every model detects
+extern const std::vector<std::string> DNN_CLASSES;
+
+/**
+ * A model that can be picked per frame, keyed by its name, input shape and
+ * precision. The model file is <name>.onnx in the DNN dir, with a -int8 or
+ * -fp16 suffix for quantized models.
+ */
+struct OnnxModel {
+    std::string name;
+    cv::Size inputShape;
+    Precision precision;
+    std::unique_ptr<OnnxCtx> ctx; // null if the model failed to load
+};
+
+/**
+ * All models loaded by the process. The model id sent with a detection
+ * launch is the position of the model in the POCL_DNN_MODELS list, the
+ * first model is the default and has to load.
+ */
+class OnnxModelRegistry {
+public:
+    OnnxModelRegistry(const std::string &dnnPath, const std::string &modelList,
+                      Task task, bool runWithCuda);
+
+    OnnxCtx *get(int modelId);
+
+    OnnxCtx *getDefault() const;
+
+    int find(const std::string &name, const cv::Size &inputShape,
+             Precision precision) const;
+
+    std::vector<OnnxModel> models;
 
-    std::vector<std::string> classes{
-            "person", "bicycle", "car",
-            "motorcycle", "airplane", "bus",
-            "train", "truck", "boat",
-            "traffic light", "fire hydrant", "stop sign",
-            "parking meter", "bench", "bird",
-            "cat", "dog", "horse",
-            "sheep", "cow", "elephant",
-            "bear", "zebra", "giraffe",
-            "backpack", "umbrella", "handbag",
-            "tie", "suitcase", "frisbee",
-            "skis", "snowboard", "sports ball",
-            "kite", "baseball bat", "baseball glove",
-            "skateboard", "surfboard", "tennis racket",
-            "bottle", "wine glass", "cup",
-            "fork", "knife", "spoon",
-            "bowl", "banana", "apple",
-            "sandwich", "orange", "broccoli",
-            "carrot", "hot dog", "pizza",
-            "donut", "cake", "chair",
-            "couch", "potted plant", "bed",
-            "dining table", "toilet", "tv",
-            "laptop", "mouse", "remote",
-            "keyboard", "cell phone", "microwave",
-            "oven", "toaster", "sink",
-            "refrigerator", "book", "clock",
-            "vase", "scissors", "teddy bear",
-            "hair drier", "toothbrush"};
+private:
+    // unknown model ids that have already been warned about
+    std::set<int> fallbackWarned;
+    std::mutex fallbackMutex;
 };
 
 void run_onnx_inference(OnnxCtx *const onnx_ctx, const unsigned char *data, int width, int height,
                         int rotate_cw_degrees, int inp_format,
                         unsigned int *output, unsigned char *out_mask);
 
-void run_segmentation_postprocess(const OnnxCtx *const onnx_ctx, const unsigned int *detection_data,
-                                  const unsigned char *segmentation_data,
-                                  unsigned char *output);
+/**
+ * merge the detection masks of a frame into one class map. The masks are
+ * laid out like the rotated frame at a quarter of its resolution, the same
+ * for every model.
+ * @param width of the frame given to the detection
+ * @param height of the frame given to the detection
+ * @param rotate_cw_degrees rotation given to the detection
+ */
+void run_segmentation_postprocess(const unsigned int *detection_data,
+                                  const unsigned char *segmentation_data, int width, int height,
+                                  int rotate_cw_degrees, unsigned char *output);
 
-void run_segmentation_reconstruct(const OnnxCtx *const onnx_ctx, const unsigned char *postprocess_data,
-                                  unsigned char *output);
+void run_segmentation_reconstruct(const unsigned char *postprocess_data, unsigned char *output);
 
 void run_decompress_from_jpeg_rgb888(const uint8_t *input,
                                      const uint64_t *input_size,
                                      int32_t width, int32_t height,
                                      uint8_t *output);
 
-void eval_iou(const OnnxCtx *const onnx_ctx, const uint8_t *det_data, const uint8_t *seg_data,
+/**
+ * compare a segmentation against a reference one
+ * @param iou output: mean IoU over the classes present, negative on errors
+ * @param confusion output: NUM_CLASSES (81) squared pixel counts with the
+ * reference class as the row and the predicted one as the column, can be null
+ */
+void eval_iou(const uint8_t *det_data, const uint8_t *seg_data,
               const uint8_t *ref_det_data, const uint8_t *ref_seg_data,
-              int do_segment, float *iou);
+              int do_segment, float *iou, uint32_t *confusion);
 
 POCL_EXPORT
 void _pocl_kernel_pocl_dnn_ctx_init_workgroup(
@@ -194,9 +194,11 @@ pocl_pthread_init (unsigned j, cl_device_id device, const char* parameters)
                                 "pocl.dnn.ctx.detection.u8;"
                                 "pocl.dnn.ctx.segmentation.postprocess.u8;"
                                 "pocl.dnn.ctx.segmentation.reconstruct.u8;"
-                                "pocl.dnn.ctx.eval.iou.f32";
+                                "pocl.dnn.ctx.eval.iou.f32;"
+                                "pocl.dnn.eval.confusion.u32;"
+                                "pocl.dnn.stats.u64";
   // device->builtin_kernel_list = "pocl.add.i8";
-    device->num_builtin_kernels = 21;
+    device->num_builtin_kernels = 23;
 
   if (!scheduler_initialized)
     {
@@ -220,6 +220,9 @@ POdeclsym (clSetKernelArgDevicePointerEXT);
 /* cl_pocl_add_device */
 POdeclsym(clAddDevicePOCL)
 
+/* cl_pocl_mem_manager_stats */
+POdeclsym(clGetMemManagerStatsPOCL)
+
 #ifdef __cplusplus
 }
 #endif
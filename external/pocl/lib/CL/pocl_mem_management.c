@@ -23,7 +23,7 @@
 
 #include "pocl_mem_management.h"
 #include "pocl.h"
-#include "utlist.h"
+#include <stddef.h>
 #include <string.h>
 
 #ifndef USE_POCL_MEMMANAGER
@@ -38,20 +38,210 @@ cl_event pocl_mem_manager_new_event ()
 
 #else
 
+/* Every thread keeps the objects it frees in its own cache and hands them
+   out again without locking. Objects flow between threads, e.g. events are
+   created by the thread that enqueues and freed by the one that drops the
+   last reference, so full batches of objects are moved through a shared
+   depot. The depot slots are swapped atomically, so no thread ever takes a
+   lock here. Only objects that don't fit anywhere go back to the heap. */
+
+/* objects one thread keeps per kind before it spills a batch */
+#define MM_CACHE_MAX 64
+/* objects that move between a thread cache and the depot at once */
+#define MM_BATCH 32
+/* batches the depot holds per kind */
+#define MM_DEPOT_SLOTS 64
+
+enum
+{
+  MM_EVENT = 0,
+  MM_COMMAND,
+  MM_EVENT_NODE,
+  MM_KINDS
+};
+
+static const size_t mm_next_offset[MM_KINDS]
+    = { offsetof (struct _cl_event, next),
+        offsetof (struct _cl_command_node, next), offsetof (event_node, next) };
+
+static const size_t mm_size[MM_KINDS]
+    = { sizeof (struct _cl_event), sizeof (struct _cl_command_node),
+        sizeof (event_node) };
+
+#define MM_NEXT(kind, obj) (*(void **)((char *)(obj) + mm_next_offset[kind]))
+
+typedef struct _mem_manager_cache
+{
+  void *list[MM_KINDS];
+  unsigned count[MM_KINDS];
+} pocl_mem_manager_cache;
+
 typedef struct _mem_manager
 {
-  pocl_lock_t event_lock;
-  pocl_lock_t cmd_lock;
-  pocl_lock_t event_node_lock;
+  pthread_key_t cache_key;
+  /* chains of free objects, NULL for an empty slot */
+  void *depot[MM_KINDS][MM_DEPOT_SLOTS];
 
-  cl_event event_list;
-  _cl_command_node *volatile cmd_list;
-  event_node *event_node_list;
+  /* only updated on the slow paths */
+  cl_ulong allocated[MM_KINDS];
+  cl_ulong depot_transfers;
+  cl_ulong freed;
 } pocl_mem_manager;
 
-
 static pocl_mem_manager *mm = NULL;
 
+/* Put a chain of free objects into an empty depot slot.
+   Returns 0 if the depot is full. */
+static int
+depot_put (int kind, void *chain)
+{
+  for (unsigned i = 0; i < MM_DEPOT_SLOTS; ++i)
+    {
+      void *expected = NULL;
+      if (__atomic_load_n (&mm->depot[kind][i], __ATOMIC_RELAXED) == NULL
+          && __atomic_compare_exchange_n (&mm->depot[kind][i], &expected,
+                                          chain, 0, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED))
+        {
+          POCL_ATOMIC_INC (mm->depot_transfers);
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/* Take a whole chain of free objects out of the depot, or NULL. */
+static void *
+depot_take (int kind)
+{
+  for (unsigned i = 0; i < MM_DEPOT_SLOTS; ++i)
+    {
+      if (__atomic_load_n (&mm->depot[kind][i], __ATOMIC_RELAXED) == NULL)
+        continue;
+      void *chain
+          = __atomic_exchange_n (&mm->depot[kind][i], NULL, __ATOMIC_ACQUIRE);
+      if (chain)
+        {
+          POCL_ATOMIC_INC (mm->depot_transfers);
+          return chain;
+        }
+    }
+  return NULL;
+}
+
+static void
+free_chain (int kind, void *chain)
+{
+  while (chain)
+    {
+      void *next = MM_NEXT (kind, chain);
+      free (chain);
+      POCL_ATOMIC_INC (mm->freed);
+      chain = next;
+    }
+}
+
+/* Returns the cached objects of an exiting thread. */
+static void
+cache_destructor (void *arg)
+{
+  pocl_mem_manager_cache *cache = (pocl_mem_manager_cache *)arg;
+  for (int kind = 0; kind < MM_KINDS; ++kind)
+    {
+      if (cache->list[kind] && !depot_put (kind, cache->list[kind]))
+        free_chain (kind, cache->list[kind]);
+    }
+  free (cache);
+}
+
+static pocl_mem_manager_cache *
+get_cache (void)
+{
+  pocl_mem_manager_cache *cache
+      = (pocl_mem_manager_cache *)pthread_getspecific (mm->cache_key);
+  if (cache == NULL)
+    {
+      cache = (pocl_mem_manager_cache *)calloc (
+          1, sizeof (pocl_mem_manager_cache));
+      if (cache == NULL)
+        return NULL;
+      pthread_setspecific (mm->cache_key, cache);
+    }
+  return cache;
+}
+
+/* Returns a zeroed object of the kind. */
+static void *
+cache_get (int kind)
+{
+  pocl_mem_manager_cache *cache = get_cache ();
+  void *obj = NULL;
+  if (cache)
+    {
+      if (cache->list[kind] == NULL)
+        {
+          void *chain = depot_take (kind);
+          unsigned count = 0;
+          for (void *o = chain; o; o = MM_NEXT (kind, o))
+            ++count;
+          /* Nothing to reuse: allocate a whole batch. Objects only come back
+             once the freeing thread spills a batch, so allocating one at a
+             time would keep missing until enough objects are in
+             circulation. */
+          for (; count < MM_BATCH; ++count)
+            {
+              void *o = calloc (1, mm_size[kind]);
+              if (o == NULL)
+                break;
+              POCL_ATOMIC_INC (mm->allocated[kind]);
+              MM_NEXT (kind, o) = chain;
+              chain = o;
+            }
+          cache->list[kind] = chain;
+          cache->count[kind] = count;
+        }
+      if ((obj = cache->list[kind]))
+        {
+          cache->list[kind] = MM_NEXT (kind, obj);
+          cache->count[kind] -= 1;
+          memset (obj, 0, mm_size[kind]);
+          return obj;
+        }
+    }
+
+  POCL_ATOMIC_INC (mm->allocated[kind]);
+  return calloc (1, mm_size[kind]);
+}
+
+static void
+cache_put (int kind, void *obj)
+{
+  pocl_mem_manager_cache *cache = get_cache ();
+  if (cache == NULL)
+    {
+      free (obj);
+      POCL_ATOMIC_INC (mm->freed);
+      return;
+    }
+
+  MM_NEXT (kind, obj) = cache->list[kind];
+  cache->list[kind] = obj;
+  cache->count[kind] += 1;
+  if (cache->count[kind] <= MM_CACHE_MAX)
+    return;
+
+  /* spill the oldest objects, the recently used ones are more likely
+     still in the cpu cache */
+  void *last = cache->list[kind];
+  for (unsigned i = 1; i < MM_CACHE_MAX - MM_BATCH; ++i)
+    last = MM_NEXT (kind, last);
+  void *chain = MM_NEXT (kind, last);
+  MM_NEXT (kind, last) = NULL;
+  cache->count[kind] = MM_CACHE_MAX - MM_BATCH;
+  if (!depot_put (kind, chain))
+    free_chain (kind, chain);
+}
+
 void pocl_init_mem_manager (void)
 {
   static unsigned int init_done = 0;
@@ -66,91 +256,67 @@ void pocl_init_mem_manager (void)
   if (!mm)
     {
       mm = (pocl_mem_manager*) calloc (1, sizeof (pocl_mem_manager));
-      POCL_INIT_LOCK (mm->event_lock);
-      POCL_INIT_LOCK (mm->cmd_lock);
-      POCL_INIT_LOCK (mm->event_node_lock);
+      pthread_key_create (&mm->cache_key, cache_destructor);
     }
   POCL_UNLOCK(pocl_init_lock);
 }
 
 cl_event pocl_mem_manager_new_event ()
 {
-  cl_event ev = NULL;
-  POCL_LOCK (mm->event_lock);
-  if ((ev = mm->event_list))
-    {
-      LL_DELETE (mm->event_list, ev);
-      POCL_UNLOCK (mm->event_lock);
-      POCL_INIT_OBJECT (ev); /* reinit the pocl_lock mutex */
-      return ev;
-    }
-  POCL_UNLOCK (mm->event_lock);
-
-  ev = (struct _cl_event*) calloc (1, sizeof (struct _cl_event));
-  POCL_INIT_OBJECT(ev);
+  cl_event ev = (cl_event)cache_get (MM_EVENT);
+  if (ev != NULL)
+    POCL_INIT_OBJECT (ev);
   return ev;
 }
 
 void pocl_mem_manager_free_event (cl_event event)
 {
   assert (event->status <= CL_COMPLETE);
-  POCL_LOCK (mm->event_lock);
-  LL_PREPEND (mm->event_list, event);
-  POCL_UNLOCK(mm->event_lock);
+  cache_put (MM_EVENT, event);
 }
 
 _cl_command_node* pocl_mem_manager_new_command ()
 {
-  _cl_command_node *cmd = NULL;
-  POCL_LOCK (mm->cmd_lock);
-  if ((cmd = mm->cmd_list))
-    LL_DELETE (mm->cmd_list, cmd);
-  POCL_UNLOCK (mm->cmd_lock);
-  
-  if (cmd)
-    {
-      memset (cmd, 0, sizeof (struct _cl_command_node));
-      return cmd;
-    }
-  return (_cl_command_node*) calloc (1, sizeof (_cl_command_node));
+  return (_cl_command_node *)cache_get (MM_COMMAND);
 }
 
 void pocl_mem_manager_free_command (_cl_command_node *cmd_ptr)
 {
-  if (cmd && cmd->buffered)
+  if (cmd_ptr == NULL)
+    return;
+  if (cmd_ptr->buffered)
     {
       /* TODO: recycle these somehow? */
-      POCL_MEM_FREE (cmd->sync.syncpoint.sync_point_wait_list);
-      POCL_MEM_FREE (cmd->memobj_list);
-      POCL_MEM_FREE (cmd->readonly_flag_list);
+      POCL_MEM_FREE (cmd_ptr->sync.syncpoint.sync_point_wait_list);
     }
-  POCL_LOCK (mm->cmd_lock);
-  LL_PREPEND (mm->cmd_list, cmd_ptr);
-  POCL_UNLOCK(mm->cmd_lock);
+  POCL_MEM_FREE (cmd_ptr->memobj_list);
+  POCL_MEM_FREE (cmd_ptr->readonly_flag_list);
+  cache_put (MM_COMMAND, cmd_ptr);
 }
 
 event_node* pocl_mem_manager_new_event_node ()
 {
-  event_node *ed = NULL;
-  POCL_LOCK(mm->event_node_lock);
-  if ((ed = mm->event_node_list))
-    LL_DELETE (mm->event_node_list, ed);
-  POCL_UNLOCK (mm->event_node_lock);
-  
-  if (ed)
-    {
-      memset (ed, 0, sizeof(event_node));
-      return ed;
-    }
-
-  return calloc (1, sizeof (event_node));
+  return (event_node *)cache_get (MM_EVENT_NODE);
 }
 
 void pocl_mem_manager_free_event_node (event_node *ed)
 {
-  POCL_LOCK (mm->event_node_lock);
-  LL_PREPEND (mm->event_node_list, ed);
-  POCL_UNLOCK (mm->event_node_lock);
+  cache_put (MM_EVENT_NODE, ed);
+}
+
+void pocl_mem_manager_get_stats (cl_mem_manager_stats_pocl *stats)
+{
+  if (!mm)
+    {
+      memset (stats, 0, sizeof (cl_mem_manager_stats_pocl));
+      return;
+    }
+  stats->events_allocated = POCL_ATOMIC_LOAD (mm->allocated[MM_EVENT]);
+  stats->commands_allocated = POCL_ATOMIC_LOAD (mm->allocated[MM_COMMAND]);
+  stats->event_nodes_allocated
+      = POCL_ATOMIC_LOAD (mm->allocated[MM_EVENT_NODE]);
+  stats->depot_transfers = POCL_ATOMIC_LOAD (mm->depot_transfers);
+  stats->objects_freed = POCL_ATOMIC_LOAD (mm->freed);
 }
 
 #endif
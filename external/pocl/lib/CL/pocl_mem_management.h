@@ -43,6 +43,8 @@ event_node* pocl_mem_manager_new_event_node ();
 
 void pocl_mem_manager_free_event_node (event_node *ed);
 
+void pocl_mem_manager_get_stats (cl_mem_manager_stats_pocl *stats);
+
 #else
 
 #define pocl_init_mem_manager() NULL
@@ -0,0 +1,613 @@
+//
+// Offline simulator for the codec selection. Replays the frames of recorded
+// profiling logs (as csv, see ProfileLog/profileToCsv) through update_stats()
+// and select_codec_auto_at() on a simulated clock, so a change to the
+// selection can be tried on real measurements in seconds.
+//
+// Every recorded frame keeps the latency, kernel times, frame size, fill ping
+// and power it had with its codec. Replaying a codec takes the next recorded
+// frame of that codec, starting over at the end, so the trace has to contain
+// every codec of CONFIGS; the calibration of the automatic selection records
+// all of them. Pings are replayed on the timeline of the recording, IoU samples
+// of a codec are replayed in order whenever the simulated eval pipeline runs.
+//
+// For each policy variant a csv summary row is printed, followed by the codec
+// sequence of every variant as segments of frames that ran the same codec.
+//
+// usage: ./codecSelectSim [options] <profile.csv> [more profile.csv ...]
+//   --variant SPEC   policy variant to simulate, can be given several times
+//                    (default staged, bandit and predict). SPEC is the
+//                    policy, staged|bandit|predict|fixed, followed by
+//                    comma separated key=value settings:
+//                      name=NAME            label in the report
+//                      latency_limit=MS     hard latency constraint
+//                      iou_limit=X          hard IoU constraint
+//                      lock=0|1             lock the codec after calibration
+//                      codec=N              codec to run with fixed
+//   --duration S     simulated time (default the length of the recording)
+//   --eval 0|1       run the eval pipeline outside of calibration (default 1)
+//
+
+#include "codec_select.h"
+#include "eval.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// kernels that the codec selection reads from the collected events
+static const char *const KERNEL_EVENTS[] = {"enc_event", "dec_event", "dnn_event",
+                                            "postprocess_event", "seg_enc_event",
+                                            "seg_dec_event", "reconstruct_event"};
+#define NUM_KERNELS (int) (sizeof(KERNEL_EVENTS) / sizeof(KERNEL_EVENTS[0]))
+
+typedef struct {
+    int codec_id;
+    int64_t start_ns;
+    int64_t stop_ns;
+    int64_t fill_ping_ns;
+    uint64_t size_bytes_tx;
+    uint64_t size_bytes_rx;
+    int64_t kernel_start_ns[NUM_KERNELS];
+    int64_t kernel_end_ns[NUM_KERNELS];
+    bool is_skipped;
+    float iou;  // -1 if the frame was not evaluated
+    float pow_sum_w;
+    int pow_nsamples;
+} trace_frame_t;
+
+// ping or power sample
+typedef struct {
+    int64_t ts_ns;
+    float value;
+} trace_sample_t;
+
+typedef struct {
+    std::vector<trace_frame_t> frames;  // by start time, only frames that ran
+    std::vector<int> codec_frames[NUM_CONFIGS];  // indices into frames
+    std::vector<float> codec_ious[NUM_CONFIGS];
+    float codec_iou[NUM_CONFIGS];  // average, -1 if unknown
+    float codec_pow_w[NUM_CONFIGS];  // average, -1 if unknown
+    std::vector<trace_sample_t> pings;  // ms, relative to start_ns
+    int64_t start_ns;
+    int64_t duration_ns;
+} trace_t;
+
+typedef enum {
+    POLICY_STAGED,
+    POLICY_BANDIT,
+    POLICY_PREDICT,
+    POLICY_FIXED,
+} policy_t;
+
+static const char *const POLICY_NAMES[] = {"staged", "bandit", "predict", "fixed"};
+
+typedef struct {
+    std::string name;
+    policy_t policy;
+    float latency_limit_ms;  // < 0 keeps the limit of init_codec_select()
+    float iou_limit;
+    bool lock_codec;
+    int codec_id;
+} variant_t;
+
+typedef struct {
+    float start_s;
+    int codec_id;
+    int frames;
+} segment_t;
+
+typedef struct {
+    int frames;
+    double duration_s;
+    double mean_latency_ms;
+    double p95_latency_ms;
+    double violating_pct;
+    double energy_j;
+    int switches;
+    std::vector<segment_t> segments;
+} sim_result_t;
+
+static int64_t parse_i64(const char *value) {
+    return strtoll(value, nullptr, 10);
+}
+
+static trace_frame_t &get_frame(std::map<int, trace_frame_t> &frames, int frame_index) {
+    auto found = frames.find(frame_index);
+    if (found != frames.end()) {
+        return found->second;
+    }
+    trace_frame_t frame = {};
+    frame.codec_id = -1;
+    frame.fill_ping_ns = -1;
+    frame.iou = -1.0f;
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        frame.kernel_start_ns[k] = -1;
+        frame.kernel_end_ns[k] = -1;
+    }
+    return frames.emplace(frame_index, frame).first->second;
+}
+
+static void append_frames(std::map<int, trace_frame_t> &frames,
+                          std::vector<trace_frame_t> &all_frames) {
+    for (const auto &entry: frames) {
+        all_frames.push_back(entry.second);
+    }
+    frames.clear();
+}
+
+/**
+ * read the frames, IoU, power and ping samples of a csv profiling log
+ * @return 0 if successful, otherwise -1
+ */
+static int read_trace(const char *path, std::vector<trace_frame_t> &all_frames,
+                      std::vector<trace_sample_t> &pings, std::vector<trace_sample_t> &powers) {
+    FILE *file = fopen(path, "r");
+    if (nullptr == file) {
+        fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    // frame indices start over with every run, so runs are kept apart
+    std::map<int, trace_frame_t> frames;
+    int64_t external_ts_ns = 0;
+    char line[512];
+    while (nullptr != fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *fields[4];
+        char *cursor = line;
+        int nfields = 0;
+        for (; nfields < 3; nfields++) {
+            fields[nfields] = cursor;
+            cursor = strchr(cursor, ',');
+            if (nullptr == cursor) {
+                break;
+            }
+            *cursor++ = '\0';
+        }
+        if (nfields < 3) {
+            continue;
+        }
+        fields[3] = cursor;
+
+        if (0 == strcmp(fields[0], "frame_id")) {
+            // header of the next run appended to the same file
+            append_frames(frames, all_frames);
+            continue;
+        }
+
+        const int frame_index = atoi(fields[0]);
+        const char *tag = fields[1];
+        const char *parameter = fields[2];
+        const char *value = fields[3];
+
+        if (0 == strcmp(tag, "cs_update") && 0 == strcmp(parameter, "frame_codec_id")) {
+            get_frame(frames, frame_index).codec_id = atoi(value);
+        } else if (0 == strcmp(tag, "frame_time")) {
+            trace_frame_t &frame = get_frame(frames, frame_index);
+            if (0 == strcmp(parameter, "start_ns")) {
+                frame.start_ns = parse_i64(value);
+            } else if (0 == strcmp(parameter, "stop_ns")) {
+                frame.stop_ns = parse_i64(value);
+            } else if (0 == strcmp(parameter, "fill_ping_ns")) {
+                frame.fill_ping_ns = parse_i64(value);
+            }
+        } else if (0 == strcmp(tag, "compression")) {
+            if (0 == strcmp(parameter, "size_bytes_tx")) {
+                get_frame(frames, frame_index).size_bytes_tx = strtoull(value, nullptr, 10);
+            } else if (0 == strcmp(parameter, "size_bytes_rx")) {
+                get_frame(frames, frame_index).size_bytes_rx = strtoull(value, nullptr, 10);
+            }
+        } else if (0 == strcmp(tag, "skip") && 0 == strcmp(parameter, "is_skipped")) {
+            get_frame(frames, frame_index).is_skipped = 0 != atoi(value);
+        } else if (0 == strcmp(tag, "cs_eval") && 0 == strcmp(parameter, "iou")) {
+            get_frame(frames, frame_index).iou = (float) atof(value);
+        } else if (0 == strcmp(tag, "cs_update_external")) {
+            // every external sample is logged as its timestamp followed by its value
+            if (0 == strcmp(parameter, "ts_ns")) {
+                external_ts_ns = parse_i64(value);
+            } else if (0 == strcmp(parameter, "ping_ms")) {
+                pings.push_back({external_ts_ns, (float) atof(value)});
+            } else if (0 == strcmp(parameter, "pow_w")) {
+                powers.push_back({external_ts_ns, (float) atof(value)});
+            }
+        } else {
+            for (int k = 0; k < NUM_KERNELS; k++) {
+                if (0 == strcmp(tag, KERNEL_EVENTS[k])) {
+                    trace_frame_t &frame = get_frame(frames, frame_index);
+                    if (0 == strcmp(parameter, "start_ns")) {
+                        frame.kernel_start_ns[k] = parse_i64(value);
+                    } else if (0 == strcmp(parameter, "end_ns")) {
+                        frame.kernel_end_ns[k] = parse_i64(value);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    fclose(file);
+
+    append_frames(frames, all_frames);
+    return 0;
+}
+
+/**
+ * read all logs and sort their frames by codec
+ * @return 0 if successful, otherwise -1
+ */
+static int load_trace(char **paths, int npaths, trace_t *trace) {
+    std::vector<trace_frame_t> all_frames;
+    std::vector<trace_sample_t> pings;
+    std::vector<trace_sample_t> powers;
+    for (int i = 0; i < npaths; i++) {
+        if (0 != read_trace(paths[i], all_frames, pings, powers)) {
+            return -1;
+        }
+    }
+
+    for (const trace_frame_t &frame: all_frames) {
+        if (frame.codec_id < 0 || frame.codec_id >= NUM_CONFIGS || frame.is_skipped ||
+            frame.start_ns <= 0 || frame.stop_ns <= frame.start_ns) {
+            continue;
+        }
+        trace->frames.push_back(frame);
+    }
+    if (trace->frames.empty()) {
+        fprintf(stderr, "no frames with a codec id, was the log recorded with profiling and the "
+                        "automatic codec selection enabled?\n");
+        return -1;
+    }
+    std::sort(trace->frames.begin(), trace->frames.end(),
+              [](const trace_frame_t &a, const trace_frame_t &b) {
+                  return a.start_ns < b.start_ns;
+              });
+
+    // power belongs to the codec of the frame that was running when it was sampled
+    for (const trace_sample_t &power: powers) {
+        auto after = std::upper_bound(trace->frames.begin(), trace->frames.end(), power.ts_ns,
+                                      [](int64_t ts_ns, const trace_frame_t &frame) {
+                                          return ts_ns < frame.start_ns;
+                                      });
+        if (after != trace->frames.begin() && power.ts_ns <= (after - 1)->stop_ns) {
+            (after - 1)->pow_sum_w += power.value;
+            (after - 1)->pow_nsamples += 1;
+        }
+    }
+
+    trace->start_ns = trace->frames.front().start_ns;
+    trace->duration_ns = 0;
+    float iou_sum[NUM_CONFIGS] = {};
+    float pow_sum[NUM_CONFIGS] = {};
+    int pow_nsamples[NUM_CONFIGS] = {};
+    for (int i = 0; i < (int) trace->frames.size(); i++) {
+        const trace_frame_t &frame = trace->frames[i];
+        trace->codec_frames[frame.codec_id].push_back(i);
+        if (frame.iou >= 0.0f) {
+            trace->codec_ious[frame.codec_id].push_back(frame.iou);
+            iou_sum[frame.codec_id] += frame.iou;
+        }
+        pow_sum[frame.codec_id] += frame.pow_sum_w;
+        pow_nsamples[frame.codec_id] += frame.pow_nsamples;
+        trace->duration_ns = std::max(trace->duration_ns, frame.stop_ns - trace->start_ns);
+    }
+
+    bool missing = false;
+    for (int id = 0; id < NUM_CONFIGS; id++) {
+        if (trace->codec_frames[id].empty()) {
+            fprintf(stderr, "codec %d has no recorded frames\n", id);
+            missing = true;
+        }
+        const int nious = (int) trace->codec_ious[id].size();
+        trace->codec_iou[id] = (id == LOCAL_CODEC_ID) ? 1.0f :
+                               (nious > 0) ? iou_sum[id] / (float) nious : -1.0f;
+        trace->codec_pow_w[id] =
+                (pow_nsamples[id] > 0) ? pow_sum[id] / (float) pow_nsamples[id] : -1.0f;
+    }
+    if (missing) {
+        fprintf(stderr, "every codec has to be recorded, e.g. by a calibration run\n");
+        return -1;
+    }
+
+    for (const trace_sample_t &ping: pings) {
+        trace->pings.push_back({ping.ts_ns - trace->start_ns, ping.value});
+    }
+    std::sort(trace->pings.begin(), trace->pings.end(),
+              [](const trace_sample_t &a, const trace_sample_t &b) { return a.ts_ns < b.ts_ns; });
+    return 0;
+}
+
+static float hard_limit(const codec_select_state_t *state, metric_t metric) {
+    for (int i = 0; i < NUM_CONSTRAINTS; i++) {
+        if (state->constraints[i].metric == metric && state->constraints[i].type == CONSTR_HARD) {
+            return state->constraints[i].limit;
+        }
+    }
+    return NAN;
+}
+
+static void set_hard_limit(codec_select_state_t *state, metric_t metric, float limit) {
+    for (int i = 0; i < NUM_CONSTRAINTS; i++) {
+        if (state->constraints[i].metric == metric && state->constraints[i].type != CONSTR_SOFT) {
+            state->constraints[i].limit = limit;
+        }
+    }
+}
+
+static sim_result_t simulate(const trace_t &trace, const variant_t &variant, double duration_s,
+                             bool enable_eval) {
+    // the selection always logs a few values, even without ENABLE_PROFILING
+    int null_fd = open("/dev/null", O_WRONLY);
+    const int algorithm = (variant.policy == POLICY_STAGED) ? SELECT_ALGORITHM_STAGED :
+                          (variant.policy == POLICY_BANDIT) ? SELECT_ALGORITHM_BANDIT :
+                          (variant.policy == POLICY_PREDICT) ? SELECT_ALGORITHM_PREDICT :
+                          SELECT_ALGORITHM_NONE;
+    codec_select_state_t *state;
+    init_codec_select(0, null_fd, algorithm, variant.lock_codec, false, &state);
+    if (variant.policy == POLICY_FIXED) {
+        state->id = variant.codec_id;
+    }
+    if (variant.latency_limit_ms >= 0.0f) {
+        set_hard_limit(state, METRIC_LATENCY_MS, variant.latency_limit_ms);
+    }
+    if (variant.iou_limit >= 0.0f) {
+        set_hard_limit(state, METRIC_IOU, variant.iou_limit);
+    }
+    const float latency_limit_ms = hard_limit(state, METRIC_LATENCY_MS);
+    const float iou_limit = hard_limit(state, METRIC_IOU);
+
+    size_t next_frame[NUM_CONFIGS] = {};
+    size_t next_iou[NUM_CONFIGS] = {};
+    size_t next_ping = 0;
+
+    sim_result_t result = {};
+    std::vector<float> latencies;
+    int violating = 0;
+    const int64_t start_ns = trace.start_ns;  // simulated time runs on the clock of the recording
+    const int64_t end_ns = start_ns + (int64_t) (duration_s * 1e9);
+    int64_t now_ns = start_ns;
+    int64_t next_eval_ns = start_ns;
+
+    for (int frame_index = 0; now_ns < end_ns; frame_index++) {
+        const int id = get_codec_id(state);
+        const bool codec_selected = drain_codec_selected(state);
+        const trace_frame_t &recorded =
+                trace.frames[trace.codec_frames[id][next_frame[id]++ %
+                                                    trace.codec_frames[id].size()]];
+
+        if (result.segments.empty() || result.segments.back().codec_id != id) {
+            result.switches += result.segments.empty() ? 0 : 1;
+            result.segments.push_back({(float) ((now_ns - start_ns) / 1e9), id, 0});
+        }
+        result.segments.back().frames += 1;
+
+        frame_metadata_t metadata = {};
+        metadata.frame_index = frame_index;
+        metadata.codec.id = id;
+        metadata.codec.compression_type = CONFIGS[id].compression_type;
+        metadata.codec.device_type = CONFIGS[id].device_type;
+        metadata.codec.model_id = CONFIGS[id].model_id;
+        metadata.size_bytes_tx = recorded.size_bytes_tx;
+        metadata.size_bytes_rx = recorded.size_bytes_rx;
+        metadata.host_ts_ns.start = now_ns;
+        metadata.host_ts_ns.stop = now_ns + (recorded.stop_ns - recorded.start_ns);
+        metadata.host_ts_ns.fill_ping_duration_ms = recorded.fill_ping_ns;
+        metadata.run_args.codec_selected = codec_selected;
+
+        state->collected_events->num_events = 0;
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            if (recorded.kernel_start_ns[k] >= 0 && recorded.kernel_end_ns[k] >= 0) {
+                const int event = state->collected_events->num_events++;
+                state->collected_events->descriptions[event] = KERNEL_EVENTS[k];
+                state->collected_events->end_start_ms[event] =
+                        (float) (recorded.kernel_end_ns[k] - recorded.kernel_start_ns[k]) / 1e6f;
+            }
+        }
+
+        // external samples have to be in before the frame that they belong to is collected
+        const int64_t stop_ns = metadata.host_ts_ns.stop;
+        while (next_ping < trace.pings.size() &&
+               start_ns + trace.pings[next_ping].ts_ns <= stop_ns) {
+            push_external_ping(state, start_ns + trace.pings[next_ping].ts_ns,
+                               trace.pings[next_ping].value);
+            next_ping++;
+        }
+        float pow_w = trace.codec_pow_w[id];
+        if (recorded.pow_nsamples > 0) {
+            pow_w = recorded.pow_sum_w / (float) recorded.pow_nsamples;
+            // push_external_pow() takes the current and voltage as Android reports them
+            push_external_pow(state, (now_ns + stop_ns) / 2, -(int) lroundf(pow_w * 1e3f), 1000);
+        }
+
+        const bool eval_every_frame = state->stage == STAGE_CALIB_IOU_ONLY;
+        const bool eval_running = enable_eval || needs_eval(state);
+        metadata.run_args.is_eval_frame =
+                id != LOCAL_CODEC_ID && !trace.codec_ious[id].empty() &&
+                (eval_every_frame || (eval_running && stop_ns >= next_eval_ns));
+
+        now_ns = stop_ns;
+        update_stats(&metadata, nullptr, state);
+
+        if (metadata.run_args.is_eval_frame) {
+            signal_eval_start(state, frame_index, id);
+            signal_eval_finish(state, trace.codec_ious[id][next_iou[id]++ %
+                                                           trace.codec_ious[id].size()]);
+            next_eval_ns = now_ns + EVAL_INTERVAL_SEC * 1000000000LL;
+        }
+
+        select_codec_auto_at(state, now_ns);
+
+        const float latency_ms = (float) (recorded.stop_ns - recorded.start_ns) / 1e6f;
+        latencies.push_back(latency_ms);
+        const float codec_iou = trace.codec_iou[id];
+        if (latency_ms > latency_limit_ms || (codec_iou >= 0.0f && codec_iou < iou_limit)) {
+            violating += 1;
+        }
+        if (pow_w > 0.0f) {
+            result.energy_j += pow_w * latency_ms / 1e3;
+        }
+    }
+
+    destroy_codec_select(&state);
+    close(null_fd);
+
+    result.frames = (int) latencies.size();
+    result.duration_s = (double) (now_ns - start_ns) / 1e9;
+    if (result.frames > 0) {
+        double sum = 0.0;
+        for (float latency_ms: latencies) {
+            sum += latency_ms;
+        }
+        result.mean_latency_ms = sum / result.frames;
+        std::sort(latencies.begin(), latencies.end());
+        result.p95_latency_ms = latencies[(size_t) (0.95 * (result.frames - 1))];
+        result.violating_pct = 100.0 * violating / result.frames;
+    }
+    return result;
+}
+
+/**
+ * @return 0 if the variant is valid, otherwise -1
+ */
+static int parse_variant(const char *spec, variant_t *variant) {
+    variant->latency_limit_ms = -1.0f;
+    variant->iou_limit = -1.0f;
+    variant->lock_codec = false;
+    variant->codec_id = LOCAL_CODEC_ID;
+
+    std::string rest = spec;
+    std::string policy = rest.substr(0, rest.find(','));
+    if ("staged" == policy) {
+        variant->policy = POLICY_STAGED;
+    } else if ("bandit" == policy) {
+        variant->policy = POLICY_BANDIT;
+    } else if ("predict" == policy) {
+        variant->policy = POLICY_PREDICT;
+    } else if ("fixed" == policy) {
+        variant->policy = POLICY_FIXED;
+    } else {
+        return -1;
+    }
+    // the spec itself, without the commas of the csv
+    variant->name = spec;
+    std::replace(variant->name.begin(), variant->name.end(), ',', ';');
+
+    size_t pos = rest.find(',');
+    while (std::string::npos != pos) {
+        const size_t next = rest.find(',', pos + 1);
+        const std::string setting = rest.substr(pos + 1, next - pos - 1);
+        const size_t equals = setting.find('=');
+        if (std::string::npos == equals) {
+            return -1;
+        }
+        const std::string key = setting.substr(0, equals);
+        const char *value = setting.c_str() + equals + 1;
+        if ("name" == key) {
+            variant->name = value;
+        } else if ("latency_limit" == key) {
+            variant->latency_limit_ms = (float) atof(value);
+        } else if ("iou_limit" == key) {
+            variant->iou_limit = (float) atof(value);
+        } else if ("lock" == key) {
+            variant->lock_codec = 0 != atoi(value);
+        } else if ("codec" == key) {
+            variant->codec_id = atoi(value);
+            if (variant->codec_id < 0 || variant->codec_id >= NUM_CONFIGS) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+        pos = next;
+    }
+    return 0;
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "usage: %s [--variant staged|bandit|predict|fixed[,key=value...]] "
+                    "[--duration S] [--eval 0|1] <profile.csv> [more profile.csv ...]\n", name);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+            {"variant",  required_argument, nullptr, 'v'},
+            {"duration", required_argument, nullptr, 'd'},
+            {"eval",     required_argument, nullptr, 'e'},
+            {nullptr, 0,                    nullptr, 0},
+    };
+
+    std::vector<variant_t> variants;
+    double duration_s = 0.0;
+    bool enable_eval = true;
+    int opt;
+    while (-1 != (opt = getopt_long(argc, argv, "", long_options, nullptr))) {
+        switch (opt) {
+            case 'v': {
+                variant_t variant;
+                if (0 != parse_variant(optarg, &variant)) {
+                    fprintf(stderr, "invalid variant %s\n", optarg);
+                    return 1;
+                }
+                variants.push_back(variant);
+                break;
+            }
+            case 'd':
+                duration_s = atof(optarg);
+                break;
+            case 'e':
+                enable_eval = 0 != atoi(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (variants.empty()) {
+        variants.resize(3);
+        parse_variant("staged", &variants[0]);
+        parse_variant("bandit", &variants[1]);
+        parse_variant("predict", &variants[2]);
+    }
+
+    trace_t trace;
+    if (0 != load_trace(argv + optind, argc - optind, &trace)) {
+        return 1;
+    }
+    if (duration_s <= 0.0) {
+        duration_s = (double) trace.duration_ns / 1e9;
+    }
+    fprintf(stderr, "replaying %zu frames, %zu pings, %.1f s\n", trace.frames.size(),
+            trace.pings.size(), duration_s);
+
+    std::vector<sim_result_t> results;
+    printf("variant,policy,frames,duration_s,mean_latency_ms,p95_latency_ms,violating_pct,"
+           "energy_j,switches\n");
+    for (const variant_t &variant: variants) {
+        sim_result_t result = simulate(trace, variant, duration_s, enable_eval);
+        printf("%s,%s,%d,%.1f,%.1f,%.1f,%.1f,%.2f,%d\n", variant.name.c_str(),
+               POLICY_NAMES[variant.policy], result.frames, result.duration_s,
+               result.mean_latency_ms, result.p95_latency_ms, result.violating_pct,
+               result.energy_j, result.switches);
+        results.push_back(result);
+    }
+
+    printf("\nvariant,start_s,codec_id,frames\n");
+    for (size_t i = 0; i < variants.size(); i++) {
+        for (const segment_t &segment: results[i].segments) {
+            printf("%s,%.2f,%d,%d\n", variants[i].name.c_str(), segment.start_s,
+                   segment.codec_id, segment.frames);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+//
+// Turns a binary profiling log, as written by the image processor when profiling is enabled,
+// into the frame_id,tag,parameter,value csv.
+//
+// usage: ./profileToCsv <profile.bin> [profile.csv]
+// the csv goes to stdout if no output file is given
+//
+
+#include "profile_log.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <profile.bin> [profile.csv]\n", argv[0]);
+        return 1;
+    }
+
+    int in_fd = open(argv[1], O_RDONLY);
+    if (-1 == in_fd) {
+        fprintf(stderr, "could not open %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    int out_fd = STDOUT_FILENO;
+    if (argc > 2) {
+        out_fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, S_IWRITE | S_IREAD);
+        if (-1 == out_fd) {
+            fprintf(stderr, "could not open %s: %s\n", argv[2], strerror(errno));
+            close(in_fd);
+            return 1;
+        }
+    }
+
+    int records = profile_log_convert(in_fd, out_fd);
+    close(in_fd);
+    if (STDOUT_FILENO != out_fd) {
+        close(out_fd);
+    }
+
+    if (records < 0) {
+        fprintf(stderr, "%s is not a profiling log of this version\n", argv[1]);
+        return 1;
+    }
+    fprintf(stderr, "converted %d records\n", records);
+    return 0;
+}
@@ -50,7 +50,10 @@ constexpr int do_algorithm = 0;
 constexpr int lock_codec = 0;
 constexpr bool enable_eval = true;
 constexpr int max_lanes = 1;
+constexpr int lane_depth = 1; // frames in flight per lane
 constexpr bool has_video_input = false;
+constexpr backpressure_mode_t backpressure_mode = BACKPRESSURE_WAIT;
+constexpr int backpressure_deadline_ms = 1000;
 
 /* Read input image, assumes app is in a build dir */
 const char *inp_name = "../../android/app/src/main/assets/bus_640x480.jpg";
@@ -65,7 +68,7 @@ int main() {
 
     /* Init */
     int fd =
-        open("profile.csv", O_WRONLY | O_CREAT | O_APPEND, S_IWRITE | S_IREAD);
+        open("profile.bin", O_WRONLY | O_CREAT | O_APPEND, S_IWRITE | S_IREAD);
 
     if (fd == -1) {
         perror("Cannot open file");
@@ -101,10 +104,11 @@ RETRY:
                                    codec_sources.at(1).size()};
 
     status = create_pocl_image_processor_context(
-        &ctx, max_lanes, inp_w, inp_h, config_flags, source_strings,
+        &ctx, max_lanes, lane_depth, inp_w, inp_h, config_flags, source_strings,
         source_sizes, fd, enable_eval, nullptr);
     assert(status == CL_SUCCESS);
     assert(ctx != nullptr);
+    set_backpressure_policy(ctx, backpressure_mode, backpressure_deadline_ms);
 
     codec_select_state_t *state = nullptr;
     init_codec_select(config_flags, fd, do_algorithm, lock_codec,
@@ -152,6 +156,11 @@ RETRY:
     // join the thread
     thread.join();
 
+    backpressure_stats_t backpressure_stats = get_backpressure_stats(ctx);
+    printf("dropped frames: %u, superseded frames: %u, expired frames: %u\n",
+           backpressure_stats.dropped_frames, backpressure_stats.superseded_frames,
+           backpressure_stats.expired_frames);
+
     status = destroy_pocl_image_processor_context(&ctx);
 
     if (true == RETRY_ON_DISCONNECT && (frame_index < NFRAMES)) {
@@ -0,0 +1,217 @@
+//
+// Offline evaluation of the automatic codec selection. Instead of running the
+// pipeline, every frame gets its latency, size and IoU from a model of the
+// codecs and of a network that changes over time, and the codec selection is
+// fed the same way the app feeds it: update_stats() per received frame, eval
+// results every EVAL_INTERVAL_SEC, and select_codec_auto_at() on the clock of
+// the simulated frames. Each algorithm runs on the same network trace and a
+// csv row per algorithm is printed:
+//   violating_pct   time spent in codecs that break the hard constraints
+//   missed_pct      frames that took longer than the latency limit
+//   bad_pct         time spent in codecs reaching less than BAD_SCORE of the
+//                   best codec of the moment (violating ones included)
+//   score_pct       time weighted product of the codec in use, relative to
+//                   the best codec of the moment
+//   switches        how often the codec changed
+//
+// usage: ./bench_codec_select [duration_s] [seed]
+//
+
+#include "codec_select.h"
+#include "eval.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <random>
+#include <unistd.h>
+
+#define BAD_SCORE 0.75f
+
+// same hard constraints as init_codec_select()
+#define LIMIT_LATENCY_MS 300.0f
+#define LIMIT_IOU 0.5f
+
+typedef struct {
+    float compute_ms; // encoding, inference and decoding, without the network
+    float size_bytes; // encoded frame size, 0 for local
+    float iou;
+} codec_model_t;
+
+// roughly what the codecs of CONFIGS do on a phone with a 640x480 camera
+static const codec_model_t CODEC_MODELS[NUM_CONFIGS] = {
+        {350.0f, 0.0f, 1.0f},       // local
+        {60.0f, 460800.0f, 1.0f},   // remote, no compression
+        {75.0f, 120000.0f, 0.97f},  // jpeg 99
+        {70.0f, 45000.0f, 0.92f},   // jpeg 80
+        {65.0f, 15000.0f, 0.72f},   // jpeg 20
+        {90.0f, 80000.0f, 0.93f},   // hevc 5 Mbit/s
+        {90.0f, 20000.0f, 0.80f},   // hevc 250 kbit/s
+        {90.0f, 2500.0f, 0.40f},    // hevc 10 kbit/s
+        {40.0f, 460800.0f, 0.82f},  // low res model, no compression
+        {50.0f, 45000.0f, 0.78f},   // low res model, jpeg 80
+};
+
+typedef struct {
+    float start; // fraction of the run
+    float bandwidth_mbit;
+    float rtt_ms;
+} network_phase_t;
+
+// fast wifi, a congested link and a recovery to somewhere in between, each interrupted by a
+// drop of a few seconds, e.g. a handover
+static const network_phase_t NETWORK_PHASES[] = {
+        {0.0f, 100.0f, 10.0f},
+        {0.2f, 2.0f, 60.0f},
+        {0.205f, 100.0f, 10.0f},
+        {0.35f, 4.0f, 40.0f},
+        {0.5f, 1.0f, 80.0f},
+        {0.505f, 4.0f, 40.0f},
+        {0.7f, 30.0f, 15.0f},
+        {0.85f, 2.0f, 60.0f},
+        {0.855f, 30.0f, 15.0f},
+};
+#define NUM_PHASES (int) (sizeof(NETWORK_PHASES) / sizeof(NETWORK_PHASES[0]))
+
+static const network_phase_t &network_at(float fraction) {
+    int phase = 0;
+    while (phase + 1 < NUM_PHASES && NETWORK_PHASES[phase + 1].start <= fraction) {
+        phase += 1;
+    }
+    return NETWORK_PHASES[phase];
+}
+
+static float model_latency_ms(int id, const network_phase_t &network) {
+    const codec_model_t &model = CODEC_MODELS[id];
+    if (id == LOCAL_CODEC_ID) {
+        return model.compute_ms;
+    }
+    const float bytes_per_ms = network.bandwidth_mbit * 1e6f / 8.0f / 1e3f;
+    return model.compute_ms + network.rtt_ms + model.size_bytes / bytes_per_ms;
+}
+
+static bool model_violates(int id, const network_phase_t &network) {
+    return model_latency_ms(id, network) > LIMIT_LATENCY_MS || CODEC_MODELS[id].iou < LIMIT_IOU;
+}
+
+// the product that the selection maximizes with the constraints of init_codec_select()
+static float model_product(int id, const network_phase_t &network) {
+    return CODEC_MODELS[id].iou / (model_latency_ms(id, network) * LATENCY_SCALE);
+}
+
+typedef struct {
+    double total_ms;
+    double violating_ms;
+    int missed;
+    double bad_ms;
+    double score_ms;
+    int frames;
+    int switches;
+} run_result_t;
+
+static run_result_t run(int do_algorithm, float duration_s, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> latency_noise(1.0f, 0.1f);
+    std::normal_distribution<float> iou_noise(0.0f, 0.05f);
+
+    // the selection always logs a few values, even without ENABLE_PROFILING
+    int null_fd = open("/dev/null", O_WRONLY);
+    codec_select_state_t *state;
+    init_codec_select(0, null_fd, do_algorithm, false, false, &state);
+
+    run_result_t result = {};
+    const int64_t duration_ns = (int64_t) (duration_s * 1e9f);
+    const int64_t start_ns = 1000000000; // 0 means no selection happened yet
+    const int64_t end_ns = start_ns + duration_ns;
+    int64_t now_ns = start_ns;
+    int64_t next_eval_ns = now_ns;
+    int prev_id = get_codec_id(state);
+
+    for (int frame_index = 0; now_ns < end_ns; frame_index++) {
+        const network_phase_t &network =
+                network_at((float) (now_ns - start_ns) / (float) duration_ns);
+        const int id = get_codec_id(state);
+        const bool codec_selected = drain_codec_selected(state);
+        result.switches += (id != prev_id) ? 1 : 0;
+        prev_id = id;
+
+        const float latency_ms = model_latency_ms(id, network) * fmaxf(0.5f, latency_noise(rng));
+        const float compute_ms = CODEC_MODELS[id].compute_ms;
+
+        // the app would have filled these from the events of the frame
+        state->collected_events->num_events = 1;
+        state->collected_events->descriptions[0] = "dnn_event";
+        state->collected_events->end_start_ms[0] = fminf(compute_ms, latency_ms);
+
+        frame_metadata_t metadata = {};
+        metadata.frame_index = frame_index;
+        metadata.codec.id = id;
+        metadata.codec.compression_type = CONFIGS[id].compression_type;
+        metadata.codec.device_type = CONFIGS[id].device_type;
+        metadata.size_bytes_tx = (uint64_t) CODEC_MODELS[id].size_bytes;
+        metadata.host_ts_ns.start = now_ns;
+        metadata.host_ts_ns.stop = now_ns + (int64_t) (latency_ms * 1e6f);
+        // the ping of the fill buffer command, in ns
+        const float ping_ms = network.rtt_ms * latency_noise(rng);
+        metadata.host_ts_ns.fill_ping_duration_ms =
+                (id == LOCAL_CODEC_ID) ? -1 : (int64_t) (ping_ms * 1e6f);
+        metadata.run_args.codec_selected = codec_selected;
+        // one lane: the next frame starts when this one is received
+        now_ns = metadata.host_ts_ns.stop;
+
+        const bool eval_every_frame = state->stage == STAGE_CALIB_IOU_ONLY;
+        metadata.run_args.is_eval_frame =
+                id != LOCAL_CODEC_ID && (eval_every_frame || now_ns >= next_eval_ns);
+        update_stats(&metadata, NULL, state);
+
+        if (metadata.run_args.is_eval_frame) {
+            signal_eval_start(state, frame_index, id);
+            float iou = CODEC_MODELS[id].iou + iou_noise(rng);
+            signal_eval_finish(state, fminf(1.0f, fmaxf(0.0f, iou)));
+            next_eval_ns = now_ns + EVAL_INTERVAL_SEC * 1000000000LL;
+        }
+
+        select_codec_auto_at(state, now_ns);
+
+        float best_product = 0.0f;
+        for (int i = 0; i < NUM_CONFIGS; i++) {
+            if (!model_violates(i, network)) {
+                best_product = fmaxf(best_product, model_product(i, network));
+            }
+        }
+        const float score = model_violates(id, network) ? 0.0f :
+                            model_product(id, network) / best_product;
+
+        result.total_ms += latency_ms;
+        result.violating_ms += model_violates(id, network) ? latency_ms : 0.0f;
+        result.missed += (latency_ms > LIMIT_LATENCY_MS) ? 1 : 0;
+        result.bad_ms += (score < BAD_SCORE) ? latency_ms : 0.0f;
+        result.score_ms += score * latency_ms;
+        result.frames += 1;
+    }
+
+    destroy_codec_select(&state);
+    close(null_fd);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    const float duration_s = (argc > 1) ? (float) atof(argv[1]) : 900.0f;
+    const unsigned seed = (argc > 2) ? (unsigned) atoi(argv[2]) : 42;
+
+    const int algorithms[] = {SELECT_ALGORITHM_STAGED, SELECT_ALGORITHM_BANDIT,
+                              SELECT_ALGORITHM_PREDICT};
+    const char *const names[] = {"staged", "bandit", "predict"};
+    const int num_algorithms = (int) (sizeof(algorithms) / sizeof(algorithms[0]));
+
+    printf("algorithm,frames,violating_pct,missed_pct,bad_pct,score_pct,switches\n");
+    for (int i = 0; i < num_algorithms; i++) {
+        run_result_t result = run(algorithms[i], duration_s, seed);
+        printf("%s,%d,%.1f,%.1f,%.1f,%.1f,%d\n", names[i], result.frames,
+               100.0 * result.violating_ms / result.total_ms,
+               100.0 * result.missed / result.frames,
+               100.0 * result.bad_ms / result.total_ms,
+               100.0 * result.score_ms / result.total_ms, result.switches);
+    }
+    return 0;
+}
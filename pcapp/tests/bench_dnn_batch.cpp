@@ -0,0 +1,260 @@
+//
+// Load test for server-side batching and the session pool of the
+// pocl.dnn.detection.u8 kernel. Several clients, each with their own queue,
+// run detection back to back on the same device. Per frame latency and
+// aggregate throughput are printed for a growing number of clients.
+//
+// Every client count first runs BENCH_WARMUP_FRAMES per client unmeasured.
+// The model inputs and inference slots of the device only grow with the
+// number of frames in flight, so the benchmark fails if pocl.dnn.stats.u64
+// reports a buffer allocation during the measured frames.
+//
+// Batching and sessions are configured on the device side, e.g:
+// POCL_DNN_MAX_BATCH=8 POCL_DNN_BATCH_WINDOW_US=2000 ./bench_dnn_batch [device index]
+// POCL_DNN_SESSIONS=4 POCL_DNN_INTRA_OP_THREADS=2 POCL_DNN_PIN_THREADS=1 ./bench_dnn_batch
+// run with POCL_DNN_MAX_BATCH=1 and POCL_DNN_SESSIONS=1 to get the baseline.
+//
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+
+#include "rename_opencl.h"
+#include <CL/cl.h>
+
+#include "dnn_stage.hpp"
+#include "jpegReader.h"
+#include "poclImageProcessorTypes.h"
+#include "sharedUtils.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define BENCH_FRAMES_PER_CLIENT 20
+#define BENCH_WARMUP_FRAMES 4
+
+static const int client_counts[] = {1, 2, 4, 8, 16};
+
+/**
+ * run detection on the same frame num_frames times and record the
+ * latency of each run.
+ * @return OpenCL status
+ */
+static cl_int run_client(cl_context context, cl_device_id device, cl_program program,
+                         const uint8_t *frame, int width, int height, int num_frames,
+                         std::vector<int64_t> *latencies_ns) {
+    cl_int status;
+
+    cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL,
+                                                                &status);
+    CHECK_AND_RETURN(status, "could not create queue");
+
+    cl_kernel kernel = clCreateKernel(program, "pocl.dnn.detection.u8", &status);
+    CHECK_AND_RETURN(status, "could not create kernel");
+
+    size_t inp_size = width * height * 3 / 2;
+    cl_mem inp_buf = clCreateBuffer(context, CL_MEM_READ_ONLY, inp_size, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create input buffer");
+    cl_mem detect_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, DET_COUNT * sizeof(cl_int),
+                                       NULL, &status);
+    CHECK_AND_RETURN(status, "could not create detect buffer");
+    cl_mem mask_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, SEG_COUNT * sizeof(cl_uchar),
+                                     NULL, &status);
+    CHECK_AND_RETURN(status, "could not create mask buffer");
+
+    status = clEnqueueWriteBuffer(queue, inp_buf, CL_TRUE, 0, inp_size, frame, 0, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not write input buffer");
+
+    int rotation = 0;
+    int inp_format = YUV_NV12;
+    int model_id = DNN_MODEL_DEFAULT;
+    status = clSetKernelArg(kernel, 0, sizeof(cl_mem), &inp_buf);
+    status |= clSetKernelArg(kernel, 1, sizeof(cl_int), &width);
+    status |= clSetKernelArg(kernel, 2, sizeof(cl_int), &height);
+    status |= clSetKernelArg(kernel, 3, sizeof(cl_int), &rotation);
+    status |= clSetKernelArg(kernel, 4, sizeof(cl_int), &inp_format);
+    status |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &detect_buf);
+    status |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &mask_buf);
+    status |= clSetKernelArg(kernel, 7, sizeof(cl_int), &model_id);
+    CHECK_AND_RETURN(status, "could not set kernel args");
+
+    const size_t global_size = 1;
+    for (int i = 0; i < num_frames; i++) {
+        int64_t start_ns = get_timestamp_ns();
+        status = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, NULL, 0, NULL,
+                                        NULL);
+        CHECK_AND_RETURN(status, "could not enqueue detection");
+        status = clFinish(queue);
+        CHECK_AND_RETURN(status, "could not finish queue");
+        latencies_ns->push_back(get_timestamp_ns() - start_ns);
+    }
+
+    clReleaseMemObject(inp_buf);
+    clReleaseMemObject(detect_buf);
+    clReleaseMemObject(mask_buf);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+    return CL_SUCCESS;
+}
+
+/**
+ * run num_frames detections on each of clients queues at the same time
+ * @param latencies output: per client, the latency of each frame
+ * @return OpenCL status
+ */
+static cl_int run_clients(cl_context context, cl_device_id device, cl_program program,
+                          const uint8_t *frame, int width, int height, int clients,
+                          int num_frames, std::vector<std::vector<int64_t>> *latencies) {
+    latencies->assign(clients, std::vector<int64_t>());
+    std::vector<std::thread> threads;
+    std::vector<cl_int> statuses(clients, CL_SUCCESS);
+
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&, c] {
+            statuses[c] = run_client(context, device, program, frame, width, height,
+                                     num_frames, &(*latencies)[c]);
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    for (int c = 0; c < clients; c++) {
+        CHECK_AND_RETURN(statuses[c], "client failed");
+    }
+    return CL_SUCCESS;
+}
+
+/**
+ * read the counters of the detection models with pocl.dnn.stats.u64
+ * @param stats output: inference runs and buffer allocations
+ * @return OpenCL status
+ */
+static cl_int read_dnn_stats(cl_context context, cl_device_id device, cl_program program,
+                             cl_ulong stats[2]) {
+    cl_int status;
+
+    cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL,
+                                                                &status);
+    CHECK_AND_RETURN(status, "could not create queue");
+    cl_kernel kernel = clCreateKernel(program, "pocl.dnn.stats.u64", &status);
+    CHECK_AND_RETURN(status, "could not create stats kernel");
+    cl_mem stats_buf = clCreateBuffer(context, CL_MEM_WRITE_ONLY, 2 * sizeof(cl_ulong), NULL,
+                                      &status);
+    CHECK_AND_RETURN(status, "could not create stats buffer");
+
+    status = clSetKernelArg(kernel, 0, sizeof(cl_mem), &stats_buf);
+    CHECK_AND_RETURN(status, "could not set kernel args");
+    const size_t global_size = 1;
+    status = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, NULL, 0, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not enqueue stats");
+    status = clEnqueueReadBuffer(queue, stats_buf, CL_TRUE, 0, 2 * sizeof(cl_ulong), stats, 0,
+                                 NULL, NULL);
+    CHECK_AND_RETURN(status, "could not read stats");
+
+    clReleaseMemObject(stats_buf);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+    return CL_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    cl_int status;
+
+    int device_index = (argc > 1) ? atoi(argv[1]) : 0;
+
+    image_data_t image_data;
+    JPEGReader jpegReader("../../../android/app/src/main/assets/bus_640x480.jpg");
+    auto dims = jpegReader.getDimensions();
+    int width = dims.first;
+    int height = dims.second;
+    jpegReader.readImage(&image_data);
+    // the reader stores the frame as one contiguous nv21 buffer
+    const uint8_t *frame = image_data.data.yuv.planes[0];
+
+    cl_platform_id platform_id;
+    status = clGetPlatformIDs(1, &platform_id, NULL);
+    CHECK_AND_RETURN(status, "can't get platform id");
+
+    cl_uint dev_count = 0;
+    status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, 0, NULL, &dev_count);
+    CHECK_AND_RETURN(status, "can't get device count");
+    assert(dev_count > (cl_uint) device_index);
+    cl_device_id device_ids[dev_count];
+    status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, dev_count, device_ids, NULL);
+    CHECK_AND_RETURN(status, "can't get device id");
+
+    cl_context context = clCreateContext(nullptr, dev_count, device_ids, NULL, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create context");
+
+    cl_device_id device = device_ids[device_index];
+    cl_program program = clCreateProgramWithBuiltInKernels(
+            context, 1, &device, "pocl.dnn.detection.u8;pocl.dnn.stats.u64", &status);
+    CHECK_AND_RETURN(status, "could not create program");
+    status = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not build program");
+
+    const char *max_batch = getenv("POCL_DNN_MAX_BATCH");
+    const char *window_us = getenv("POCL_DNN_BATCH_WINDOW_US");
+    const char *sessions = getenv("POCL_DNN_SESSIONS");
+    const char *intra_op_threads = getenv("POCL_DNN_INTRA_OP_THREADS");
+    printf("clients,max_batch,window_us,sessions,intra_op_threads,frames,mean_latency_ms,"
+           "p95_latency_ms,throughput_fps,buffer_allocations\n");
+
+    int failed = 0;
+    for (int clients : client_counts) {
+        // loads the model and grows the buffers to this many frames in flight
+        std::vector<std::vector<int64_t>> latencies;
+        status = run_clients(context, device, program, frame, width, height, clients,
+                             BENCH_WARMUP_FRAMES, &latencies);
+        CHECK_AND_RETURN(status, "warmup failed");
+
+        cl_ulong warm_stats[2], end_stats[2];
+        status = read_dnn_stats(context, device, program, warm_stats);
+        CHECK_AND_RETURN(status, "could not get dnn stats");
+
+        int64_t start_ns = get_timestamp_ns();
+        status = run_clients(context, device, program, frame, width, height, clients,
+                             BENCH_FRAMES_PER_CLIENT, &latencies);
+        CHECK_AND_RETURN(status, "clients failed");
+        int64_t total_ns = get_timestamp_ns() - start_ns;
+
+        status = read_dnn_stats(context, device, program, end_stats);
+        CHECK_AND_RETURN(status, "could not get dnn stats");
+        const cl_ulong allocations = end_stats[1] - warm_stats[1];
+        if (allocations > 0) {
+            failed += 1;
+        }
+
+        std::vector<int64_t> all;
+        for (int c = 0; c < clients; c++) {
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        }
+        std::sort(all.begin(), all.end());
+
+        double mean_ns = 0;
+        for (int64_t l : all) {
+            mean_ns += (double) l / all.size();
+        }
+        int64_t p95_ns = all[(all.size() * 95) / 100];
+        double fps = (double) all.size() / ((double) total_ns / 1e9);
+
+        printf("%d,%s,%s,%s,%s,%zu,%.2f,%.2f,%.2f,%lu\n", clients, max_batch ? max_batch : "1",
+               window_us ? window_us : "2000", sessions ? sessions : "1",
+               intra_op_threads ? intra_op_threads : "0", all.size(), mean_ns / 1e6,
+               p95_ns / 1e6, fps, (unsigned long) allocations);
+    }
+    if (failed > 0) {
+        printf("the dnn kept allocating buffers after %d frames per client\n",
+               BENCH_WARMUP_FRAMES);
+    }
+
+    clReleaseProgram(program);
+    clReleaseContext(context);
+    for (cl_uint i = 0; i < dev_count; i++) {
+        clReleaseDevice(device_ids[i]);
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+//
+// Microbenchmark of the ONNX detection kernel output decoding.
+// Compares the channel-major decoder and top-k NMS against the
+// transpose + minMaxLoc + NMSBoxes path on a synthetic yolov8 output
+// and checks that both keep the same detections.
+//
+
+#include "onnx_postprocess.h"
+#include "sharedUtils.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+
+#define BENCH_ITERATIONS 500
+#define BENCH_CLASSES 80
+#define BENCH_MASK_COEFFS 32
+#define BENCH_DIMENSIONS (4 + BENCH_CLASSES + BENCH_MASK_COEFFS)
+#define BENCH_ROWS 6300
+#define BENCH_SCORE_THRESHOLD 0.45f
+#define BENCH_NMS_THRESHOLD 0.50f
+
+// number of rows above the score threshold, a few clusters of
+// overlapping boxes like the model produces around each object
+static const int strong_rows[] = {0, 8, 40, 200, 1000};
+
+/**
+ * fill a channel-major output with low background scores and clusters
+ * of boxes that pass the threshold.
+ */
+static void fill_output(float *output, int nstrong, std::mt19937 &rng) {
+    std::uniform_real_distribution<float> background(0.0f, 0.2f);
+    std::uniform_real_distribution<float> strong(0.5f, 1.0f);
+    std::uniform_real_distribution<float> jitter(-8.0f, 8.0f);
+    std::uniform_int_distribution<int> row_dist(0, BENCH_ROWS - 1);
+    std::uniform_int_distribution<int> class_dist(0, BENCH_CLASSES - 1);
+
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        output[0 * BENCH_ROWS + i] = (float) (i % 80) * 8.0f;
+        output[1 * BENCH_ROWS + i] = (float) (i / 80) * 6.0f;
+        output[2 * BENCH_ROWS + i] = 16.0f;
+        output[3 * BENCH_ROWS + i] = 16.0f;
+    }
+    for (int c = 4; c < BENCH_DIMENSIONS; c++) {
+        for (int i = 0; i < BENCH_ROWS; i++) {
+            output[c * BENCH_ROWS + i] = background(rng);
+        }
+    }
+
+    for (int n = 0; n < nstrong; n++) {
+        int row = row_dist(rng);
+        int cluster = n % 12;
+        output[0 * BENCH_ROWS + row] = 60.0f + 45.0f * cluster + jitter(rng);
+        output[1 * BENCH_ROWS + row] = 240.0f + jitter(rng);
+        output[2 * BENCH_ROWS + row] = 80.0f + jitter(rng);
+        output[3 * BENCH_ROWS + row] = 120.0f + jitter(rng);
+        output[(4 + class_dist(rng)) * BENCH_ROWS + row] = strong(rng);
+    }
+}
+
+static int decode_vectorized(const float *output, DetectionCandidate *detections) {
+    static DetectionCandidate candidates[DNN_CANDIDATE_CAPACITY];
+    int keep[DNN_MAX_DETECTIONS];
+
+    int ncandidates = decode_detections(output, BENCH_DIMENSIONS, BENCH_ROWS,
+                                        BENCH_CLASSES, BENCH_SCORE_THRESHOLD,
+                                        1.0f, candidates);
+    int ndetections = nms_top_k(candidates, ncandidates, BENCH_NMS_THRESHOLD,
+                                DNN_MAX_DETECTIONS, keep);
+    for (int i = 0; i < ndetections; i++) {
+        detections[i] = candidates[keep[i]];
+    }
+    return ndetections;
+}
+
+static int decode_opencv(const float *output, DetectionCandidate *detections) {
+    return decode_detections_opencv(output, BENCH_DIMENSIONS, BENCH_ROWS,
+                                    BENCH_CLASSES, BENCH_SCORE_THRESHOLD,
+                                    BENCH_NMS_THRESHOLD, 1.0f,
+                                    DNN_MAX_DETECTIONS, detections);
+}
+
+typedef int (*decode_fn)(const float *, DetectionCandidate *);
+
+/**
+ * @return average time per call in ms
+ */
+static double time_decode(decode_fn fn, const float *output,
+                          DetectionCandidate *detections, int *ndetections) {
+    // warm up caches and any lazily allocated buffers
+    *ndetections = fn(output, detections);
+
+    int64_t start_ns = get_timestamp_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        *ndetections = fn(output, detections);
+    }
+    return (double) (get_timestamp_ns() - start_ns) / BENCH_ITERATIONS / 1e6;
+}
+
+static bool same_detection(const DetectionCandidate &a, const DetectionCandidate &b) {
+    return a.score == b.score && a.class_id == b.class_id && a.row == b.row &&
+           a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+int main() {
+    std::mt19937 rng(42);
+    std::unique_ptr<float[]> output(new float[BENCH_DIMENSIONS * BENCH_ROWS]);
+    DetectionCandidate opencv_dets[DNN_MAX_DETECTIONS];
+    DetectionCandidate vector_dets[DNN_MAX_DETECTIONS];
+    int failures = 0;
+
+    printf("strong_rows,opencv_ms,vectorized_ms,speedup,detections,match\n");
+    for (int nstrong : strong_rows) {
+        fill_output(output.get(), nstrong, rng);
+
+        int opencv_n, vector_n;
+        double opencv_ms = time_decode(decode_opencv, output.get(), opencv_dets,
+                                       &opencv_n);
+        double vector_ms = time_decode(decode_vectorized, output.get(), vector_dets,
+                                       &vector_n);
+
+        bool match = opencv_n == vector_n;
+        for (int i = 0; match && i < opencv_n; i++) {
+            match = same_detection(opencv_dets[i], vector_dets[i]);
+        }
+        if (!match) {
+            failures++;
+        }
+
+        printf("%d,%.4f,%.4f,%.2f,%d,%d\n", nstrong, opencv_ms, vector_ms,
+               opencv_ms / vector_ms, vector_n, match ? 1 : 0);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+//
+// Microbenchmark of the segmentation IoU evaluation. Compares the
+// confusion matrix evaluator against the per pixel one on class maps at
+// the mask resolution and at a resolution where 16-bit counters would
+// overflow, and checks that the class counts and IoU are the same.
+//
+
+#include "onnx_eval.h"
+#include "sharedUtils.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define BENCH_ITERATIONS 500
+#define BENCH_NUM_CLASSES 81
+#define BENCH_NO_CLASS_ID (BENCH_NUM_CLASSES - 1)
+
+typedef struct {
+    int width;
+    int height;
+} bench_shape_t;
+
+static const bench_shape_t shapes[] = {{160, 120}, {640, 480}};
+
+// fraction of a frame covered by objects
+static const float coverages[] = {0.0f, 0.1f, 0.5f};
+
+/**
+ * fill a ground truth map with a few rectangular objects and derive a
+ * prediction from it with shifted boxes and some flipped pixels.
+ */
+static void fill_maps(int width, int height, float coverage, uint8_t *seg, uint8_t *ref_seg,
+                      std::mt19937 &rng) {
+    std::uniform_int_distribution<int> class_dist(0, BENCH_NO_CLASS_ID - 1);
+    std::uniform_int_distribution<int> noise_dist(0, 99);
+    const int npixels = width * height;
+
+    memset(ref_seg, BENCH_NO_CLASS_ID, npixels);
+    memset(seg, BENCH_NO_CLASS_ID, npixels);
+
+    const int nobjects = coverage > 0.0f ? 5 : 0;
+    // each object covers about coverage / nobjects of the frame
+    const int box_w = nobjects ? (int) (width * coverage * 2 / nobjects) : 0;
+    const int box_h = height / 2;
+    for (int n = 0; n < nobjects; n++) {
+        const uint8_t cls = (uint8_t) class_dist(rng);
+        const int x0 = (n * width) / nobjects;
+        const int y0 = height / 4;
+        for (int y = y0; y < y0 + box_h; y++) {
+            for (int x = x0; x < x0 + box_w && x < width; x++) {
+                ref_seg[y * width + x] = cls;
+                // predictions are off by a few pixels
+                int px = x + 3;
+                if (px < width) {
+                    seg[y * width + px] = (noise_dist(rng) < 5) ? (uint8_t) class_dist(rng) : cls;
+                }
+            }
+        }
+    }
+}
+
+static bool same_counts(const EvalClassCounts *a, const EvalClassCounts *b) {
+    for (int cls = 0; cls < BENCH_NUM_CLASSES; cls++) {
+        if (a[cls].correct != b[cls].correct || a[cls].wrong != b[cls].wrong) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    std::mt19937 rng(42);
+    int failures = 0;
+
+    printf("width,height,coverage,reference_ms,confusion_ms,speedup,iou,match\n");
+    for (const bench_shape_t &shape : shapes) {
+        const int npixels = shape.width * shape.height;
+        std::vector<uint8_t> seg(npixels), ref_seg(npixels);
+        std::vector<uint32_t> confusion(BENCH_NUM_CLASSES * BENCH_NUM_CLASSES);
+        EvalClassCounts reference_counts[BENCH_NUM_CLASSES];
+        EvalClassCounts confusion_counts[BENCH_NUM_CLASSES];
+
+        for (float coverage : coverages) {
+            fill_maps(shape.width, shape.height, coverage, seg.data(), ref_seg.data(), rng);
+
+            int64_t start_ns = get_timestamp_ns();
+            for (int i = 0; i < BENCH_ITERATIONS; i++) {
+                eval_class_counts_reference(seg.data(), ref_seg.data(), npixels,
+                                            BENCH_NUM_CLASSES, BENCH_NO_CLASS_ID,
+                                            reference_counts);
+            }
+            double reference_ms =
+                    (double) (get_timestamp_ns() - start_ns) / BENCH_ITERATIONS / 1e6;
+
+            start_ns = get_timestamp_ns();
+            for (int i = 0; i < BENCH_ITERATIONS; i++) {
+                eval_confusion_matrix(seg.data(), ref_seg.data(), npixels, BENCH_NUM_CLASSES,
+                                      BENCH_NO_CLASS_ID, confusion.data());
+                eval_class_counts(confusion.data(), BENCH_NUM_CLASSES, BENCH_NO_CLASS_ID,
+                                  confusion_counts);
+            }
+            double confusion_ms =
+                    (double) (get_timestamp_ns() - start_ns) / BENCH_ITERATIONS / 1e6;
+
+            float reference_iou = -2.0f, confusion_iou = -2.0f;
+            eval_mean_iou(reference_counts, BENCH_NUM_CLASSES, &reference_iou);
+            eval_mean_iou(confusion_counts, BENCH_NUM_CLASSES, &confusion_iou);
+
+            // the matrix has to account for every pixel
+            uint64_t total = 0;
+            for (uint32_t n : confusion) {
+                total += n;
+            }
+
+            bool match = same_counts(reference_counts, confusion_counts) &&
+                         reference_iou == confusion_iou && total == (uint64_t) npixels;
+            if (!match) {
+                failures++;
+            }
+
+            printf("%d,%d,%.2f,%.4f,%.4f,%.2f,%.3f,%d\n", shape.width, shape.height, coverage,
+                   reference_ms, confusion_ms, reference_ms / confusion_ms, confusion_iou,
+                   match ? 1 : 0);
+        }
+
+        // an invalid class has to be reported at the right pixel
+        const int invalid_pixel = npixels - 3;
+        seg[invalid_pixel] = BENCH_NUM_CLASSES;
+        int reference_invalid = eval_class_counts_reference(
+                seg.data(), ref_seg.data(), npixels, BENCH_NUM_CLASSES, BENCH_NO_CLASS_ID,
+                reference_counts);
+        int confusion_invalid = eval_confusion_matrix(seg.data(), ref_seg.data(), npixels,
+                                                      BENCH_NUM_CLASSES, BENCH_NO_CLASS_ID,
+                                                      confusion.data());
+        if (reference_invalid != invalid_pixel || confusion_invalid != invalid_pixel) {
+            printf("invalid pixel %d reported as %d and %d\n", invalid_pixel, reference_invalid,
+                   confusion_invalid);
+            failures++;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
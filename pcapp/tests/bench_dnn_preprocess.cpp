@@ -0,0 +1,75 @@
+//
+// Microbenchmark of the ONNX detection kernel input preprocessing.
+// Compares the fused yuv -> letterboxed float tensor path against the
+// OpenCV based path for every rotation and prints the time per frame
+// and the largest difference between the two outputs.
+//
+
+#include "jpegReader.h"
+#include "onnx_preprocess.h"
+#include "sharedUtils.h"
+#include <cmath>
+#include <cstdio>
+#include <memory>
+
+#define BENCH_ITERATIONS 200
+#define BENCH_MODEL_W 640
+#define BENCH_MODEL_H 480
+
+static const int rotations[] = {0, 90, 180, 270};
+
+typedef float (*preprocess_fn)(const uint8_t *, int, int, int, int, int, int,
+                               float *);
+
+/**
+ * @return average time per call in ms
+ */
+static double time_preprocess(preprocess_fn fn, const uint8_t *frame, int width,
+                              int height, int rotation, float *output) {
+    // warm up caches and any lazily allocated buffers
+    fn(frame, width, height, rotation, PREPROCESS_NV21, BENCH_MODEL_W,
+       BENCH_MODEL_H, output);
+
+    int64_t start_ns = get_timestamp_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fn(frame, width, height, rotation, PREPROCESS_NV21, BENCH_MODEL_W,
+           BENCH_MODEL_H, output);
+    }
+    return (double)(get_timestamp_ns() - start_ns) / BENCH_ITERATIONS / 1e6;
+}
+
+int main() {
+    image_data_t image_data;
+    JPEGReader jpegReader("../../../android/app/src/main/assets/bus_640x480.jpg");
+    auto dims = jpegReader.getDimensions();
+    jpegReader.readImage(&image_data);
+    // the reader stores the frame as one contiguous nv21 buffer
+    const uint8_t *frame = image_data.data.yuv.planes[0];
+
+    const size_t count = 3 * BENCH_MODEL_W * BENCH_MODEL_H;
+    std::unique_ptr<float[]> fused_out(new float[count]);
+    std::unique_ptr<float[]> opencv_out(new float[count]);
+
+    printf("rotation,opencv_ms,fused_ms,speedup,max_abs_diff,mean_abs_diff\n");
+    for (int rotation : rotations) {
+        double opencv_ms = time_preprocess(preprocess_opencv, frame, dims.first,
+                                           dims.second, rotation, opencv_out.get());
+        double fused_ms = time_preprocess(preprocess_fused, frame, dims.first,
+                                          dims.second, rotation, fused_out.get());
+
+        // the opencv path rounds to 8 bits after resizing and uses fixed
+        // point color conversion, so small differences are expected
+        double max_diff = 0.0;
+        double sum_diff = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            double diff = std::fabs(fused_out[i] - opencv_out[i]);
+            max_diff = std::fmax(max_diff, diff);
+            sum_diff += diff;
+        }
+
+        printf("%d,%.3f,%.3f,%.2f,%.4f,%.6f\n", rotation, opencv_ms, fused_ms,
+               opencv_ms / fused_ms, max_diff, sum_diff / count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+//
+// Accuracy and latency of the quantized models against the float32 one.
+// Every model in DNN_MODEL_NAMES runs detection and segmentation on the
+// sample frame, and pocl.dnn.eval.iou.f32 compares its segmentation with
+// the one of the default float32 model.
+//
+// The device has to load the models in the order of DNN_MODEL_NAMES, e.g:
+// POCL_DNN_MODELS=yolov8n-seg:640x480,yolov8n-seg:320x256,yolov8n-seg:640x480:int8,yolov8n-seg:640x480:fp16 \
+//     ./bench_dnn_quantized [device index]
+// models the device doesn't have fall back to the default and get an iou of 1.
+//
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+
+#include "rename_opencl.h"
+#include <CL/cl.h>
+
+#include "dnn_stage.hpp"
+#include "jpegReader.h"
+#include "poclImageProcessorTypes.h"
+#include "sharedUtils.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+
+#define BENCH_FRAMES 50
+#define BENCH_WARMUP_FRAMES 2
+
+/**
+ * kernels and buffers to run detection + segmentation postprocessing
+ */
+typedef struct {
+    cl_kernel dnn_kernel;
+    cl_kernel postprocess_kernel;
+    cl_mem detect_buf;
+    cl_mem mask_buf;
+    cl_mem postprocess_buf;
+} bench_pipeline_t;
+
+static cl_int create_pipeline(cl_context context, cl_program program, cl_mem inp_buf, int width,
+                              int height, bench_pipeline_t *p) {
+    cl_int status;
+
+    p->dnn_kernel = clCreateKernel(program, "pocl.dnn.detection.u8", &status);
+    CHECK_AND_RETURN(status, "could not create detection kernel");
+    p->postprocess_kernel = clCreateKernel(program, "pocl.dnn.segmentation.postprocess.u8",
+                                           &status);
+    CHECK_AND_RETURN(status, "could not create postprocess kernel");
+
+    p->detect_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, DET_COUNT * sizeof(cl_int), NULL,
+                                   &status);
+    CHECK_AND_RETURN(status, "could not create detect buffer");
+    p->mask_buf = clCreateBuffer(context, CL_MEM_READ_WRITE, SEG_COUNT * sizeof(cl_uchar), NULL,
+                                 &status);
+    CHECK_AND_RETURN(status, "could not create mask buffer");
+    p->postprocess_buf = clCreateBuffer(context, CL_MEM_READ_WRITE,
+                                        MASK_SZ1 * MASK_SZ2 * sizeof(cl_uchar), NULL, &status);
+    CHECK_AND_RETURN(status, "could not create postprocess buffer");
+
+    int rotation = 0;
+    int inp_format = YUV_NV12;
+    int model_id = DNN_MODEL_DEFAULT;
+    status = clSetKernelArg(p->dnn_kernel, 0, sizeof(cl_mem), &inp_buf);
+    status |= clSetKernelArg(p->dnn_kernel, 1, sizeof(cl_int), &width);
+    status |= clSetKernelArg(p->dnn_kernel, 2, sizeof(cl_int), &height);
+    status |= clSetKernelArg(p->dnn_kernel, 3, sizeof(cl_int), &rotation);
+    status |= clSetKernelArg(p->dnn_kernel, 4, sizeof(cl_int), &inp_format);
+    status |= clSetKernelArg(p->dnn_kernel, 5, sizeof(cl_mem), &p->detect_buf);
+    status |= clSetKernelArg(p->dnn_kernel, 6, sizeof(cl_mem), &p->mask_buf);
+    status |= clSetKernelArg(p->dnn_kernel, 7, sizeof(cl_int), &model_id);
+    CHECK_AND_RETURN(status, "could not set detection kernel args");
+
+    status = clSetKernelArg(p->postprocess_kernel, 0, sizeof(cl_mem), &p->detect_buf);
+    status |= clSetKernelArg(p->postprocess_kernel, 1, sizeof(cl_mem), &p->mask_buf);
+    status |= clSetKernelArg(p->postprocess_kernel, 2, sizeof(cl_mem), &p->postprocess_buf);
+    status |= clSetKernelArg(p->postprocess_kernel, 3, sizeof(cl_int), &rotation);
+    status |= clSetKernelArg(p->postprocess_kernel, 4, sizeof(cl_int), &width);
+    status |= clSetKernelArg(p->postprocess_kernel, 5, sizeof(cl_int), &height);
+    CHECK_AND_RETURN(status, "could not set postprocess kernel args");
+
+    return CL_SUCCESS;
+}
+
+static void release_pipeline(bench_pipeline_t *p) {
+    clReleaseMemObject(p->postprocess_buf);
+    clReleaseMemObject(p->mask_buf);
+    clReleaseMemObject(p->detect_buf);
+    clReleaseKernel(p->postprocess_kernel);
+    clReleaseKernel(p->dnn_kernel);
+}
+
+/**
+ * run the model on the frame num_frames times, the last run leaves its
+ * detections and segmentation in the pipeline buffers.
+ * @return OpenCL status
+ */
+static cl_int run_model(cl_command_queue queue, bench_pipeline_t *p, int model_id, int num_frames,
+                        std::vector<int64_t> *latencies_ns) {
+    cl_int status;
+    const size_t global_size = 1;
+
+    status = clSetKernelArg(p->dnn_kernel, 7, sizeof(cl_int), &model_id);
+    CHECK_AND_RETURN(status, "could not set model id");
+
+    for (int i = 0; i < num_frames; i++) {
+        int64_t start_ns = get_timestamp_ns();
+        status = clEnqueueNDRangeKernel(queue, p->dnn_kernel, 1, NULL, &global_size, NULL, 0,
+                                        NULL, NULL);
+        CHECK_AND_RETURN(status, "could not enqueue detection");
+        status = clFinish(queue);
+        CHECK_AND_RETURN(status, "could not finish queue");
+        latencies_ns->push_back(get_timestamp_ns() - start_ns);
+    }
+
+    status = clEnqueueNDRangeKernel(queue, p->postprocess_kernel, 1, NULL, &global_size, NULL, 0,
+                                    NULL, NULL);
+    CHECK_AND_RETURN(status, "could not enqueue postprocess");
+    return clFinish(queue);
+}
+
+int main(int argc, char **argv) {
+    cl_int status;
+
+    int device_index = (argc > 1) ? atoi(argv[1]) : 0;
+
+    image_data_t image_data;
+    JPEGReader jpegReader("../../../android/app/src/main/assets/bus_640x480.jpg");
+    auto dims = jpegReader.getDimensions();
+    int width = dims.first;
+    int height = dims.second;
+    jpegReader.readImage(&image_data);
+    // the reader stores the frame as one contiguous nv21 buffer
+    const uint8_t *frame = image_data.data.yuv.planes[0];
+
+    cl_platform_id platform_id;
+    status = clGetPlatformIDs(1, &platform_id, NULL);
+    CHECK_AND_RETURN(status, "can't get platform id");
+
+    cl_uint dev_count = 0;
+    status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, 0, NULL, &dev_count);
+    CHECK_AND_RETURN(status, "can't get device count");
+    assert(dev_count > (cl_uint) device_index);
+    cl_device_id device_ids[dev_count];
+    status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, dev_count, device_ids, NULL);
+    CHECK_AND_RETURN(status, "can't get device id");
+
+    cl_context context = clCreateContext(nullptr, dev_count, device_ids, NULL, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create context");
+
+    cl_device_id device = device_ids[device_index];
+    cl_program program = clCreateProgramWithBuiltInKernels(
+            context, 1, &device,
+            "pocl.dnn.detection.u8;pocl.dnn.segmentation.postprocess.u8;pocl.dnn.eval.iou.f32",
+            &status);
+    CHECK_AND_RETURN(status, "could not create program");
+    status = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not build program");
+
+    cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create queue");
+
+    size_t inp_size = width * height * 3 / 2;
+    cl_mem inp_buf = clCreateBuffer(context, CL_MEM_READ_ONLY, inp_size, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create input buffer");
+    status = clEnqueueWriteBuffer(queue, inp_buf, CL_TRUE, 0, inp_size, frame, 0, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not write input buffer");
+
+    // float32 reference results
+    bench_pipeline_t ref, test;
+    status = create_pipeline(context, program, inp_buf, width, height, &ref);
+    CHECK_AND_RETURN(status, "could not create reference pipeline");
+    status = create_pipeline(context, program, inp_buf, width, height, &test);
+    CHECK_AND_RETURN(status, "could not create test pipeline");
+
+    std::vector<int64_t> ref_latencies;
+    status = run_model(queue, &ref, DNN_MODEL_DEFAULT, 1, &ref_latencies);
+    CHECK_AND_RETURN(status, "reference run failed");
+
+    cl_kernel eval_kernel = clCreateKernel(program, "pocl.dnn.eval.iou.f32", &status);
+    CHECK_AND_RETURN(status, "could not create eval kernel");
+    cl_mem iou_buf = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_float), NULL, &status);
+    CHECK_AND_RETURN(status, "could not create iou buffer");
+    int do_segment = 1;
+    status = clSetKernelArg(eval_kernel, 0, sizeof(cl_mem), &test.detect_buf);
+    status |= clSetKernelArg(eval_kernel, 1, sizeof(cl_mem), &test.postprocess_buf);
+    status |= clSetKernelArg(eval_kernel, 2, sizeof(cl_mem), &ref.detect_buf);
+    status |= clSetKernelArg(eval_kernel, 3, sizeof(cl_mem), &ref.postprocess_buf);
+    status |= clSetKernelArg(eval_kernel, 4, sizeof(cl_int), &do_segment);
+    status |= clSetKernelArg(eval_kernel, 5, sizeof(cl_mem), &iou_buf);
+    CHECK_AND_RETURN(status, "could not set eval kernel args");
+
+    printf("model_id,model,frames,mean_latency_ms,p95_latency_ms,iou\n");
+    for (int model_id = 0; model_id < NUM_DNN_MODELS; model_id++) {
+        std::vector<int64_t> latencies;
+        status = run_model(queue, &test, model_id, BENCH_WARMUP_FRAMES, &latencies);
+        CHECK_AND_RETURN(status, "warmup failed");
+        latencies.clear();
+        status = run_model(queue, &test, model_id, BENCH_FRAMES, &latencies);
+        CHECK_AND_RETURN(status, "benchmark run failed");
+
+        const size_t global_size = 1;
+        cl_float iou;
+        status = clEnqueueNDRangeKernel(queue, eval_kernel, 1, NULL, &global_size, NULL, 0, NULL,
+                                        NULL);
+        CHECK_AND_RETURN(status, "could not enqueue eval");
+        status = clEnqueueReadBuffer(queue, iou_buf, CL_TRUE, 0, sizeof(cl_float), &iou, 0, NULL,
+                                     NULL);
+        CHECK_AND_RETURN(status, "could not read iou");
+
+        std::sort(latencies.begin(), latencies.end());
+        double mean_ns = 0;
+        for (int64_t l : latencies) {
+            mean_ns += (double) l / latencies.size();
+        }
+        int64_t p95_ns = latencies[(latencies.size() * 95) / 100];
+
+        printf("%d,%s,%zu,%.2f,%.2f,%.3f\n", model_id, DNN_MODEL_NAMES[model_id],
+               latencies.size(), mean_ns / 1e6, p95_ns / 1e6, iou);
+    }
+
+    clReleaseMemObject(iou_buf);
+    clReleaseKernel(eval_kernel);
+    release_pipeline(&test);
+    release_pipeline(&ref);
+    clReleaseMemObject(inp_buf);
+    clReleaseCommandQueue(queue);
+    clReleaseProgram(program);
+    clReleaseContext(context);
+    for (cl_uint i = 0; i < dev_count; i++) {
+        clReleaseDevice(device_ids[i]);
+    }
+    return 0;
+}
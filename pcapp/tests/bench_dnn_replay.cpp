@@ -0,0 +1,180 @@
+//
+// Host cost of enqueueing the dnn stage with and without REPLAY_COMMAND_BUFFERS.
+// The same frame runs through enqueue_dnn with detection, postprocessing and
+// reconstruction, once with every command enqueued separately and once
+// replayed from the recorded command buffer. Both have to give the same
+// detections and segmentation.
+//
+// usage: ./bench_dnn_replay [device index]
+//
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+
+#include "rename_opencl.h"
+#include <CL/cl.h>
+
+#include "dnn_stage.hpp"
+#include "jpegReader.h"
+#include "poclImageProcessorTypes.h"
+#include "sharedUtils.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define BENCH_FRAMES 50
+#define BENCH_WARMUP_FRAMES 2
+#define BENCH_MAX_EVENTS 32
+
+typedef struct {
+    int64_t enqueue_ns;
+    int64_t latency_ns;
+} frame_times_t;
+
+/**
+ * run the dnn stage num_frames times on the frame in inp_buf
+ * @return OpenCL status
+ */
+static cl_int run_frames(dnn_context_t *dnn_ctx, cl_command_queue queue, cl_mem inp_buf,
+                         int num_frames, std::vector<frame_times_t> *times) {
+    cl_int status;
+    event_array_t *event_array = create_event_array_pointer(BENCH_MAX_EVENTS);
+
+    codec_config_t config = {};
+    config.compression_type = NO_COMPRESSION;
+    config.device_type = LOCAL_DEVICE;
+    config.do_segment = 1;
+    config.model_id = DNN_MODEL_DEFAULT;
+
+    for (int i = 0; i < num_frames; i++) {
+        cl_event start_event, out_event;
+        status = clEnqueueMarkerWithWaitList(queue, 0, NULL, &start_event);
+        CHECK_AND_RETURN(status, "could not enqueue marker");
+        append_to_event_array(event_array, start_event, VAR_NAME(start_event));
+
+        int64_t start_ns = get_timestamp_ns();
+        status = enqueue_dnn(dnn_ctx, &start_event, config, YUV_NV12, true, inp_buf, event_array,
+                             &out_event, NULL);
+        CHECK_AND_RETURN(status, "could not enqueue dnn");
+        int64_t enqueued_ns = get_timestamp_ns();
+        status = clWaitForEvents(1, &out_event);
+        CHECK_AND_RETURN(status, "could not wait for dnn");
+        times->push_back({enqueued_ns - start_ns, get_timestamp_ns() - start_ns});
+
+        release_events(event_array);
+        reset_event_array(event_array);
+    }
+
+    free_event_array_pointer(&event_array);
+    return clFinish(queue);
+}
+
+static cl_int read_results(dnn_context_t *dnn_ctx, cl_command_queue queue,
+                           std::vector<uint8_t> *results) {
+    results->resize(DET_COUNT * sizeof(cl_int) + SEG_OUT_COUNT);
+    cl_int status = clEnqueueReadBuffer(queue, dnn_ctx->detect_buf, CL_TRUE, 0,
+                                        DET_COUNT * sizeof(cl_int), results->data(), 0, NULL,
+                                        NULL);
+    CHECK_AND_RETURN(status, "could not read detections");
+    status = clEnqueueReadBuffer(queue, dnn_ctx->segmentation_buf, CL_TRUE, 0, SEG_OUT_COUNT,
+                                 results->data() + DET_COUNT * sizeof(cl_int), 0, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not read segmentation");
+    return CL_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    cl_int status;
+
+    int device_index = (argc > 1) ? atoi(argv[1]) : 0;
+
+    image_data_t image_data;
+    JPEGReader jpegReader("../../../android/app/src/main/assets/bus_640x480.jpg");
+    auto dims = jpegReader.getDimensions();
+    int width = dims.first;
+    int height = dims.second;
+    jpegReader.readImage(&image_data);
+    const uint8_t *frame = image_data.data.yuv.planes[0];
+
+    cl_platform_id platform_id;
+    status = clGetPlatformIDs(1, &platform_id, NULL);
+    CHECK_AND_RETURN(status, "can't get platform id");
+
+    cl_uint dev_count = 0;
+    status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, 0, NULL, &dev_count);
+    CHECK_AND_RETURN(status, "can't get device count");
+    assert(dev_count > (cl_uint) device_index);
+    cl_device_id device_ids[dev_count];
+    status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, dev_count, device_ids, NULL);
+    CHECK_AND_RETURN(status, "can't get device id");
+
+    cl_context context = clCreateContext(nullptr, dev_count, device_ids, NULL, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create context");
+    cl_device_id device = device_ids[device_index];
+    cl_queue_properties cq_properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+    cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, cq_properties,
+                                                                &status);
+    CHECK_AND_RETURN(status, "could not create queue");
+
+    size_t inp_size = width * height * 3 / 2;
+    cl_mem inp_buf = clCreateBuffer(context, CL_MEM_READ_ONLY, inp_size, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create input buffer");
+    status = clEnqueueWriteBuffer(queue, inp_buf, CL_TRUE, 0, inp_size, frame, 0, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not write input buffer");
+
+    const char *mode_names[] = {"direct", "replay"};
+    const int mode_flags[] = {NO_COMPRESSION, NO_COMPRESSION | REPLAY_COMMAND_BUFFERS};
+    std::vector<uint8_t> results[2];
+
+    printf("mode,frames,mean_enqueue_us,p95_enqueue_us,mean_latency_ms\n");
+    for (int mode = 0; mode < 2; mode++) {
+        dnn_context_t *dnn_ctx = create_dnn_context();
+        dnn_ctx->local_queue = queue;
+        dnn_ctx->remote_queue = queue;
+        dnn_ctx->local_tracy_ctx = TracyCLContext(context, device);
+        dnn_ctx->remote_tracy_ctx = dnn_ctx->local_tracy_ctx;
+        status = init_dnn_context(dnn_ctx, mode_flags[mode], context, width, height, &device,
+                                  &device, 0);
+        CHECK_AND_RETURN(status, "could not init dnn context");
+
+        std::vector<frame_times_t> times;
+        status = run_frames(dnn_ctx, queue, inp_buf, BENCH_WARMUP_FRAMES, &times);
+        CHECK_AND_RETURN(status, "warmup failed");
+        times.clear();
+        status = run_frames(dnn_ctx, queue, inp_buf, BENCH_FRAMES, &times);
+        CHECK_AND_RETURN(status, "benchmark run failed");
+        status = read_results(dnn_ctx, queue, &results[mode]);
+        CHECK_AND_RETURN(status, "could not read results");
+
+        std::vector<int64_t> enqueue_ns;
+        double mean_enqueue_ns = 0, mean_latency_ns = 0;
+        for (const frame_times_t &t: times) {
+            enqueue_ns.push_back(t.enqueue_ns);
+            mean_enqueue_ns += (double) t.enqueue_ns / times.size();
+            mean_latency_ns += (double) t.latency_ns / times.size();
+        }
+        std::sort(enqueue_ns.begin(), enqueue_ns.end());
+        int64_t p95_enqueue_ns = enqueue_ns[(enqueue_ns.size() * 95) / 100];
+
+        printf("%s,%zu,%.1f,%.1f,%.2f\n", mode_names[mode], times.size(), mean_enqueue_ns / 1e3,
+               p95_enqueue_ns / 1e3, mean_latency_ns / 1e6);
+
+        destroy_dnn_context(&dnn_ctx);
+    }
+
+    int ret = 0;
+    if (results[0] != results[1]) {
+        printf("replayed results differ from the directly enqueued ones\n");
+        ret = 1;
+    }
+
+    clReleaseMemObject(inp_buf);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    for (cl_uint i = 0; i < dev_count; i++) {
+        clReleaseDevice(device_ids[i]);
+    }
+    return ret;
+}
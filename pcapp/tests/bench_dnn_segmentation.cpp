@@ -0,0 +1,178 @@
+//
+// Microbenchmark of the segmentation postprocess and reconstruct kernels.
+// Compares the single pass versions against the cv::Mat and per channel
+// ones on random detections and masks and checks that the outputs are
+// bit-exact.
+//
+
+#include "onnx_segmentation.h"
+#include "sharedUtils.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#define BENCH_ITERATIONS 500
+#define BENCH_MASK_W 160
+#define BENCH_MASK_H 120
+#define BENCH_IMG_W 640
+#define BENCH_IMG_H 480
+#define BENCH_MAX_DETECTIONS 10
+#define BENCH_NO_CLASS_ID 80
+#define BENCH_RANDOM_FRAMES 200
+
+static const int detection_counts[] = {0, 1, 5, 10};
+
+/**
+ * fill in random detections, some of them partly or fully outside the
+ * image, and masks with about a third of the pixels set.
+ */
+static void fill_frame(int ndetections, int mask_w, int mask_h, int img_w, int img_h,
+                       unsigned int *detections, unsigned char *masks, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> class_dist(0, BENCH_NO_CLASS_ID - 1);
+    std::uniform_int_distribution<int> x_dist(-img_w / 8, img_w + img_w / 8);
+    std::uniform_int_distribution<int> y_dist(-img_h / 8, img_h + img_h / 8);
+    std::uniform_int_distribution<int> w_dist(0, img_w);
+    std::uniform_int_distribution<int> h_dist(0, img_h);
+    std::uniform_int_distribution<int> pixel_dist(0, 2);
+
+    detections[0] = ndetections;
+    for (int i = 0; i < ndetections; i++) {
+        unsigned int *det = detections + 1 + 6 * i;
+        det[0] = class_dist(rng);
+        det[1] = 50;
+        det[2] = (unsigned int) x_dist(rng);
+        det[3] = (unsigned int) y_dist(rng);
+        det[4] = w_dist(rng);
+        det[5] = h_dist(rng);
+    }
+    for (int i = 0; i < ndetections * mask_w * mask_h; i++) {
+        masks[i] = (pixel_dist(rng) == 0) ? 255 : 0;
+    }
+}
+
+typedef void (*postprocess_fn)(const unsigned int *, const unsigned char *, int, int, int,
+                               int, unsigned char, unsigned char *);
+typedef void (*reconstruct_fn)(const unsigned char *, int, unsigned char *);
+
+/**
+ * @return average time per call in ms
+ */
+static double time_postprocess(postprocess_fn fn, const unsigned int *detections,
+                               const unsigned char *masks, unsigned char *output) {
+    fn(detections, masks, BENCH_MASK_W, BENCH_MASK_H, BENCH_IMG_W, BENCH_IMG_H,
+       BENCH_NO_CLASS_ID, output);
+
+    int64_t start_ns = get_timestamp_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fn(detections, masks, BENCH_MASK_W, BENCH_MASK_H, BENCH_IMG_W, BENCH_IMG_H,
+           BENCH_NO_CLASS_ID, output);
+    }
+    return (double) (get_timestamp_ns() - start_ns) / BENCH_ITERATIONS / 1e6;
+}
+
+/**
+ * @return average time per call in ms
+ */
+static double time_reconstruct(reconstruct_fn fn, const unsigned char *class_map,
+                               unsigned char *output) {
+    const int nsamples = BENCH_MASK_W * BENCH_MASK_H;
+    fn(class_map, nsamples, output);
+
+    int64_t start_ns = get_timestamp_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        fn(class_map, nsamples, output);
+    }
+    return (double) (get_timestamp_ns() - start_ns) / BENCH_ITERATIONS / 1e6;
+}
+
+/**
+ * run both postprocess versions on random frames in both orientations
+ * @return number of frames with different outputs
+ */
+static int check_postprocess(std::mt19937 &rng) {
+    const int mask_count = BENCH_MASK_W * BENCH_MASK_H;
+    std::vector<unsigned int> detections(1 + 6 * BENCH_MAX_DETECTIONS);
+    std::vector<unsigned char> masks(BENCH_MAX_DETECTIONS * mask_count);
+    std::vector<unsigned char> expected(mask_count), actual(mask_count);
+    std::uniform_int_distribution<int> count_dist(0, BENCH_MAX_DETECTIONS);
+
+    int failures = 0;
+    for (int frame = 0; frame < BENCH_RANDOM_FRAMES; frame++) {
+        // odd frames are rotated by 90 degrees
+        const bool rotated = frame % 2;
+        const int mask_w = rotated ? BENCH_MASK_H : BENCH_MASK_W;
+        const int mask_h = rotated ? BENCH_MASK_W : BENCH_MASK_H;
+        const int img_w = rotated ? BENCH_IMG_H : BENCH_IMG_W;
+        const int img_h = rotated ? BENCH_IMG_W : BENCH_IMG_H;
+
+        fill_frame(count_dist(rng), mask_w, mask_h, img_w, img_h, detections.data(),
+                   masks.data(), rng);
+        segmentation_postprocess_opencv(detections.data(), masks.data(), mask_w, mask_h,
+                                        img_w, img_h, BENCH_NO_CLASS_ID, expected.data());
+        segmentation_postprocess(detections.data(), masks.data(), mask_w, mask_h, img_w,
+                                 img_h, BENCH_NO_CLASS_ID, actual.data());
+        if (expected != actual) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main() {
+    std::mt19937 rng(42);
+    const int mask_count = BENCH_MASK_W * BENCH_MASK_H;
+    std::vector<unsigned int> detections(1 + 6 * BENCH_MAX_DETECTIONS);
+    std::vector<unsigned char> masks(BENCH_MAX_DETECTIONS * mask_count);
+    std::vector<unsigned char> opencv_map(mask_count), single_pass_map(mask_count);
+    int failures = 0;
+
+    int postprocess_failures = check_postprocess(rng);
+    printf("postprocess random frames,%d,mismatches,%d\n", BENCH_RANDOM_FRAMES,
+           postprocess_failures);
+    failures += postprocess_failures;
+
+    printf("detections,opencv_ms,single_pass_ms,speedup,match\n");
+    for (int ndetections : detection_counts) {
+        fill_frame(ndetections, BENCH_MASK_W, BENCH_MASK_H, BENCH_IMG_W, BENCH_IMG_H,
+                   detections.data(), masks.data(), rng);
+
+        double opencv_ms = time_postprocess(segmentation_postprocess_opencv, detections.data(),
+                                            masks.data(), opencv_map.data());
+        double single_pass_ms = time_postprocess(segmentation_postprocess, detections.data(),
+                                                 masks.data(), single_pass_map.data());
+        bool match = opencv_map == single_pass_map;
+        if (!match) {
+            failures++;
+        }
+
+        printf("%d,%.4f,%.4f,%.2f,%d\n", ndetections, opencv_ms, single_pass_ms,
+               opencv_ms / single_pass_ms, match ? 1 : 0);
+    }
+
+    // every class id, including the unused ones, then a realistic class map
+    std::vector<unsigned char> class_map(mask_count);
+    std::vector<unsigned char> reference_rgba(4 * mask_count), lut_rgba(4 * mask_count);
+    for (int i = 0; i < mask_count; i++) {
+        class_map[i] = (unsigned char) i;
+    }
+    segmentation_reconstruct_reference(class_map.data(), mask_count, reference_rgba.data());
+    segmentation_reconstruct(class_map.data(), mask_count, lut_rgba.data());
+    bool all_ids_match = reference_rgba == lut_rgba;
+
+    segmentation_postprocess(detections.data(), masks.data(), BENCH_MASK_W, BENCH_MASK_H,
+                             BENCH_IMG_W, BENCH_IMG_H, BENCH_NO_CLASS_ID, class_map.data());
+    double reference_ms = time_reconstruct(segmentation_reconstruct_reference,
+                                           class_map.data(), reference_rgba.data());
+    double lut_ms = time_reconstruct(segmentation_reconstruct, class_map.data(),
+                                     lut_rgba.data());
+    bool match = all_ids_match && reference_rgba == lut_rgba;
+    if (!match) {
+        failures++;
+    }
+
+    printf("reconstruct,reference_ms,lut_ms,speedup,match\n");
+    printf("%dx%d,%.4f,%.4f,%.2f,%d\n", BENCH_MASK_W, BENCH_MASK_H, reference_ms, lut_ms,
+           reference_ms / lut_ms, match ? 1 : 0);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,523 @@
+//
+// Headless replay of a recording through the whole image processor, to track
+// throughput and latency without a phone. Frames come from a raw yuv file, the
+// format that RawImageReader reads for calibration on the phone, or from a
+// directory of jpegs. They are submitted and received the same way the app
+// does, at a fixed fps or as fast as the lanes allow. At the end a summary is
+// printed as a csv header and row: end-to-end latency percentiles from
+// capture to received results, mean kernel times per stage, bytes sent,
+// frames per second and the runtime objects pocl still had to allocate after
+// the warm up frames (-1 if pocl has no allocation counters). With more than
+// one server, a second csv has the frames, failures and latency per server.
+//
+// usage: ./bench_pipeline_replay [options] <frames.yuv | jpeg directory>
+//   --codec none|yuv|jpeg|hevc|soft_hevc|auto|bandit|predict   (default jpeg)
+//   --quality N          jpeg quality or hevc bitrate setting (default 80)
+//   --device local|remote                       (default remote)
+//   --lanes N            (default 1)
+//   --depth N            frames in flight per lane (default 1)
+//   --fps F              0 submits as fast as the lanes allow (default 0)
+//   --frames N           default one pass over the input, longer runs loop it
+//   --eval 0|1           run the quality eval pipeline (default 0)
+//   --segment 0|1        (default 1)
+//   --backpressure wait|latest|deadline         (default wait)
+//   --deadline MS        for --backpressure deadline (default 1000)
+//   --skip-static        set SKIP_STATIC_FRAMES
+//   --replay             set REPLAY_COMMAND_BUFFERS
+//   --rate-control       set RATE_CONTROL, with --codec auto|bandit|predict
+//   --multi-server       set MULTI_SERVER, to spread the lanes over the remote
+//                        devices, e.g. over two local pocld instances with
+//                        POCL_DEVICES="cpu cpu remote remote"
+//                        POCL_REMOTE0_PARAMETERS=localhost:10998/0
+//                        POCL_REMOTE1_PARAMETERS=localhost:11998/0 --lanes 2
+//   --width N --height N dimensions of a raw yuv input (default 640x480)
+//   --log FILE           write the binary profiling log of every frame to FILE,
+//                        ProfileLog/profileToCsv turns it into csv
+//
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+
+#include "rename_opencl.h"
+#include <CL/cl.h>
+
+#include "RawImageReader.hpp"
+#include "codec_select_wrapper.h"
+#include "jpegReader.h"
+#include "opencl_utils.hpp"
+#include "sharedUtils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <getopt.h>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define DEQUEUE_TIMEOUT_MS 20000
+#define RECEIVE_TIMEOUT_MS 100
+#define WARMUP_FRAMES 256 // frames after which pocl should not allocate runtime objects anymore
+
+// kernel times that are summarized, named as in the event arrays of the pipeline
+static const char *const STAGE_EVENTS[] = {"enc_event", "dec_event", "dnn_event",
+                                           "postprocess_event", "seg_enc_event", "seg_dec_event",
+                                           "reconstruct_event"};
+#define STAGE_COUNT (int) (sizeof(STAGE_EVENTS) / sizeof(STAGE_EVENTS[0]))
+
+typedef struct {
+    compression_t compression_type;
+    int do_algorithm;
+    int quality;
+    device_type_enum device;
+    int lanes;
+    int depth;
+    float fps;
+    int frames;
+    bool enable_eval;
+    int do_segment;
+    backpressure_mode_t backpressure_mode;
+    int deadline_ms;
+    int extra_flags;
+    int width;
+    int height;
+    const char *log_path;
+    const char *input;
+} replay_options_t;
+
+typedef struct {
+    std::vector<int64_t> latency_ns;
+    double stage_ms[STAGE_COUNT];
+    int stage_count[STAGE_COUNT];
+    uint64_t bytes_tx;
+    int received;
+    int skipped;
+    int errors;
+    int lost; // frames dropped because their server failed, see MULTI_SERVER
+} replay_stats_t;
+
+/**
+ * frames of the input, either read from a raw yuv file or preloaded jpegs
+ */
+class FrameSource {
+public:
+    explicit FrameSource(const replay_options_t &options) noexcept(false) {
+        if (std::filesystem::is_directory(options.input)) {
+            std::vector<std::string> paths;
+            for (const auto &entry: std::filesystem::directory_iterator(options.input)) {
+                std::string ext = entry.path().extension().string();
+                if (".jpg" == ext || ".jpeg" == ext) {
+                    paths.push_back(entry.path().string());
+                }
+            }
+            if (paths.empty()) {
+                throw std::invalid_argument("no jpegs in the input directory");
+            }
+            std::sort(paths.begin(), paths.end());
+            jpegs.push_back(std::make_unique<JPEGReader>(paths[0].c_str()));
+            std::tie(width, height) = jpegs[0]->getDimensions();
+            for (size_t i = 1; i < paths.size(); i++) {
+                jpegs.push_back(std::make_unique<JPEGReader>(width, height, paths[i].c_str()));
+            }
+        } else {
+            width = options.width;
+            height = options.height;
+            int fd = open(options.input, O_RDONLY);
+            if (-1 == fd) {
+                throw std::invalid_argument(strerror(errno));
+            }
+            // the reader keeps a duplicate of the fd
+            raw = std::make_unique<RawImageReader>(width, height, fd);
+            close(fd);
+        }
+    }
+
+    int getTotalFrames() const {
+        return (nullptr != raw) ? raw->getTotalFrames() : (int) jpegs.size();
+    }
+
+    /**
+     * @param frame_index frames past the end of the input wrap around to the start
+     * @param image output, valid until the next call
+     */
+    void readImage(const int frame_index, image_data_t *image) {
+        if (nullptr != raw) {
+            if (raw->getCurrentFrameNum() == raw->getTotalFrames()) {
+                raw->reset();
+            }
+            raw->readImage(image);
+        } else {
+            jpegs[frame_index % jpegs.size()]->readImage(image);
+        }
+    }
+
+    int width;
+    int height;
+
+private:
+    std::unique_ptr<RawImageReader> raw;
+    std::vector<std::unique_ptr<JPEGReader>> jpegs;
+};
+
+static void print_usage(const char *name) {
+    printf("usage: %s [--codec none|yuv|jpeg|hevc|soft_hevc|auto|bandit|predict] "
+           "[--quality N] "
+           "[--device local|remote] [--lanes N] [--depth N] [--fps F] [--frames N] "
+           "[--eval 0|1] [--segment 0|1] [--backpressure wait|latest|deadline] "
+           "[--deadline MS] [--skip-static] [--replay] [--rate-control] [--multi-server] "
+           "[--width N] [--height N] [--log FILE] "
+           "<frames.yuv | jpeg directory>\n", name);
+}
+
+/**
+ * @return 0 if the options are valid, otherwise -1
+ */
+static int parse_options(int argc, char **argv, replay_options_t *options) {
+    *options = {};
+    options->compression_type = JPEG_COMPRESSION;
+    options->quality = 80;
+    options->device = REMOTE_DEVICE;
+    options->lanes = 1;
+    options->depth = 1;
+    options->do_segment = 1;
+    options->backpressure_mode = BACKPRESSURE_WAIT;
+    options->deadline_ms = 1000;
+    options->width = 640;
+    options->height = 480;
+
+    static const struct option long_options[] = {
+            {"codec",        required_argument, nullptr, 'c'},
+            {"quality",      required_argument, nullptr, 'q'},
+            {"device",       required_argument, nullptr, 'd'},
+            {"lanes",        required_argument, nullptr, 'l'},
+            {"depth",        required_argument, nullptr, 'D'},
+            {"fps",          required_argument, nullptr, 'f'},
+            {"frames",       required_argument, nullptr, 'n'},
+            {"eval",         required_argument, nullptr, 'e'},
+            {"segment",      required_argument, nullptr, 's'},
+            {"backpressure", required_argument, nullptr, 'b'},
+            {"deadline",     required_argument, nullptr, 't'},
+            {"skip-static",  no_argument,       nullptr, 'S'},
+            {"replay",       no_argument,       nullptr, 'R'},
+            {"rate-control", no_argument,       nullptr, 'C'},
+            {"multi-server", no_argument,       nullptr, 'M'},
+            {"width",        required_argument, nullptr, 'W'},
+            {"height",       required_argument, nullptr, 'H'},
+            {"log",          required_argument, nullptr, 'L'},
+            {nullptr, 0,                        nullptr, 0}};
+
+    int opt;
+    while (-1 != (opt = getopt_long(argc, argv, "", long_options, nullptr))) {
+        switch (opt) {
+            case 'c':
+                if (0 == strcmp(optarg, "none")) {
+                    options->compression_type = NO_COMPRESSION;
+                } else if (0 == strcmp(optarg, "yuv")) {
+                    options->compression_type = YUV_COMPRESSION;
+                } else if (0 == strcmp(optarg, "jpeg")) {
+                    options->compression_type = JPEG_COMPRESSION;
+                } else if (0 == strcmp(optarg, "hevc")) {
+                    options->compression_type = HEVC_COMPRESSION;
+                } else if (0 == strcmp(optarg, "soft_hevc")) {
+                    options->compression_type = SOFTWARE_HEVC_COMPRESSION;
+                } else if (0 == strcmp(optarg, "auto")) {
+                    options->do_algorithm = SELECT_ALGORITHM_STAGED;
+                } else if (0 == strcmp(optarg, "bandit")) {
+                    options->do_algorithm = SELECT_ALGORITHM_BANDIT;
+                } else if (0 == strcmp(optarg, "predict")) {
+                    options->do_algorithm = SELECT_ALGORITHM_PREDICT;
+                } else {
+                    return -1;
+                }
+                break;
+            case 'q':
+                options->quality = atoi(optarg);
+                break;
+            case 'd':
+                if (0 == strcmp(optarg, "local")) {
+                    options->device = LOCAL_DEVICE;
+                } else if (0 == strcmp(optarg, "remote")) {
+                    options->device = REMOTE_DEVICE;
+                } else {
+                    return -1;
+                }
+                break;
+            case 'l':
+                options->lanes = atoi(optarg);
+                break;
+            case 'D':
+                options->depth = atoi(optarg);
+                break;
+            case 'f':
+                options->fps = strtof(optarg, nullptr);
+                break;
+            case 'n':
+                options->frames = atoi(optarg);
+                break;
+            case 'e':
+                options->enable_eval = 0 != atoi(optarg);
+                break;
+            case 's':
+                options->do_segment = atoi(optarg);
+                break;
+            case 'b':
+                if (0 == strcmp(optarg, "wait")) {
+                    options->backpressure_mode = BACKPRESSURE_WAIT;
+                } else if (0 == strcmp(optarg, "latest")) {
+                    options->backpressure_mode = BACKPRESSURE_LATEST_FRAME;
+                } else if (0 == strcmp(optarg, "deadline")) {
+                    options->backpressure_mode = BACKPRESSURE_DEADLINE;
+                } else {
+                    return -1;
+                }
+                break;
+            case 't':
+                options->deadline_ms = atoi(optarg);
+                break;
+            case 'S':
+                options->extra_flags |= SKIP_STATIC_FRAMES;
+                break;
+            case 'R':
+                options->extra_flags |= REPLAY_COMMAND_BUFFERS;
+                break;
+            case 'C':
+                options->extra_flags |= RATE_CONTROL;
+                break;
+            case 'M':
+                options->extra_flags |= MULTI_SERVER;
+                break;
+            case 'W':
+                options->width = atoi(optarg);
+                break;
+            case 'H':
+                options->height = atoi(optarg);
+                break;
+            case 'L':
+                options->log_path = optarg;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if (optind != argc - 1 || options->lanes < 1 || options->depth < 1 || options->fps < 0.0f) {
+        return -1;
+    }
+    options->input = argv[optind];
+    return 0;
+}
+
+/**
+ * the same as codec_select_receive_image, but the kernel times of the frame are kept for the
+ * summary before they are reset
+ */
+static int receive_frame(codec_select_state_t *state, pocl_image_processor_context *ctx,
+                         int32_t *detections, uint8_t *segmentation, replay_stats_t *stats) {
+    int status;
+    frame_metadata_t metadata;
+    int segmentation_flag;
+    status = receive_image(ctx, detections, segmentation, &metadata, &segmentation_flag,
+                           state->collected_events);
+
+    if (CL_SUCCESS == status && metadata.is_skipped) {
+        signal_skipped_frame(state, &metadata);
+        stats->skipped += 1;
+    } else if (CL_SUCCESS == status) {
+        update_stats(&metadata, ctx->eval_ctx, state);
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            float time_ms;
+            if (-1 != find_event_time(STAGE_EVENTS[i], state->collected_events, &time_ms)) {
+                stats->stage_ms[i] += time_ms;
+                stats->stage_count[i] += 1;
+            }
+        }
+    }
+    reset_collected_events(state->collected_events);
+
+    if (CL_SUCCESS == status) {
+        // the image timestamp is taken when the frame is read, so this includes waiting for a lane
+        stats->latency_ns.push_back(metadata.host_ts_ns.stop - metadata.image_timestamp);
+        stats->bytes_tx += metadata.size_bytes_tx;
+        stats->received += 1;
+    } else if (POCL_IMAGE_PROCESSOR_FRAME_DROPPED == status) {
+        stats->lost += 1;
+    } else {
+        stats->errors += 1;
+    }
+    return status;
+}
+
+/**
+ * @param sorted latencies in ascending order
+ * @param percentile between 0 and 100
+ * @return the latency in milliseconds, nearest rank
+ */
+static double percentile_ms(const std::vector<int64_t> &sorted, const double percentile) {
+    if (sorted.empty()) {
+        return -1.0;
+    }
+    size_t rank = (size_t) (percentile / 100.0 * (double) sorted.size() + 0.5);
+    rank = std::min(std::max(rank, (size_t) 1), sorted.size());
+    return (double) sorted[rank - 1] / 1e6;
+}
+
+int main(int argc, char **argv) {
+    replay_options_t options;
+    if (0 != parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    FrameSource source(options);
+    const int num_frames = (options.frames > 0) ? options.frames : source.getTotalFrames();
+
+    int config_flags = NO_COMPRESSION | options.extra_flags;
+    if (options.do_algorithm) {
+        config_flags |= YUV_COMPRESSION | JPEG_COMPRESSION;
+    } else {
+        config_flags |= options.compression_type;
+    }
+    if (nullptr != options.log_path) {
+        config_flags |= ENABLE_PROFILING;
+    }
+
+    const char *log_path = (nullptr != options.log_path) ? options.log_path : "/dev/null";
+    int fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, S_IWRITE | S_IREAD);
+    if (-1 == fd) {
+        perror("Cannot open log file");
+        return 1;
+    }
+
+    // assuming the build directory is pcapp/<cmake build dir>/tests
+    std::vector<std::string> source_files = {
+            "../../../android/app/src/main/assets/kernels/copy.cl",
+            "../../../android/app/src/main/assets/kernels/compress_seg.cl"};
+    auto codec_sources = read_files(source_files);
+    if (codec_sources[0].empty() || codec_sources[1].empty()) {
+        printf("could not read the codec kernels\n");
+        return 1;
+    }
+    const char *source_strings[] = {codec_sources[0].c_str(), codec_sources[1].c_str()};
+    const size_t source_sizes[] = {codec_sources[0].size(), codec_sources[1].size()};
+
+    pocl_image_processor_context *ctx = nullptr;
+    int status = create_pocl_image_processor_context(&ctx, options.lanes, options.depth,
+                                                     source.width, source.height, config_flags,
+                                                     source_strings, source_sizes, fd,
+                                                     options.enable_eval, nullptr);
+    if (CL_SUCCESS != status) {
+        printf("could not create the image processor: %d\n", status);
+        return 1;
+    }
+    set_backpressure_policy(ctx, options.backpressure_mode, options.deadline_ms);
+
+    codec_select_state_t *state = nullptr;
+    init_codec_select(config_flags, fd, options.do_algorithm, false, false, &state);
+
+    replay_stats_t stats = {};
+    std::atomic<int> submitted(0);
+    std::atomic<bool> submit_done(false);
+
+    std::thread receiver([&]() {
+        std::vector<int32_t> detections(DET_COUNT);
+        std::vector<uint8_t> segmentation(SEG_OUT_COUNT);
+        while (!submit_done || stats.received + stats.errors + stats.lost < submitted) {
+            if (0 != wait_image_available(ctx, RECEIVE_TIMEOUT_MS)) {
+                continue;
+            }
+            receive_frame(state, ctx, detections.data(), segmentation.data(), &stats);
+        }
+    });
+
+    const auto frame_interval = std::chrono::nanoseconds(
+            (options.fps > 0.0f) ? (int64_t) (1e9 / options.fps) : 0);
+    auto next_frame = std::chrono::steady_clock::now();
+    int dropped = 0;
+
+    // the free lists of pocl fill up during the first frames, after that frames should not
+    // allocate anymore
+    cl_mem_manager_stats_pocl warm_stats, end_stats;
+    bool has_alloc_stats = false;
+
+    const int64_t start_ns = get_timestamp_ns();
+    for (int i = 0; i < num_frames; i++) {
+        if (WARMUP_FRAMES == i) {
+            has_alloc_stats = (0 == get_alloc_stats(ctx, &warm_stats));
+        }
+
+        if (options.fps > 0.0f) {
+            std::this_thread::sleep_until(next_frame);
+            next_frame += frame_interval;
+        }
+
+        image_data_t image_data;
+        source.readImage(i, &image_data);
+        image_data.image_timestamp = get_timestamp_ns();
+
+        // a frame without a free lane is dropped, like a camera frame would be
+        if (0 != dequeue_spot(ctx, DEQUEUE_TIMEOUT_MS, options.device)) {
+            dropped += 1;
+            continue;
+        }
+
+        status = codec_select_submit_image(state, ctx, options.device, options.do_segment,
+                                           options.compression_type, options.quality, 0,
+                                           options.do_algorithm, &image_data);
+        submitted += 1;
+        if (CL_SUCCESS != status) {
+            printf("could not submit frame %d: %d\n", i, status);
+            break;
+        }
+    }
+    submit_done = true;
+    receiver.join();
+    const int64_t elapsed_ns = get_timestamp_ns() - start_ns;
+    long steady_allocs = -1;
+    if (has_alloc_stats && 0 == get_alloc_stats(ctx, &end_stats)) {
+        steady_allocs = (long) ((end_stats.events_allocated - warm_stats.events_allocated) +
+                                (end_stats.commands_allocated - warm_stats.commands_allocated) +
+                                (end_stats.event_nodes_allocated -
+                                 warm_stats.event_nodes_allocated));
+    }
+
+    std::sort(stats.latency_ns.begin(), stats.latency_ns.end());
+
+    printf("frames,received,dropped,skipped,errors,lost,frames_per_s,latency_p50_ms,"
+           "latency_p95_ms,latency_p99_ms,bytes_tx,pocl_allocs_after_warmup");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        printf(",%s_ms", STAGE_EVENTS[i]);
+    }
+    printf("\n%d,%d,%d,%d,%d,%d,%.2f,%.2f,%.2f,%.2f,%lu,%ld", num_frames, stats.received,
+           dropped, stats.skipped, stats.errors, stats.lost,
+           stats.received / ((double) elapsed_ns / 1e9),
+           percentile_ms(stats.latency_ns, 50), percentile_ms(stats.latency_ns, 95),
+           percentile_ms(stats.latency_ns, 99), stats.bytes_tx, steady_allocs);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        // -1 for stages that did not run
+        printf(",%.3f", (stats.stage_count[i] > 0) ? stats.stage_ms[i] / stats.stage_count[i]
+                                                   : -1.0);
+    }
+    printf("\n");
+
+    if (get_server_count(ctx) > 1) {
+        printf("server,received,failed,latency_ms\n");
+        for (int i = 0; i < get_server_count(ctx); i++) {
+            const server_state_t server = get_server_state(ctx, i);
+            printf("%d,%u,%u,%.2f\n", i, server.received, server.failed, server.latency_ms);
+        }
+    }
+
+    destroy_codec_select(&state);
+    destroy_pocl_image_processor_context(&ctx);
+    close(fd);
+
+    return (0 == stats.errors && stats.received > 0) ? 0 : 1;
+}
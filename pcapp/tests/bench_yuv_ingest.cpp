@@ -0,0 +1,210 @@
+//
+// Per frame cost of getting a camera frame into the input buffer of a lane.
+// The old path copies the frame to a host buffer with copy_yuv_to_arrayV2 and
+// writes it with clEnqueueWriteBuffer, the new path maps a host visible
+// buffer and converts the frame straight into it with copy_yuv_to_nv12.
+// Synthetic frames are used for the layouts android cameras produce, both
+// paths have to give the same nv12 buffer.
+//
+// usage: ./bench_yuv_ingest [device index]
+//
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+
+#include "rename_opencl.h"
+#include <CL/cl.h>
+
+#include "poclImageProcessorUtils.h"
+#include "sharedUtils.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define BENCH_WIDTH 640
+#define BENCH_HEIGHT 480
+#define BENCH_FRAMES 500
+#define BENCH_WARMUP_FRAMES 10
+
+typedef enum {
+    LAYOUT_NV21, LAYOUT_NV12, LAYOUT_I420,
+} layout_t;
+
+static const char *LAYOUT_NAMES[] = {"nv21", "nv12", "i420"};
+
+/**
+ * fill a frame with random pixels and point the planes of image at it in the
+ * given layout, the way the android camera does.
+ */
+static void make_frame(layout_t layout, int width, int height, std::vector<uint8_t> *frame,
+                       image_data_t *image) {
+    const int y_size = width * height;
+    frame->resize(y_size * 3 / 2);
+    for (size_t i = 0; i < frame->size(); i++) {
+        (*frame)[i] = rand() & 0xFF;
+    }
+    uint8_t *base = frame->data();
+
+    image->type = YUV_DATA_T;
+    image->data.yuv.planes[0] = base;
+    image->data.yuv.pixel_strides[0] = 1;
+    image->data.yuv.row_strides[0] = width;
+    switch (layout) {
+        case LAYOUT_NV21:
+            image->data.yuv.planes[1] = base + y_size + 1;
+            image->data.yuv.planes[2] = base + y_size;
+            image->data.yuv.pixel_strides[1] = 2;
+            image->data.yuv.pixel_strides[2] = 2;
+            break;
+        case LAYOUT_NV12:
+            image->data.yuv.planes[1] = base + y_size;
+            image->data.yuv.planes[2] = base + y_size + 1;
+            image->data.yuv.pixel_strides[1] = 2;
+            image->data.yuv.pixel_strides[2] = 2;
+            break;
+        case LAYOUT_I420:
+            image->data.yuv.planes[1] = base + y_size;
+            image->data.yuv.planes[2] = base + y_size + y_size / 4;
+            image->data.yuv.pixel_strides[1] = 1;
+            image->data.yuv.pixel_strides[2] = 1;
+            break;
+    }
+    image->data.yuv.row_strides[1] = width / image->data.yuv.pixel_strides[1];
+    image->data.yuv.row_strides[2] = width / image->data.yuv.pixel_strides[2];
+}
+
+static cl_int write_copy(cl_command_queue queue, cl_mem buf, size_t size, const image_data_t image,
+                         cl_uchar *host_buf) {
+    copy_yuv_to_arrayV2(BENCH_WIDTH, BENCH_HEIGHT, image, NO_COMPRESSION, host_buf);
+    cl_int status = clEnqueueWriteBuffer(queue, buf, CL_FALSE, 0, size, host_buf, 0, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not write input buffer");
+    return clFinish(queue);
+}
+
+static cl_int write_mapped(cl_command_queue queue, cl_mem buf, size_t size,
+                           const image_data_t image) {
+    cl_int status;
+    cl_event mig_event;
+    status = clEnqueueMigrateMemObjects(queue, 1, &buf, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED, 0,
+                                        NULL, &mig_event);
+    CHECK_AND_RETURN(status, "could not migrate input buffer");
+    cl_uchar *mapped = (cl_uchar *) clEnqueueMapBuffer(queue, buf, CL_TRUE,
+                                                       CL_MAP_WRITE_INVALIDATE_REGION, 0, size, 1,
+                                                       &mig_event, NULL, &status);
+    clReleaseEvent(mig_event);
+    CHECK_AND_RETURN(status, "could not map input buffer");
+    copy_yuv_to_nv12(BENCH_WIDTH, BENCH_HEIGHT, image, mapped);
+    status = clEnqueueUnmapMemObject(queue, buf, mapped, 0, NULL, NULL);
+    CHECK_AND_RETURN(status, "could not unmap input buffer");
+    return clFinish(queue);
+}
+
+static double mean_ms(const std::vector<int64_t> &times_ns) {
+    double mean_ns = 0;
+    for (int64_t t: times_ns) {
+        mean_ns += (double) t / times_ns.size();
+    }
+    return mean_ns / 1e6;
+}
+
+int main(int argc, char **argv) {
+    cl_int status;
+
+    int device_index = (argc > 1) ? atoi(argv[1]) : 0;
+
+    cl_platform_id platform_id;
+    status = clGetPlatformIDs(1, &platform_id, NULL);
+    CHECK_AND_RETURN(status, "can't get platform id");
+
+    cl_uint dev_count = 0;
+    status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, 0, NULL, &dev_count);
+    CHECK_AND_RETURN(status, "can't get device count");
+    assert(dev_count > (cl_uint) device_index);
+    cl_device_id device_ids[dev_count];
+    status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, dev_count, device_ids, NULL);
+    CHECK_AND_RETURN(status, "can't get device id");
+
+    cl_context context = clCreateContext(nullptr, dev_count, device_ids, NULL, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create context");
+    cl_device_id device = device_ids[device_index];
+    cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create queue");
+
+    const size_t size = BENCH_WIDTH * BENCH_HEIGHT * 3 / 2;
+    cl_mem copy_buf = clCreateBuffer(context, CL_MEM_READ_ONLY, size, NULL, &status);
+    CHECK_AND_RETURN(status, "could not create copy buffer");
+    cl_mem mapped_buf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, size,
+                                       NULL, &status);
+    CHECK_AND_RETURN(status, "could not create mapped buffer");
+    std::vector<cl_uchar> host_buf(size), copy_out(size), mapped_out(size);
+
+    int ret = 0;
+    printf("layout,frames,copy_ms,copy_write_ms,nv12_ms,map_write_ms,speedup\n");
+    for (int l = LAYOUT_NV21; l <= LAYOUT_I420; l++) {
+        std::vector<uint8_t> frame;
+        image_data_t image;
+        make_frame((layout_t) l, BENCH_WIDTH, BENCH_HEIGHT, &frame, &image);
+
+        // conversion only
+        std::vector<int64_t> copy_ns, nv12_ns;
+        for (int i = 0; i < BENCH_FRAMES; i++) {
+            int64_t start_ns = get_timestamp_ns();
+            copy_yuv_to_arrayV2(BENCH_WIDTH, BENCH_HEIGHT, image, NO_COMPRESSION, copy_out.data());
+            copy_ns.push_back(get_timestamp_ns() - start_ns);
+
+            start_ns = get_timestamp_ns();
+            copy_yuv_to_nv12(BENCH_WIDTH, BENCH_HEIGHT, image, mapped_out.data());
+            nv12_ns.push_back(get_timestamp_ns() - start_ns);
+        }
+        if (0 != memcmp(copy_out.data(), mapped_out.data(), size)) {
+            printf("%s: copy_yuv_to_nv12 differs from copy_yuv_to_arrayV2\n", LAYOUT_NAMES[l]);
+            ret = 1;
+        }
+
+        // full ingest into the device buffer
+        std::vector<int64_t> copy_write_ns, map_write_ns;
+        for (int i = 0; i < BENCH_WARMUP_FRAMES + BENCH_FRAMES; i++) {
+            int64_t start_ns = get_timestamp_ns();
+            status = write_copy(queue, copy_buf, size, image, host_buf.data());
+            CHECK_AND_RETURN(status, "copy and write failed");
+            int64_t copy_write = get_timestamp_ns() - start_ns;
+
+            start_ns = get_timestamp_ns();
+            status = write_mapped(queue, mapped_buf, size, image);
+            CHECK_AND_RETURN(status, "mapped write failed");
+            int64_t map_write = get_timestamp_ns() - start_ns;
+
+            if (i >= BENCH_WARMUP_FRAMES) {
+                copy_write_ns.push_back(copy_write);
+                map_write_ns.push_back(map_write);
+            }
+        }
+
+        status = clEnqueueReadBuffer(queue, copy_buf, CL_TRUE, 0, size, copy_out.data(), 0, NULL,
+                                     NULL);
+        CHECK_AND_RETURN(status, "could not read copy buffer");
+        status = clEnqueueReadBuffer(queue, mapped_buf, CL_TRUE, 0, size, mapped_out.data(), 0,
+                                     NULL, NULL);
+        CHECK_AND_RETURN(status, "could not read mapped buffer");
+        if (0 != memcmp(copy_out.data(), mapped_out.data(), size)) {
+            printf("%s: mapped buffer differs from written buffer\n", LAYOUT_NAMES[l]);
+            ret = 1;
+        }
+
+        printf("%s,%d,%.3f,%.3f,%.3f,%.3f,%.2f\n", LAYOUT_NAMES[l], BENCH_FRAMES, mean_ms(copy_ns),
+               mean_ms(copy_write_ns), mean_ms(nv12_ns), mean_ms(map_write_ns),
+               mean_ms(copy_write_ns) / mean_ms(map_write_ns));
+    }
+
+    clReleaseMemObject(mapped_buf);
+    clReleaseMemObject(copy_buf);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    for (cl_uint i = 0; i < dev_count; i++) {
+        clReleaseDevice(device_ids[i]);
+    }
+    return ret;
+}
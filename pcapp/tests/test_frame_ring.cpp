@@ -0,0 +1,222 @@
+//
+// Checks the frame ring that hands out the lanes of the image processor. A
+// producer thread reserves and pushes frames the way dequeue_spot and
+// submit_image do, and completes them out of order the way the read callbacks
+// do. A consumer thread waits for and pops them the way wait_image_available
+// and receive_image do. Every frame has to come out once, no more than the
+// capacity may be in flight, and waits have to time out, also the ones for a
+// slot out of a mask.
+//
+// usage: ./test_frame_ring [frames]
+//
+
+#include "frame_ring.h"
+#include "sharedUtils.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define RING_CAPACITY 3
+#define RING_LOCAL_CAPACITY 1
+#define WAIT_TIMEOUT_MS 50
+
+static_assert(offsetof(frame_ring_t, tail) - offsetof(frame_ring_t, head) >= FRAME_RING_CACHE_LINE,
+              "producer and consumer indices share a cache line");
+
+typedef struct {
+    int frame_index;
+    int is_local;
+} slot_t;
+
+int main(int argc, char **argv) {
+    const int num_frames = (argc > 1) ? atoi(argv[1]) : 200000;
+    int ret = 0;
+
+    frame_ring_t ring;
+    frame_ring_init(&ring, RING_CAPACITY, RING_LOCAL_CAPACITY);
+
+    // an empty ring has nothing to pop
+    int64_t start_ns = get_timestamp_ns();
+    if (0 == frame_ring_wait(&ring, WAIT_TIMEOUT_MS) || ETIMEDOUT != errno) {
+        printf("wait on an empty ring did not time out\n");
+        ret = 1;
+    }
+    int64_t waited_ms = (get_timestamp_ns() - start_ns) / 1000000;
+    if (waited_ms < WAIT_TIMEOUT_MS) {
+        printf("wait on an empty ring returned after %ld ms\n", (long) waited_ms);
+        ret = 1;
+    }
+
+    // a full ring has no spot to reserve, and only one local spot exists
+    if (0 != frame_ring_reserve(&ring, 1, WAIT_TIMEOUT_MS)) {
+        printf("could not reserve local spot\n");
+        ret = 1;
+    }
+    if (0 == frame_ring_reserve(&ring, 1, WAIT_TIMEOUT_MS)) {
+        printf("reserved a second local spot\n");
+        ret = 1;
+    }
+    for (int i = 1; i < RING_CAPACITY; i++) {
+        if (0 != frame_ring_reserve(&ring, 0, WAIT_TIMEOUT_MS)) {
+            printf("could not reserve spot %d\n", i);
+            ret = 1;
+        }
+    }
+    if (0 == frame_ring_reserve(&ring, 0, WAIT_TIMEOUT_MS)) {
+        printf("reserved more spots than the capacity\n");
+        ret = 1;
+    }
+    frame_ring_unreserve(&ring, RING_CAPACITY - 1, 0);
+    frame_ring_unreserve(&ring, 1, 1);
+
+    // slots complete in any order and are reused once popped
+    for (int i = 0; i < RING_CAPACITY; i++) {
+        frame_ring_reserve(&ring, 0, WAIT_TIMEOUT_MS);
+        frame_ring_push(&ring, frame_ring_next_slot(&ring));
+    }
+    frame_ring_complete(&ring, 2);
+    frame_ring_complete(&ring, 0);
+    if (0 != frame_ring_wait(&ring, WAIT_TIMEOUT_MS) || frame_ring_completed(&ring) != 0b101) {
+        printf("expected slots 0 and 2 to be completed, got %x\n", frame_ring_completed(&ring));
+        ret = 1;
+    }
+    if (0 == frame_ring_wait_more(&ring, WAIT_TIMEOUT_MS) || frame_ring_completed(&ring) != 0b101) {
+        printf("waiting for more frames returned without a new one\n");
+        ret = 1;
+    }
+    frame_ring_pop(&ring, 2, 0);
+    frame_ring_pop(&ring, 0, 0);
+    if (0 == frame_ring_wait(&ring, WAIT_TIMEOUT_MS)) {
+        printf("slot 1 was not completed but could be popped\n");
+        ret = 1;
+    }
+    if (0 != frame_ring_next_slot(&ring)) {
+        printf("expected slot 0 to be reused, got %d\n", frame_ring_next_slot(&ring));
+        ret = 1;
+    }
+    // frames that may only use some of the slots, like the lanes of one server
+    if (-1 != frame_ring_next_slot_in(&ring, 0b010) || 2 != frame_ring_next_slot_in(&ring, 0b110)) {
+        printf("expected slot 1 to be in use and slot 2 to be free\n");
+        ret = 1;
+    }
+    start_ns = get_timestamp_ns();
+    if (0 == frame_ring_reserve_in(&ring, 0, 0b010, WAIT_TIMEOUT_MS) || ETIMEDOUT != errno ||
+        get_timestamp_ns() - start_ns < WAIT_TIMEOUT_MS * 1000000LL) {
+        printf("reserving busy slot 1 did not time out\n");
+        ret = 1;
+    }
+    if (0 != frame_ring_reserve_in(&ring, 0, 0b100, WAIT_TIMEOUT_MS)) {
+        printf("reserving free slot 2 failed, the timed out spot was not given back\n");
+        ret = 1;
+    } else {
+        frame_ring_unreserve(&ring, 1, 0);
+    }
+
+    frame_ring_complete(&ring, 1);
+    frame_ring_wait(&ring, WAIT_TIMEOUT_MS);
+    frame_ring_pop(&ring, 1, 0);
+
+    // a frame that reserved a remote spot can still run locally, e.g. once its lane fell back to
+    // local only. Like dequeue_spot and submit_image, it gives back only what it reserved, so the
+    // local spot of the local frame stays taken.
+    const slot_t local_frame = {0, 1}, fallback_frame = {1, 0};
+    frame_ring_reserve(&ring, 1, WAIT_TIMEOUT_MS);
+    const int local_index = frame_ring_next_slot(&ring);
+    frame_ring_push(&ring, local_index);
+    frame_ring_reserve(&ring, 0, WAIT_TIMEOUT_MS);
+    const int fallback_index = frame_ring_next_slot(&ring);
+    frame_ring_push(&ring, fallback_index);
+    frame_ring_complete(&ring, fallback_index);
+    frame_ring_wait(&ring, WAIT_TIMEOUT_MS);
+    frame_ring_pop(&ring, fallback_index, fallback_frame.is_local);
+    if (0 == frame_ring_reserve(&ring, 1, WAIT_TIMEOUT_MS)) {
+        printf("a remote spot that ran locally gave back the local spot of another frame\n");
+        frame_ring_unreserve(&ring, 1, 1);
+        ret = 1;
+    }
+    frame_ring_complete(&ring, local_index);
+    frame_ring_wait(&ring, WAIT_TIMEOUT_MS);
+    frame_ring_pop(&ring, local_index, local_frame.is_local);
+    if (ring.local_reserved != ring.local_released) {
+        printf("%u local spots in use after all frames were popped\n",
+               ring.local_reserved - ring.local_released);
+        ret = 1;
+    }
+    const uint32_t start_frames = frame_ring_head(&ring);
+
+    // stream frames from a producer to a consumer thread
+    std::vector<slot_t> slots(RING_CAPACITY);
+    std::atomic<int> in_flight(0), max_in_flight(0);
+    std::atomic<int> local_in_flight(0), max_local_in_flight(0);
+    std::vector<int> received(num_frames, 0);
+
+    start_ns = get_timestamp_ns();
+    std::thread consumer([&]() {
+        for (int i = 0; i < num_frames; i++) {
+            while (0 != frame_ring_wait(&ring, WAIT_TIMEOUT_MS)) {
+            }
+            int index = __builtin_ctz(frame_ring_completed(&ring));
+            const slot_t &slot = slots[index];
+            received[slot.frame_index] += 1;
+            if (slot.is_local) {
+                local_in_flight--;
+            }
+            in_flight--;
+            frame_ring_pop(&ring, index, slot.is_local);
+        }
+    });
+
+    int previous_index = -1;
+    for (int i = 0; i < num_frames; i++) {
+        // every fourth frame runs locally, like a codec that switches devices
+        const int is_local = (0 == i % 4);
+        while (0 != frame_ring_reserve(&ring, is_local, WAIT_TIMEOUT_MS)) {
+        }
+        int count = ++in_flight;
+        max_in_flight = std::max(max_in_flight.load(), count);
+        if (is_local) {
+            count = ++local_in_flight;
+            max_local_in_flight = std::max(max_local_in_flight.load(), count);
+        }
+
+        int index = frame_ring_next_slot(&ring);
+        slot_t &slot = slots[index];
+        slot.frame_index = i;
+        slot.is_local = is_local;
+        frame_ring_push(&ring, index);
+
+        // complete pairs of frames in reverse order
+        if (1 == i % 2) {
+            frame_ring_complete(&ring, index);
+            frame_ring_complete(&ring, previous_index);
+        } else if (i == num_frames - 1) {
+            frame_ring_complete(&ring, index);
+        }
+        previous_index = index;
+    }
+    consumer.join();
+    int64_t elapsed_ns = get_timestamp_ns() - start_ns;
+
+    if (std::count(received.begin(), received.end(), 1) != num_frames) {
+        printf("not every frame was received exactly once\n");
+        ret = 1;
+    }
+    if (max_in_flight > RING_CAPACITY || max_local_in_flight > RING_LOCAL_CAPACITY) {
+        printf("%d frames (%d local) were in flight\n", max_in_flight.load(),
+               max_local_in_flight.load());
+        ret = 1;
+    }
+    if (frame_ring_head(&ring) - start_frames != (uint32_t) num_frames ||
+        frame_ring_tail(&ring) - start_frames != (uint32_t) num_frames) {
+        printf("ring ended at head %u tail %u\n", frame_ring_head(&ring), frame_ring_tail(&ring));
+        ret = 1;
+    }
+
+    printf("frames,ns_per_frame\n%d,%.1f\n", num_frames, (double) elapsed_ns / num_frames);
+    return ret;
+}
@@ -0,0 +1,160 @@
+//
+// Checks that pocl stops allocating runtime objects once frames are in steady
+// state. Frames are enqueued the way a lane does it, a write, a kernel-like
+// fill and a read that depend on each other, with several frames in flight.
+// The events are waited on and released on a second thread, like
+// receive_image does, so freed objects have to travel back to the submitting
+// thread. After the warm-up frames the allocation counters of
+// clGetMemManagerStatsPOCL must not grow anymore. Needs a pocl built with
+// USE_POCL_MEMMANAGER.
+//
+// usage: ./test_mem_manager [frames] [warmup_frames]
+//
+
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 300
+#endif
+
+#include "rename_opencl.h"
+#include <CL/cl.h>
+#include <CL/cl_ext_pocl.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// every thread that frees objects keeps up to a cache full of them, so the objects in
+// circulation only settle after a few hundred frames
+#define WARMUP_FRAMES 256
+#define FRAMES_IN_FLIGHT 4
+#define BUF_SIZE 4096
+
+typedef struct {
+    cl_event events[3];
+} frame_events_t;
+
+int main(int argc, char **argv) {
+    const int num_frames = (argc > 1) ? atoi(argv[1]) : 2000;
+    const int warmup_frames = (argc > 2) ? atoi(argv[2]) : WARMUP_FRAMES;
+    cl_int status;
+
+    cl_platform_id platform;
+    cl_device_id device;
+    status = clGetPlatformIDs(1, &platform, NULL);
+    if (CL_SUCCESS != status ||
+        CL_SUCCESS != clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, NULL)) {
+        printf("no device: %d\n", status);
+        return 1;
+    }
+
+    clGetMemManagerStatsPOCL_fn get_stats = (clGetMemManagerStatsPOCL_fn)
+            clGetExtensionFunctionAddressForPlatform(platform, "clGetMemManagerStatsPOCL");
+    cl_mem_manager_stats_pocl warm_stats, end_stats;
+    if (NULL == get_stats || CL_SUCCESS != get_stats(&warm_stats)) {
+        printf("pocl was built without USE_POCL_MEMMANAGER\n");
+        return 1;
+    }
+
+    cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &status);
+    cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL, &status);
+    cl_mem bufs[FRAMES_IN_FLIGHT];
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        bufs[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, BUF_SIZE, NULL, &status);
+    }
+    std::vector<uint8_t> host_in(BUF_SIZE, 1);
+    std::vector<uint8_t> host_out(BUF_SIZE * FRAMES_IN_FLIGHT);
+    const uint8_t pattern = 255;
+
+    std::deque<frame_events_t> in_flight;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool submit_done = false;
+    int failed = 0;
+
+    // releases the events of the frames in submission order, like the receiving thread
+    std::thread receiver([&]() {
+        for (;;) {
+            frame_events_t frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&] { return !in_flight.empty() || submit_done; });
+                if (in_flight.empty()) {
+                    return;
+                }
+                frame = in_flight.front();
+                in_flight.pop_front();
+            }
+            if (CL_SUCCESS != clWaitForEvents(1, &frame.events[2])) {
+                failed += 1;
+            }
+            for (cl_event event: frame.events) {
+                clReleaseEvent(event);
+            }
+            cond.notify_all();
+        }
+    });
+
+    for (int i = 0; i < num_frames; i++) {
+        if (warmup_frames == i) {
+            clFinish(queue);
+            get_stats(&warm_stats);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return in_flight.size() < FRAMES_IN_FLIGHT; });
+        lock.unlock();
+
+        const int slot = i % FRAMES_IN_FLIGHT;
+        frame_events_t frame;
+        status = clEnqueueWriteBuffer(queue, bufs[slot], CL_FALSE, 0, BUF_SIZE, host_in.data(), 0,
+                                      NULL, &frame.events[0]);
+        status |= clEnqueueFillBuffer(queue, bufs[slot], &pattern, 1, 0, BUF_SIZE / 2, 1,
+                                      &frame.events[0], &frame.events[1]);
+        status |= clEnqueueReadBuffer(queue, bufs[slot], CL_FALSE, 0, BUF_SIZE,
+                                      host_out.data() + slot * BUF_SIZE, 1, &frame.events[1],
+                                      &frame.events[2]);
+        if (CL_SUCCESS != status) {
+            printf("could not enqueue frame %d\n", i);
+            failed += 1;
+            break;
+        }
+        clFlush(queue);
+
+        lock.lock();
+        in_flight.push_back(frame);
+        cond.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        submit_done = true;
+    }
+    cond.notify_all();
+    receiver.join();
+    clFinish(queue);
+    get_stats(&end_stats);
+
+    printf("frames,events_allocated,commands_allocated,event_nodes_allocated,depot_transfers\n");
+    printf("%d,%lu,%lu,%lu,%lu\n", num_frames,
+           (unsigned long) (end_stats.events_allocated - warm_stats.events_allocated),
+           (unsigned long) (end_stats.commands_allocated - warm_stats.commands_allocated),
+           (unsigned long) (end_stats.event_nodes_allocated - warm_stats.event_nodes_allocated),
+           (unsigned long) (end_stats.depot_transfers - warm_stats.depot_transfers));
+
+    if (end_stats.events_allocated != warm_stats.events_allocated ||
+        end_stats.commands_allocated != warm_stats.commands_allocated ||
+        end_stats.event_nodes_allocated != warm_stats.event_nodes_allocated) {
+        printf("pocl kept allocating after %d frames\n", warmup_frames);
+        failed += 1;
+    }
+
+    for (cl_mem buf: bufs) {
+        clReleaseMemObject(buf);
+    }
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+//
+// Checks the frame difference test that skips static frames. Frames are
+// random textures, which are compared unchanged, with noise, moved and
+// replaced. Static and moved frames have to be skipped with the right motion,
+// other frames have to run and become the new reference.
+//
+// usage: ./test_motion_skip [frames]
+//
+
+#include "motion_skip.h"
+#include "sharedUtils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define FRAME_WIDTH 640
+#define FRAME_HEIGHT 480
+#define TEXTURE_BLOCK 4 // pixels that share a random value, so thumbnails keep some contrast
+
+static std::vector<uint8_t> make_texture(unsigned int seed) {
+    std::vector<uint8_t> frame(FRAME_WIDTH * FRAME_HEIGHT);
+    srand(seed);
+    std::vector<uint8_t> blocks((FRAME_WIDTH / TEXTURE_BLOCK) * (FRAME_HEIGHT / TEXTURE_BLOCK));
+    for (uint8_t &b: blocks) {
+        b = rand() % 256;
+    }
+    for (int y = 0; y < FRAME_HEIGHT; y++) {
+        for (int x = 0; x < FRAME_WIDTH; x++) {
+            frame[y * FRAME_WIDTH + x] =
+                    blocks[(y / TEXTURE_BLOCK) * (FRAME_WIDTH / TEXTURE_BLOCK) + x / TEXTURE_BLOCK];
+        }
+    }
+    return frame;
+}
+
+/**
+ * move the frame right by dx and down by dy, filling the uncovered part with mid gray
+ */
+static std::vector<uint8_t> move_frame(const std::vector<uint8_t> &frame, int dx, int dy) {
+    std::vector<uint8_t> moved(frame.size(), 128);
+    for (int y = 0; y < FRAME_HEIGHT; y++) {
+        for (int x = 0; x < FRAME_WIDTH; x++) {
+            int src_x = x - dx;
+            int src_y = y - dy;
+            if (src_x >= 0 && src_x < FRAME_WIDTH && src_y >= 0 && src_y < FRAME_HEIGHT) {
+                moved[y * FRAME_WIDTH + x] = frame[src_y * FRAME_WIDTH + src_x];
+            }
+        }
+    }
+    return moved;
+}
+
+static int check(motion_skip_t *ctx, const std::vector<uint8_t> &frame, int allow_skip,
+                 int expect_skip, int expect_dx, int expect_dy, const char *name) {
+    motion_estimate_t motion;
+    int skipped = check_motion_skip(ctx, frame.data(), FRAME_WIDTH, 1, allow_skip, &motion);
+    if (skipped != expect_skip || (skipped && (motion.dx != expect_dx || motion.dy != expect_dy))) {
+        printf("%s: skipped %d (expected %d), motion %d,%d (expected %d,%d), score %.2f\n", name,
+               skipped, expect_skip, motion.dx, motion.dy, expect_dx, expect_dy, motion.score);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const int num_frames = (argc > 1) ? atoi(argv[1]) : 1000;
+    int ret = 0;
+
+    motion_skip_t ctx;
+    if (0 != init_motion_skip(&ctx, FRAME_WIDTH, FRAME_HEIGHT, MOTION_SKIP_THRESHOLD,
+                              MOTION_SKIP_MAX_FRAMES)) {
+        printf("could not init motion skip\n");
+        return 1;
+    }
+
+    const std::vector<uint8_t> frame = make_texture(1);
+    std::vector<uint8_t> noisy = frame;
+    for (uint8_t &p: noisy) {
+        p = (p < 2) ? p : p - 2 + rand() % 5;
+    }
+
+    ret |= check(&ctx, frame, 1, 0, 0, 0, "first frame");
+    ret |= check(&ctx, frame, 1, 1, 0, 0, "same frame");
+    ret |= check(&ctx, noisy, 1, 1, 0, 0, "noisy frame");
+    ret |= check(&ctx, move_frame(frame, 16, 8), 1, 1, 16, 8, "moved frame");
+    ret |= check(&ctx, move_frame(frame, -24, 0), 1, 1, -24, 0, "frame moved left");
+    ret |= check(&ctx, frame, 0, 0, 0, 0, "frame that has to run");
+    ret |= check(&ctx, make_texture(2), 1, 0, 0, 0, "new scene");
+
+    // a static scene still runs every so often
+    for (int i = 0; i < MOTION_SKIP_MAX_FRAMES; i++) {
+        ret |= check(&ctx, make_texture(2), 1, 1, 0, 0, "static scene");
+    }
+    ret |= check(&ctx, make_texture(2), 1, 0, 0, 0, "static scene after max skipped frames");
+
+    reset_motion_skip(&ctx);
+    ret |= check(&ctx, make_texture(2), 1, 0, 0, 0, "frame after reset");
+
+    int64_t start_ns = get_timestamp_ns();
+    motion_estimate_t motion;
+    for (int i = 0; i < num_frames; i++) {
+        check_motion_skip(&ctx, noisy.data(), FRAME_WIDTH, 1, 1, &motion);
+    }
+    int64_t elapsed_ns = get_timestamp_ns() - start_ns;
+
+    destroy_motion_skip(&ctx);
+
+    printf("frames,us_per_frame\n%d,%.1f\n", num_frames, (double) elapsed_ns / num_frames / 1e3);
+    return ret;
+}
@@ -0,0 +1,161 @@
+//
+// Checks the predictive codec selection. The codecs run over a network model
+// whose bandwidth drops and recovers, with every frame fed to the selection
+// the way the app does it. After the codecs are measured, the codec in use has
+// to fit the hard constraints with every phase, the selection has to leave a
+// codec that the network change makes too slow within a few frames, and it
+// must not keep switching while the network stays the same.
+//
+// usage: ./test_predict_select [frames_per_phase]
+//
+
+#include "codec_select.h"
+#include "eval.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <random>
+#include <unistd.h>
+
+// same hard constraints as init_codec_select()
+#define LIMIT_LATENCY_MS 300.0f
+#define LIMIT_IOU 0.5f
+
+// frames of the first phase to measure every codec, which takes up to SELECT_INTERVAL_MS each
+#define EXPLORE_FRAMES 250
+// frames after a network change until the codec in use has to fit again
+#define REACT_FRAMES 4
+// switches allowed per phase once the selection settled
+#define MAX_SETTLED_SWITCHES 2
+
+typedef struct {
+    float compute_ms;
+    float size_bytes;
+    float iou;
+} codec_model_t;
+
+// same models as bench_codec_select
+static const codec_model_t CODEC_MODELS[NUM_CONFIGS] = {
+        {350.0f, 0.0f, 1.0f},
+        {60.0f, 460800.0f, 1.0f},
+        {75.0f, 120000.0f, 0.97f},
+        {70.0f, 45000.0f, 0.92f},
+        {65.0f, 15000.0f, 0.72f},
+        {90.0f, 80000.0f, 0.93f},
+        {90.0f, 20000.0f, 0.80f},
+        {90.0f, 2500.0f, 0.40f},
+        {40.0f, 460800.0f, 0.82f},
+        {50.0f, 45000.0f, 0.78f},
+};
+
+typedef struct {
+    float bandwidth_mbit;
+    float rtt_ms;
+} network_t;
+
+// fast, a drop that only the smallest codecs survive, then in between
+static const network_t PHASES[] = {{100.0f, 10.0f}, {1.5f, 60.0f}, {20.0f, 20.0f}};
+#define NUM_PHASES (int) (sizeof(PHASES) / sizeof(PHASES[0]))
+
+static float model_latency_ms(int id, const network_t &network) {
+    if (id == LOCAL_CODEC_ID) {
+        return CODEC_MODELS[id].compute_ms;
+    }
+    const float bytes_per_ms = network.bandwidth_mbit * 1e6f / 8.0f / 1e3f;
+    return CODEC_MODELS[id].compute_ms + network.rtt_ms +
+           CODEC_MODELS[id].size_bytes / bytes_per_ms;
+}
+
+static bool model_fits(int id, const network_t &network) {
+    return model_latency_ms(id, network) <= LIMIT_LATENCY_MS && CODEC_MODELS[id].iou >= LIMIT_IOU;
+}
+
+int main(int argc, char **argv) {
+    const int frames_per_phase = (argc > 1) ? atoi(argv[1]) : 300;
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(1.0f, 0.05f);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    codec_select_state_t *state;
+    init_codec_select(0, null_fd, SELECT_ALGORITHM_PREDICT, false, false, &state);
+
+    int failed = 0;
+    int64_t now_ns = 1000000000;  // 0 means no selection happened yet
+    int64_t next_eval_ns = now_ns;
+    int frame_index = 0;
+
+    printf("phase,bandwidth_mbit,react_frames,settled_switches,unfit_frames\n");
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+        const network_t &network = PHASES[phase];
+        // the first phase also measures every codec
+        const int settle_frames = (phase == 0) ? EXPLORE_FRAMES : REACT_FRAMES;
+        const int num_frames = frames_per_phase + ((phase == 0) ? EXPLORE_FRAMES : 0);
+        int react_frames = -1;
+        int settled_switches = 0;
+        int unfit_frames = 0;
+        int prev_id = get_codec_id(state);
+
+        for (int i = 0; i < num_frames; i++, frame_index++) {
+            const int id = get_codec_id(state);
+            const bool codec_selected = drain_codec_selected(state);
+            if (react_frames < 0 && model_fits(id, network)) {
+                react_frames = i;
+            }
+            if (i >= settle_frames) {
+                settled_switches += (id != prev_id) ? 1 : 0;
+                unfit_frames += model_fits(id, network) ? 0 : 1;
+            }
+            prev_id = id;
+
+            const float latency_ms = model_latency_ms(id, network) * noise(rng);
+            state->collected_events->num_events = 1;
+            state->collected_events->descriptions[0] = "dnn_event";
+            state->collected_events->end_start_ms[0] = fminf(CODEC_MODELS[id].compute_ms,
+                                                             latency_ms);
+
+            frame_metadata_t metadata = {};
+            metadata.frame_index = frame_index;
+            metadata.codec.id = id;
+            metadata.codec.compression_type = CONFIGS[id].compression_type;
+            metadata.codec.device_type = CONFIGS[id].device_type;
+            metadata.size_bytes_tx = (uint64_t) CODEC_MODELS[id].size_bytes;
+            metadata.host_ts_ns.start = now_ns;
+            metadata.host_ts_ns.stop = now_ns + (int64_t) (latency_ms * 1e6f);
+            metadata.host_ts_ns.fill_ping_duration_ms =
+                    (id == LOCAL_CODEC_ID) ? -1 : (int64_t) (network.rtt_ms * 1e6f);
+            metadata.run_args.codec_selected = codec_selected;
+            now_ns = metadata.host_ts_ns.stop;
+            metadata.run_args.is_eval_frame = id != LOCAL_CODEC_ID && now_ns >= next_eval_ns;
+            update_stats(&metadata, NULL, state);
+
+            if (metadata.run_args.is_eval_frame) {
+                signal_eval_start(state, frame_index, id);
+                signal_eval_finish(state, CODEC_MODELS[id].iou);
+                next_eval_ns = now_ns + EVAL_INTERVAL_SEC * 1000000000LL;
+            }
+
+            select_codec_auto_at(state, now_ns);
+        }
+
+        printf("%d,%.1f,%d,%d,%d\n", phase, network.bandwidth_mbit, react_frames, settled_switches,
+               unfit_frames);
+        if (phase > 0 && (react_frames < 0 || react_frames > REACT_FRAMES)) {
+            printf("phase %d: took %d frames to get to a codec that fits\n", phase, react_frames);
+            failed += 1;
+        }
+        if (settled_switches > MAX_SETTLED_SWITCHES) {
+            printf("phase %d: %d switches after settling\n", phase, settled_switches);
+            failed += 1;
+        }
+        if (unfit_frames > 0) {
+            printf("phase %d: %d frames with a codec that does not fit after settling\n", phase,
+                   unfit_frames);
+            failed += 1;
+        }
+    }
+
+    destroy_codec_select(&state);
+    close(null_fd);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+//
+// Checks the binary profiling log. Two threads log values of every type
+// while the flusher runs, the log is converted back to csv and compared
+// against the lines the csv log would have had. The binary log has to be
+// smaller than the csv. Also compares the time a logging thread spends per
+// value against writing csv lines right away.
+//
+// usage: ./test_profile_log [values_per_thread]
+//
+
+#include "profile_log.h"
+#include "sharedUtils.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <set>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#define NUM_THREADS 2
+// as long as the longest tag and string value the app logs, which have to fit uncut
+#define LONG_TAG "read_compress_size_event"
+#define LONG_STR "yolov8n-seg:640x480:int8"
+
+static void log_values(int fd, int thread_index, int count) {
+    for (int i = 0; i < count; i++) {
+        int frame_index = thread_index * count + i;
+        log_frame_int(fd, frame_index, "thread", "int", i);
+        log_frame_i64(fd, frame_index, "thread", "i64", -(int64_t) i * 1000000000LL);
+        log_frame_u64(fd, frame_index, "thread", "u64", (uint64_t) i * 1000000000ULL);
+        log_frame_f(fd, frame_index, "thread", "f", 0.5f * (float) i);
+        log_frame_str(fd, frame_index, LONG_TAG, "str", (i % 2) ? LONG_STR : "");
+    }
+}
+
+static std::set<std::string> expected_lines(int count) {
+    std::set<std::string> lines;
+    char line[256];
+    for (int t = 0; t < NUM_THREADS; t++) {
+        for (int i = 0; i < count; i++) {
+            int frame_index = t * count + i;
+            snprintf(line, sizeof(line), "%d,thread,int,%d", frame_index, i);
+            lines.insert(line);
+            snprintf(line, sizeof(line), "%d,thread,i64,%ld", frame_index,
+                     -(long) i * 1000000000L);
+            lines.insert(line);
+            snprintf(line, sizeof(line), "%d,thread,u64,%lu", frame_index,
+                     (unsigned long) i * 1000000000UL);
+            lines.insert(line);
+            snprintf(line, sizeof(line), "%d,thread,f,%f", frame_index, 0.5f * (float) i);
+            lines.insert(line);
+            snprintf(line, sizeof(line), "%d," LONG_TAG ",str,%s", frame_index,
+                     (i % 2) ? LONG_STR : "");
+            lines.insert(line);
+        }
+    }
+    return lines;
+}
+
+/**
+ * log from all threads to fd
+ * @return ns per logged value, seen from the logging threads
+ */
+static double run_threads(int fd, int count) {
+    int64_t start_ns = get_timestamp_ns();
+    std::thread threads[NUM_THREADS];
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads[t] = std::thread(log_values, fd, t, count);
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    return (double) (get_timestamp_ns() - start_ns) / (NUM_THREADS * count * 5);
+}
+
+int main(int argc, char **argv) {
+    // small enough by default that the flusher keeps up and nothing is dropped
+    const int count = (argc > 1) ? atoi(argv[1]) : 200;
+    int ret = 0;
+
+    char bin_path[] = "/tmp/test_profile_log_XXXXXX";
+    char csv_path[] = "/tmp/test_profile_log_csv_XXXXXX";
+    int bin_fd = mkstemp(bin_path);
+    int csv_fd = mkstemp(csv_path);
+    if (-1 == bin_fd || -1 == csv_fd) {
+        printf("could not create temporary files\n");
+        return 1;
+    }
+
+    if (0 != profile_log_open(bin_fd)) {
+        printf("could not open the profile log\n");
+        return 1;
+    }
+    if (0 == profile_log_open(csv_fd)) {
+        printf("a second profile log could be opened\n");
+        ret = 1;
+    }
+    double binary_ns = run_threads(bin_fd, count);
+    profile_log_close(bin_fd);
+    // records only get dropped when the threads outrun the flusher for a whole ring
+    const int dropped = (int) profile_log_dropped();
+
+    // the text fallback is what a file without a binary log gets
+    double text_ns = run_threads(csv_fd, count);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    lseek(bin_fd, 0, SEEK_SET);
+    int records = profile_log_convert(bin_fd, null_fd);
+    close(null_fd);
+    const int expected_records = 2 + NUM_THREADS * count * 5 - dropped;
+    if (records != expected_records) {
+        printf("converted %d records, expected %d\n", records, expected_records);
+        ret = 1;
+    }
+
+    // the converted log and the text fallback have to match line for line, up to ordering.
+    // A converted log with dropped records has to be a part of the lines.
+    std::set<std::string> expected = expected_lines(count);
+    char conv_path[] = "/tmp/test_profile_log_conv_XXXXXX";
+    int conv_fd = mkstemp(conv_path);
+    lseek(bin_fd, 0, SEEK_SET);
+    profile_log_convert(bin_fd, conv_fd);
+
+    const char *paths[] = {conv_path, csv_path};
+    for (const char *path: paths) {
+        FILE *file = fopen(path, "r");
+        std::set<std::string> lines;
+        char line[256];
+        while (NULL != fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\n")] = '\0';
+            lines.insert(line);
+        }
+        fclose(file);
+
+        std::set<std::string> wanted = expected;
+        bool match = (lines == wanted);
+        if (path == conv_path) {
+            wanted.insert("frame_id,tag,parameter,value");
+            wanted.insert("-1,profile_log,dropped_records," + std::to_string(dropped));
+            match = (0 == dropped) ? (lines == wanted)
+                                   : std::includes(wanted.begin(), wanted.end(), lines.begin(),
+                                                   lines.end());
+        }
+        if (!match) {
+            printf("%s: %zu lines, expected %zu\n", path == conv_path ? "converted log" : "csv log",
+                   lines.size(), wanted.size());
+            ret = 1;
+        }
+    }
+
+    // the same values, the texts of the binary log are only written once
+    const off_t bin_size = lseek(bin_fd, 0, SEEK_END);
+    const off_t csv_size = lseek(csv_fd, 0, SEEK_END);
+    if (bin_size >= csv_size) {
+        printf("binary log has %ld bytes, csv %ld bytes\n", (long) bin_size, (long) csv_size);
+        ret = 1;
+    }
+
+    close(bin_fd);
+    close(csv_fd);
+    close(conv_fd);
+    unlink(bin_path);
+    unlink(csv_path);
+    unlink(conv_path);
+
+    const int values = NUM_THREADS * count * 5;
+    printf("values,dropped,binary_ns_per_value,csv_ns_per_value,"
+           "binary_bytes_per_value,csv_bytes_per_value\n%d,%d,%.1f,%.1f,%.1f,%.1f\n",
+           values, dropped, binary_ns, text_ns, (double) bin_size / values,
+           (double) csv_size / values);
+    return ret;
+}
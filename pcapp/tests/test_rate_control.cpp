@@ -0,0 +1,153 @@
+//
+// Checks the rate control of the codec selection. A JPEG and an HEVC codec run
+// over a network model whose bandwidth drops and recovers, with the encoded
+// size following the quality or bitrate handed out by get_codec_params(). Once
+// settled, the latency has to stay close to the latency budget wherever the
+// CONFIGS entry leaves room for it, the values have to change by bounded steps
+// and never go above the CONFIGS entry. Without RATE_CONTROL the codecs have
+// to stay at their CONFIGS entries.
+//
+// usage: ./test_rate_control [frames_per_phase]
+//
+
+#include "codec_select.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define JPEG_CODEC_ID 2  // jpeg 99
+#define HEVC_CODEC_ID 5  // hevc 5 Mbit/s
+#define COMPUTE_MS 75.0f
+#define RTT_MS 20.0f
+#define RAW_SIZE_BYTES 460800.0f
+
+// frames that may pass before the latency has to be within the budget
+#define SETTLE_FRAMES 40
+// how far the settled latency may be from the budget
+#define TOLERANCE 0.12f
+
+// fast enough for the best quality, then in between the CONFIGS entries
+static const float PHASE_BANDWIDTH_MBIT[] = {50.0f, 2.0f, 6.0f};
+#define NUM_PHASES (int) (sizeof(PHASE_BANDWIDTH_MBIT) / sizeof(PHASE_BANDWIDTH_MBIT[0]))
+
+// how the encoded size grows with the JPEG quality and the HEVC bitrate
+static float model_size_bytes(const codec_params_t &params) {
+    if (params.compression_type == JPEG_COMPRESSION) {
+        const float q = (float) params.config.jpeg.quality / 100.0f;
+        return RAW_SIZE_BYTES * (0.01f + 0.25f * q * q * q * q);
+    }
+    return (float) params.config.hevc.bitrate / 64.0f;
+}
+
+static int param_of(const codec_params_t &params) {
+    return params.compression_type == JPEG_COMPRESSION ? params.config.jpeg.quality
+                                                       : params.config.hevc.bitrate;
+}
+
+static bool step_too_large(const codec_params_t &params, int prev, int cur) {
+    if (params.compression_type == JPEG_COMPRESSION) {
+        return abs(cur - prev) > 6;
+    }
+    return fabsf((float) cur / (float) prev - 1.0f) > 0.16f;
+}
+
+/**
+ * run a codec through all phases
+ * @return number of failed checks
+ */
+static int run(int codec_id, bool rate_control, int frames_per_phase) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    codec_select_state_t *state;
+    init_codec_select(rate_control ? RATE_CONTROL : 0, null_fd, SELECT_ALGORITHM_NONE, true,
+                      false, &state);
+    state->id = codec_id;
+
+    const int max_param = param_of(CONFIGS[codec_id]);
+    int failures = 0;
+    int64_t now_ns = 1000000000;
+    int prev_param = max_param;
+    int frame_index = 0;
+
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+        const float bytes_per_ms = PHASE_BANDWIDTH_MBIT[phase] * 1e6f / 8.0f / 1e3f;
+        double settled_latency_ms = 0.0;
+        int settled_frames = 0;
+        int min_param = max_param;
+
+        for (int i = 0; i < frames_per_phase; i++, frame_index++) {
+            const codec_params_t params = get_codec_params(state);
+            const int param = param_of(params);
+            if (param > max_param || (!rate_control && param != max_param)) {
+                printf("codec %d frame %d: %d out of range\n", codec_id, frame_index, param);
+                failures += 1;
+            }
+            if (step_too_large(params, prev_param, param)) {
+                printf("codec %d frame %d: step from %d to %d\n", codec_id, frame_index,
+                       prev_param, param);
+                failures += 1;
+            }
+            prev_param = param;
+            min_param = std::min(min_param, param);
+
+            const float size_bytes = model_size_bytes(params);
+            const float latency_ms = COMPUTE_MS + RTT_MS + size_bytes / bytes_per_ms;
+
+            state->collected_events->num_events = 1;
+            state->collected_events->descriptions[0] = "dnn_event";
+            state->collected_events->end_start_ms[0] = COMPUTE_MS;
+
+            frame_metadata_t metadata = {};
+            metadata.frame_index = frame_index;
+            metadata.codec.id = codec_id;
+            metadata.codec.compression_type = params.compression_type;
+            metadata.codec.device_type = params.device_type;
+            metadata.size_bytes_tx = (uint64_t) size_bytes;
+            metadata.host_ts_ns.start = now_ns;
+            metadata.host_ts_ns.stop = now_ns + (int64_t) (latency_ms * 1e6f);
+            metadata.host_ts_ns.fill_ping_duration_ms = -1;
+            now_ns = metadata.host_ts_ns.stop;
+            update_stats(&metadata, NULL, state);
+
+            if (i >= SETTLE_FRAMES) {
+                settled_latency_ms += latency_ms;
+                settled_frames += 1;
+            }
+        }
+
+        // the budget can't be reached when even the CONFIGS entry is faster
+        const float max_latency_ms =
+                COMPUTE_MS + RTT_MS + model_size_bytes(CONFIGS[codec_id]) / bytes_per_ms;
+        const float expected_ms = (!rate_control || max_latency_ms < state->tgt_latency_ms)
+                                  ? max_latency_ms : state->tgt_latency_ms;
+        const float mean_ms = (float) (settled_latency_ms / settled_frames);
+        const bool ok = fabsf(mean_ms / expected_ms - 1.0f) <= TOLERANCE;
+        failures += ok ? 0 : 1;
+        printf("%d,%d,%.0f,%.1f,%.1f,%d,%d,%s\n", codec_id, rate_control ? 1 : 0,
+               PHASE_BANDWIDTH_MBIT[phase], mean_ms, expected_ms, min_param, prev_param,
+               ok ? "ok" : "FAIL");
+    }
+
+    destroy_codec_select(&state);
+    close(null_fd);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    const int frames_per_phase = (argc > 1) ? atoi(argv[1]) : 200;
+    if (frames_per_phase <= SETTLE_FRAMES) {
+        printf("need more than %d frames per phase\n", SETTLE_FRAMES);
+        return 1;
+    }
+
+    int failures = 0;
+    printf("codec,rate_control,bandwidth_mbit,mean_latency_ms,expected_ms,min_param,last_param,"
+           "result\n");
+    for (int codec_id: {JPEG_CODEC_ID, HEVC_CODEC_ID}) {
+        failures += run(codec_id, false, frames_per_phase);
+        failures += run(codec_id, true, frames_per_phase);
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+//
+// Checks the load estimates that spread frames over the remote servers. The
+// choice has to measure every server first and then follow latency and frames
+// in flight, and lost servers have to be left out until the retry interval
+// passed. Then frames stream to a fast and a slow server the way the lanes
+// offload them, with the slow one going down for a while: the fast one has to
+// get most of the frames, and no frame may go to the lost one before it is
+// retried.
+//
+// usage: ./test_server_pool [frames]
+//
+
+#include "server_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define RETRY_MS 1000
+#define FRAME_INTERVAL_MS 20
+#define MAX_IN_FLIGHT 4
+
+// time each server needs for a frame, frames queue up behind each other
+static const int SERVICE_MS[] = {30, 60};
+#define NUM_SERVERS (int) (sizeof(SERVICE_MS) / sizeof(SERVICE_MS[0]))
+
+#define MS_TO_NS(ms) ((int64_t) (ms) * 1000000)
+
+static int expect(int got, int expected, const char *name) {
+    if (got != expected) {
+        printf("%s: got %d, expected %d\n", name, got, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_choice() {
+    int ret = 0;
+    server_pool_t pool;
+    server_pool_init(&pool, 2, RETRY_MS);
+    int64_t now_ns = MS_TO_NS(1000);
+
+    // unmeasured servers go first, the one with fewer frames in flight
+    ret |= expect(server_pool_choose(&pool, 0b11, now_ns), 0, "first frame");
+    server_pool_submit(&pool, 0);
+    ret |= expect(server_pool_choose(&pool, 0b11, now_ns), 1, "second frame");
+    server_pool_submit(&pool, 1);
+    server_pool_receive(&pool, 0, 100.0f);
+    ret |= expect(server_pool_choose(&pool, 0b11, now_ns), 1, "unmeasured before measured");
+    server_pool_receive(&pool, 1, 50.0f);
+
+    // then the one that is expected to be done first
+    ret |= expect(server_pool_choose(&pool, 0b11, now_ns), 1, "lower latency");
+    server_pool_submit(&pool, 1);
+    server_pool_submit(&pool, 1);
+    ret |= expect(server_pool_choose(&pool, 0b11, now_ns), 0, "fewer frames in flight");
+    ret |= expect(server_pool_choose(&pool, 0b10, now_ns), 1, "only candidate");
+    ret |= expect(server_pool_choose(&pool, 0, now_ns), -1, "no candidate");
+
+    // the latency is smoothed
+    server_pool_submit(&pool, 0);
+    server_pool_receive(&pool, 0, 200.0f);
+    server_state_t state = server_pool_get(&pool, 0);
+    if (fabsf(state.latency_ms - 120.0f) > 0.01f || state.received != 2 || state.in_flight != 0) {
+        printf("server 0: latency %.2f, %u received, %u in flight\n", state.latency_ms,
+               state.received, state.in_flight);
+        ret = 1;
+    }
+
+    // a lost server is left out until the retry interval passed
+    server_pool_fail(&pool, 1, now_ns);
+    ret |= expect((int) server_pool_usable_mask(&pool, now_ns), 0b01, "usable after failure");
+    ret |= expect(server_pool_choose(&pool, 0b10, now_ns), -1, "lost server");
+    now_ns += MS_TO_NS(RETRY_MS);
+    ret |= expect((int) server_pool_usable_mask(&pool, now_ns), 0b11, "usable after retry");
+    server_pool_receive(&pool, 1, 50.0f);
+    state = server_pool_get(&pool, 1);
+    ret |= expect(state.lost_ts_ns == 0 && state.failed == 1 && state.in_flight == 0, 1,
+                  "server 1 back");
+    return ret;
+}
+
+#define FAIL_TIMEOUT_MS 200 // how long a frame on a server that is down takes to fail
+
+typedef struct {
+    int server;
+    int64_t submit_ns;
+    int64_t done_ns;
+    int fails;
+} frame_t;
+
+static int check_stream(int num_frames) {
+    int ret = 0;
+    server_pool_t pool;
+    server_pool_init(&pool, NUM_SERVERS, RETRY_MS);
+
+    // the slow server is down for the middle third of the frames
+    const int64_t down_from_ns = MS_TO_NS((num_frames / 3) * FRAME_INTERVAL_MS);
+    const int64_t down_until_ns = 2 * down_from_ns;
+
+    std::vector<frame_t> in_flight;
+    std::vector<int64_t> busy_until_ns(NUM_SERVERS, 0);
+    std::vector<int> sent_up(NUM_SERVERS, 0);
+    int64_t lost_ns = -1;
+    int retried_early = 0;
+
+    for (int i = 0; i < num_frames; i++) {
+        const int64_t now_ns = MS_TO_NS(i * FRAME_INTERVAL_MS);
+
+        // receive what is done, like receive_image
+        for (auto it = in_flight.begin(); it != in_flight.end();) {
+            if (it->done_ns > now_ns) {
+                ++it;
+                continue;
+            }
+            if (it->fails) {
+                server_pool_fail(&pool, it->server, it->done_ns);
+                lost_ns = it->done_ns;
+            } else {
+                server_pool_receive(&pool, it->server,
+                                    (float) (it->done_ns - it->submit_ns) / 1e6f);
+            }
+            it = in_flight.erase(it);
+        }
+        if (in_flight.size() >= MAX_IN_FLIGHT) {
+            continue;
+        }
+
+        // submit, like submit_image
+        const int server = server_pool_choose(&pool, (1u << NUM_SERVERS) - 1, now_ns);
+        if (server < 0) {
+            printf("frame %d: no server to offload to\n", i);
+            ret = 1;
+            continue;
+        }
+        server_pool_submit(&pool, server);
+        frame_t frame = {server, now_ns, 0, 0};
+        frame.fails = 1 == server && now_ns >= down_from_ns && now_ns < down_until_ns;
+        if (frame.fails) {
+            if (lost_ns >= 0 && now_ns - lost_ns < MS_TO_NS(RETRY_MS)) {
+                retried_early += 1;
+            }
+            frame.done_ns = now_ns + MS_TO_NS(FAIL_TIMEOUT_MS);
+        } else {
+            const int64_t start_ns = std::max(now_ns, busy_until_ns[server]);
+            frame.done_ns = start_ns + MS_TO_NS(SERVICE_MS[server]);
+            busy_until_ns[server] = frame.done_ns;
+            if (now_ns < down_from_ns) {
+                sent_up[server] += 1;
+            }
+        }
+        in_flight.push_back(frame);
+    }
+
+    const server_state_t fast = server_pool_get(&pool, 0);
+    const server_state_t slow = server_pool_get(&pool, 1);
+    printf("server,received,failed,latency_ms\n0,%u,%u,%.1f\n1,%u,%u,%.1f\n", fast.received,
+           fast.failed, fast.latency_ms, slow.received, slow.failed, slow.latency_ms);
+
+    if (sent_up[0] <= sent_up[1] || 0 == sent_up[1]) {
+        printf("fast server got %d frames, slow server %d\n", sent_up[0], sent_up[1]);
+        ret = 1;
+    }
+    // only the frames in flight when it went down and when it was retried may fail
+    const int64_t retries = (down_until_ns - down_from_ns) / MS_TO_NS(RETRY_MS);
+    if (0 == slow.failed || slow.failed > (uint32_t) ((retries + 1) * MAX_IN_FLIGHT)) {
+        printf("slow server failed %u frames while down\n", slow.failed);
+        ret = 1;
+    }
+    if (retried_early > 0) {
+        printf("%d frames went to the lost server before the retry interval\n", retried_early);
+        ret = 1;
+    }
+    if (0 != slow.lost_ts_ns) {
+        printf("slow server was not taken back after it came up\n");
+        ret = 1;
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    const int num_frames = (argc > 1) ? atoi(argv[1]) : 3000;
+    int ret = check_choice();
+    ret |= check_stream(num_frames);
+    return ret;
+}